@@ -0,0 +1,137 @@
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+    // The Z80EMU_ options this binary was built with (z80core exports them)
+    std::vector<std::string> BuildOptions()
+    {
+        std::vector<std::string> options;
+#if defined(Z80EMU_THREADED_DISPATCH)
+        options.push_back("Z80EMU_THREADED_DISPATCH");
+#endif
+#if defined(Z80EMU_LAZY_FLAGS)
+        options.push_back("Z80EMU_LAZY_FLAGS");
+#endif
+#if defined(Z80EMU_DECODE_CACHE)
+        options.push_back("Z80EMU_DECODE_CACHE");
+#endif
+#if defined(Z80EMU_JIT)
+        options.push_back("Z80EMU_JIT");
+#endif
+#if defined(Z80EMU_PROFILER)
+        options.push_back("Z80EMU_PROFILER");
+#endif
+#if defined(Z80EMU_TRACE)
+        options.push_back("Z80EMU_TRACE");
+#endif
+#if defined(Z80EMU_PAGE_HASH)
+        options.push_back("Z80EMU_PAGE_HASH");
+#endif
+        return options;
+    }
+
+    std::string Quoted(const std::string& text)
+    {
+        std::string out = "\"";
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    // JSON has no inf or nan; those go out as null
+    std::string Number(double value)
+    {
+        if (!std::isfinite(value))
+            return "null";
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+        return buffer;
+    }
+
+    // `amount` per second, or null for a run too short to time
+    std::string Rate(double amount, double seconds)
+    {
+        return seconds > 0 ? Number(amount / seconds) : "null";
+    }
+
+    std::string Hex(std::uint8_t value)
+    {
+        char buffer[8];
+        std::snprintf(buffer, sizeof(buffer), "\"0x%02X\"", value);
+        return buffer;
+    }
+}
+
+BenchReport& BenchReport::Get()
+{
+    static BenchReport report;
+    return report;
+}
+
+void BenchReport::AddWorkload(const Workload& workload)
+{
+    const auto same = std::find_if(workloads_.begin(), workloads_.end(),
+        [&](const Workload& w) { return w.name == workload.name; });
+    if (same == workloads_.end())
+        workloads_.push_back(workload);
+    else if (workload.seconds < same->seconds)
+        *same = workload;
+}
+
+void BenchReport::AddOpcode(const Opcode& opcode)
+{
+    opcodes_.push_back(opcode);
+}
+
+bool BenchReport::WriteJson(const std::string& path) const
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    out << "{\n  \"schema\": 1,\n  \"build\": {\n    \"optimised\": ";
+#if defined(NDEBUG)
+    out << "true";
+#else
+    out << "false";
+#endif
+    out << ",\n    \"options\": [";
+    const std::vector<std::string> options = BuildOptions();
+    for (std::size_t i = 0; i < options.size(); ++i)
+        out << (i ? ", " : "") << Quoted(options[i]);
+    out << "]\n  },\n  \"workloads\": [";
+
+    for (std::size_t i = 0; i < workloads_.size(); ++i)
+    {
+        const Workload& w = workloads_[i];
+        out << (i ? "," : "") << "\n    { \"name\": " << Quoted(w.name)
+            << ", \"instructions\": " << w.instructions
+            << ", \"tstates\": " << w.tstates
+            << ", \"seconds\": " << Number(w.seconds)
+            << ", \"instructionsPerSecond\": " << Rate(static_cast<double>(w.instructions), w.seconds)
+            << ", \"emulatedMHz\": " << Rate(w.tstates / 1e6, w.seconds) << " }";
+    }
+    out << "\n  ],\n  \"opcodes\": [";
+
+    for (std::size_t i = 0; i < opcodes_.size(); ++i)
+    {
+        const Opcode& o = opcodes_[i];
+        out << (i ? "," : "") << "\n    { \"prefix\": " << Hex(o.prefix)
+            << ", \"opcode\": " << Hex(o.opcode)
+            << ", \"tstates\": " << Number(o.tstates)
+            << ", \"nanoseconds\": " << Number(o.nanoseconds)
+            << ", \"ticks\": " << Number(o.ticks) << " }";
+    }
+    out << "\n  ]\n}\n";
+
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+// What the workload and opcode benchmarks measured, kept until the run is
+// over so bench_main.cpp can write it out for `z80_bench --json <file>`.
+class BenchReport
+{
+public:
+    struct Workload
+    {
+        std::string name;
+        std::uint64_t instructions = 0;     // per run
+        std::uint64_t tstates = 0;          // per run
+        double seconds = 0;                 // the fastest run
+    };
+
+    struct Opcode
+    {
+        std::uint8_t prefix = 0;            // 0x00 or 0xED
+        std::uint8_t opcode = 0;
+        double tstates = 0;                 // emulated, per instruction
+        double nanoseconds = 0;             // host, per instruction
+        double ticks = 0;                   // host TSC ticks per instruction, 0 without a TSC
+    };
+
+    static BenchReport& Get();
+
+    // Catch runs a benchmark body many times; only the fastest run is kept
+    void AddWorkload(const Workload& workload);
+    void AddOpcode(const Opcode& opcode);
+
+    bool WriteJson(const std::string& path) const;
+
+private:
+    std::vector<Workload> workloads_;
+    std::vector<Opcode> opcodes_;
+};
+
+// Wall time from steady_clock plus, on x86, the time-stamp counter
+class HostTimer
+{
+public:
+    HostTimer() : start_(std::chrono::steady_clock::now()), startTicks_(Ticks()) {}
+
+    double Seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    std::uint64_t ElapsedTicks() const { return Ticks() - startTicks_; }
+
+    static std::uint64_t Ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    std::uint64_t startTicks_;
+};
@@ -0,0 +1,90 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Bus.h"
+
+// **********************************************
+// *          BULK BUS ACCESS BENCHMARKS        *
+// **********************************************
+// *                                            *
+// *  Each case moves the whole 64K, starting   *
+// *  mid-page so it wraps. The byte loops are  *
+// *  what host tooling did before the block    *
+// *  API: one Read()/Write() call per byte.    *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    constexpr std::uint16_t START = 0x8123;
+}
+
+TEST_CASE("Dumping and loading all 64K", "[!benchmark][bus]")
+{
+    auto bus = std::make_unique<Bus>();
+    std::vector<std::uint8_t> buffer(Bus::RAM_SIZE);
+    for (std::size_t i = 0; i < buffer.size(); ++i)
+        buffer[i] = static_cast<std::uint8_t>(i * 7);
+
+    BENCHMARK("ReadBlock")
+    {
+        bus->ReadBlock(START, buffer);
+        return buffer[0];
+    };
+
+    BENCHMARK("Read() loop")
+    {
+        for (std::size_t i = 0; i < buffer.size(); ++i)
+            buffer[i] = bus->Read(static_cast<std::uint16_t>(START + i));
+        return buffer[0];
+    };
+
+    BENCHMARK("WriteBlock")
+    {
+        bus->WriteBlock(START, buffer);
+        return bus->Read(START);
+    };
+
+    BENCHMARK("Write() loop")
+    {
+        for (std::size_t i = 0; i < buffer.size(); ++i)
+            bus->Write(static_cast<std::uint16_t>(START + i), buffer[i]);
+        return bus->Read(START);
+    };
+}
+
+TEST_CASE("Clearing and comparing all 64K", "[!benchmark][bus]")
+{
+    auto bus = std::make_unique<Bus>();
+    std::vector<std::uint8_t> expected(Bus::RAM_SIZE, 0x00);
+
+    BENCHMARK("Fill")
+    {
+        bus->Fill(START, Bus::RAM_SIZE, 0x00);
+        return bus->Read(START);
+    };
+
+    BENCHMARK("Write() loop")
+    {
+        for (std::size_t i = 0; i < Bus::RAM_SIZE; ++i)
+            bus->Write(static_cast<std::uint16_t>(START + i), 0x00);
+        return bus->Read(START);
+    };
+
+    BENCHMARK("Compare")
+    {
+        return bus->Compare(START, expected);
+    };
+
+    BENCHMARK("Read() loop compare")
+    {
+        std::size_t matched = 0;
+        while (matched < expected.size() && bus->Read(static_cast<std::uint16_t>(START + matched)) == expected[matched])
+            ++matched;
+        return matched;
+    };
+}
@@ -0,0 +1,145 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Cpu.h"
+#include "Bus.h"
+
+// **********************************************
+// *        CPU CORE BENCHMARKS                 *
+// **********************************************
+// *                                            *
+// *  Run with: z80_bench "[!benchmark]"        *
+// *  Build optimised (Release) for numbers     *
+// *  worth comparing.                          *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    // Loads, 8-bit ALU, INC/DEC, 16-bit ops and stack traffic repeated over all
+    // of memory. There are no jumps yet, so the program loops by PC wrapping.
+    // SP sits just above the operand of the first LD BC,nn, so the stack only
+    // ever rewrites data bytes and can never plant a HALT in the code.
+    const std::vector<std::uint8_t> OPCODE_MIX = {
+        0x01, 0x00, 0x00,                   // LD BC,nn (doubles as the stack)
+        0x3E, 0x12,                         // LD A,n
+        0x06, 0x34,                         // LD B,n
+        0x80, 0x88, 0x90, 0x98,             // ADD/ADC/SUB/SBC A,B
+        0x04, 0x0C, 0x15, 0x1D,             // INC B, INC C, DEC D, DEC E
+        0x41, 0x4A, 0x53, 0x5C, 0x67, 0x78, // LD r,r
+        0xE6, 0x0F, 0xF6, 0x80,             // AND n, OR n
+        0xEE, 0x55, 0xFE, 0x10,             // XOR n, CP n
+        0x03, 0x13, 0x0B, 0x09, 0x19,       // INC BC, INC DE, DEC BC, ADD HL,BC/DE
+        0xC5, 0xD1, 0xE5, 0xC1,             // PUSH BC, POP DE, PUSH HL, POP BC
+        0x00, 0x37, 0xC6, 0x01, 0x27,       // NOP, SCF, ADD A,n, DAA
+    };
+
+    constexpr std::uint16_t STACK_TOP = 0x0003;
+
+    struct Machine
+    {
+        Bus bus;
+        Cpu cpu;
+
+        explicit Machine(const std::vector<std::uint8_t>& program)
+        {
+            for (std::size_t address = 0; address + program.size() <= Bus::RAM_SIZE; address += program.size())
+                for (std::size_t i = 0; i < program.size(); ++i)
+                    bus.Write(static_cast<std::uint16_t>(address + i), program[i]);
+
+            cpu.Connect(&bus);
+            cpu.Reset();
+            cpu.SetSp(STACK_TOP);
+        }
+    };
+}
+
+TEST_CASE("CPU throughput on the opcode mix", "[!benchmark][cpu]")
+{
+    auto machine = std::make_unique<Machine>(OPCODE_MIX);
+
+    BENCHMARK("Execute 100k instructions")
+    {
+        return machine->cpu.Execute(100000);
+    };
+
+    BENCHMARK("Run 1M T-states")
+    {
+        return machine->cpu.Run(1000000);
+    };
+}
+
+TEST_CASE("Bus byte access", "[!benchmark][bus]")
+{
+    auto bus = std::make_unique<Bus>();
+
+    BENCHMARK("Read all 64K bytes")
+    {
+        std::uint32_t sum = 0;
+        for (std::uint32_t address = 0; address < Bus::RAM_SIZE; ++address)
+            sum += bus->Read(static_cast<std::uint16_t>(address));
+        return sum;
+    };
+
+    BENCHMARK("Write all 64K bytes")
+    {
+        for (std::uint32_t address = 0; address < Bus::RAM_SIZE; ++address)
+            bus->Write(static_cast<std::uint16_t>(address), static_cast<std::uint8_t>(address));
+        return bus->Read(0x1234);
+    };
+}
+
+TEST_CASE("Block instructions over 16K", "[!benchmark][cpu][ed]")
+{
+    // LDIR copies 0x4000-0x7FFF to 0x8000-0xBFFF; CPIR scans the same 16K
+    // for a byte that is not there. Step() runs one iteration per call, which
+    // is what every iteration cost before the bulk path.
+    constexpr std::uint16_t BLOCK = 0x4000;
+    constexpr std::uint64_t BLOCK_TSTATES = 21 * (BLOCK - 1) + 16;
+
+    const auto start = [](Machine& machine, std::uint8_t op)
+    {
+        machine.bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0xED, op });
+        machine.cpu.Reset(0x0000);
+        machine.cpu.SetA(0xFF);
+        machine.cpu.SetHl(0x4000);
+        machine.cpu.SetDe(0x8000);
+        machine.cpu.SetBc(BLOCK);
+    };
+
+    auto machine = std::make_unique<Machine>(std::vector<std::uint8_t>{ 0x00 });
+
+    BENCHMARK("LDIR: one Run")
+    {
+        start(*machine, 0xB0);
+        return machine->cpu.Run(BLOCK_TSTATES);
+    };
+
+    BENCHMARK("LDIR: a Step per iteration")
+    {
+        start(*machine, 0xB0);
+        std::uint64_t cycles = 0;
+        while (cycles < BLOCK_TSTATES)
+            cycles += machine->cpu.Step();
+        return cycles;
+    };
+
+    BENCHMARK("CPIR: one Run")
+    {
+        start(*machine, 0xB1);
+        return machine->cpu.Run(BLOCK_TSTATES);
+    };
+
+    BENCHMARK("CPIR: a Step per iteration")
+    {
+        start(*machine, 0xB1);
+        std::uint64_t cycles = 0;
+        while (cycles < BLOCK_TSTATES)
+            cycles += machine->cpu.Step();
+        return cycles;
+    };
+}
@@ -0,0 +1,64 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Divergence.h"
+#include "Machine.h"
+
+// **********************************************
+// *           DIVERGENCE BENCHMARKS            *
+// **********************************************
+// *                                            *
+// *  Two machines run NOPs round the 64K, and  *
+// *  once per trip add the byte at HL to B     *
+// *  and step HL. Their ROMs differ in the     *
+// *  last byte, which HL reaches on trip 300:  *
+// *  about 20M instructions in. It has to      *
+// *  be found through 19 checkpoints and a     *
+// *  bisection of the last one.                *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    struct Twins
+    {
+        Machine first;
+        Machine second;
+        std::vector<std::uint8_t> firstRom = std::vector<std::uint8_t>(0x4000, 0x00);
+        std::vector<std::uint8_t> secondRom = std::vector<std::uint8_t>(0x4000, 0x00);
+
+        Twins()
+        {
+            secondRom.back() = 0x7F;        // LD A,A
+            for (Machine* machine : { &first, &second })
+            {
+                machine->GetBus().WriteBlock(0xFFFC, std::vector<std::uint8_t>{ 0x7E, 0x80, 0x47, 0x23 });
+                machine->GetCpu().SetHl(0xBFFF - 300);
+            }
+            first.GetBus().MapRom(0x20, 16, firstRom.data());
+            second.GetBus().MapRom(0x20, 16, secondRom.data());
+        }
+    };
+}
+
+TEST_CASE("Finding the first divergent instruction", "[!benchmark][divergence]")
+{
+    auto twins = std::make_unique<Twins>();
+    const std::uint64_t limit = 1000000000;
+
+    BENCHMARK("DivergenceFinder::Find, 20M instructions in, two threads")
+    {
+        return DivergenceFinder::Find(twins->first, twins->second, limit).instruction;
+    };
+
+    DivergenceConfig serial;
+    serial.parallel = false;
+    BENCHMARK("DivergenceFinder::Find, 20M instructions in, one thread")
+    {
+        return DivergenceFinder::Find(twins->first, twins->second, limit, serial).instruction;
+    };
+}
@@ -0,0 +1,52 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Bus.h"
+#include "Machine.h"
+
+// **********************************************
+// *              FORK BENCHMARKS               *
+// **********************************************
+// *                                            *
+// *  Fork shares all 64 RAM pages; the copy    *
+// *  case is a fresh machine with the 64K      *
+// *  image copied in, which is what a branch   *
+// *  cost before. Writes after a fork pay for  *
+// *  a 1K page copy the first time only.       *
+// *                                            *
+// **********************************************
+
+TEST_CASE("Branching a machine", "[!benchmark][fork]")
+{
+    Machine checkpoint;
+    std::vector<std::uint8_t> image(Bus::RAM_SIZE);
+    for (std::size_t i = 0; i < image.size(); ++i)
+        image[i] = static_cast<std::uint8_t>(i * 7);
+    checkpoint.GetBus().WriteBlock(0x0000, image);
+
+    BENCHMARK("Fork")
+    {
+        return checkpoint.Fork();
+    };
+
+    BENCHMARK("New machine + 64K copy")
+    {
+        auto copy = std::make_unique<Machine>();
+        checkpoint.GetBus().ReadRam(0, image);
+        copy->GetBus().RestoreRam(0, image);
+        copy->GetCpu().SetState(checkpoint.GetCpu().GetState());
+        return copy;
+    };
+
+    BENCHMARK("Fork + one write to each of 4 pages")
+    {
+        auto child = checkpoint.Fork();
+        for (std::uint16_t address = 0x8000; address < 0x9000; address += Bus::MAP_PAGE_SIZE)
+            child->GetBus().Write(address, 0xFF);
+        return child;
+    };
+}
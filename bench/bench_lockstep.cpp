@@ -0,0 +1,122 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Cpu.h"
+#include "Bus.h"
+#include "LockstepCpu.h"
+
+// **********************************************
+// *          LOCKSTEP CPU BENCHMARKS           *
+// **********************************************
+// *                                            *
+// *  32 copies of one program, each started    *
+// *  with different register inputs, run 100k  *
+// *  instructions: one scalar Cpu after        *
+// *  another, then as LockstepCpu groups of    *
+// *  32, 16 and 8 lanes.                       *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    constexpr std::size_t MACHINES = 32;
+    constexpr std::uint64_t INSTRUCTIONS = 100000;
+
+    // bench_cpu's mix without DAA, which has no kernel. The stack sits on
+    // the operand of the first LD BC,nn.
+    const std::vector<std::uint8_t> PROGRAM = {
+        0x01, 0x00, 0x00,                   // LD BC,nn (doubles as the stack)
+        0x80, 0x88, 0x90, 0x98,             // ADD/ADC/SUB/SBC A,B
+        0x04, 0x0C, 0x15, 0x1D,             // INC B, INC C, DEC D, DEC E
+        0x41, 0x4A, 0x53, 0x5C, 0x67, 0x78, // LD r,r
+        0xE6, 0x0F, 0xF6, 0x80,             // AND n, OR n
+        0xEE, 0x55, 0xFE, 0x10,             // XOR n, CP n
+        0x03, 0x13, 0x0B, 0x09, 0x19,       // INC BC, INC DE, DEC BC, ADD HL,BC/DE
+        0xC5, 0xD1, 0xE5, 0xC1,             // PUSH BC, POP DE, PUSH HL, POP BC
+        0x00, 0x37, 0xC6, 0x01,             // NOP, SCF, ADD A,n
+    };
+
+    std::vector<std::unique_ptr<Bus>> MakeBuses()
+    {
+        // Whole copies, NOPs after the last one: wrapping into the middle of
+        // a copy would run the stack bytes as code, and they differ by lane
+        std::vector<std::uint8_t> memory(Bus::RAM_SIZE, 0x00);
+        for (std::size_t i = 0; i + PROGRAM.size() <= memory.size(); i += PROGRAM.size())
+            std::copy(PROGRAM.begin(), PROGRAM.end(), memory.begin() + static_cast<std::ptrdiff_t>(i));
+
+        std::vector<std::unique_ptr<Bus>> buses;
+        for (std::size_t i = 0; i < MACHINES; ++i)
+        {
+            buses.push_back(std::make_unique<Bus>());
+            buses.back()->WriteBlock(0x0000, memory);
+        }
+        return buses;
+    }
+
+    Cpu::State Input(std::size_t machine)
+    {
+        Cpu::State state;
+        state.sp = 0x0003;
+        state.af = static_cast<std::uint16_t>(machine * 0x0801);
+        state.de = static_cast<std::uint16_t>(machine * 0x1357);
+        state.hl = static_cast<std::uint16_t>(machine * 0x2468);
+        return state;
+    }
+
+    template<std::size_t Lanes>
+    std::uint64_t RunGroups(std::vector<std::unique_ptr<Bus>>& buses)
+    {
+        std::uint64_t tstates = 0;
+        for (std::size_t first = 0; first < MACHINES; first += Lanes)
+        {
+            LockstepCpu<Lanes> group;
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+            {
+                group.Connect(lane, buses[first + lane].get());
+                group.SetState(lane, Input(first + lane));
+            }
+            group.Execute(INSTRUCTIONS);
+            tstates += group.GetState(0).tstates;
+        }
+        return tstates;
+    }
+}
+
+TEST_CASE("Lockstep against scalar on 32 machines", "[!benchmark][lockstep]")
+{
+    auto buses = MakeBuses();
+
+    BENCHMARK("32 scalar Cpus")
+    {
+        std::uint64_t tstates = 0;
+        for (std::size_t machine = 0; machine < MACHINES; ++machine)
+        {
+            Cpu cpu;
+            cpu.Connect(buses[machine].get());
+            cpu.SetState(Input(machine));
+            tstates += cpu.Execute(INSTRUCTIONS);
+        }
+        return tstates;
+    };
+
+    BENCHMARK("1 x LockstepCpu<32>")
+    {
+        return RunGroups<32>(buses);
+    };
+
+    BENCHMARK("2 x LockstepCpu<16>")
+    {
+        return RunGroups<16>(buses);
+    };
+
+    BENCHMARK("4 x LockstepCpu<8>")
+    {
+        return RunGroups<8>(buses);
+    };
+}
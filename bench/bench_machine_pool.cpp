@@ -0,0 +1,72 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MachinePool.h"
+
+// **********************************************
+// *          MACHINE POOL BENCHMARKS           *
+// **********************************************
+// *                                            *
+// *  256 machines each run 2M T-states of the  *
+// *  ALU/stack mix. The same work is timed on  *
+// *  1, 2, 4... threads up to the hardware     *
+// *  count: with independent machines the time *
+// *  should fall close to 1/threads.           *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    constexpr std::size_t MACHINES = 256;
+    constexpr std::uint64_t TSTATES = 2000000;
+
+    // The stack sits on the operand of the first LD BC,nn, as in bench_cpu
+    const std::vector<std::uint8_t> PROGRAM = {
+        0x01, 0x00, 0x00,                   // LD BC,nn (doubles as the stack)
+        0x3E, 0x12, 0x06, 0x34,             // LD A,n ; LD B,n
+        0x80, 0x88, 0x90, 0x98,             // ADD/ADC/SUB/SBC A,B
+        0x04, 0x0C, 0x15, 0x1D,             // INC B, INC C, DEC D, DEC E
+        0x03, 0x13, 0x0B, 0x09, 0x19,       // INC BC, INC DE, DEC BC, ADD HL,BC/DE
+        0xC5, 0xD1, 0xE5, 0xC1,             // PUSH BC, POP DE, PUSH HL, POP BC
+    };
+
+    std::unique_ptr<Machine> MixMachine()
+    {
+        auto machine = std::make_unique<Machine>();
+        std::vector<std::uint8_t> memory(Bus::RAM_SIZE);
+        for (std::size_t i = 0; i < memory.size(); ++i)
+            memory[i] = PROGRAM[i % PROGRAM.size()];
+        machine->GetBus().WriteBlock(0x0000, memory);
+        machine->GetCpu().SetSp(0x0003);
+        return machine;
+    }
+}
+
+TEST_CASE("Scaling across threads", "[!benchmark][pool]")
+{
+    const std::size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t threads = 1; ; threads *= 2)
+    {
+        threads = std::min(threads, hardware);
+        MachinePool pool(threads);
+        for (std::size_t i = 0; i < MACHINES; ++i)
+            pool.Add(MixMachine());
+
+        BENCHMARK(std::to_string(threads) + (threads == 1 ? " thread" : " threads"))
+        {
+            pool.RunAll(TSTATES);
+            pool.Wait();
+            return pool.Size();
+        };
+
+        if (threads == hardware)
+            break;
+    }
+}
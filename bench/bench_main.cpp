@@ -0,0 +1,32 @@
+#include <catch2/catch_session.hpp>
+
+#include <iostream>
+#include <string>
+
+#include "BenchReport.h"
+
+// z80_bench's own main: Catch2's, plus --json <file> to write what the
+// workload and opcode benchmarks measured once the run is over, e.g.
+//
+//   z80_bench "[workload],[opcodes]" --json bench.json
+int main(int argc, char* argv[])
+{
+    Catch::Session session;
+
+    std::string jsonPath;
+    session.cli(session.cli()
+        | Catch::Clara::Opt(jsonPath, "file")["--json"]("write the workload and opcode results to <file> as JSON"));
+
+    const int error = session.applyCommandLine(argc, argv);
+    if (error != 0)
+        return error;
+
+    const int failed = session.run();
+
+    if (!jsonPath.empty() && !BenchReport::Get().WriteJson(jsonPath))
+    {
+        std::cerr << "z80_bench: could not write " << jsonPath << '\n';
+        return failed != 0 ? failed : 1;
+    }
+    return failed;
+}
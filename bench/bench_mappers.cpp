@@ -0,0 +1,72 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "Bus.h"
+#include "Mappers.h"
+
+// **********************************************
+// *        BANK SWITCH BENCHMARKS              *
+// **********************************************
+// *                                            *
+// *  Each case does 1000 switches. A switch    *
+// *  only re-points Bus pages; the memcpy case *
+// *  is what copying a 16K bank in would cost. *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    constexpr int SWITCHES = 1000;
+}
+
+TEST_CASE("Spectrum 128 bank switch through port 0x7FFD", "[!benchmark][mapper]")
+{
+    auto bus = std::make_unique<Bus>();
+    auto mapper = std::make_unique<Spectrum128Mapper>();
+    mapper->Attach(*bus);
+
+    BENCHMARK("1000 OUTs to 0x7FFD")
+    {
+        for (int i = 0; i < SWITCHES; ++i)
+            bus->Out(0x7FFD, static_cast<std::uint8_t>(i & 0x17));
+        return bus->Read(0xC000);
+    };
+
+    BENCHMARK("1000 16K memcpy bank swaps (for comparison)")
+    {
+        std::vector<std::uint8_t> live(Spectrum128Mapper::BANK_SIZE);
+        for (int i = 0; i < SWITCHES; ++i)
+            std::memcpy(live.data(), mapper->Ram(static_cast<std::size_t>(i & 7)), live.size());
+        return live[0];
+    };
+}
+
+TEST_CASE("MSX cartridge bank switch through register writes", "[!benchmark][mapper]")
+{
+    auto bus = std::make_unique<Bus>();
+    auto ascii8 = std::make_unique<MsxAscii8Mapper>(std::vector<std::uint8_t>(0x2000 * 32, 0x00));
+    ascii8->Attach(*bus);
+
+    BENCHMARK("ASCII8: 1000 bank writes")
+    {
+        for (int i = 0; i < SWITCHES; ++i)
+            bus->Write(static_cast<std::uint16_t>(0x6000 + ((i & 3) << 11)), static_cast<std::uint8_t>(i));
+        return bus->Read(0x4000);
+    };
+
+    auto bus16 = std::make_unique<Bus>();
+    auto ascii16 = std::make_unique<MsxAscii16Mapper>(std::vector<std::uint8_t>(0x4000 * 16, 0x00));
+    ascii16->Attach(*bus16);
+
+    BENCHMARK("ASCII16: 1000 bank writes")
+    {
+        for (int i = 0; i < SWITCHES; ++i)
+            bus16->Write(static_cast<std::uint16_t>(0x6000 + ((i & 1) << 12)), static_cast<std::uint8_t>(i));
+        return bus16->Read(0x4000);
+    };
+}
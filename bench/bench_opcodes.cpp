@@ -0,0 +1,157 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "Cpu.h"
+#include "Bus.h"
+#include "BenchReport.h"
+
+// **********************************************
+// *          OPCODE COST MATRIX                *
+// **********************************************
+// *                                            *
+// *  Host cost of every primary and ED opcode  *
+// *  the core implements: memory is filled     *
+// *  with one instruction and run in chunks.   *
+// *  Prints a 16x16 ns table per prefix; ns,   *
+// *  TSC ticks and T-states go to --json.      *
+// *                                            *
+// *  z80_bench "[opcodes]" --json out.json     *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    constexpr std::uint64_t CHUNK = 1024;
+    constexpr int CHUNKS = 128;
+    constexpr std::uint32_t CODE_END = 0x8000;
+    constexpr std::uint8_t OPERAND = 0xE0;
+
+    // Every chunk starts from here. Memory operands land above the code, and
+    // BC is large enough that no block repeat finishes inside a chunk.
+    Cpu::State Start()
+    {
+        Cpu::State state;
+        state.af = 0x5500;
+        state.bc = 0xB000;
+        state.de = 0xD000;
+        state.hl = 0xC000;
+        state.sp = 0xF000;
+        state.ix = 0xC800;
+        state.iy = 0xC800;
+        return state;
+    }
+
+    std::vector<std::uint8_t> Encode(std::uint8_t prefix, std::uint8_t opcode)
+    {
+        if (prefix != 0)
+            return { prefix, opcode, OPERAND, OPERAND };
+        return { opcode, OPERAND, OPERAND };
+    }
+
+    // The instruction's length, or 0 if the core has no handler for it or it
+    // stops the CPU. A block repeat leaves PC where it was and counts as the
+    // two opcode bytes.
+    std::size_t Probe(Bus& bus, std::uint8_t prefix, std::uint8_t opcode)
+    {
+        bus.WriteBlock(0x0000, Encode(prefix, opcode));
+        Cpu cpu;
+        cpu.Connect(&bus);
+        cpu.Reset();
+        cpu.SetState(Start());
+        cpu.Step();
+        if (cpu.has_unimplemented() || cpu.is_halted())
+            return 0;
+        const std::uint16_t pc = cpu.GetState().pc;
+        return pc != 0 ? pc : 2;
+    }
+
+    BenchReport::Opcode Measure(Bus& bus, std::uint8_t prefix, std::uint8_t opcode, std::size_t length)
+    {
+        std::vector<std::uint8_t> bytes = Encode(prefix, opcode);
+        bytes.resize(length);
+        std::vector<std::uint8_t> code(CODE_END, 0x00);
+        for (std::size_t address = 0; address + length <= CODE_END; address += length)
+            std::copy(bytes.begin(), bytes.end(), code.begin() + static_cast<std::ptrdiff_t>(address));
+        bus.WriteBlock(0x0000, code);
+
+        Cpu cpu;
+        cpu.Connect(&bus);
+        cpu.Reset();
+
+        // The fastest chunk, so preemption and cold caches drop out
+        double seconds = std::numeric_limits<double>::max();
+        std::uint64_t ticks = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t tstates = 0;
+        for (int chunk = 0; chunk < CHUNKS; ++chunk)
+        {
+            cpu.SetState(Start());
+            const HostTimer timer;
+            tstates = cpu.Execute(CHUNK);
+            ticks = std::min(ticks, timer.ElapsedTicks());
+            seconds = std::min(seconds, timer.Seconds());
+        }
+
+        BenchReport::Opcode result;
+        result.prefix = prefix;
+        result.opcode = opcode;
+        result.tstates = static_cast<double>(tstates) / CHUNK;
+        result.nanoseconds = seconds * 1e9 / CHUNK;
+        result.ticks = static_cast<double>(ticks) / CHUNK;
+        return result;
+    }
+
+    void PrintMatrix(std::uint8_t prefix, const std::array<double, 256>& nanoseconds)
+    {
+        std::printf("\nns per instruction, %s opcodes (- = not in the core)\n    ", prefix != 0 ? "ED" : "primary");
+        for (int column = 0; column < 16; ++column)
+            std::printf("    x%X", column);
+        for (int row = 0; row < 16; ++row)
+        {
+            std::printf("\n%Xx  ", row);
+            for (int column = 0; column < 16; ++column)
+            {
+                const double ns = nanoseconds[row * 16 + column];
+                if (ns < 0)
+                    std::printf("     -");
+                else
+                    std::printf("%6.1f", ns);
+            }
+        }
+        std::printf("\n");
+    }
+}
+
+TEST_CASE("Per-opcode host cost", "[!benchmark][opcodes]")
+{
+    auto bus = std::make_unique<Bus>();
+
+    for (const std::uint8_t prefix : { std::uint8_t{ 0x00 }, std::uint8_t{ 0xED } })
+    {
+        std::array<double, 256> nanoseconds;
+        nanoseconds.fill(-1);
+        for (int opcode = 0; opcode < 256; ++opcode)
+        {
+            const std::uint8_t op = static_cast<std::uint8_t>(opcode);
+            if (prefix == 0 && op == 0xED)
+                continue;
+
+            const std::size_t length = Probe(*bus, prefix, op);
+            if (length == 0)
+                continue;
+
+            const BenchReport::Opcode result = Measure(*bus, prefix, op, length);
+            REQUIRE(result.tstates > 0);
+            nanoseconds[opcode] = result.nanoseconds;
+            BenchReport::Get().AddOpcode(result);
+        }
+        PrintMatrix(prefix, nanoseconds);
+    }
+}
@@ -0,0 +1,48 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Bus.h"
+#include "Machine.h"
+
+// **********************************************
+// *           FINGERPRINT BENCHMARKS           *
+// **********************************************
+// *                                            *
+// *  A machine with no zero bytes in RAM, so   *
+// *  the scan has to hash all 64K. Built with  *
+// *  Z80EMU_PAGE_HASH the fingerprint folds    *
+// *  the kept page hashes instead; the write   *
+// *  case shows what keeping them costs.       *
+// *                                            *
+// **********************************************
+
+TEST_CASE("Fingerprinting a machine", "[!benchmark][hash]")
+{
+    auto machine = std::make_unique<Machine>();
+    std::vector<std::uint8_t> image(Bus::RAM_SIZE);
+    for (std::size_t i = 0; i < image.size(); ++i)
+        image[i] = static_cast<std::uint8_t>(i * 7 + 1) | 1;
+    machine->GetBus().WriteBlock(0x0000, image);
+
+    BENCHMARK("Machine::Fingerprint")
+    {
+        return machine->Fingerprint();
+    };
+
+    BENCHMARK("Bus::HashRun, 64K")
+    {
+        return Bus::HashRun(0, image);
+    };
+
+    BENCHMARK("Bus::Write, 64K")
+    {
+        Bus& bus = machine->GetBus();
+        for (std::uint32_t address = 0; address < Bus::RAM_SIZE; ++address)
+            bus.Write(static_cast<std::uint16_t>(address), static_cast<std::uint8_t>(address));
+        return bus.Read(0x1234);
+    };
+}
@@ -0,0 +1,83 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Bus.h"
+#include "Cpu.h"
+#include "RewindBuffer.h"
+
+// **********************************************
+// *            REWIND BENCHMARKS               *
+// **********************************************
+// *                                            *
+// *  The program loops through ROM writing a   *
+// *  byte every four instructions, walking     *
+// *  the 16K of RAM above it, so every delta   *
+// *  has a few dirty pages. Recording takes a  *
+// *  snapshot every 10000 instructions and a   *
+// *  keyframe every 50 of those.               *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    constexpr std::uint64_t INSTRUCTIONS = 1000000;
+
+    struct RomMachine
+    {
+        Bus bus;
+        Cpu cpu;
+        std::vector<std::uint8_t> rom = std::vector<std::uint8_t>(0xC000);
+
+        RomMachine()
+        {
+            // INC A ; AND 0x3F ; LD (HL),A ; INC L ..., INC H every 256 bytes
+            const std::uint8_t loop[] = { 0x3C, 0xE6, 0x3F, 0x77, 0x2C };
+            for (std::size_t i = 0; i < rom.size(); ++i)
+                rom[i] = (i & 0xFF) == 0xFF ? 0x24 : loop[(i & 0xFF) % sizeof(loop)];
+            cpu.Connect(&bus);
+            cpu.Reset();
+            bus.MapRom(0, 0xC000 / Bus::MAP_PAGE_SIZE, rom.data());
+            cpu.SetHl(0xC000);
+        }
+    };
+}
+
+TEST_CASE("Forward execution with and without recording", "[!benchmark][rewind]")
+{
+    auto plain = std::make_unique<RomMachine>();
+    auto recorded = std::make_unique<RomMachine>();
+    RewindBuffer rewind(recorded->cpu, recorded->bus);
+
+    BENCHMARK("Cpu::Execute, 1M instructions")
+    {
+        return plain->cpu.Execute(INSTRUCTIONS);
+    };
+
+    BENCHMARK("RewindBuffer::Execute, 1M instructions")
+    {
+        return rewind.Execute(INSTRUCTIONS);
+    };
+}
+
+TEST_CASE("Seeking back", "[!benchmark][rewind]")
+{
+    auto machine = std::make_unique<RomMachine>();
+    RewindBuffer rewind(machine->cpu, machine->bus);
+    rewind.Execute(INSTRUCTIONS);
+
+    BENCHMARK("StepBack(1)")
+    {
+        rewind.Execute(1);
+        return rewind.StepBack();
+    };
+
+    BENCHMARK("SeekTo half a keyframe group back")
+    {
+        rewind.Execute(250000);
+        return rewind.SeekTo(rewind.Position() - 250000);
+    };
+}
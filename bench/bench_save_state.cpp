@@ -0,0 +1,109 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Bus.h"
+#include "Cpu.h"
+#include "SaveState.h"
+
+// **********************************************
+// *          SAVE STATE BENCHMARKS             *
+// **********************************************
+// *                                            *
+// *  RAM is half a repeating pattern, half     *
+// *  noise, so some blocks compress and some   *
+// *  are kept raw, as in a running program.    *
+// *  A delta saves only the pages written      *
+// *  since the one before.                     *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    struct Machine
+    {
+        Bus bus;
+        Cpu cpu;
+
+        Machine()
+        {
+            cpu.Connect(&bus);
+            cpu.Reset();
+
+            std::vector<std::uint8_t> bytes(Bus::RAM_SIZE);
+            std::uint32_t seed = 0x1234567;
+            for (std::size_t i = 0; i < bytes.size(); ++i)
+            {
+                seed = seed * 1103515245u + 12345u;
+                bytes[i] = i < bytes.size() / 2 ? static_cast<std::uint8_t>(i % 7) : static_cast<std::uint8_t>(seed >> 16);
+            }
+            bus.WriteBlock(0x0000, bytes);
+        }
+    };
+}
+
+TEST_CASE("Saving and restoring a machine", "[!benchmark][save-state]")
+{
+    auto machine = std::make_unique<Machine>();
+    std::vector<std::uint8_t> raw;
+    std::vector<std::uint8_t> packed;
+    SaveState::Save(machine->cpu, machine->bus, raw, SaveCompression::None);
+    SaveState::Save(machine->cpu, machine->bus, packed, SaveCompression::Lz);
+
+    BENCHMARK("Save, uncompressed")
+    {
+        raw.clear();
+        SaveState::Save(machine->cpu, machine->bus, raw, SaveCompression::None);
+        return raw.size();
+    };
+
+    BENCHMARK("Save, LZ")
+    {
+        packed.clear();
+        SaveState::Save(machine->cpu, machine->bus, packed, SaveCompression::Lz);
+        return packed.size();
+    };
+
+    BENCHMARK("Restore, uncompressed")
+    {
+        return SaveState::Restore(machine->cpu, machine->bus, raw).ok;
+    };
+
+    BENCHMARK("Restore, LZ")
+    {
+        return SaveState::Restore(machine->cpu, machine->bus, packed).ok;
+    };
+}
+
+TEST_CASE("Snapshotting a frame that touched three pages", "[!benchmark][save-state]")
+{
+    auto machine = std::make_unique<Machine>();
+    std::vector<std::uint8_t> state;
+    SaveState::Save(machine->cpu, machine->bus, state);
+    machine->bus.ClearDirty();
+
+    auto touchFrame = [&]
+    {
+        machine->bus.Write(0x0100, 0x01);
+        machine->bus.Fill(0x5B00, 0x300, 0x02);
+    };
+
+    BENCHMARK("Full state, LZ")
+    {
+        touchFrame();
+        state.clear();
+        SaveState::Save(machine->cpu, machine->bus, state);
+        return state.size();
+    };
+
+    BENCHMARK("Delta, LZ")
+    {
+        touchFrame();
+        state.clear();
+        SaveState::SaveDelta(machine->cpu, machine->bus, state);
+        return state.size();
+    };
+}
@@ -0,0 +1,91 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Bus.h"
+#include "Cpu.h"
+#include "BenchReport.h"
+
+#if defined(Z80EMU_TRACE)
+#include "Trace.h"
+
+// **********************************************
+// *             TRACE BENCHMARKS               *
+// **********************************************
+// *                                            *
+// *  The rewind program again: INC A ; AND n ; *
+// *  LD (HL),A ; INC L through 48K, a write    *
+// *  every four instructions. Recording runs   *
+// *  it through TraceRecorder into a file in   *
+// *  the temp directory; reading decodes that  *
+// *  file back. Both go to --json.             *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    constexpr std::uint64_t INSTRUCTIONS = 1000000;
+
+    struct Machine
+    {
+        Bus bus;
+        Cpu cpu;
+
+        Machine()
+        {
+            const std::uint8_t loop[] = { 0x3C, 0xE6, 0x3F, 0x77, 0x2C };
+            std::vector<std::uint8_t> code(0xC000);
+            for (std::size_t i = 0; i < code.size(); ++i)
+                code[i] = (i & 0xFF) == 0xFF ? 0x24 : loop[(i & 0xFF) % sizeof(loop)];
+            cpu.Connect(&bus);
+            cpu.Reset();
+            bus.WriteBlock(0x0000, code);
+            cpu.SetHl(0xC000);
+        }
+    };
+}
+
+TEST_CASE("Recording and reading a trace", "[!benchmark][trace]")
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "z80emu_bench_trace.bin").string();
+    auto plain = std::make_unique<Machine>();
+    auto traced = std::make_unique<Machine>();
+
+    BENCHMARK("Cpu::Step, 1M instructions")
+    {
+        std::uint64_t tstates = 0;
+        for (std::uint64_t i = 0; i < INSTRUCTIONS; ++i)
+            tstates += plain->cpu.Step();
+        return tstates;
+    };
+
+    BENCHMARK("TraceRecorder::Execute, 1M instructions")
+    {
+        const HostTimer timer;
+        TraceRecorder recorder(traced->cpu, traced->bus, path);
+        const std::uint64_t tstates = recorder.Execute(INSTRUCTIONS);
+        recorder.Close();
+        BenchReport::Get().AddWorkload({ "trace-record", INSTRUCTIONS, tstates, timer.Seconds() });
+        return tstates;
+    };
+
+    BENCHMARK("TraceReader::Next, 1M instructions")
+    {
+        const HostTimer timer;
+        TraceReader reader(path);
+        TraceStep step;
+        std::uint64_t tstates = 0;
+        while (reader.Next(step))
+            tstates += step.tstates;
+        BenchReport::Get().AddWorkload({ "trace-read", INSTRUCTIONS, tstates, timer.Seconds() });
+        return tstates;
+    };
+
+    std::filesystem::remove(path);
+}
+#endif
@@ -0,0 +1,130 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Cpu.h"
+#include "Bus.h"
+#include "BenchReport.h"
+
+// **********************************************
+// *           WORKLOAD BENCHMARKS              *
+// **********************************************
+// *                                            *
+// *  Synthetic programs that each lean on one  *
+// *  part of the core, 1M instructions a run.  *
+// *  Emulated MHz and instructions per second  *
+// *  of the fastest run go to --json.          *
+// *                                            *
+// *  z80_bench "[workload]" --json out.json    *
+// *                                            *
+// **********************************************
+
+namespace
+{
+    constexpr std::uint64_t INSTRUCTIONS = 1000000;
+
+    // Register and immediate ALU ops with INC/DEC to keep the operands moving
+    const std::vector<std::uint8_t> ALU = {
+        0x80, 0x89, 0x92, 0x9B, 0xA4, 0xAD, 0xB0, 0xB9,     // ADD ADC SUB SBC AND XOR OR CP, r
+        0x04, 0x0C, 0x15, 0x1D, 0x24, 0x2C, 0x3C,           // INC/DEC r
+        0xC6, 0x11, 0xE6, 0xF7, 0xEE, 0x5A, 0xF6, 0x81,     // ADD AND XOR OR, n
+        0xFE, 0x40, 0x87, 0x88, 0x97, 0x3D, 0x27,           // CP n ; ADD A,A ; ADC A,B ; SUB A ; DEC A ; DAA
+    };
+
+    // 2K from 0x8000 to 0xA000 by LDIR, one iteration per instruction
+    const std::vector<std::uint8_t> MEMORY_COPY = {
+        0x21, 0x00, 0x80, 0x11, 0x00, 0xA0, 0x01, 0x00, 0x08,   // LD HL,nn ; LD DE,nn ; LD BC,nn
+        0xED, 0xB0,                                             // LDIR
+    };
+
+    // There is no CALL/RET in the core yet, so frames are saved and restored
+    // with balanced PUSH/POP runs across both register banks. The registers
+    // stay zero, so the stack only ever holds NOPs.
+    const std::vector<std::uint8_t> STACK = {
+        0xC5, 0xD5, 0xE5, 0xF5, 0xD9, 0xC5, 0xD5, 0xE5,     // PUSH BC DE HL AF ; EXX ; PUSH BC DE HL
+        0xD9, 0xE1, 0xD1, 0xC1, 0xF1, 0xD9, 0xE1, 0xD1,     // EXX ; POP HL DE BC AF ; EXX ; POP HL DE
+        0xC1, 0xD9, 0xC5, 0xC1, 0xE5, 0xE1,                 // POP BC ; EXX ; PUSH/POP BC ; PUSH/POP HL
+    };
+    constexpr std::uint16_t STACK_TOP = 0xF800;
+
+    // Every LD r,r' and LD r,(HL); nothing writes memory
+    std::vector<std::uint8_t> LdSoup()
+    {
+        std::vector<std::uint8_t> program;
+        for (std::uint8_t dst = 0; dst < 8; ++dst)
+            for (std::uint8_t src = 0; src < 8; ++src)
+                if (dst != 6)
+                    program.push_back(static_cast<std::uint8_t>(0x40 | (dst << 3) | src));
+        return program;
+    }
+
+    struct Machine
+    {
+        Bus bus;
+        Cpu cpu;
+
+        // Whole copies of the program up to codeEnd, NOPs after it
+        Machine(const std::vector<std::uint8_t>& program, std::uint32_t codeEnd)
+        {
+            std::vector<std::uint8_t> memory(Bus::RAM_SIZE, 0x00);
+            for (std::size_t address = 0; address + program.size() <= codeEnd; address += program.size())
+                std::copy(program.begin(), program.end(), memory.begin() + static_cast<std::ptrdiff_t>(address));
+            bus.WriteBlock(0x0000, memory);
+
+            cpu.Connect(&bus);
+            cpu.Reset();
+        }
+    };
+
+    std::uint64_t Measure(const std::string& name, Machine& machine)
+    {
+        const HostTimer timer;
+        const std::uint64_t tstates = machine.cpu.Execute(INSTRUCTIONS);
+        BenchReport::Get().AddWorkload({ name, INSTRUCTIONS, tstates, timer.Seconds() });
+        return tstates;
+    }
+}
+
+TEST_CASE("Synthetic workloads", "[!benchmark][workload]")
+{
+    auto alu = std::make_unique<Machine>(ALU, Bus::RAM_SIZE);
+    alu->cpu.SetBc(0x1234);
+    alu->cpu.SetDe(0x5678);
+    alu->cpu.SetHl(0x9ABC);
+
+    auto copy = std::make_unique<Machine>(MEMORY_COPY, 0x8000);
+
+    auto stack = std::make_unique<Machine>(STACK, 0xF000);
+    stack->cpu.SetSp(STACK_TOP);
+
+    auto soup = std::make_unique<Machine>(LdSoup(), Bus::RAM_SIZE);
+    soup->cpu.SetBc(0x0102);
+    soup->cpu.SetDe(0x0304);
+    soup->cpu.SetHl(0xC000);
+
+    BENCHMARK("alu")
+    {
+        return Measure("alu", *alu);
+    };
+
+    BENCHMARK("memory-copy")
+    {
+        return Measure("memory-copy", *copy);
+    };
+
+    BENCHMARK("stack")
+    {
+        return Measure("stack", *stack);
+    };
+
+    BENCHMARK("ld-soup")
+    {
+        return Measure("ld-soup", *soup);
+    };
+}
@@ -1,18 +1,267 @@
 #pragma once
 #include <array>
+#include <bitset>
 #include <cstdint>
 #include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+#include "MemoryDevice.h"
+#include "PortDevice.h"
 
+// The 64K address space as 64 pages of 1 KB. Each page has a read and a
+// write pointer: RAM pages point both at memory, ROM pages send writes to a
+// sink page (or a device), and device pages have null pointers so the access
+// goes to the MemoryDevice mapped there. A plain access is one table lookup
+// plus a branch that is only ever taken for devices.
+//
+// The Bus's own RAM is 64 separately allocated pages that Fork() shares with
+// the child. A shared page is mapped with a null write pointer like a device
+// page, so its first write takes the slow path, which copies the page first.
+// Dirty tracking uses the same trap: ClearDirty() unmaps writes to the pages
+// and the first write to each marks it dirty and maps it back.
 class Bus
 {
 public:
     static constexpr std::size_t RAM_SIZE = 65536;
+    static constexpr std::size_t MAP_PAGE_SHIFT = 10;
+    static constexpr std::size_t MAP_PAGE_SIZE = std::size_t{1} << MAP_PAGE_SHIFT;
+    static constexpr std::size_t MAP_PAGE_COUNT = RAM_SIZE >> MAP_PAGE_SHIFT;
+
+    using PageSet = std::bitset<MAP_PAGE_COUNT>;
 
     Bus();
 
-    std::uint8_t Read(uint16_t address) const;
-    void Write(uint16_t address, uint8_t value);
+    // Pages point into this Bus's own RAM, so it is never copied; see Fork()
+    Bus(const Bus&) = delete;
+    Bus& operator=(const Bus&) = delete;
+
+    // An independent Bus with the same memory, in O(pages). Own RAM pages are
+    // shared copy-on-write by both Buses until either writes to them. The
+    // mapping and attached port devices are taken over as they are: ROM is
+    // read-only and fine to share, but RAM handed to MapRam() and devices
+    // are still the parent's, so remap those if the child needs its own.
+    std::unique_ptr<Bus> Fork();
+
+    // Read/Write live in the header so the CPU's memory accesses inline
+    // straight into the opcode handlers instead of being calls.
+    std::uint8_t Read(uint16_t address) const
+    {
+        const std::uint8_t* page = readPage_[address >> MAP_PAGE_SHIFT];
+        if (page != nullptr) [[likely]]
+            return page[address & (MAP_PAGE_SIZE - 1)];
+        return ReadDevice(address);
+    }
+
+    void Write(uint16_t address, uint8_t value)
+    {
+        std::uint8_t* page = writePage_[address >> MAP_PAGE_SHIFT];
+        if (page != nullptr) [[likely]]
+        {
+#if defined(Z80EMU_PAGE_HASH)
+            std::uint8_t& byte = page[address & (MAP_PAGE_SIZE - 1)];
+            if (page == ownPage_[address >> MAP_PAGE_SHIFT])
+                pageHash_[address >> MAP_PAGE_SHIFT] ^= ByteHash(address, byte) ^ ByteHash(address, value);
+            byte = value;
+#else
+            page[address & (MAP_PAGE_SIZE - 1)] = value;
+#endif
+        }
+        else
+            WriteDevice(address, value);
+#if defined(Z80EMU_DECODE_CACHE) || defined(Z80EMU_JIT)
+        if (codeWatched_[address >> PAGE_SHIFT])
+            InvalidateCodePage(static_cast<std::uint8_t>(address >> PAGE_SHIFT));
+#endif
+#if defined(Z80EMU_TRACE)
+        if (writeLog_ != nullptr)
+            writeLog_->push_back({ address, value });
+#endif
+    }
+
+    // Host-side bulk access starting at `address` and wrapping at 64K, with
+    // the same result as the byte-at-a-time loop. Runs a page at a time: RAM
+    // and ROM take a memcpy/memset/memcmp, writes to ROM are dropped like
+    // Write() does, and device pages see every byte.
+    void ReadBlock(std::uint16_t address, std::span<std::uint8_t> out) const;
+    void WriteBlock(std::uint16_t address, std::span<const std::uint8_t> data);
+    void Fill(std::uint16_t address, std::size_t count, std::uint8_t value);
+
+    // How many leading bytes of `data` match memory from `address`;
+    // data.size() if all of them do
+    std::size_t Compare(std::uint16_t address, std::span<const std::uint8_t> data) const;
+
+    // Direct access for the CPU's block instructions. The pointer is valid
+    // up to the end of the address's mapping page, and null if the page
+    // belongs to a device. Anything written through WritePointer() has to
+    // be reported with CodeWritten() afterwards.
+    const std::uint8_t* ReadPointer(std::uint16_t address) const
+    {
+        const std::uint8_t* page = readPage_[address >> MAP_PAGE_SHIFT];
+        return page != nullptr ? page + (address & (MAP_PAGE_SIZE - 1)) : nullptr;
+    }
+
+    // A page shared with a fork is copied here, which moves it: take
+    // WritePointer() before any ReadPointer() into the same page.
+    std::uint8_t* WritePointer(std::uint16_t address)
+    {
+        std::uint8_t* page = WritablePage(address >> MAP_PAGE_SHIFT);
+        return page != nullptr ? page + (address & (MAP_PAGE_SIZE - 1)) : nullptr;
+    }
+
+    // `bytes` must not run past the end of the mapping page
+    void CodeWritten(std::uint16_t address, std::size_t bytes);
+
+    // What each byte of RAM adds to a page hash: a 64-bit mix of its
+    // address and value, and nothing for a zero byte, so zeroed RAM hashes
+    // to 0. HashRun() is the XOR over `bytes` stored from `address`.
+    static std::uint64_t ByteHash(std::uint16_t address, std::uint8_t value)
+    {
+        // splitmix64's finaliser; the mask is a select, not a branch
+        std::uint64_t z = ((std::uint64_t{address} << 8) | value) + 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return (z ^ (z >> 31)) & (0 - std::uint64_t{value != 0});
+    }
+    static std::uint64_t HashRun(std::uint16_t address, std::span<const std::uint8_t> bytes);
+
+#if defined(Z80EMU_PAGE_HASH)
+    // Hashes of the Bus's own RAM, kept up to date as it is written
+    // (Z80EMU_PAGE_HASH). Each write XORs the old byte's share out of its
+    // page's hash and the new one's in, so PageHash(page) always equals
+    // HashRun() over that page and RamHash() is a fold of 64 words instead
+    // of a pass over 64K. Forks take the hashes with the pages. Writes
+    // through WritePointer() have to be bracketed by HashOut() before and
+    // HashIn() after, over the same run; both only count bytes that land in
+    // own RAM.
+    std::uint64_t PageHash(std::size_t page) const { return pageHash_[page]; }
+    std::uint64_t RamHash() const;
+    void HashOut(std::uint16_t address, std::size_t bytes) { ToggleHash(address, bytes); }
+    void HashIn(std::uint16_t address, std::size_t bytes) { ToggleHash(address, bytes); }
+#endif
+
+    // Mapping works on whole pages: `pages` pages from `firstPage`, clipped
+    // to the address space. `memory` must hold pages * MAP_PAGE_SIZE bytes
+    // and outlive the mapping. Writes to ROM are dropped, or handed to
+    // `writes` if given (bank-switch latches that sit in cartridge ROM space).
+    void MapRam(std::size_t firstPage, std::size_t pages, std::uint8_t* memory);
+    void MapRom(std::size_t firstPage, std::size_t pages, const std::uint8_t* memory, MemoryDevice* writes = nullptr);
+    void MapDevice(std::size_t firstPage, std::size_t pages, MemoryDevice* device);
+
+    // Back to the Bus's own 64K of RAM
+    void UnmapAll();
+
+    // The Bus's own 64K of RAM, whatever is mapped over it, for save states.
+    // Both clip to the 64K. RestoreRam counts as a write wherever that RAM
+    // is mapped.
+    void ReadRam(std::size_t offset, std::span<std::uint8_t> out) const;
+    void RestoreRam(std::size_t offset, std::span<const std::uint8_t> data);
+
+    // Own RAM pages written since the last ClearDirty() (all of them before
+    // the first), by any route: Write, the block calls, the CPU's block
+    // instructions or RestoreRam. Writes that land in ROM, devices or RAM
+    // handed to MapRam() are not counted. Until ClearDirty() is first called
+    // tracking costs nothing; after it, the first write to each page costs
+    // one trip through the slow path.
+    PageSet CollectDirty() const { return dirty_; }
+    void ClearDirty();
+
+    // Port I/O for IN/OUT. Devices are called in the order they were attached.
+    void AttachPorts(PortDevice* device);
+    void DetachPorts(PortDevice* device);
+    std::uint8_t In(std::uint16_t port) const;
+    void Out(std::uint16_t port, std::uint8_t value);
+
+#if defined(Z80EMU_DECODE_CACHE) || defined(Z80EMU_JIT)
+    // Code page tracking for the CPU's decode cache and JIT. The CPU watches
+    // every page it has decoded from. The first write to a watched page bumps that
+    // page's generation (and the bus-wide one) and stops watching it, so
+    // writes to plain data pages only cost the watch check. Remapping a
+    // watched page counts as a write to all of it.
+    static constexpr std::size_t PAGE_SHIFT = 8;
+    static constexpr std::size_t PAGE_COUNT = RAM_SIZE >> PAGE_SHIFT;
+
+    void WatchCodePage(std::uint8_t page) { codeWatched_[page] = true; }
+    std::uint32_t CodeGeneration() const { return codeGeneration_; }
+    std::uint32_t PageGeneration(std::uint8_t page) const { return pageGeneration_[page]; }
+#endif
+
+#if defined(Z80EMU_TRACE)
+    // Write logging for the trace recorder (Z80EMU_TRACE). While a log is
+    // set, every Write() and every byte reported through CodeWritten() is
+    // appended to it in order, the latter read back from the page it was
+    // written to (a ROM page's sink, so the values are the ones written).
+    // Writes through WriteBlock/Fill/RestoreRam to device pages are not logged.
+    struct LoggedWrite
+    {
+        std::uint16_t address = 0;
+        std::uint8_t value = 0;
+
+        bool operator==(const LoggedWrite&) const = default;
+    };
+
+    void SetWriteLog(std::vector<LoggedWrite>* log) { writeLog_ = log; }
+#endif
 
 private:
-    std::array<uint8_t, RAM_SIZE> ram_;
-};
\ No newline at end of file
+    using RamPage = std::array<std::uint8_t, MAP_PAGE_SIZE>;
+
+    std::array<std::shared_ptr<RamPage>, MAP_PAGE_COUNT> ram_;
+    std::array<uint8_t, MAP_PAGE_SIZE> romSink_;     // writes to ROM pages land here
+
+    std::array<const std::uint8_t*, MAP_PAGE_COUNT> readPage_;
+    std::array<std::uint8_t*, MAP_PAGE_COUNT> writePage_;
+    std::array<MemoryDevice*, MAP_PAGE_COUNT> device_{};
+    PageSet dirty_;
+
+    // Own RAM is mapped here, but writes go through OwnRamPage() first,
+    // because a fork still shares it or it is clean
+    std::array<bool, MAP_PAGE_COUNT> writeTrap_{};
+    std::vector<PortDevice*> ports_;
+#if defined(Z80EMU_TRACE)
+    std::vector<LoggedWrite>* writeLog_ = nullptr;      // not handed to forks
+#endif
+#if defined(Z80EMU_PAGE_HASH)
+    std::array<std::uint64_t, MAP_PAGE_COUNT> pageHash_{};
+    std::array<std::uint8_t*, MAP_PAGE_COUNT> ownPage_{};    // ram_[page]->data(), for the checks
+
+    // XORs the share of the own RAM bytes in [address, address + bytes) into
+    // the page hash, which takes them out if they were in. One mapping page.
+    void ToggleHash(std::uint16_t address, std::size_t bytes);
+#endif
+
+    struct ForkTag {};
+    explicit Bus(ForkTag) {}
+
+    std::uint8_t* WritablePage(std::size_t page)
+    {
+        std::uint8_t* memory = writePage_[page];
+        if (memory == nullptr && writeTrap_[page]) [[unlikely]]
+            memory = OwnRamPage(page);
+        return memory;
+    }
+
+    // One of this Bus's own RAM pages, about to be written: copied first if
+    // a fork still shares it, marked dirty, and mapped for writes if mapped
+    std::uint8_t* OwnRamPage(std::size_t page);
+
+    std::uint8_t ReadDevice(std::uint16_t address) const;
+    void WriteDevice(std::uint16_t address, std::uint8_t value);
+
+    // Clips a mapping request to the address space; returns the page count left
+    std::size_t ClipPages(std::size_t firstPage, std::size_t pages) const;
+    void PagesRemapped(std::size_t firstPage, std::size_t pages);
+
+#if defined(Z80EMU_DECODE_CACHE) || defined(Z80EMU_JIT)
+    std::array<bool, PAGE_COUNT> codeWatched_{};
+    std::array<std::uint32_t, PAGE_COUNT> pageGeneration_{};
+    std::uint32_t codeGeneration_ = 0;
+
+    void InvalidateCodePage(std::uint8_t page)
+    {
+        codeWatched_[page] = false;
+        ++pageGeneration_[page];
+        ++codeGeneration_;
+    }
+#endif
+};
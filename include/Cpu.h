@@ -1,8 +1,31 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
 #include <array>
+#include <bit>
+#include <utility>
+#include <vector>
+#include "Bus.h"
 
-class Bus;
+#if defined(Z80EMU_DECODE_CACHE) && defined(Z80EMU_THREADED_DISPATCH)
+#error "Z80EMU_DECODE_CACHE works with the opcode-table core only; turn off Z80EMU_THREADED_DISPATCH"
+#endif
+
+#if defined(Z80EMU_JIT)
+#if defined(Z80EMU_THREADED_DISPATCH) || defined(Z80EMU_DECODE_CACHE)
+#error "Z80EMU_JIT works with the plain opcode-table core only"
+#endif
+#include "Jit.h"
+#endif
+
+#if defined(Z80EMU_PROFILER)
+#if defined(Z80EMU_JIT)
+#error "Z80EMU_PROFILER counts the interpreter's instructions and cannot see into JIT blocks"
+#endif
+#include "Profiler.h"
+#endif
+
+template<std::size_t Lanes> class LockstepCpu;
 
 class Cpu
 {
@@ -12,18 +35,46 @@ class Cpu
 	    void Connect(Bus* bus);
 	    void PushByte(std::uint8_t value);
 	    void ExecScf();
-	    void ExecIncReg(uint8_t opcode);
-	    void ExecDecReg(uint8_t opcode);
-	    void ExecLdRegReg(uint8_t opcode);
 	    void SetFlag(uint8_t mask, bool on);
 	    uint8_t GetFlag(uint8_t mask) const;
-	    void ExecAddAReg(uint8_t opcode);
-		void ExecAdcAReg(uint8_t opcode);
-		void Step();
+		// Each of these returns the T-states used
+		std::uint32_t Step();
+		std::uint64_t Execute(std::uint64_t instructions);
+		std::uint64_t Run(std::uint64_t tstates);
+		std::uint64_t GetTStates() const { return tstates_; }
 	    bool is_connected() const;
 	    bool is_halted() const { return halted_; }
+
+		// Set when Step() meets an opcode that has no handler yet (it then acts as a NOP)
+		bool has_unimplemented() const { return unimplemented_; }
+		std::uint8_t last_unimplemented() const { return last_unimplemented_; }
 		std::uint16_t FetchWord();
 
+#if defined(Z80EMU_JIT)
+		Jit& GetJit() { return jit_; }
+#endif
+#if defined(Z80EMU_PROFILER)
+		Profiler& GetProfiler() { return profiler_; }
+		const Profiler& GetProfiler() const { return profiler_; }
+#endif
+
+		// Everything that makes up the CPU between two instructions, for save
+		// states and snapshots. F is the resolved flags byte.
+		struct State
+		{
+			std::uint16_t af = 0, bc = 0, de = 0, hl = 0;
+			std::uint16_t afAlt = 0, bcAlt = 0, deAlt = 0, hlAlt = 0;
+			std::uint16_t pc = 0, sp = 0, ix = 0, iy = 0;
+			std::uint8_t i = 0, r = 0;
+			bool halted = false;
+			std::uint64_t tstates = 0;
+
+			bool operator==(const State&) const = default;
+		};
+
+		State GetState() const;
+		void SetState(const State& state);
+
 	    // Flag masks (standard Z80)
 	    static constexpr uint8_t FLAG_S = 0x80;
 	    static constexpr uint8_t FLAG_Z = 0x40;
@@ -32,79 +83,304 @@ class Cpu
 	    static constexpr uint8_t FLAG_N = 0x02;
 	    static constexpr uint8_t FLAG_C = 0x01;
 
-		// Public getters for the 8-bit registers
 		std::uint8_t PopByte();
 		std::uint8_t FetchByte();
-		std::uint8_t GetA() const;
-		std::uint8_t GetB() const;
-		std::uint8_t GetC() const;
-		std::uint8_t GetD() const;
-		std::uint8_t GetE() const;
+
+		// Public getters for the 8-bit registers
+		std::uint8_t GetA() const { return Reg8(REG_A); }
+		std::uint8_t GetB() const { return Reg8(REG_B); }
+		std::uint8_t GetC() const { return Reg8(REG_C); }
+		std::uint8_t GetD() const { return Reg8(REG_D); }
+		std::uint8_t GetE() const { return Reg8(REG_E); }
 		std::uint8_t GetF() const;
-		std::uint8_t GetH() const;
-		std::uint8_t GetL() const;
+		std::uint8_t GetH() const { return Reg8(REG_H); }
+		std::uint8_t GetL() const { return Reg8(REG_L); }
+		std::uint8_t GetI() const { return i_; }
+		std::uint8_t GetR() const { return r_; }
 
 		// Public setters for the 8-bit registers
-		void SetA(std::uint8_t value);
-		void SetB(std::uint8_t value);
-		void SetC(std::uint8_t value);
-		void SetD(std::uint8_t value);
-		void SetE(std::uint8_t value);
+		void SetA(std::uint8_t value) { Reg8(REG_A) = value; }
+		void SetB(std::uint8_t value) { Reg8(REG_B) = value; }
+		void SetC(std::uint8_t value) { Reg8(REG_C) = value; }
+		void SetD(std::uint8_t value) { Reg8(REG_D) = value; }
+		void SetE(std::uint8_t value) { Reg8(REG_E) = value; }
 		void SetF(std::uint8_t value);
-		void SetG(std::uint8_t value);
-		void SetH(std::uint8_t value);
-	    void SetL(std::uint8_t value);
+		void SetH(std::uint8_t value) { Reg8(REG_H) = value; }
+	    void SetL(std::uint8_t value) { Reg8(REG_L) = value; }
+		void SetI(std::uint8_t value) { i_ = value; }
+		void SetR(std::uint8_t value) { r_ = value; }
 
 	    // Public getters for the 16-bit registers
-		std::uint16_t GetAf() const { return af_; }
-		std::uint16_t GetBc() const { return bc_; }
-		std::uint16_t GetDe() const { return de_; }
-		std::uint16_t GetHl() const { return hl_; }
+#if defined(Z80EMU_LAZY_FLAGS)
+		std::uint16_t GetAf() const { return static_cast<std::uint16_t>((Pair(PAIR_AF) & 0xFF00) | GetF()); }
+#else
+		std::uint16_t GetAf() const { return Pair(PAIR_AF); }
+#endif
+		std::uint16_t GetBc() const { return Pair(PAIR_BC); }
+		std::uint16_t GetDe() const { return Pair(PAIR_DE); }
+		std::uint16_t GetHl() const { return Pair(PAIR_HL); }
 		std::uint16_t GetPc() const { return pc_; }
 		std::uint16_t GetSp() const { return sp_; }
+		std::uint16_t GetIx() const { return ix_; }
+		std::uint16_t GetIy() const { return iy_; }
 
 		// Public setters for the 16-bit registers
-		void SetAf(std::uint16_t value) { af_ = value; }
-		void SetBc(std::uint16_t value) { bc_ = value; }
-		void SetDe(std::uint16_t value) { de_ = value; }
-		void SetHl(std::uint16_t value) { hl_ = value; }
+#if defined(Z80EMU_LAZY_FLAGS)
+		void SetAf(std::uint16_t value) { Pair(PAIR_AF) = value; pending_.op = FlagOp::None; }
+#else
+		void SetAf(std::uint16_t value) { Pair(PAIR_AF) = value; }
+#endif
+		void SetBc(std::uint16_t value) { Pair(PAIR_BC) = value; }
+		void SetDe(std::uint16_t value) { Pair(PAIR_DE) = value; }
+		void SetHl(std::uint16_t value) { Pair(PAIR_HL) = value; }
 		void SetSp(std::uint16_t value) { sp_ = value; }
+		void SetIx(std::uint16_t value) { ix_ = value; }
+		void SetIy(std::uint16_t value) { iy_ = value; }
+
+		// The alternate set (AF' BC' DE' HL'), i.e. whichever bank is not live
+		std::uint16_t GetAfAlt() const { return regs_[ALT_BANK + PAIR_AF]; }
+		std::uint16_t GetBcAlt() const { return regs_[ALT_BANK + PAIR_BC]; }
+		std::uint16_t GetDeAlt() const { return regs_[ALT_BANK + PAIR_DE]; }
+		std::uint16_t GetHlAlt() const { return regs_[ALT_BANK + PAIR_HL]; }
+		void SetAfAlt(std::uint16_t value) { regs_[ALT_BANK + PAIR_AF] = value; }
+		void SetBcAlt(std::uint16_t value) { regs_[ALT_BANK + PAIR_BC] = value; }
+		void SetDeAlt(std::uint16_t value) { regs_[ALT_BANK + PAIR_DE] = value; }
+		void SetHlAlt(std::uint16_t value) { regs_[ALT_BANK + PAIR_HL] = value; }
 
 	private:
-	    using Reg8Getter = uint8_t(Cpu::*)() const;
-	    using Reg8Setter = void (Cpu::*)(uint8_t);
+	    using OpHandler = std::uint32_t (Cpu::*)();
+
+	    // ---- Register file ----
+	    // BC DE HL AF and their shadows held as 16-bit words. The live set always
+	    // sits in the first four words so every access is a fixed offset from
+	    // this; EXX and EX AF,AF' swap words with the shadow half instead of
+	    // moving a bank index that every access would have to load first.
+	    // The 8-bit registers are the bytes of those same words: REG8_BYTE maps
+	    // an opcode's 3-bit register field straight to its byte, so LD r,r' and
+	    // friends are a single byte load/store.
+	    static constexpr std::uint8_t REG_B = 0;
+	    static constexpr std::uint8_t REG_C = 1;
+	    static constexpr std::uint8_t REG_D = 2;
+	    static constexpr std::uint8_t REG_E = 3;
+	    static constexpr std::uint8_t REG_H = 4;
+	    static constexpr std::uint8_t REG_L = 5;
+	    static constexpr std::uint8_t REG_F = 6;        // field 6 is (HL) in opcodes; F borrows the slot
+	    static constexpr std::uint8_t REG_A = 7;
+
+	    static constexpr std::uint8_t PAIR_BC = 0;
+	    static constexpr std::uint8_t PAIR_DE = 1;
+	    static constexpr std::uint8_t PAIR_HL = 2;
+	    static constexpr std::uint8_t PAIR_AF = 3;
+	    static constexpr std::uint8_t ALT_BANK = 4;     // word offset of the shadow set
+
+	    static constexpr std::uint8_t LO = std::endian::native == std::endian::little ? 0 : 1;
+	    static constexpr std::uint8_t HI = 1 - LO;
+
+	    static constexpr std::array<std::uint8_t, 8> REG8_BYTE = {
+	        2 * PAIR_BC + HI, 2 * PAIR_BC + LO,             // B C
+	        2 * PAIR_DE + HI, 2 * PAIR_DE + LO,             // D E
+	        2 * PAIR_HL + HI, 2 * PAIR_HL + LO,             // H L
+	        2 * PAIR_AF + LO, 2 * PAIR_AF + HI              // F A
+	    };
+
+	    std::array<std::uint16_t, 8> regs_{};      // BC DE HL AF | BC' DE' HL' AF'
+
+	    std::uint16_t& Pair(std::uint8_t pair) { return regs_[pair]; }
+	    std::uint16_t Pair(std::uint8_t pair) const { return regs_[pair]; }
+
+	    std::uint8_t& Reg8(std::uint8_t r) { return reinterpret_cast<std::uint8_t*>(regs_.data())[REG8_BYTE[r]]; }
+	    std::uint8_t Reg8(std::uint8_t r) const { return reinterpret_cast<const std::uint8_t*>(regs_.data())[REG8_BYTE[r]]; }
 
 	    Bus* bus_ = nullptr;
 	    std::uint16_t pc_ = 0;
 	    std::uint16_t sp_ = 0;
-	    std::uint16_t af_ = 0;
-	    std::uint16_t bc_ = 0;
-	    std::uint16_t de_ = 0;
-	    std::uint16_t hl_ = 0;
+	    std::uint16_t ix_ = 0;
+	    std::uint16_t iy_ = 0;
+	    std::uint8_t i_ = 0;
+	    std::uint8_t r_ = 0;
 
+	    std::uint64_t tstates_ = 0;
 	    bool halted_ = false;
+	    bool unimplemented_ = false;
+	    std::uint8_t last_unimplemented_ = 0;
+
+	    // One handler per opcode, each one an Exec<Op> specialisation (see CpuOps.cpp)
+	    static const std::array<OpHandler, 256> opTable_;
+	    static const std::array<std::uint8_t, 256> OP_TSTATES;
+
+	    template<std::size_t... Ops>
+	    static constexpr std::array<OpHandler, 256> BuildOpTable(std::index_sequence<Ops...>);
+
+	    template<std::uint8_t Op> std::uint32_t Exec();
+#if defined(Z80EMU_PROFILER)
+	    // Exec<Op> with the dispatch recorded; the cores run this instead
+	    template<std::uint8_t Op> std::uint32_t ExecProfiled();
+#endif
+	    template<bool ByTStates> std::uint64_t RunThreaded(std::uint64_t limit);
+	    std::uint32_t Dispatch();
+
+	    // ED-prefixed opcodes, looked up by the byte after the prefix (see CpuOps_Ed.cpp)
+	    static const std::array<OpHandler, 256> edTable_;
+
+	    template<std::size_t... Ops>
+	    static constexpr std::array<OpHandler, 256> BuildEdTable(std::index_sequence<Ops...>);
+
+	    template<std::uint8_t Op> std::uint32_t ExecEd();
+	    std::uint32_t ExecEdPrefix();
+
+	    // A repeating block instruction (LDIR, CPIR, INIR, OTIR...) may run
+	    // several of its iterations in one dispatch. These hold what is left of
+	    // the caller's budget when it dispatches: instructions for Execute(),
+	    // T-states for Run(). Each iteration counts as one instruction, so the
+	    // handler takes the extra ones it ran off blockInstructions_.
+	    std::uint64_t blockInstructions_ = 1;
+	    std::uint64_t blockTStates_ = 1;
 
-	    void ExecLdRegImm8(void (Cpu::* setter)(uint8_t));
+	    std::uint64_t BlockIterations() const;
+	    bool BlockStillAt(std::uint16_t pc, std::uint8_t op) const;
+	    std::uint32_t EndBlockRepeat(std::uint64_t iterations, bool finished);
+
+	    template<std::uint8_t Op> std::uint32_t ExecBlockLoad();
+	    template<std::uint8_t Op> std::uint32_t ExecBlockCompare();
+	    template<std::uint8_t Op> std::uint32_t ExecBlockIn();
+	    template<std::uint8_t Op> std::uint32_t ExecBlockOut();
+	    template<bool Down> std::size_t BlockCopyRun(std::uint16_t pc, std::size_t count);
+	    template<bool Down> std::size_t BlockScanRun(std::uint16_t pc, std::size_t count, std::uint8_t& last);
+
+	    // Immediate operands of the instruction being executed. Handlers use these
+	    // rather than FetchByte so the decode cache can serve its stored copy.
+	    std::uint8_t OperandByte();
+	    std::uint16_t OperandWord();
+
+#if defined(Z80EMU_DECODE_CACHE)
+	    // Decode cache: one entry per address, filled the first time an
+	    // instruction runs from there. Entries are dropped a whole page at a time
+	    // when the Bus reports a write to a page they were decoded from.
+	    struct DecodedOp
+	    {
+	        OpHandler handler = nullptr;
+	        std::array<std::uint8_t, 2> operand{};  // the bytes after the opcode
+	        std::uint8_t length = 0;                // 0 = not decoded
+	    };
+
+	    std::vector<DecodedOp> decoded_;
+	    std::array<std::uint32_t, Bus::PAGE_COUNT> decodedGeneration_{};
+	    std::uint32_t seenCodeGeneration_ = 0;
+	    const std::uint8_t* operand_ = nullptr;
+	    std::uint8_t* capture_ = nullptr;       // set while decoding: operands come from the Bus into here
+
+	    std::uint32_t DecodeAndExec(DecodedOp& op);
+	    void SyncDecodeCache();
+	    void ResetDecodeCache();
+#endif
+
+#if defined(Z80EMU_JIT)
+	    friend class Jit;
+	    Jit jit_;
+#endif
+#if defined(Z80EMU_PROFILER)
+	    Profiler profiler_;
+#endif
+	    // Runs this core's opcodes as vector kernels and needs its timings
+	    template<std::size_t Lanes> friend class LockstepCpu;
+
+	    template<std::uint8_t Op> void ExecIncReg();
+	    template<std::uint8_t Op> void ExecDecReg();
+	    template<std::uint8_t Op> void ExecLdRegReg();
+	    template<std::uint8_t Op> void ExecAddAReg();
+	    template<std::uint8_t Op> void ExecAdcAReg();
+	    template<std::uint8_t Op> void ExecSubAReg();
+	    template<std::uint8_t Op> void ExecSbcAReg();
+	    void ExecUnimplemented(std::uint8_t opcode);
+
+	    template<std::uint8_t Op> void ExecLdRegImm8();
 	    void ExecLdRegImm16(void (Cpu::* setter)(uint16_t));
+	    void ExecExAf();
+	    void ExecExx();
 		void ExecAddAImm();
-		void ExecSubAReg(uint8_t opcode);
-		void ExecSbcAReg(uint8_t opcode);
-	    bool Parity(uint8_t value);
+		void ExecAndImm();
+		void ExecOrImm();
+		void ExecXorImm();
+		void ExecCpImm();
+		void ExecDaa();
+		void ExecOutImm();
+		void ExecInImm();
 	    void execAddHl(uint16_t value);
 	    void ExecPush(uint16_t value);
 	    uint16_t ExecPop();
-	    void SetFlagsAdd8(uint8_t a, uint8_t b_val, uint8_t carryIn, uint8_t result);
-		void SetFlagsSub8(uint8_t a, uint8_t b, uint8_t carryIn, uint8_t result);
+	    void SetFlagsAdd8(uint8_t lhs, uint8_t rhs, uint8_t carryIn);
+		void SetFlagsSub8(uint8_t lhs, uint8_t rhs, uint8_t carryIn);
+		void SetFlagsLogic8(uint8_t result, uint8_t hFlag);
+		uint8_t CarryIn() const;
+
+#if defined(Z80EMU_LAZY_FLAGS)
+		// Lazy flags: the ALU only records what the last flag-setting op was and
+		// its inputs. F (the low byte of AF) is rebuilt from this when it is read.
+		enum class FlagOp : std::uint8_t { None, Add, Sub, Inc, Dec, Logic };
+
+		struct PendingFlags
+		{
+			FlagOp op = FlagOp::None;
+			std::uint8_t lhs = 0;       // Logic: the result
+			std::uint8_t rhs = 0;       // Logic: the extra flag bits (H for AND)
+			std::uint8_t carry = 0;     // Add/Sub: carry in. Inc/Dec: the C flag they keep
+		};
+
+		PendingFlags pending_;
+
+		uint8_t ResolveFlags() const;
+		void FlushFlags();
+#endif
 
 	    uint8_t Inc8(uint8_t v);
 	    uint8_t Dec8(uint8_t v);
+};
 
-	    static constexpr std::array<Reg8Getter, 8> reg8Get = {
-	    &Cpu::GetB, &Cpu::GetC, &Cpu::GetD, &Cpu::GetE, &Cpu::GetH, &Cpu::GetL, nullptr, &Cpu::GetA
-	    };
+// Memory access helpers are inline so they compile down to Bus array accesses
+// inside the opcode handlers.
+inline std::uint8_t Cpu::PopByte()
+{
+    const auto value = bus_->Read(sp_);
+    ++sp_;
+    return value;
+}
 
-		static constexpr std::array<Reg8Setter, 8> reg8Set = {
-			&Cpu::SetB, &Cpu::SetC, &Cpu::SetD, &Cpu::SetE, &Cpu::SetH, &Cpu::SetL, nullptr, &Cpu::SetA
-		};
-};
-    
\ No newline at end of file
+inline void Cpu::PushByte(std::uint8_t value)
+{
+    --sp_;                      // stack grows downward
+    bus_->Write(sp_, value);
+}
+
+inline std::uint8_t Cpu::FetchByte()
+{
+    //TODO :: (Decide how to handle "not connected" in a later step.)
+    const auto value = bus_->Read(pc_);
+    pc_++;
+    return value;
+}
+
+inline std::uint16_t Cpu::FetchWord()
+{
+    const std::uint16_t lo = FetchByte();
+    const std::uint16_t hi = FetchByte();
+    return static_cast<std::uint16_t>((hi << 8) | lo);
+}
+
+inline std::uint8_t Cpu::OperandByte()
+{
+#if defined(Z80EMU_DECODE_CACHE)
+    if (capture_ != nullptr)
+        return *capture_++ = FetchByte();
+    ++pc_;
+    return *operand_++;
+#else
+    return FetchByte();
+#endif
+}
+
+inline std::uint16_t Cpu::OperandWord()
+{
+    const std::uint16_t lo = OperandByte();
+    const std::uint16_t hi = OperandByte();
+    return static_cast<std::uint16_t>((hi << 8) | lo);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include "Cpu.h"
+#include "Machine.h"
+
+struct DivergenceConfig
+{
+    std::uint64_t checkpoint = 1 << 20;     // instructions between two hash checks going forward
+    std::uint64_t linear = 64;              // bisect down to this many, then single-step
+    bool parallel = true;                   // run the two machines on two threads
+};
+
+// Where two runs first came apart
+struct Divergence
+{
+    bool found = false;
+    bool atStart = false;                   // they differed before either ran anything
+    std::uint64_t instruction = 0;          // instructions both ran before the one that differs
+    std::uint16_t pc = 0;                   // where that one starts
+    std::array<std::uint8_t, 4> bytes{};    // memory at pc in the first machine before it ran; 0 on device pages
+    std::string field;                      // the first difference after it: "A", "HL'"... "T-states" or "memory"
+    std::uint16_t address = 0;              // which byte, for "memory"
+    std::uint64_t first = 0;                // the field in each machine
+    std::uint64_t second = 0;
+    Cpu::State firstState;                  // both CPUs after it
+    Cpu::State secondState;
+};
+
+// Finds the first instruction after which two machines that should run the
+// same way disagree. Both are forked (the originals stay where they are)
+// and run forward `checkpoint` instructions at a time, comparing
+// Machine::Fingerprint() at each stop; the last matching stop is kept as a
+// fork. Once the fingerprints differ, the interval is bisected from that
+// fork, and the last `linear` instructions are single-stepped, comparing
+// the whole state after each, to name the instruction and the register or
+// RAM byte.
+//
+// A difference that appears and is overwritten again between two checks is
+// not seen. The comparison covers the CPU and the Bus's own RAM; RAM handed
+// to MapRam() and devices are shared by the forks and not rewound, so
+// anything that keeps state there is replayed, and with `parallel` two
+// machines must not share a device.
+class DivergenceFinder
+{
+public:
+    // Looks through the first `limit` instructions
+    static Divergence Find(Machine& first, Machine& second, std::uint64_t limit, const DivergenceConfig& config = {});
+};
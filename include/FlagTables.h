@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Precomputed F register results for the 8-bit ALU.
+// All of them are built at compile time in FlagTables.cpp, so an ALU op
+// updates F with one or two table loads instead of testing bit by bit.
+struct FlagTables
+{
+    static constexpr std::size_t ALU_SIZE = 2 * 256 * 256;
+    static constexpr std::size_t DAA_SIZE = 8 * 256;
+
+    // S, Z and P/V (even parity) of a result. Used by AND/OR/XOR.
+    static const std::array<std::uint8_t, 256> Szp;
+
+    // S Z H P/V N for INC/DEC, indexed by the value before the op. C is not included.
+    static const std::array<std::uint8_t, 256> Inc;
+    static const std::array<std::uint8_t, 256> Dec;
+
+    // Complete F for ADD/ADC and SUB/SBC/CP, indexed by AluIndex().
+    static const std::array<std::uint8_t, ALU_SIZE> Add;
+    static const std::array<std::uint8_t, ALU_SIZE> Sub;
+
+    // AF after DAA, indexed by DaaIndex().
+    static const std::array<std::uint16_t, DAA_SIZE> Daa;
+
+    static constexpr std::size_t AluIndex(std::uint8_t lhs, std::uint8_t rhs, std::uint8_t carryIn)
+    {
+        return (static_cast<std::size_t>(carryIn) << 16) | (static_cast<std::size_t>(lhs) << 8) | rhs;
+    }
+
+    // DAA only looks at C, N and H, so they are folded into 3 bits above A.
+    static constexpr std::size_t DaaIndex(std::uint8_t a, std::uint8_t f)
+    {
+        const std::size_t cnh = (f & 0x03u) | ((f & 0x10u) >> 2);
+        return (cnh << 8) | a;
+    }
+};
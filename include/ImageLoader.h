@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include "Bus.h"
+
+// A file mapped read-only into the process. Many machines can map ROM pages
+// straight onto one MappedFile, so they share the OS page cache instead of
+// each holding a copy. Move-only; unmapped when destroyed, so it has to
+// outlive every Bus it is mapped into.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // False if the file could not be opened or mapped. An empty file is open
+    // with no bytes.
+    bool IsOpen() const { return open_; }
+    std::span<const std::uint8_t> Bytes() const { return { data_, size_ }; }
+
+private:
+    const std::uint8_t* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool open_ = false;
+#if defined(_WIN32)
+    void* mapping_ = nullptr;       // HANDLE of the file mapping object
+#endif
+
+    void Close();
+};
+
+enum class ImageFormat
+{
+    Raw,            // plain bytes, loaded at the address given
+    IntelHex,       // ':LLAAAATT..CC' text records
+    Tagged,         // two-byte little-endian load address, then the bytes
+};
+
+struct LoadResult
+{
+    bool ok = false;
+    std::size_t bytes = 0;                  // bytes stored into the Bus
+    std::optional<std::uint16_t> entry;     // start record (HEX) or load address (tagged)
+    std::string error;
+};
+
+// Getting programs and ROMs into a Bus without going through Write() a byte
+// at a time. ROMs are mapped, not copied; RAM images go in with WriteBlock.
+class ImageLoader
+{
+public:
+    // Points ROM pages starting at `firstPage` straight at the mapping. The
+    // last page is padded with zeros past the end of the file.
+    static LoadResult MapRom(Bus& bus, const MappedFile& rom, std::size_t firstPage);
+
+    // Copies an image into whatever is mapped (ROM pages drop it). `address`
+    // is where Raw images go; the other formats carry their own addresses.
+    static LoadResult Load(Bus& bus, std::span<const std::uint8_t> image, ImageFormat format, std::uint16_t address = 0);
+
+    // Maps the file just long enough to load it
+    static LoadResult LoadFile(Bus& bus, const std::string& path, ImageFormat format, std::uint16_t address = 0);
+
+    // .hex/.ihx are Intel HEX, .prg is tagged, anything else is raw
+    static ImageFormat FormatForPath(const std::string& path);
+
+private:
+    static LoadResult LoadIntelHex(Bus& bus, std::span<const std::uint8_t> text);
+    static LoadResult LoadTagged(Bus& bus, std::span<const std::uint8_t> image);
+};
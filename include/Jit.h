@@ -0,0 +1,101 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "Bus.h"
+
+#if !defined(__x86_64__)
+#error "Z80EMU_JIT emits x86-64 code; build without it on this host"
+#endif
+
+class Cpu;
+
+// Optional dynamic recompiler (Z80EMU_JIT). A PC the interpreter reaches often
+// enough becomes the start of a block: the straight run of instructions from
+// there, compiled to x86-64 with the Z80 registers held in host registers.
+// Register and ALU instructions become native code. Memory accesses call
+// small helpers on the Bus (or the interpreter's handler for the rarer ones),
+// and the block leaves early if a write landed on a watched code page. Unimplemented opcodes
+// end the block so the interpreter deals with them.
+class Jit
+{
+public:
+    static constexpr std::uint32_t DEFAULT_THRESHOLD = 16;
+    static constexpr std::uint32_t MAX_BLOCK_INSTRUCTIONS = 128;
+    // A page whose blocks were dropped this many times is left to the interpreter
+    static constexpr std::uint8_t SELF_MODIFYING_DROPS = 8;
+
+    // What a block did. instructions == 0 means nothing ran.
+    struct Result
+    {
+        std::uint32_t instructions = 0;
+        std::uint32_t tstates = 0;
+    };
+
+    Jit();
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // Disabled (or unable to map executable memory) means Run never runs anything
+    void SetEnabled(bool on) { enabled_ = on; }
+    bool IsEnabled() const { return enabled_ && code_ != nullptr; }
+
+    // How many times the interpreter must reach a PC before it gets compiled
+    void SetThreshold(std::uint32_t runs) { threshold_ = runs == 0 ? 1 : runs; }
+
+    std::size_t BlockCount() const;
+
+    // Drop every block, e.g. after the CPU is connected to another bus
+    void Reset(const Bus* bus);
+
+    // Runs the block at the CPU's PC if there is one (compiling it if the PC
+    // just became hot) and it fits the budgets. The last instruction of a
+    // block may overshoot maxTStates, the same as the interpreter's Run.
+    Result Run(Cpu& cpu, std::uint64_t maxInstructions, std::uint64_t maxTStates);
+
+private:
+    using BlockFn = std::uint64_t (*)(Cpu*);
+
+    static constexpr std::int32_t NO_BLOCK = -1;
+    static constexpr std::int32_t NOT_COMPILABLE = -2;
+    static constexpr std::size_t CODE_SIZE = std::size_t{4} << 20;
+
+    struct Block
+    {
+        BlockFn code = nullptr;
+        std::uint16_t start = 0;
+        std::uint16_t length = 0;               // Z80 bytes covered
+        std::uint32_t instructions = 0;
+        std::uint32_t tstatesBeforeLast = 0;    // for the Run() budget check
+        bool live = false;
+    };
+
+    bool enabled_ = true;
+    std::uint32_t threshold_ = DEFAULT_THRESHOLD;
+
+    std::uint8_t* code_ = nullptr;              // mmap'd, RX except while a block is copied in
+    std::size_t codeUsed_ = 0;
+
+    std::vector<Block> blocks_;
+    std::vector<std::int32_t> entry_;           // per address: block index or NO_BLOCK/NOT_COMPILABLE
+    std::vector<std::uint16_t> heat_;           // per address: times reached without a block
+
+    std::array<std::uint32_t, Bus::PAGE_COUNT> pageGeneration_{};
+    std::array<std::uint8_t, Bus::PAGE_COUNT> pageDrops_{};   // times a page's blocks were dropped
+    std::uint32_t seenGeneration_ = 0;
+
+    void Flush();
+    void Sync(const Bus& bus);
+    void DropPage(std::uint8_t page);
+    std::int32_t Compile(Cpu& cpu, std::uint16_t pc);
+
+    // Called from compiled code. The writers return nonzero when the write
+    // landed on a watched code page.
+    static std::uint32_t ReadByte(Cpu* cpu, std::uint32_t address);
+    static std::uint32_t WriteByte(Cpu* cpu, std::uint32_t address, std::uint32_t value);
+    static std::uint32_t PushWord(Cpu* cpu, std::uint32_t value);
+    static std::uint32_t PopWord(Cpu* cpu);
+    static std::uint32_t ExecInterpreted(Cpu* cpu, std::uint32_t pc, std::uint32_t opcode);
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include "Bus.h"
+#include "Cpu.h"
+
+// Runs up to Lanes independent Z80s (8, 16 or 32) in lockstep, for many
+// copies of one program fed different inputs. The register file is kept
+// as one array per register with a byte per lane, so an instruction that
+// every lane is about to run is one pass of SSE2 (or AVX2) operations over
+// all of them, flags included.
+//
+// Each round, every running lane executes one instruction. The lanes that
+// share the most common PC and opcode form the vector group; register and
+// ALU opcodes run there as vector kernels, and memory operands are read
+// and written one lane at a time. Lanes that diverged, and opcodes with no
+// kernel (ED, DAA, port I/O...), run on a scalar Cpu per lane instead. The
+// result for every lane is exactly what Cpu::Execute would give it alone.
+//
+// Each lane needs a Bus of its own.
+template<std::size_t Lanes>
+class LockstepCpu
+{
+	static_assert(Lanes == 8 || Lanes == 16 || Lanes == 32, "LockstepCpu runs 8, 16 or 32 lanes");
+
+	public:
+		static constexpr std::size_t LANES = Lanes;
+
+		// A lane runs once it has a Bus; the others are left alone
+		void Connect(std::size_t lane, Bus* bus);
+
+		Cpu::State GetState(std::size_t lane) const;
+		void SetState(std::size_t lane, const Cpu::State& state);
+
+		// Runs `instructions` instructions on every connected lane, like
+		// Cpu::Execute on each; a halted lane idles 4 T-states each
+		void Execute(std::uint64_t instructions);
+
+		// Lane instructions run by the vector kernels and by the scalar Cpus
+		std::uint64_t VectorSteps() const { return vectorSteps_; }
+		std::uint64_t ScalarSteps() const { return scalarSteps_; }
+
+	private:
+		// Every register array is this wide whatever the lane count, so its
+		// layout does not depend on the vector width the kernels were built for
+		static constexpr std::size_t STRIDE = 32;
+
+		// The Cpu's register field order, then the alternate set from ALT_BANK
+		static constexpr std::uint8_t REG_B = 0;
+		static constexpr std::uint8_t REG_C = 1;
+		static constexpr std::uint8_t REG_D = 2;
+		static constexpr std::uint8_t REG_E = 3;
+		static constexpr std::uint8_t REG_H = 4;
+		static constexpr std::uint8_t REG_L = 5;
+		static constexpr std::uint8_t REG_F = 6;
+		static constexpr std::uint8_t REG_A = 7;
+		static constexpr std::uint8_t ALT_BANK = 8;
+
+		using LaneBytes = std::array<std::uint8_t, STRIDE>;
+
+		alignas(32) std::array<LaneBytes, 16> regs_{};
+		alignas(32) LaneBytes mask_{};         // 0xFF for the lanes in the vector group
+		alignas(32) LaneBytes operand0_{};     // the group's immediate operands
+		alignas(32) LaneBytes operand1_{};
+		alignas(32) LaneBytes scratchLo_{};    // (HL) bytes and SP halves
+		alignas(32) LaneBytes scratchHi_{};
+
+		std::array<std::uint16_t, Lanes> pc_{};
+		std::array<std::uint16_t, Lanes> sp_{};
+		std::array<std::uint16_t, Lanes> ix_{};
+		std::array<std::uint16_t, Lanes> iy_{};
+		std::array<std::uint8_t, Lanes> i_{};
+		std::array<std::uint8_t, Lanes> r_{};
+		std::array<bool, Lanes> halted_{};
+		std::array<std::uint64_t, Lanes> tstates_{};
+		std::array<Bus*, Lanes> bus_{};
+
+		// The lanes of this round's vector group
+		std::array<std::uint8_t, Lanes> group_{};
+		std::size_t groupSize_ = 0;
+
+		// Divergent lanes and opcodes with no kernel run here, one Step() at a time
+		std::array<Cpu, Lanes> scalar_;
+
+		std::uint64_t vectorSteps_ = 0;
+		std::uint64_t scalarSteps_ = 0;
+
+		using Kernel = void (LockstepCpu::*)();
+
+		// One kernel per opcode, null where the opcode runs on the scalar Cpus
+		static const std::array<Kernel, 256> kernels_;
+
+		template<std::size_t... Ops>
+		static constexpr std::array<Kernel, 256> BuildKernelTable(std::index_sequence<Ops...>);
+
+		template<std::uint8_t Op> void Exec();
+
+		// Picks the PC most running lanes are at, and fills group_ and mask_
+		// with the ones there that also read the same opcode; returns it
+		std::uint8_t FormGroup(const std::array<std::uint8_t, Lanes>& running, std::size_t runningCount);
+		void StepScalar(std::size_t lane);
+		void GatherOperands(std::size_t count);
+
+		std::uint8_t* Reg(std::uint8_t r) { return regs_[r].data(); }
+
+		std::uint16_t Hl(std::size_t lane) const
+		{
+			return static_cast<std::uint16_t>((regs_[REG_H][lane] << 8) | regs_[REG_L][lane]);
+		}
+
+		template<typename Visit>
+		void EachInGroup(Visit visit)
+		{
+			for (std::size_t i = 0; i < groupSize_; ++i)
+				visit(group_[i]);
+		}
+
+		// The kernels (see LockstepCpu.cpp). Each only changes the lanes in mask_.
+		void ExecLoad(std::uint8_t r, const std::uint8_t* from);
+		template<bool Inc> void ExecIncDec(std::uint8_t* value);
+		template<bool Inc> void ExecIncDecPair(std::uint8_t hi, std::uint8_t lo);
+		template<std::uint8_t Kind> void ExecAlu(const std::uint8_t* rhs);
+		void ExecAddHl(const std::uint8_t* hi, const std::uint8_t* lo);
+		void ExecScf();
+		void ExecSwap(std::uint8_t first, std::uint8_t count);
+		void ExecPush(std::uint8_t hi, std::uint8_t lo);
+		void ExecPop(std::uint8_t hi, std::uint8_t lo);
+};
+
+extern template class LockstepCpu<8>;
+extern template class LockstepCpu<16>;
+extern template class LockstepCpu<32>;
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// A small LZ77 codec in the LZ4 block layout: each sequence is a token byte
+// (literal count in the high nibble, match length - 4 in the low one), the
+// literals, and a two-byte little-endian match offset. Counts of 15 carry on
+// in extra bytes, 255 at a time. The last sequence is literals only.
+// Compression is a single greedy pass with a hash of the next four bytes.
+// Decoding is bounds-checked, so a damaged stream fails instead of writing
+// past the output.
+class LzCodec
+{
+public:
+    // Appends the compressed form of `in` to `out`
+    static void Compress(std::span<const std::uint8_t> in, std::vector<std::uint8_t>& out);
+
+    // Decodes `in` into `out`, which has to come out exactly full
+    static bool Decompress(std::span<const std::uint8_t> in, std::span<std::uint8_t> out);
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <memory>
+#include "Bus.h"
+#include "Cpu.h"
+
+// A Cpu connected to a Bus of its own: the unit that gets forked, pooled and
+// snapshotted. Neither is ever moved, so the Cpu's pointer to the Bus holds.
+class Machine
+{
+public:
+    Machine();
+
+    Machine(const Machine&) = delete;
+    Machine& operator=(const Machine&) = delete;
+
+    Bus& GetBus() { return *bus_; }
+    const Bus& GetBus() const { return *bus_; }
+    Cpu& GetCpu() { return cpu_; }
+    const Cpu& GetCpu() const { return cpu_; }
+
+    // An independent child in O(pages): the CPU state is copied and the RAM
+    // shared copy-on-write (see Bus::Fork). The child's decode cache and JIT
+    // start empty. Either side can go on running without affecting the other.
+    std::unique_ptr<Machine> Fork();
+
+    // The CPU state (T-states included) and the Bus's own RAM hashed
+    // together, the same in every build: equal machines always match and
+    // different ones almost never do. With Z80EMU_PAGE_HASH the RAM part is
+    // Bus::RamHash(), a fold of 64 words; otherwise a pass over the 64K.
+    std::uint64_t Fingerprint() const;
+
+private:
+    explicit Machine(std::unique_ptr<Bus> bus);
+
+    std::unique_ptr<Bus> bus_;
+    Cpu cpu_;
+};
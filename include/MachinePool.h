@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Machine.h"
+
+struct MachineRun
+{
+    std::size_t id = 0;
+    std::uint64_t tstates = 0;      // T-states run, idling after a HALT included
+    bool halted = false;            // the CPU ended up halted
+};
+
+// Runs many independent Machines on a fixed set of worker threads. A run is
+// cut into slices of Cpu::Run(slice); after each slice an unfinished
+// machine goes back on the worker's own deque. Each worker takes work from
+// the back of its deque and, when that is empty, steals from the front of
+// the others', so a worker that drew short programs helps with the long
+// ones. Slices are long next to a deque operation, so each deque is just a
+// mutex and a std::deque.
+//
+// A finished run is reported through its future and, if given, a callback
+// on the worker thread that ran the last slice. Machines never share
+// anything through the pool, so the only thing to keep apart is one
+// machine's runs: start the next only once the last has completed.
+class MachinePool
+{
+public:
+    using Completion = std::function<void(Machine& machine, const MachineRun& run)>;
+
+    static constexpr std::uint64_t DEFAULT_SLICE = 200000;
+
+    // threads = 0 uses one per hardware thread
+    explicit MachinePool(std::size_t threads = 0, std::uint64_t slice = DEFAULT_SLICE);
+
+    // Waits for every run, then stops the workers
+    ~MachinePool();
+
+    MachinePool(const MachinePool&) = delete;
+    MachinePool& operator=(const MachinePool&) = delete;
+
+    // The pool owns its machines; ids count up from 0
+    std::size_t Add(std::unique_ptr<Machine> machine);
+    Machine& GetMachine(std::size_t id);
+    std::size_t Size() const;
+    std::size_t Threads() const { return workers_.size(); }
+
+    // Runs machine `id` for `tstates` T-states, or until it halts
+    std::future<MachineRun> Run(std::size_t id, std::uint64_t tstates, Completion done = {});
+
+    // Runs every machine; `done` is called once per machine
+    void RunAll(std::uint64_t tstates, const Completion& done = {});
+
+    // Blocks until every run so far has completed
+    void Wait();
+
+private:
+    struct Task
+    {
+        Machine* machine = nullptr;
+        std::uint64_t remaining = 0;
+        MachineRun run;
+        Completion done;
+        std::promise<MachineRun> promise;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    std::uint64_t slice_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    mutable std::mutex machinesMutex_;
+    std::deque<std::unique_ptr<Machine>> machines_;     // a deque, so Machine& stays put
+
+    std::atomic<std::size_t> queued_{0};                // tasks sitting in some deque
+    std::atomic<std::size_t> sleeping_{0};
+    std::atomic<std::size_t> nextWorker_{0};
+    bool stopping_ = false;
+    std::mutex idleMutex_;
+    std::condition_variable idle_;
+
+    std::size_t outstanding_ = 0;                       // runs not completed yet
+    std::mutex doneMutex_;
+    std::condition_variable done_;
+
+    void Push(std::size_t worker, Task task, bool front);
+    bool Pop(std::size_t worker, Task& task);
+    bool Steal(std::size_t thief, Task& task);
+    void Work(std::size_t self);
+    void RunSlice(std::size_t self, Task& task);
+};
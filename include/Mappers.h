@@ -0,0 +1,141 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "Bus.h"
+
+// Bank-switching memory layouts. Each mapper owns its whole backing store and
+// switches banks by re-pointing Bus pages, so a switch is a handful of
+// pointer stores and never copies memory. Attach() maps the power-on layout
+// and hooks the mapper's latch up to the Bus; the Bus points into the
+// mapper's store, so the mapper has to stay alive for as long as the Bus is used.
+
+// ZX Spectrum 128: two 16K ROMs and eight 16K RAM banks behind port 0x7FFD
+// (decoded on A15 = 0, A1 = 0).
+//   bits 0-2  RAM bank at 0xC000
+//   bit 3     screen from bank 7 instead of bank 5
+//   bit 4     ROM at 0x0000
+//   bit 5     lock paging until reset
+// 0x4000 is always bank 5 and 0x8000 bank 2.
+class Spectrum128Mapper : public PortDevice
+{
+public:
+    static constexpr std::size_t BANK_SIZE = 0x4000;
+    static constexpr std::size_t RAM_BANKS = 8;
+
+    Spectrum128Mapper() : Spectrum128Mapper(2) {}
+    ~Spectrum128Mapper() override = default;
+
+    void Attach(Bus& bus);
+
+    // Power-on paging: ROM 0, bank 0 at 0xC000, unlocked
+    virtual void Reset();
+
+    std::uint8_t* Rom(std::size_t bank) { return &store_[bank * BANK_SIZE]; }
+    std::uint8_t* Ram(std::size_t bank) { return &store_[(romBanks_ + bank) * BANK_SIZE]; }
+    std::size_t RomBanks() const { return romBanks_; }
+
+    std::uint8_t Port7FFD() const { return port7FFD_; }
+    std::size_t ScreenBank() const { return (port7FFD_ & 0x08) != 0 ? 7 : 5; }
+    bool IsLocked() const { return (port7FFD_ & 0x20) != 0; }
+
+    void Out(std::uint16_t port, std::uint8_t value) override;
+
+protected:
+    explicit Spectrum128Mapper(std::size_t romBanks);
+
+    Bus* bus_ = nullptr;
+    std::uint8_t port7FFD_ = 0;
+
+    // Maps one 16K slot; a slot that already shows that bank is left alone
+    void MapSlot(std::size_t slot, std::uint8_t* bank, bool rom);
+    virtual void Remap();
+
+private:
+    std::size_t romBanks_;
+    std::vector<std::uint8_t> store_;
+    std::array<const std::uint8_t*, 4> slots_{};
+};
+
+// ZX Spectrum +2A/+3: four ROMs, 0x7FFD decoded on A15 = 0, A14 = 1, A1 = 0,
+// plus port 0x1FFD (A15-A12 = 0001, A1 = 0).
+//   bit 0     special (all-RAM) paging; bits 1-2 pick one of four layouts
+//   bit 2     otherwise the high bit of the ROM number (bit 4 of 0x7FFD is the low)
+// The lock bit in 0x7FFD locks both ports.
+class SpectrumPlus3Mapper : public Spectrum128Mapper
+{
+public:
+    SpectrumPlus3Mapper() : Spectrum128Mapper(4) {}
+
+    std::uint8_t Port1FFD() const { return port1FFD_; }
+
+    void Reset() override;
+    void Out(std::uint16_t port, std::uint8_t value) override;
+
+protected:
+    void Remap() override;
+
+private:
+    std::uint8_t port1FFD_ = 0;
+};
+
+// MSX ASCII8 / ASCII16 mega-ROM cartridges, mapped at 0x4000-0xBFFF. The
+// bank registers are write-only addresses inside the cartridge's own ROM
+// space; every other write there is ignored.
+class MsxAsciiMapper : public MemoryDevice
+{
+public:
+    static constexpr std::uint16_t CARTRIDGE_START = 0x4000;
+    static constexpr std::size_t CARTRIDGE_SIZE = 0x8000;
+
+    void Attach(Bus& bus);
+
+    // Power-on: bank 0 in every slot
+    void Reset();
+
+    std::size_t BankSize() const { return bankSize_; }
+    std::size_t BankCount() const { return rom_.size() / bankSize_; }
+    std::size_t Bank(std::size_t slot) const { return banks_[slot]; }
+
+    std::uint8_t Read(std::uint16_t address) override;
+    void Write(std::uint16_t address, std::uint8_t value) override;
+
+protected:
+    // The image is padded with 0xFF up to a whole number of banks
+    MsxAsciiMapper(std::vector<std::uint8_t> rom, std::size_t bankSize);
+
+    // Which slot a write to `address` selects the bank for, or -1 for none
+    virtual int SlotForWrite(std::uint16_t address) const = 0;
+
+private:
+    std::vector<std::uint8_t> rom_;
+    std::size_t bankSize_;
+    std::array<std::size_t, 4> banks_{};
+    Bus* bus_ = nullptr;
+
+    std::size_t SlotCount() const { return CARTRIDGE_SIZE / bankSize_; }
+    void MapSlot(std::size_t slot);
+};
+
+// 8K banks at 0x4000/0x6000/0x8000/0xA000, selected by writes to
+// 0x6000/0x6800/0x7000/0x7800 (each register is 2K wide)
+class MsxAscii8Mapper : public MsxAsciiMapper
+{
+public:
+    explicit MsxAscii8Mapper(std::vector<std::uint8_t> rom) : MsxAsciiMapper(std::move(rom), 0x2000) {}
+
+protected:
+    int SlotForWrite(std::uint16_t address) const override;
+};
+
+// 16K banks at 0x4000/0x8000, selected by writes to 0x6000-0x67FF and 0x7000-0x77FF
+class MsxAscii16Mapper : public MsxAsciiMapper
+{
+public:
+    explicit MsxAscii16Mapper(std::vector<std::uint8_t> rom) : MsxAsciiMapper(std::move(rom), 0x4000) {}
+
+protected:
+    int SlotForWrite(std::uint16_t address) const override;
+};
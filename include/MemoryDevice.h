@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+
+// Something mapped into the address space that has to see each access
+// (I/O registers, bank-switch latches, ...). The Bus only calls it for the
+// pages it was mapped on; ordinary RAM and ROM never go through here.
+class MemoryDevice
+{
+public:
+    virtual ~MemoryDevice() = default;
+
+    // address is the full CPU address, not an offset into the page
+    virtual std::uint8_t Read(std::uint16_t address) = 0;
+    virtual void Write(std::uint16_t address, std::uint8_t value) = 0;
+};
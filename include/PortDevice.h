@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+// Something on the I/O port bus (IN/OUT). Every attached device sees every
+// access and decodes the 16-bit port address itself, the way the address
+// lines are partially decoded on real machines.
+class PortDevice
+{
+public:
+    virtual ~PortDevice() = default;
+
+    // Ports the device does not answer read as 0xFF; the Bus ANDs the
+    // answers together like a pulled-up data bus
+    virtual std::uint8_t In(std::uint16_t port) { (void)port; return 0xFF; }
+    virtual void Out(std::uint16_t port, std::uint8_t value) = 0;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+// Optional execution profiler (Z80EMU_PROFILER). Without the option it is not
+// compiled in and the cores carry no trace of it.
+//
+// Count mode counts every instruction the interpreter runs: per opcode, per
+// ED opcode and per PC. Sample mode only records the PC of the instruction
+// running every N T-states, which costs a subtract and a compare per
+// instruction. Each iteration of a repeating block instruction counts as one
+// instruction at its PC, the same as Execute() counts them. A halted CPU and
+// LockstepCpu's vector kernels are not seen.
+class Profiler
+{
+public:
+    enum class Mode : std::uint8_t { Off, Count, Sample };
+
+    static constexpr std::uint32_t DEFAULT_SAMPLE_INTERVAL = 1000;      // T-states
+    static constexpr std::size_t DEFAULT_TOP = 20;
+
+    // The counter tables (64K entries for PCs) are allocated on first use
+    void SetMode(Mode mode);
+    Mode GetMode() const { return mode_; }
+
+    void SetSampleInterval(std::uint32_t tstates);
+    std::uint32_t GetSampleInterval() const { return interval_; }
+
+    // Zero every count; the mode and interval stay
+    void Clear();
+
+    std::uint64_t OpcodeCount(std::uint8_t opcode) const { return opcodes_[opcode]; }
+    std::uint64_t EdOpcodeCount(std::uint8_t opcode) const { return edOpcodes_[opcode]; }
+    std::uint64_t PcCount(std::uint16_t pc) const { return pcs_.empty() ? 0 : pcs_[pc]; }
+    std::uint64_t SampleCount(std::uint16_t pc) const { return samples_.empty() ? 0 : samples_[pc]; }
+    std::uint64_t Instructions() const { return instructions_; }
+    std::uint64_t Samples() const { return sampleTotal_; }
+
+    // A readable summary: the `top` busiest opcodes, PCs and sampled PCs
+    void WriteText(std::ostream& out, std::size_t top = DEFAULT_TOP) const;
+
+    // Every non-zero count as `kind,key,count`, kind being opcode, ed, pc or
+    // sample and key the opcode or address in hex
+    void WriteCsv(std::ostream& out) const;
+
+    // ---- Called by the Cpu ----
+    // The byte after an ED prefix, for the Record() that follows
+    void Prefixed(std::uint8_t opcode) { edOpcode_ = opcode; }
+
+    // One dispatch: `runs` instructions (more than one for a block repeat)
+    // starting at pc, taking `tstates` between them
+    void Record(std::uint16_t pc, std::uint8_t opcode, std::uint64_t runs, std::uint32_t tstates)
+    {
+        if (mode_ == Mode::Count)
+        {
+            instructions_ += runs;
+            opcodes_[opcode] += runs;
+            if (opcode == 0xED)
+                edOpcodes_[edOpcode_] += runs;
+            pcs_[pc] += runs;
+        }
+        else if (mode_ == Mode::Sample)
+        {
+            if (tstates < untilSample_)
+                untilSample_ -= tstates;
+            else
+                Sample(pc, tstates);
+        }
+    }
+
+private:
+    Mode mode_ = Mode::Off;
+    std::uint32_t interval_ = DEFAULT_SAMPLE_INTERVAL;
+    std::uint32_t untilSample_ = DEFAULT_SAMPLE_INTERVAL;  // T-states to the next sample, 1..interval_
+    std::uint8_t edOpcode_ = 0;
+
+    std::uint64_t instructions_ = 0;
+    std::uint64_t sampleTotal_ = 0;
+    std::vector<std::uint64_t> opcodes_ = std::vector<std::uint64_t>(256);
+    std::vector<std::uint64_t> edOpcodes_ = std::vector<std::uint64_t>(256);
+    std::vector<std::uint64_t> pcs_;
+    std::vector<std::uint64_t> samples_;
+
+    void Sample(std::uint16_t pc, std::uint32_t tstates);
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include "Bus.h"
+#include "Cpu.h"
+#include "SaveState.h"
+
+struct RewindConfig
+{
+    std::uint64_t interval = 10000;         // instructions between snapshots
+    std::size_t keyframeEvery = 50;         // deltas between two full states
+    std::size_t memoryCap = 8 << 20;        // bytes of snapshots kept
+    SaveCompression compression = SaveCompression::Lz;
+};
+
+// Records a machine as it runs so it can be sent back to any earlier
+// instruction. Every `interval` instructions it takes a snapshot: a full
+// SaveState every `keyframeEvery` deltas, and SaveState::SaveDelta otherwise
+// (so the Bus's dirty set belongs to the buffer while it records). Seeking
+// restores the nearest keyframe, applies the deltas up to the nearest
+// snapshot and executes the remaining instructions. Execute(n) runs exactly
+// n instructions, the same as n Step() calls, so the replay is exact.
+//
+// When the snapshots outgrow `memoryCap`, the oldest keyframe and its
+// deltas are dropped together; the newest group is always kept. What
+// SaveState leaves out (ROM, mappers, devices) is not rewound, and devices
+// see their I/O again during the replay.
+class RewindBuffer
+{
+public:
+    // Takes the first keyframe at position 0
+    RewindBuffer(Cpu& cpu, Bus& bus, const RewindConfig& config = {});
+
+    // Runs the machine forward like Cpu::Execute, recording as it goes
+    std::uint64_t Execute(std::uint64_t instructions);
+
+    // Instructions executed through the buffer, and the oldest position a
+    // seek can still reach
+    std::uint64_t Position() const { return position_; }
+    std::uint64_t Oldest() const { return snapshots_.front().position; }
+
+    // Puts the machine back to how it was at `position`. Snapshots after it
+    // are dropped, so running on records the new future. False, with the
+    // machine left alone, if `position` is ahead of Position() or before
+    // Oldest(). Also false if a snapshot fails to restore; the machine's CPU
+    // and RAM are then put back to Position(), though the restored pages
+    // count as dirty for the next delta.
+    bool SeekTo(std::uint64_t position);
+    bool StepBack(std::uint64_t instructions = 1);
+
+    std::size_t Snapshots() const { return snapshots_.size(); }
+    std::size_t MemoryUsed() const { return memoryUsed_; }
+
+private:
+    struct Snapshot
+    {
+        std::uint64_t position = 0;
+        bool keyframe = false;
+        std::vector<std::uint8_t> data;
+    };
+
+    Cpu& cpu_;
+    Bus& bus_;
+    RewindConfig config_;
+
+    std::deque<Snapshot> snapshots_;
+    std::vector<std::uint8_t> scratch_;     // saves land here, then are copied to size; RAM kept over a seek
+    std::size_t memoryUsed_ = 0;
+    std::size_t deltasSinceKeyframe_ = 0;
+    std::uint64_t position_ = 0;
+
+    void Record();
+    void Trim();
+};
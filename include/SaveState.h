@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+#include "Bus.h"
+#include "Cpu.h"
+
+enum class SaveCompression
+{
+    None,           // every RAM block stored as is: biggest, fastest
+    Lz,             // LzCodec per block, kept raw where that is not smaller
+};
+
+struct RestoreResult
+{
+    bool ok = false;
+    std::string error;
+};
+
+// Binary save state of a machine: the CPU (Cpu::State) and the Bus's own
+// 64K of RAM. What is mapped over that RAM (ROM files, mapper banks) and the
+// mapping itself belong to whoever set them up and are not included.
+//
+// Layout, all little-endian:
+//   "Z80S", u16 version, u16 flags (FLAG_DELTA or 0)
+//   CPU: AF BC DE HL AF' BC' DE' HL' PC SP IX IY (u16 each), I, R,
+//        halted (u8), one reserved byte, T-states (u64)
+//   RAM, full state: RAM_BLOCKS records of RAM_BLOCK_SIZE bytes
+//   RAM, delta: u8 page count, then per page a u8 page number and a record
+//        of Bus::MAP_PAGE_SIZE bytes
+// A record is a u8 codec (0 raw, 1 LZ), a u16 length and that many bytes.
+// Both directions are one pass over the buffer.
+class SaveState
+{
+public:
+    static constexpr std::uint16_t VERSION = 1;
+    static constexpr std::uint16_t FLAG_DELTA = 0x0001;
+    static constexpr std::size_t RAM_BLOCK_SIZE = 4096;
+    static constexpr std::size_t RAM_BLOCKS = Bus::RAM_SIZE / RAM_BLOCK_SIZE;
+
+    // Appends the save state to `out`
+    static void Save(const Cpu& cpu, const Bus& bus, std::vector<std::uint8_t>& out, SaveCompression compression = SaveCompression::Lz);
+
+    // Appends a delta: the CPU and only the pages in bus.CollectDirty(), then
+    // clears the dirty set for the next one. Restoring a delta on top of the
+    // state the Bus had at the previous ClearDirty() gives this state, so a
+    // recording is a full Save(), a ClearDirty() and then one delta a frame.
+    static void SaveDelta(const Cpu& cpu, Bus& bus, std::vector<std::uint8_t>& out, SaveCompression compression = SaveCompression::Lz);
+
+    // Takes full states and deltas. RAM is restored block by block as it is
+    // decoded and the CPU only at the end, so a damaged state leaves the CPU
+    // alone but may have changed RAM.
+    static RestoreResult Restore(Cpu& cpu, Bus& bus, std::span<const std::uint8_t> data);
+};
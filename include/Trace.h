@@ -0,0 +1,143 @@
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Bus.h"
+#include "Cpu.h"
+
+#if !defined(Z80EMU_TRACE)
+#error "Trace.h needs the Bus write log; build with Z80EMU_TRACE"
+#endif
+
+// Binary instruction traces (Z80EMU_TRACE).
+//
+// A trace file is a header followed by frames. Each frame holds the records
+// of a run of instructions, compressed with LzCodec (or stored raw when that
+// does not help). One record per instruction: where it started, its opcode
+// bytes, its T-states, the registers after it as the fields that changed
+// since the record before, and the memory writes it made. The first record
+// of a frame is taken against an all-zero state, so every frame decodes on
+// its own.
+struct TraceConfig
+{
+    // Readers take a bigger frame for a damaged one
+    static constexpr std::size_t MAX_FRAME_SIZE = 16 << 20;
+
+    std::size_t frameSize = 64 << 10;       // bytes of records per frame, up to MAX_FRAME_SIZE
+    std::size_t frames = 32;                // frames in the ring
+};
+
+// One decoded record
+struct TraceStep
+{
+    std::uint64_t instruction = 0;          // counted from 0 at the start of the recording
+    std::uint16_t pc = 0;                   // where it started
+    std::uint8_t length = 0;                // opcode bytes; 0 for a halted CPU idling
+    std::array<std::uint8_t, 4> bytes{};
+    std::uint32_t tstates = 0;              // this instruction's
+    Cpu::State state;                       // after it
+    std::vector<Bus::LoggedWrite> writes;
+};
+
+// Records a machine as it runs. Step() and Execute() run the CPU like
+// Cpu::Step() and Cpu::Execute(), encoding a record after each instruction
+// into a ring of frames. A writer thread compresses full frames and writes
+// them out, so the CPU only waits when every frame in the ring is still
+// queued for the writer (see Stalls()).
+class TraceRecorder
+{
+public:
+    // Creates `path`; check IsOpen()
+    TraceRecorder(Cpu& cpu, Bus& bus, const std::string& path, const TraceConfig& config = {});
+
+    // Close()s
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    bool IsOpen() const { return open_; }
+
+    // Once closed, the CPU still runs but nothing is recorded
+    std::uint32_t Step();
+    std::uint64_t Execute(std::uint64_t instructions);
+
+    // Writes out what is left and stops the writer. False if any write to
+    // the file failed.
+    bool Close();
+
+    std::uint64_t Recorded() const { return recorded_; }
+    std::uint64_t Stalls() const { return stalls_; }
+
+private:
+    struct Frame
+    {
+        std::vector<std::uint8_t> data;
+        std::size_t used = 0;
+        std::uint32_t records = 0;
+        std::uint64_t firstInstruction = 0;
+        std::uint64_t tstates = 0;          // before its first record
+    };
+
+    Cpu& cpu_;
+    Bus& bus_;
+    std::ofstream file_;
+    bool open_ = false;
+
+    std::vector<Frame> frames_;
+    std::size_t current_ = 0;               // the frame Step() fills
+    Cpu::State last_;                       // state after the last record, or zero at a frame start
+    std::vector<Bus::LoggedWrite> writes_;
+    std::uint64_t recorded_ = 0;
+    std::uint64_t stalls_ = 0;
+
+    // Handed between Step() and the writer under mutex_
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::condition_variable freed_;
+    std::deque<std::size_t> full_;
+    std::deque<std::size_t> free_;
+    bool stopping_ = false;
+    bool failed_ = false;
+    std::thread writer_;
+
+    void Encode(std::uint16_t pc, const std::uint8_t* bytes, std::uint8_t length, std::uint32_t tstates, const Cpu::State& state);
+    void Publish();
+    void WriterLoop();
+};
+
+// Reads a trace file back one record at a time
+class TraceReader
+{
+public:
+    // Opens `path` and checks its header; check IsOpen()
+    explicit TraceReader(const std::string& path);
+
+    bool IsOpen() const { return open_; }
+
+    // The next record; false at the end of the file or if it is damaged,
+    // which Failed() tells apart
+    bool Next(TraceStep& step);
+    bool Failed() const { return failed_; }
+
+private:
+    std::ifstream file_;
+    bool open_ = false;
+    bool failed_ = false;
+
+    std::vector<std::uint8_t> frame_;
+    std::size_t at_ = 0;
+    std::uint32_t recordsLeft_ = 0;
+    std::uint64_t instruction_ = 0;
+    Cpu::State last_;
+
+    bool ReadFrame();
+    bool Decode(TraceStep& step);
+};
@@ -1,16 +1,436 @@
 #include "Bus.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 
 Bus::Bus()
 {
-    ram_.fill(0);
+    for (std::shared_ptr<RamPage>& page : ram_)
+        page = std::make_shared<RamPage>();         // zeroed, so every page hash starts at 0
+#if defined(Z80EMU_PAGE_HASH)
+    for (std::size_t page = 0; page < MAP_PAGE_COUNT; ++page)
+        ownPage_[page] = ram_[page]->data();
+#endif
+    dirty_.set();
+    romSink_.fill(0);
+    UnmapAll();
 }
 
-uint8_t Bus::Read(uint16_t address) const
+std::unique_ptr<Bus> Bus::Fork()
 {
-    return ram_[address];
+    std::unique_ptr<Bus> child(new Bus(ForkTag{}));
+    child->ram_ = ram_;
+    child->romSink_.fill(0);
+    child->readPage_ = readPage_;
+    child->writePage_ = writePage_;
+    child->device_ = device_;
+    child->dirty_ = dirty_;
+    child->ports_ = ports_;
+#if defined(Z80EMU_PAGE_HASH)
+    child->pageHash_ = pageHash_;
+    child->ownPage_ = ownPage_;
+#endif
+
+    for (std::size_t page = 0; page < MAP_PAGE_COUNT; ++page)
+    {
+        if (writePage_[page] == romSink_.data())
+            child->writePage_[page] = child->romSink_.data();
+
+        // Own RAM: neither side writes to it in place any more
+        if (readPage_[page] == ram_[page]->data())
+        {
+            writePage_[page] = nullptr;
+            child->writePage_[page] = nullptr;
+            writeTrap_[page] = true;
+            child->writeTrap_[page] = true;
+        }
+    }
+    return child;
+}
+
+void Bus::UnmapAll()
+{
+    for (std::size_t page = 0; page < MAP_PAGE_COUNT; ++page)
+    {
+        // A page a fork still shares, or that is clean, waits for its first write
+        const bool trap = ram_[page].use_count() > 1 || !dirty_[page];
+        readPage_[page] = ram_[page]->data();
+        writePage_[page] = trap ? nullptr : ram_[page]->data();
+        device_[page] = nullptr;
+        writeTrap_[page] = trap;
+    }
+    PagesRemapped(0, MAP_PAGE_COUNT);
+}
+
+std::uint8_t* Bus::OwnRamPage(std::size_t page)
+{
+    std::shared_ptr<RamPage>& ram = ram_[page];
+    const bool mapped = readPage_[page] == ram->data();
+    if (ram.use_count() > 1)
+    {
+        ram = std::make_shared<RamPage>(*ram);
+#if defined(Z80EMU_PAGE_HASH)
+        ownPage_[page] = ram->data();
+#endif
+    }
+    else
+    {
+        // The other sharers are gone, maybe on other threads; order their
+        // reads of the page before the writes about to go into it
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    dirty_.set(page);
+
+    if (mapped)
+    {
+        readPage_[page] = ram->data();
+        writePage_[page] = ram->data();
+        writeTrap_[page] = false;
+    }
+    return ram->data();
+}
+
+void Bus::ClearDirty()
+{
+    dirty_.reset();
+    for (std::size_t page = 0; page < MAP_PAGE_COUNT; ++page)
+    {
+        if (readPage_[page] == ram_[page]->data())
+        {
+            writePage_[page] = nullptr;
+            writeTrap_[page] = true;
+        }
+    }
+}
+
+void Bus::ReadRam(std::size_t offset, std::span<std::uint8_t> out) const
+{
+    if (offset >= RAM_SIZE)
+        return;
+    const std::size_t bytes = std::min(out.size(), RAM_SIZE - offset);
+    for (std::size_t done = 0; done < bytes;)
+    {
+        const std::size_t page = (offset + done) >> MAP_PAGE_SHIFT;
+        const std::size_t at = (offset + done) & (MAP_PAGE_SIZE - 1);
+        const std::size_t length = std::min(MAP_PAGE_SIZE - at, bytes - done);
+        std::memcpy(out.data() + done, ram_[page]->data() + at, length);
+        done += length;
+    }
 }
 
-void Bus::Write(uint16_t address, uint8_t value)
+void Bus::RestoreRam(std::size_t offset, std::span<const std::uint8_t> data)
 {
-    ram_[address] = value;
-}
\ No newline at end of file
+    if (offset >= RAM_SIZE)
+        return;
+    const std::size_t bytes = std::min(data.size(), RAM_SIZE - offset);
+    for (std::size_t done = 0; done < bytes;)
+    {
+        const std::size_t page = (offset + done) >> MAP_PAGE_SHIFT;
+        const std::size_t at = (offset + done) & (MAP_PAGE_SIZE - 1);
+        const std::size_t length = std::min(MAP_PAGE_SIZE - at, bytes - done);
+        std::uint8_t* memory = OwnRamPage(page);
+#if defined(Z80EMU_PAGE_HASH)
+        const std::uint16_t address = static_cast<std::uint16_t>((page << MAP_PAGE_SHIFT) + at);
+        pageHash_[page] ^= HashRun(address, { memory + at, length });
+        std::memcpy(memory + at, data.data() + done, length);
+        pageHash_[page] ^= HashRun(address, { memory + at, length });
+#else
+        std::memcpy(memory + at, data.data() + done, length);
+#endif
+
+        // Own RAM only ever sits at its own address, so only a page still
+        // pointing at it can have run code from it
+        if (readPage_[page] == memory)
+            CodeWritten(static_cast<std::uint16_t>((page << MAP_PAGE_SHIFT) + at), length);
+        done += length;
+    }
+}
+
+std::size_t Bus::ClipPages(std::size_t firstPage, std::size_t pages) const
+{
+    if (firstPage >= MAP_PAGE_COUNT)
+        return 0;
+    return pages < MAP_PAGE_COUNT - firstPage ? pages : MAP_PAGE_COUNT - firstPage;
+}
+
+void Bus::MapRam(std::size_t firstPage, std::size_t pages, std::uint8_t* memory)
+{
+    pages = ClipPages(firstPage, pages);
+    for (std::size_t i = 0; i < pages; ++i)
+    {
+        readPage_[firstPage + i] = memory + i * MAP_PAGE_SIZE;
+        writePage_[firstPage + i] = memory + i * MAP_PAGE_SIZE;
+        device_[firstPage + i] = nullptr;
+        writeTrap_[firstPage + i] = false;
+    }
+    PagesRemapped(firstPage, pages);
+}
+
+void Bus::MapRom(std::size_t firstPage, std::size_t pages, const std::uint8_t* memory, MemoryDevice* writes)
+{
+    pages = ClipPages(firstPage, pages);
+    for (std::size_t i = 0; i < pages; ++i)
+    {
+        readPage_[firstPage + i] = memory + i * MAP_PAGE_SIZE;
+        writePage_[firstPage + i] = writes != nullptr ? nullptr : romSink_.data();
+        device_[firstPage + i] = writes;
+        writeTrap_[firstPage + i] = false;
+    }
+    PagesRemapped(firstPage, pages);
+}
+
+void Bus::MapDevice(std::size_t firstPage, std::size_t pages, MemoryDevice* device)
+{
+    pages = ClipPages(firstPage, pages);
+    for (std::size_t i = 0; i < pages; ++i)
+    {
+        readPage_[firstPage + i] = nullptr;
+        writePage_[firstPage + i] = nullptr;
+        device_[firstPage + i] = device;
+        writeTrap_[firstPage + i] = false;
+    }
+    PagesRemapped(firstPage, pages);
+}
+
+void Bus::PagesRemapped(std::size_t firstPage, std::size_t pages)
+{
+#if defined(Z80EMU_DECODE_CACHE) || defined(Z80EMU_JIT)
+    // Whatever was decoded from these addresses came from the old mapping
+    constexpr std::size_t WATCH_PER_MAP = std::size_t{1} << (MAP_PAGE_SHIFT - PAGE_SHIFT);
+    for (std::size_t page = firstPage * WATCH_PER_MAP; page < (firstPage + pages) * WATCH_PER_MAP; ++page)
+    {
+        if (codeWatched_[page])
+            InvalidateCodePage(static_cast<std::uint8_t>(page));
+    }
+#else
+    (void)firstPage;
+    (void)pages;
+#endif
+}
+
+namespace
+{
+    // Splits [address, address + bytes) into runs that stay inside one
+    // mapping page, wrapping at 64K. `chunk(address, offset, length)` gets
+    // each run and the offset of that run into the caller's buffer; it
+    // returns false to stop early.
+    template <typename Chunk>
+    void ForEachPageRun(std::uint16_t address, std::size_t bytes, Chunk chunk)
+    {
+        std::size_t done = 0;
+        while (done < bytes)
+        {
+            const std::size_t offset = address & (Bus::MAP_PAGE_SIZE - 1);
+            const std::size_t length = std::min(Bus::MAP_PAGE_SIZE - offset, bytes - done);
+            if (!chunk(address, done, length))
+                return;
+            address = static_cast<std::uint16_t>(address + length);
+            done += length;
+        }
+    }
+}
+
+void Bus::ReadBlock(std::uint16_t address, std::span<std::uint8_t> out) const
+{
+    ForEachPageRun(address, out.size(), [&](std::uint16_t at, std::size_t done, std::size_t length)
+    {
+        const std::uint8_t* page = readPage_[at >> MAP_PAGE_SHIFT];
+        if (page != nullptr)
+            std::memcpy(out.data() + done, page + (at & (MAP_PAGE_SIZE - 1)), length);
+        else
+        {
+            for (std::size_t i = 0; i < length; ++i)
+                out[done + i] = ReadDevice(static_cast<std::uint16_t>(at + i));
+        }
+        return true;
+    });
+}
+
+void Bus::WriteBlock(std::uint16_t address, std::span<const std::uint8_t> data)
+{
+    ForEachPageRun(address, data.size(), [&](std::uint16_t at, std::size_t done, std::size_t length)
+    {
+        std::uint8_t* page = WritablePage(at >> MAP_PAGE_SHIFT);
+        if (page != nullptr)
+        {
+#if defined(Z80EMU_PAGE_HASH)
+            HashOut(at, length);
+            std::memcpy(page + (at & (MAP_PAGE_SIZE - 1)), data.data() + done, length);
+            HashIn(at, length);
+#else
+            std::memcpy(page + (at & (MAP_PAGE_SIZE - 1)), data.data() + done, length);
+#endif
+        }
+        else
+        {
+            for (std::size_t i = 0; i < length; ++i)
+                WriteDevice(static_cast<std::uint16_t>(at + i), data[done + i]);
+        }
+        CodeWritten(at, length);
+        return true;
+    });
+}
+
+void Bus::Fill(std::uint16_t address, std::size_t count, std::uint8_t value)
+{
+    ForEachPageRun(address, count, [&](std::uint16_t at, std::size_t, std::size_t length)
+    {
+        std::uint8_t* page = WritablePage(at >> MAP_PAGE_SHIFT);
+        if (page != nullptr)
+        {
+#if defined(Z80EMU_PAGE_HASH)
+            HashOut(at, length);
+            std::memset(page + (at & (MAP_PAGE_SIZE - 1)), value, length);
+            HashIn(at, length);
+#else
+            std::memset(page + (at & (MAP_PAGE_SIZE - 1)), value, length);
+#endif
+        }
+        else
+        {
+            for (std::size_t i = 0; i < length; ++i)
+                WriteDevice(static_cast<std::uint16_t>(at + i), value);
+        }
+        CodeWritten(at, length);
+        return true;
+    });
+}
+
+std::size_t Bus::Compare(std::uint16_t address, std::span<const std::uint8_t> data) const
+{
+    std::size_t matched = 0;
+    ForEachPageRun(address, data.size(), [&](std::uint16_t at, std::size_t done, std::size_t length)
+    {
+        const std::uint8_t* page = readPage_[at >> MAP_PAGE_SHIFT];
+        if (page != nullptr)
+        {
+            const std::uint8_t* memory = page + (at & (MAP_PAGE_SIZE - 1));
+            if (std::memcmp(memory, data.data() + done, length) == 0)
+            {
+                matched += length;
+                return true;
+            }
+            // Only the run that differs is scanned byte by byte
+            while (memory[matched - done] == data[matched])
+                ++matched;
+            return false;
+        }
+        for (std::size_t i = 0; i < length; ++i, ++matched)
+        {
+            if (ReadDevice(static_cast<std::uint16_t>(at + i)) != data[done + i])
+                return false;
+        }
+        return true;
+    });
+    return matched;
+}
+
+// A run never crosses a mapping page, so it never wraps either
+void Bus::CodeWritten(std::uint16_t address, std::size_t bytes)
+{
+#if defined(Z80EMU_TRACE)
+    // Read back from where the bytes went, not from what reads see: on a ROM
+    // page that is the sink, so the log has the values written, like Write().
+    // Device pages took theirs one at a time and are left out.
+    const std::uint8_t* page = writePage_[address >> MAP_PAGE_SHIFT];
+    if (writeLog_ != nullptr && page != nullptr)
+    {
+        for (std::size_t i = 0; i < bytes; ++i)
+        {
+            const std::uint16_t at = static_cast<std::uint16_t>(address + i);
+            writeLog_->push_back({ at, page[at & (MAP_PAGE_SIZE - 1)] });
+        }
+    }
+#endif
+#if defined(Z80EMU_DECODE_CACHE) || defined(Z80EMU_JIT)
+    if (bytes == 0)
+        return;
+    const std::size_t last = (address + bytes - 1) >> PAGE_SHIFT;
+    for (std::size_t page = address >> PAGE_SHIFT; page <= last; ++page)
+    {
+        if (codeWatched_[page])
+            InvalidateCodePage(static_cast<std::uint8_t>(page));
+    }
+#else
+    (void)address;
+    (void)bytes;
+#endif
+}
+
+std::uint64_t Bus::HashRun(std::uint16_t address, std::span<const std::uint8_t> bytes)
+{
+    std::uint64_t hash = 0;
+    for (std::size_t i = 0; i < bytes.size(); ++i)
+    {
+        // Zero bytes add nothing, which skips most of a fresh machine
+        if (bytes[i] != 0)
+            hash ^= ByteHash(static_cast<std::uint16_t>(address + i), bytes[i]);
+    }
+    return hash;
+}
+
+#if defined(Z80EMU_PAGE_HASH)
+std::uint64_t Bus::RamHash() const
+{
+    std::uint64_t hash = 0;
+    for (std::uint64_t page : pageHash_)
+        hash ^= page;
+    return hash;
+}
+
+void Bus::ToggleHash(std::uint16_t address, std::size_t bytes)
+{
+    const std::size_t page = address >> MAP_PAGE_SHIFT;
+    if (writePage_[page] == ownPage_[page])
+        pageHash_[page] ^= HashRun(address, { ownPage_[page] + (address & (MAP_PAGE_SIZE - 1)), bytes });
+}
+#endif
+
+// A device page with nothing behind it reads as an open bus
+std::uint8_t Bus::ReadDevice(std::uint16_t address) const
+{
+    MemoryDevice* device = device_[address >> MAP_PAGE_SHIFT];
+    return device != nullptr ? device->Read(address) : 0xFF;
+}
+
+// Also where the first write to a trapped own RAM page ends up
+void Bus::WriteDevice(std::uint16_t address, std::uint8_t value)
+{
+    if (writeTrap_[address >> MAP_PAGE_SHIFT])
+    {
+        std::uint8_t& byte = OwnRamPage(address >> MAP_PAGE_SHIFT)[address & (MAP_PAGE_SIZE - 1)];
+#if defined(Z80EMU_PAGE_HASH)
+        pageHash_[address >> MAP_PAGE_SHIFT] ^= ByteHash(address, byte) ^ ByteHash(address, value);
+#endif
+        byte = value;
+        return;
+    }
+    MemoryDevice* device = device_[address >> MAP_PAGE_SHIFT];
+    if (device != nullptr)
+        device->Write(address, value);
+}
+
+void Bus::AttachPorts(PortDevice* device)
+{
+    if (device != nullptr && std::find(ports_.begin(), ports_.end(), device) == ports_.end())
+        ports_.push_back(device);
+}
+
+void Bus::DetachPorts(PortDevice* device)
+{
+    ports_.erase(std::remove(ports_.begin(), ports_.end(), device), ports_.end());
+}
+
+std::uint8_t Bus::In(std::uint16_t port) const
+{
+    std::uint8_t value = 0xFF;
+    for (PortDevice* device : ports_)
+        value &= device->In(port);
+    return value;
+}
+
+void Bus::Out(std::uint16_t port, std::uint8_t value)
+{
+    for (PortDevice* device : ports_)
+        device->Out(port, value);
+}
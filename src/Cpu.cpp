@@ -1,9 +1,17 @@
 #include "Cpu.h"
 #include "Bus.h"
+#include "FlagTables.h"
 
 void Cpu::Connect(Bus* bus)
 {
     bus_ = bus;
+#if defined(Z80EMU_DECODE_CACHE)
+    if (bus_)
+        ResetDecodeCache();     // entries belong to the old bus's memory
+#endif
+#if defined(Z80EMU_JIT)
+    jit_.Reset(bus_);           // so do compiled blocks
+#endif
 }
 
 void Cpu::Reset(uint16_t pc)
@@ -16,6 +24,52 @@ void Cpu::Reset()
 	pc_ = 0x0000;
     sp_ = 0xFFFF;
 	halted_ = false;
+	unimplemented_ = false;
+	tstates_ = 0;
+	i_ = 0;
+	r_ = 0;
+}
+
+Cpu::State Cpu::GetState() const
+{
+	State state;
+	state.af = GetAf();
+	state.bc = GetBc();
+	state.de = GetDe();
+	state.hl = GetHl();
+	state.afAlt = GetAfAlt();
+	state.bcAlt = GetBcAlt();
+	state.deAlt = GetDeAlt();
+	state.hlAlt = GetHlAlt();
+	state.pc = pc_;
+	state.sp = sp_;
+	state.ix = ix_;
+	state.iy = iy_;
+	state.i = i_;
+	state.r = r_;
+	state.halted = halted_;
+	state.tstates = tstates_;
+	return state;
+}
+
+void Cpu::SetState(const State& state)
+{
+	SetAf(state.af);
+	SetBc(state.bc);
+	SetDe(state.de);
+	SetHl(state.hl);
+	SetAfAlt(state.afAlt);
+	SetBcAlt(state.bcAlt);
+	SetDeAlt(state.deAlt);
+	SetHlAlt(state.hlAlt);
+	pc_ = state.pc;
+	sp_ = state.sp;
+	ix_ = state.ix;
+	iy_ = state.iy;
+	i_ = state.i;
+	r_ = state.r;
+	halted_ = state.halted;
+	tstates_ = state.tstates;
 }
 
 bool Cpu::is_connected() const
@@ -23,88 +77,28 @@ bool Cpu::is_connected() const
     return bus_ != nullptr;
 }
 
-std::uint8_t Cpu::GetA() const
-{
-	return static_cast<std::uint8_t>(af_ >> 8);
-}
-
-std::uint8_t Cpu::GetB() const
-{
-	return static_cast<std::uint8_t>(bc_ >> 8);
-}
-
-std::uint8_t Cpu::GetC() const
-{
-	return static_cast<std::uint8_t>(bc_);
-}
-
-std::uint8_t Cpu::GetD() const
-{
-	return static_cast<std::uint8_t>(de_ >> 8);
-}
-
-std::uint8_t Cpu::GetE() const
-{
-	return static_cast<std::uint8_t>(de_);
-}
-
 std::uint8_t Cpu::GetF() const
 {
-	return static_cast<std::uint8_t>(af_ & 0x00FF);
-}
-
-std::uint8_t Cpu::GetH() const
-{
-	return static_cast<std::uint8_t>(hl_ >> 8);
-}
-
-std::uint8_t Cpu::GetL() const
-{
-	return static_cast<std::uint8_t>(hl_);
-}
-
-void Cpu::SetA(std::uint8_t value)
-{
-	af_ = (af_ & 0x00FFu) | (uint16_t(value) << 8);
-}
-
-void Cpu::SetB(std::uint8_t value)
-{
-	bc_ = (bc_ & 0x00FFu) | (uint16_t(value) << 8);
-}
-
-void Cpu::SetC(std::uint8_t value)
-{
-	bc_ = (bc_ & 0xFF00u) | (uint16_t(value));
-}
-
-void Cpu::SetD(std::uint8_t value)
-{
-	de_ = (de_ & 0xFF00u) | (uint16_t(value) << 8);
-}
-
-void Cpu::SetE(std::uint8_t value)
-{
-	de_ = (de_ & 0xFF00u) | (uint16_t(value));
+#if defined(Z80EMU_LAZY_FLAGS)
+	if (pending_.op != FlagOp::None)
+		return ResolveFlags();
+#endif
+	return Reg8(REG_F);
 }
 
 void Cpu::SetF(std::uint8_t value)
 {
-	af_ = static_cast<std::uint16_t>((af_ & 0xFF00) | value);
-}
-
-void Cpu::SetH(std::uint8_t value)
-{
-	hl_ = (hl_ & 0x00FFu) | (uint16_t(value) << 8);
-}
-
-void Cpu::SetL(std::uint8_t value)
-{
-	hl_ = static_cast<std::uint16_t>((hl_ & 0xFF00) | value);
+	Reg8(REG_F) = value;
+#if defined(Z80EMU_LAZY_FLAGS)
+	pending_.op = FlagOp::None;
+#endif
 }
 
 void Cpu::SetFlag(uint8_t mask, bool on)
 {
+#if defined(Z80EMU_LAZY_FLAGS)
+	FlushFlags();
+#endif
 	std::uint8_t flags = GetF();
 	if (on) flags |= mask;
 	else    flags = static_cast<std::uint8_t>(flags & static_cast<std::uint8_t>(~mask));
@@ -116,140 +110,102 @@ uint8_t Cpu::GetFlag(uint8_t mask) const
 	return (GetF() & mask) ? 1 : 0;
 }
 
-void Cpu::ExecAddAReg(uint8_t opcode)
-{
-	const uint8_t src = opcode & 0x07;
-
-	// Skip (HL) for now, same rule as your LD r,r
-	if (src == 6)
-		return;
-
-	const uint8_t aVal = GetA();
-	const uint8_t value = (this->*reg8Get[src])();
-
-	const uint16_t sum = static_cast<uint16_t>(aVal) + value;
-	const uint8_t result = static_cast<uint8_t>(sum);
-
-	SetFlagsAdd8(aVal, value, 0, result);
-	SetA(result);
-}
+#if defined(Z80EMU_LAZY_FLAGS)
 
-void Cpu::ExecAdcAReg(uint8_t opcode)
+uint8_t Cpu::ResolveFlags() const
 {
-	const uint8_t src = opcode & 0x07;
-
-	// Skip (HL) for now
-	if (src == 6)
-		return;
-
-	const uint8_t lhs = GetA();
-	const uint8_t rhs = (this->*reg8Get[src])();
-
-	const uint8_t carry_in = (GetF() & Cpu::FLAG_C) ? 1 : 0;
-
-	const uint16_t sum = static_cast<uint16_t>(lhs) + rhs + carry_in;
-	const uint8_t result = static_cast<uint8_t>(sum);
-
-	SetFlagsAdd8(lhs, rhs, carry_in, result);
-	SetA(result);
+	switch (pending_.op)
+	{
+		case FlagOp::Add:   return FlagTables::Add[FlagTables::AluIndex(pending_.lhs, pending_.rhs, pending_.carry)];
+		case FlagOp::Sub:   return FlagTables::Sub[FlagTables::AluIndex(pending_.lhs, pending_.rhs, pending_.carry)];
+		case FlagOp::Inc:   return static_cast<uint8_t>(FlagTables::Inc[pending_.lhs] | pending_.carry);
+		case FlagOp::Dec:   return static_cast<uint8_t>(FlagTables::Dec[pending_.lhs] | pending_.carry);
+		case FlagOp::Logic: return static_cast<uint8_t>(FlagTables::Szp[pending_.lhs] | pending_.rhs);
+		case FlagOp::None:  break;
+	}
+	return Reg8(REG_F);
 }
 
-std::uint8_t Cpu::PopByte()
+void Cpu::FlushFlags()
 {
-    const auto value = bus_->Read(sp_);
-    ++sp_;
-    return value;
+	// Write the pending F back into AF so it can be modified bit by bit
+	if (pending_.op != FlagOp::None)
+		SetF(ResolveFlags());
 }
 
-void Cpu::PushByte(std::uint8_t value)
+uint8_t Cpu::CarryIn() const
 {
-    --sp_;                      // stack grows downward
-    bus_->Write(sp_, value);
+	// Only C is needed here, which is cheaper than resolving the whole of F
+	switch (pending_.op)
+	{
+		case FlagOp::Add:   return static_cast<uint8_t>((pending_.lhs + pending_.rhs + pending_.carry) >> 8);
+		case FlagOp::Sub:   return pending_.lhs < pending_.rhs + pending_.carry ? 1 : 0;
+		case FlagOp::Inc:
+		case FlagOp::Dec:   return pending_.carry;
+		case FlagOp::Logic: return 0;
+		case FlagOp::None:  break;
+	}
+	return static_cast<uint8_t>(Reg8(REG_F) & Cpu::FLAG_C);
 }
 
-std::uint8_t Cpu::FetchByte()
+void Cpu::SetFlagsAdd8(uint8_t lhs, uint8_t rhs, uint8_t carryIn)
 {
-    //TODO :: (Decide how to handle not connected in a later step.)
-    const auto value = bus_->Read(pc_);
-    pc_++;
-    return value;
+	pending_ = { FlagOp::Add, lhs, rhs, carryIn };
 }
 
-std::uint16_t Cpu::FetchWord()
+void Cpu::SetFlagsSub8(uint8_t lhs, uint8_t rhs, uint8_t carryIn)
 {
-    const std::uint16_t lo = FetchByte();
-    const std::uint16_t hi = FetchByte();
-    return static_cast<std::uint16_t>((hi << 8) | lo);
+	pending_ = { FlagOp::Sub, lhs, rhs, carryIn };
 }
 
-void Cpu::SetFlagsAdd8(uint8_t lhs, uint8_t rhs, uint8_t carryIn, uint8_t result)
+void Cpu::SetFlagsLogic8(uint8_t result, uint8_t hFlag)
 {
-	const uint16_t sum = static_cast<uint16_t>(lhs) + rhs + carryIn;
+	pending_ = { FlagOp::Logic, result, hFlag, 0 };
+}
 
-	uint8_t f = 0;
-	if (result & 0x80) f |= Cpu::FLAG_S;
-	if (result == 0)   f |= Cpu::FLAG_Z;
-	if (((lhs & 0x0F) + (rhs & 0x0F) + carryIn) > 0x0F) f |= Cpu::FLAG_H;
-	if ((~(lhs ^ rhs) & (lhs ^ result) & 0x80) != 0)      f |= Cpu::FLAG_PV;
-	// N=0
-	if (sum > 0xFF) f |= Cpu::FLAG_C;
+#else
 
-	// Save the value to F register
-	SetF(f);
+uint8_t Cpu::CarryIn() const
+{
+	return static_cast<uint8_t>(Reg8(REG_F) & Cpu::FLAG_C);
 }
 
-void Cpu::SetFlagsSub8(uint8_t lhs, uint8_t rhs, uint8_t carryIn, uint8_t result)
+void Cpu::SetFlagsAdd8(uint8_t lhs, uint8_t rhs, uint8_t carryIn)
 {
-	const uint16_t subtrahend = static_cast<uint16_t>(rhs) + carryIn;
-
-	uint8_t f = 0;
-	if (result & 0x80) f |= Cpu::FLAG_S;
-	if (result == 0)   f |= Cpu::FLAG_Z;
-	if ((lhs & 0x0F) < ((rhs & 0x0F) + carryIn)) f |= Cpu::FLAG_H;
-	if (((lhs ^ rhs) & (lhs ^ result) & 0x80) != 0) f |= Cpu::FLAG_PV;
-	f |= Cpu::FLAG_N;
-
-	if (static_cast<uint16_t>(lhs) < subtrahend) f |= Cpu::FLAG_C;
-
-	// Save the value to F register
-	SetF(f);
+	SetF(FlagTables::Add[FlagTables::AluIndex(lhs, rhs, carryIn)]);
 }
 
-void Cpu::ExecLdRegImm16(void (Cpu::* setter)(uint16_t))
+void Cpu::SetFlagsSub8(uint8_t lhs, uint8_t rhs, uint8_t carryIn)
 {
-    (this->*setter)(FetchWord());
+	SetF(FlagTables::Sub[FlagTables::AluIndex(lhs, rhs, carryIn)]);
 }
 
-void Cpu::ExecLdRegImm8(void (Cpu::* setter)(uint8_t))
+void Cpu::SetFlagsLogic8(uint8_t result, uint8_t hFlag)
 {
-    (this->*setter)(FetchByte());
+	// S Z P/V from the result, N and C reset, H as given
+	SetF(static_cast<uint8_t>(FlagTables::Szp[result] | hFlag));
 }
 
+#endif
+
 uint8_t Cpu::Inc8(uint8_t v)
 {
-	const uint8_t r = static_cast<uint8_t>(v + 1);
-
-	SetFlag(Cpu::FLAG_S, (r & 0x80) != 0);
-	SetFlag(Cpu::FLAG_Z, r == 0);
-	SetFlag(Cpu::FLAG_H, (v & 0x0F) == 0x0F);
-	SetFlag(Cpu::FLAG_PV, v == 0x7F);     // +127 -> -128 overflow
-	SetFlag(Cpu::FLAG_N, false);         // INC resets N
-	// C unchanged
-
-	return r;
+	// S Z H P/V from the table, N reset, C unchanged
+#if defined(Z80EMU_LAZY_FLAGS)
+	pending_ = { FlagOp::Inc, v, 0, CarryIn() };
+#else
+	SetF(static_cast<uint8_t>((GetF() & Cpu::FLAG_C) | FlagTables::Inc[v]));
+#endif
+	return static_cast<uint8_t>(v + 1);
 }
 
 uint8_t Cpu::Dec8(uint8_t v)
 {
-	const uint8_t r = static_cast<uint8_t>(v - 1);
-
-	SetFlag(Cpu::FLAG_S, (r & 0x80) != 0);
-	SetFlag(Cpu::FLAG_Z, r == 0);
-	SetFlag(Cpu::FLAG_H, (v & 0x0F) == 0x00);
-	SetFlag(Cpu::FLAG_PV, v == 0x80);     // -128 -> +127 overflow
-	SetFlag(Cpu::FLAG_N, true);          // DEC sets N
-	// C unchanged
-
-	return r;
+	// S Z H P/V from the table, N set, C unchanged
+#if defined(Z80EMU_LAZY_FLAGS)
+	pending_ = { FlagOp::Dec, v, 0, CarryIn() };
+#else
+	SetF(static_cast<uint8_t>((GetF() & Cpu::FLAG_C) | FlagTables::Dec[v]));
+#endif
+	return static_cast<uint8_t>(v - 1);
 }
-
@@ -1,5 +1,31 @@
 #include "Bus.h"
 #include "Cpu.h"
+#include "FlagTables.h"
+#include <limits>
+
+// Base T-states for every unprefixed opcode (Zilog UM0080). Conditional
+// instructions list their not-taken time; the prefix bytes (CB, DD, ED, FD)
+// list the cost of the prefix fetch alone.
+constexpr std::array<std::uint8_t, 256> Cpu::OP_TSTATES =
+{
+//	 x0  x1  x2  x3  x4  x5  x6  x7  x8  x9  xA  xB  xC  xD  xE  xF
+	  4, 10,  7,  6,  4,  4,  7,  4,  4, 11,  7,  6,  4,  4,  7,  4,	// 0x
+	  8, 10,  7,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4,	// 1x
+	  7, 10, 16,  6,  4,  4,  7,  4,  7, 11, 16,  6,  4,  4,  7,  4,	// 2x
+	  7, 10, 13,  6, 11, 11, 10,  4,  7, 11, 13,  6,  4,  4,  7,  4,	// 3x
+	  4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	// 4x
+	  4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	// 5x
+	  4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	// 6x
+	  7,  7,  7,  7,  7,  7,  4,  7,  4,  4,  4,  4,  4,  4,  7,  4,	// 7x
+	  4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	// 8x
+	  4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	// 9x
+	  4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	// Ax
+	  4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	// Bx
+	  5, 10, 10, 10, 10, 11,  7, 11,  5, 10, 10,  4, 10, 17,  7, 11,	// Cx
+	  5, 10, 10, 11, 10, 11,  7, 11,  5,  4, 10, 11, 10,  4,  7, 11,	// Dx
+	  5, 10, 10, 19, 10, 11,  7, 11,  5,  4, 10,  4, 10,  4,  7, 11,	// Ex
+	  5, 10, 10,  4, 10, 11,  7, 11,  5,  6, 10,  4, 10,  4,  7, 11,	// Fx
+};
 
 void Cpu::ExecScf()
 {
@@ -9,135 +35,261 @@ void Cpu::ExecScf()
 	SetFlag(Cpu::FLAG_H, false);
 }
 
-void Cpu::ExecIncReg(uint8_t opcode)
+void Cpu::ExecLdRegImm16(void (Cpu::* setter)(uint16_t))
+{
+    (this->*setter)(OperandWord());
+}
+
+template<std::uint8_t Op>
+void Cpu::ExecLdRegImm8()
+{
+	constexpr uint8_t r = (Op >> 3) & 0x07;
+
+	if constexpr (r == 6)
+		bus_->Write(GetHl(), OperandByte());        // LD (HL),n
+	else
+		Reg8(r) = OperandByte();
+}
+
+void Cpu::ExecExAf()
+{
+#if defined(Z80EMU_LAZY_FLAGS)
+	FlushFlags();                   // F must be real before it goes into the other bank
+#endif
+	std::swap(regs_[PAIR_AF], regs_[ALT_BANK + PAIR_AF]);
+}
+
+void Cpu::ExecExx()
+{
+	std::swap(regs_[PAIR_BC], regs_[ALT_BANK + PAIR_BC]);
+	std::swap(regs_[PAIR_DE], regs_[ALT_BANK + PAIR_DE]);
+	std::swap(regs_[PAIR_HL], regs_[ALT_BANK + PAIR_HL]);
+}
+
+// The opcode families below are templates on the opcode itself, so the
+// register fields (opcode >> 3 and opcode & 0x07) are decoded by the compiler
+// and each table entry gets its own straight-line handler.
+
+template<std::uint8_t Op>
+void Cpu::ExecIncReg()
 {
-	const uint8_t r = (opcode >> 3) & 0x07;
+	constexpr uint8_t r = (Op >> 3) & 0x07;
 
-	if (r == 6)
+	if constexpr (r == 6)
 	{
 		// INC (HL)
-		const std::uint16_t addr = hl_;                 // since we store hl_ directly
+		const std::uint16_t addr = GetHl();
 		const std::uint8_t  v = bus_->Read(addr);
 		const std::uint8_t  res = Inc8(v);
 		bus_->Write(addr, res);
-		return;
 	}
-
-	const std::uint8_t v = (this->*reg8Get[r])();
-	(this->*reg8Set[r])(Inc8(v));
+	else
+	{
+		Reg8(r) = Inc8(Reg8(r));
+	}
 }
 
-void Cpu::ExecDecReg(uint8_t opcode)
+template<std::uint8_t Op>
+void Cpu::ExecDecReg()
 {
-	const std::uint8_t r = (opcode >> 3) & 0x07;
+	constexpr std::uint8_t r = (Op >> 3) & 0x07;
 
-	if (r == 6)
+	if constexpr (r == 6)
 	{
 		// DEC (HL)
-		const std::uint16_t addr = hl_;
+		const std::uint16_t addr = GetHl();
 		const std::uint8_t  v = bus_->Read(addr);
 		const std::uint8_t  res = Dec8(v);
 		bus_->Write(addr, res);
-		return;
 	}
-
-	const std::uint8_t v = (this->*reg8Get[r])();
-	(this->*reg8Set[r])(Dec8(v));
+	else
+	{
+		Reg8(r) = Dec8(Reg8(r));
+	}
 }
 
-void Cpu::ExecLdRegReg(uint8_t opcode)
+template<std::uint8_t Op>
+void Cpu::ExecLdRegReg()
 {
-	const uint8_t dst = (opcode >> 3) & 0x07;
-	const uint8_t src = opcode & 0x07;
+	constexpr uint8_t dst = (Op >> 3) & 0x07;
+	constexpr uint8_t src = Op & 0x07;
 
 	// 0x76 is HALT (LD (HL),(HL) doesn't exist)
-	if (dst == 6 && src == 6)
+	if constexpr (dst == 6 && src == 6)
 	{
 		halted_ = true;
-		return;
 	}
+	else if constexpr (src == 6)
+	{
+		// LD r, (HL)
+		Reg8(dst) = bus_->Read(GetHl());
+	}
+	else if constexpr (dst == 6)
+	{
+		// LD (HL), r
+		bus_->Write(GetHl(), Reg8(src));
+	}
+	else
+	{
+		// LD r, r
+		Reg8(dst) = Reg8(src);
+	}
+}
 
-	const uint16_t hl = hl_; // or however you read HL
+template<std::uint8_t Op>
+void Cpu::ExecAddAReg()
+{
+	constexpr uint8_t src = Op & 0x07;
 
-	// LD r, (HL)
-	if (src == 6)
+	// Skip (HL) for now, same rule as your LD r,r
+	if constexpr (src != 6)
+	{
+		const uint8_t aVal = GetA();
+		const uint8_t value = Reg8(src);
+
+		const uint16_t sum = static_cast<uint16_t>(aVal) + value;
+		const uint8_t result = static_cast<uint8_t>(sum);
+
+		SetFlagsAdd8(aVal, value, 0);
+		SetA(result);
+	}
+}
+
+template<std::uint8_t Op>
+void Cpu::ExecAdcAReg()
+{
+	constexpr uint8_t src = Op & 0x07;
+
+	// Skip (HL) for now
+	if constexpr (src != 6)
 	{
-		const uint8_t value = bus_->Read(hl);     // adjust member name if needed
-		(this->*reg8Set[dst])(value);
-		return;
+		const uint8_t lhs = GetA();
+		const uint8_t rhs = Reg8(src);
+
+		const uint8_t carry_in = CarryIn();
+
+		const uint16_t sum = static_cast<uint16_t>(lhs) + rhs + carry_in;
+		const uint8_t result = static_cast<uint8_t>(sum);
+
+		SetFlagsAdd8(lhs, rhs, carry_in);
+		SetA(result);
 	}
+}
+
+template<std::uint8_t Op>
+void Cpu::ExecSubAReg()
+{
+	constexpr uint8_t src = Op & 0x07;
 
-	// LD (HL), r
-	if (dst == 6)
+	// Skip (HL) for now
+	if constexpr (src != 6)
 	{
-		const uint8_t value = (this->*reg8Get[src])();
-		bus_->Write(hl, value);                   // adjust member name if needed
-		return;
+		const uint8_t lhs = GetA();
+		const uint8_t rhs = Reg8(src);
+
+		const uint16_t diff = static_cast<uint16_t>(lhs) - rhs;
+		const uint8_t result = static_cast<uint8_t>(diff);
+
+		SetFlagsSub8(lhs, rhs, 0);
+		SetA(result);
 	}
+}
 
-	// LD r, r
-	const uint8_t value = (this->*reg8Get[src])();
-	(this->*reg8Set[dst])(value);
+template<std::uint8_t Op>
+void Cpu::ExecSbcAReg()
+{
+	constexpr uint8_t src = Op & 0x07;
+
+	// Skip (HL) for now
+	if constexpr (src != 6)
+	{
+		const uint8_t lhs = GetA();
+		const uint8_t rhs = Reg8(src);
+
+		const uint8_t carry_in = CarryIn();
+
+		const uint16_t diff = static_cast<uint16_t>(lhs) - rhs - carry_in;
+		const uint8_t result = static_cast<uint8_t>(diff);
+
+		SetFlagsSub8(lhs, rhs, carry_in);
+		SetA(result);
+	}
 }
 
 void Cpu::ExecAddAImm()
 {
 	const uint8_t lhs = GetA();
-	const uint8_t rhs = FetchByte();          // immediate n
+	const uint8_t rhs = OperandByte();          // immediate n
 	const uint16_t sum = static_cast<uint16_t>(lhs) + rhs;
 	const uint8_t result = static_cast<uint8_t>(sum);
 
-	SetFlagsAdd8(lhs, rhs, 0, result);
+	SetFlagsAdd8(lhs, rhs, 0);
 	SetA(result);
 }
 
-void Cpu::ExecSubAReg(uint8_t opcode)
+void Cpu::ExecAndImm()
 {
-	const uint8_t src = opcode & 0x07;
+	const uint8_t value = OperandByte();
+	const uint8_t result = GetA() & value;
 
-	// Skip (HL) for now
-	if (src == 6)
-		return;
+	SetA(result);
 
-	const uint8_t lhs = GetA();
-	const uint8_t rhs = (this->*reg8Get[src])();
+	SetFlagsLogic8(result, Cpu::FLAG_H);
+}
 
-	const uint16_t diff = static_cast<uint16_t>(lhs) - rhs;
-	const uint8_t result = static_cast<uint8_t>(diff);
+void Cpu::ExecOrImm()
+{
+	const uint8_t value = OperandByte();
+	const uint8_t result = GetA() | value;
 
-	SetFlagsSub8(lhs, rhs, 0, result);
 	SetA(result);
+
+	SetFlagsLogic8(result, 0);
 }
 
-void Cpu::ExecSbcAReg(uint8_t opcode)
+void Cpu::ExecXorImm()
 {
-	const uint8_t src = opcode & 0x07;
+	const uint8_t value = OperandByte();
+	const uint8_t result = GetA() ^ value;
 
-	// Skip (HL) for now
-	if (src == 6)
-		return;
+	SetA(result);
 
-	const uint8_t lhs = GetA();
-	const uint8_t rhs = (this->*reg8Get[src])();
+	SetFlagsLogic8(result, 0);
+}
 
-	const uint8_t carry_in = (GetF() & Cpu::FLAG_C) ? 1 : 0;
+void Cpu::ExecCpImm()
+{
+	// Flags as for SUB n, but A is left alone
+	const uint8_t value = OperandByte();
+	SetFlagsSub8(GetA(), value, 0);
+}
 
-	const uint16_t diff = static_cast<uint16_t>(lhs) - rhs - carry_in;
-	const uint8_t result = static_cast<uint8_t>(diff);
+void Cpu::ExecDaa()
+{
+	// Decimal adjust A after a BCD add/subtract; the table holds the whole new AF
+	SetAf(FlagTables::Daa[FlagTables::DaaIndex(GetA(), GetF())]);
+}
 
-	SetFlagsSub8(lhs, rhs, carry_in, result);
-	SetA(result);
+void Cpu::ExecOutImm()
+{
+	// OUT (n),A: A goes out on the top half of the port address as well
+	const std::uint16_t port = static_cast<std::uint16_t>((GetA() << 8) | OperandByte());
+	bus_->Out(port, GetA());
 }
 
-bool Cpu::Parity(uint8_t value)
+void Cpu::ExecInImm()
 {
-	bool parity = true; // even parity
-	while (value)
-	{
-		parity = !parity;
-		value &= (value - 1);
-	}
-	return parity;
+	// IN A,(n): no flags change
+	const std::uint16_t port = static_cast<std::uint16_t>((GetA() << 8) | OperandByte());
+	SetA(bus_->In(port));
+}
+
+void Cpu::ExecUnimplemented(std::uint8_t opcode)
+{
+	// TODO :: Remove once every opcode has a handler. Until then it runs as a NOP,
+	// but the host can see it happened instead of it passing silently.
+	unimplemented_ = true;
+	last_unimplemented_ = opcode;
 }
 
 void Cpu::execAddHl(uint16_t value)
@@ -187,141 +339,358 @@ uint16_t Cpu::ExecPop()
 	return static_cast<uint16_t>((hi << 8) | lo);
 }
 
-void Cpu::Step()
+// Compile-time decode of a single opcode. Every one of the 256 opcodes gets its
+// own instantiation, so this chain is folded away and only the matching
+// handler body is left in each table entry. Kept in opcode order.
+// Returns the T-states the instruction took.
+template<std::uint8_t Op>
+std::uint32_t Cpu::Exec()
 {
-	uint8_t opcode = FetchByte();
+	if constexpr (Op == 0x00) {}											// NOP
+	else if constexpr (Op == 0x01) ExecLdRegImm16(&Cpu::SetBc);				// LD BC,nn
+	else if constexpr (Op == 0x03) SetBc(static_cast<std::uint16_t>(GetBc() + 1));	// INC BC
+	else if constexpr (Op == 0x08) ExecExAf();								// EX AF,AF'
+	else if constexpr (Op == 0x09) execAddHl(GetBc());						// ADD HL,BC
+	else if constexpr (Op == 0x0B) SetBc(static_cast<std::uint16_t>(GetBc() - 1));	// DEC BC
+	else if constexpr (Op == 0x11) ExecLdRegImm16(&Cpu::SetDe);				// LD DE,nn
+	else if constexpr (Op == 0x13) SetDe(static_cast<std::uint16_t>(GetDe() + 1));	// INC DE
+	else if constexpr (Op == 0x19) execAddHl(GetDe());						// ADD HL,DE
+	else if constexpr (Op == 0x1B) SetDe(static_cast<std::uint16_t>(GetDe() - 1));	// DEC DE
+	else if constexpr (Op == 0x21) ExecLdRegImm16(&Cpu::SetHl);				// LD HL,nn
+	else if constexpr (Op == 0x23) SetHl(static_cast<std::uint16_t>(GetHl() + 1));	// INC HL
+	else if constexpr (Op == 0x27) ExecDaa();								// DAA
+	else if constexpr (Op == 0x29) execAddHl(GetHl());						// ADD HL,HL
+	else if constexpr (Op == 0x2B) SetHl(static_cast<std::uint16_t>(GetHl() - 1));	// DEC HL
+	else if constexpr (Op == 0x31) ExecLdRegImm16(&Cpu::SetSp);				// LD SP,nn
+	else if constexpr (Op == 0x33) sp_ = static_cast<std::uint16_t>(sp_ + 1);	// INC SP
+	else if constexpr (Op == 0x37) ExecScf();								// SCF
+	else if constexpr (Op == 0x39) execAddHl(GetSp());						// ADD HL,SP
+	else if constexpr (Op == 0x3B) sp_ = static_cast<std::uint16_t>(sp_ - 1);	// DEC SP
+	else if constexpr (Op < 0x40 && (Op & 0x07) == 0x04) ExecIncReg<Op>();	// INC r (including (HL))
+	else if constexpr (Op < 0x40 && (Op & 0x07) == 0x05) ExecDecReg<Op>();	// DEC r (including (HL))
+	else if constexpr (Op < 0x40 && (Op & 0x07) == 0x06) ExecLdRegImm8<Op>();	// LD r,n (including (HL))
+	else if constexpr (Op >= 0x40 && Op <= 0x7F) ExecLdRegReg<Op>();		// LD r,r' block, 0x76 is HALT
+	else if constexpr (Op >= 0x80 && Op <= 0x87) ExecAddAReg<Op>();			// ADD A,r
+	else if constexpr (Op >= 0x88 && Op <= 0x8F) ExecAdcAReg<Op>();			// ADC A,r
+	else if constexpr (Op >= 0x90 && Op <= 0x97) ExecSubAReg<Op>();			// SUB r
+	else if constexpr (Op >= 0x98 && Op <= 0x9F) ExecSbcAReg<Op>();			// SBC A,r
+	else if constexpr (Op == 0xC1) SetBc(ExecPop());						// POP BC
+	else if constexpr (Op == 0xC5) ExecPush(GetBc());						// PUSH BC
+	else if constexpr (Op == 0xC6) ExecAddAImm();							// ADD A,n
+	else if constexpr (Op == 0xD1) SetDe(ExecPop());						// POP DE
+	else if constexpr (Op == 0xD3) ExecOutImm();							// OUT (n),A
+	else if constexpr (Op == 0xD5) ExecPush(GetDe());						// PUSH DE
+	else if constexpr (Op == 0xD9) ExecExx();								// EXX
+	else if constexpr (Op == 0xDB) ExecInImm();								// IN A,(n)
+	else if constexpr (Op == 0xE1) SetHl(ExecPop());						// POP HL
+	else if constexpr (Op == 0xE5) ExecPush(GetHl());						// PUSH HL
+	else if constexpr (Op == 0xE6) ExecAndImm();							// AND n
+	else if constexpr (Op == 0xED) return OP_TSTATES[Op] + ExecEdPrefix();	// ED prefix
+	else if constexpr (Op == 0xEE) ExecXorImm();							// XOR n
+	else if constexpr (Op == 0xF1) SetAf(ExecPop());						// POP AF
+	else if constexpr (Op == 0xF5) ExecPush(GetAf());						// PUSH AF
+	else if constexpr (Op == 0xF6) ExecOrImm();								// OR n
+	else if constexpr (Op == 0xFE) ExecCpImm();								// CP n
+	else ExecUnimplemented(Op);
+
+	return OP_TSTATES[Op];
+}
+
+#if defined(Z80EMU_PROFILER)
+
+// Every core has fetched the opcode by the time it calls a handler, so the
+// instruction started one byte back. A block repeat takes the iterations it
+// ran beyond the first off blockInstructions_.
+template<std::uint8_t Op>
+std::uint32_t Cpu::ExecProfiled()
+{
+	const std::uint16_t pc = static_cast<std::uint16_t>(pc_ - 1);
+	const std::uint64_t budget = blockInstructions_;
+	const std::uint32_t cycles = Exec<Op>();
+	profiler_.Record(pc, Op, budget - blockInstructions_ + 1, cycles);
+	return cycles;
+}
+
+template<std::size_t... Ops>
+constexpr std::array<Cpu::OpHandler, 256> Cpu::BuildOpTable(std::index_sequence<Ops...>)
+{
+	return { &Cpu::ExecProfiled<static_cast<std::uint8_t>(Ops)>... };
+}
+
+#else
+
+template<std::size_t... Ops>
+constexpr std::array<Cpu::OpHandler, 256> Cpu::BuildOpTable(std::index_sequence<Ops...>)
+{
+	return { &Cpu::Exec<static_cast<std::uint8_t>(Ops)>... };
+}
+
+#endif
+
+constexpr std::array<Cpu::OpHandler, 256> Cpu::opTable_ = Cpu::BuildOpTable(std::make_index_sequence<256>{});
+
+// A halted CPU keeps running internal NOPs (4 T-states each, no fetch) until
+// something wakes it. This is the time it spends covering a budget that way.
+static constexpr std::uint64_t HaltedTStates(std::uint64_t budget)
+{
+	return (budget + 3) / 4 * 4;
+}
+
+#if defined(Z80EMU_THREADED_DISPATCH)
+
+// Direct-threaded core (GCC/Clang labels-as-values). Every opcode gets its own
+// label holding the inlined Exec<Op> body, and each one ends by fetching the
+// next opcode and jumping straight to its label. That spreads the indirect
+// branch over 256 sites instead of funnelling everything through Step().
+// ByTStates picks what the limit counts: T-states (Run) or instructions (Execute).
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+// ED hands its block instructions what is left of the limit, and counts the
+// extra iterations they ran against it.
+#if defined(Z80EMU_PROFILER)
+#define Z80_EXEC(hh)	ExecProfiled<0x##hh>()
+#else
+#define Z80_EXEC(hh)	Exec<0x##hh>()
+#endif
+#define Z80_OP(hh)	op_##hh:																\
+	if constexpr (0x##hh == 0xED) { if constexpr (ByTStates) blockTStates_ = limit - cycles; else blockInstructions_ = limit; } \
+	cycles += Z80_EXEC(hh);																	\
+	if constexpr (0x##hh == 0x76) goto halted;												\
+	if constexpr (0x##hh == 0xED && !ByTStates) limit = blockInstructions_;					\
+	Z80_NEXT();
+#define Z80_LABEL(hh)	&&op_##hh,
+#define Z80_ROW(X, h)	X(h##0) X(h##1) X(h##2) X(h##3) X(h##4) X(h##5) X(h##6) X(h##7) \
+						X(h##8) X(h##9) X(h##A) X(h##B) X(h##C) X(h##D) X(h##E) X(h##F)
+#define Z80_ALL(X)		Z80_ROW(X, 0) Z80_ROW(X, 1) Z80_ROW(X, 2) Z80_ROW(X, 3) \
+						Z80_ROW(X, 4) Z80_ROW(X, 5) Z80_ROW(X, 6) Z80_ROW(X, 7) \
+						Z80_ROW(X, 8) Z80_ROW(X, 9) Z80_ROW(X, A) Z80_ROW(X, B) \
+						Z80_ROW(X, C) Z80_ROW(X, D) Z80_ROW(X, E) Z80_ROW(X, F)
+
+template<bool ByTStates>
+std::uint64_t Cpu::RunThreaded(std::uint64_t limit)
+{
+	static void* const labels[256] = { Z80_ALL(Z80_LABEL) };
+	std::uint64_t cycles = 0;
+
+	// Only one of the two block budgets is tracked; the other never binds
+	if constexpr (ByTStates)
+		blockInstructions_ = std::numeric_limits<std::uint64_t>::max();
+	else
+		blockTStates_ = std::numeric_limits<std::uint64_t>::max();
+
+#define Z80_NEXT()	do {													\
+		if constexpr (ByTStates) { if (cycles >= limit) return cycles; }	\
+		else { if (--limit == 0) return cycles; }							\
+		goto *labels[FetchByte()];											\
+	} while (0)
+
+	goto *labels[FetchByte()];
+
+	Z80_ALL(Z80_OP)
+
+halted:
+	// HALT stops the stream; whatever is left of the limit is spent idling
+	if constexpr (ByTStates)
+		return cycles < limit ? cycles + HaltedTStates(limit - cycles) : cycles;
+	else
+		return cycles + 4 * (limit - 1);
+
+#undef Z80_NEXT
+}
+
+#undef Z80_ALL
+#undef Z80_ROW
+#undef Z80_LABEL
+#undef Z80_OP
+#undef Z80_EXEC
+#pragma GCC diagnostic pop
+
+std::uint32_t Cpu::Step()
+{
+	return static_cast<std::uint32_t>(Execute(1));
+}
+
+std::uint64_t Cpu::Execute(std::uint64_t instructions)
+{
+	if (instructions == 0)
+		return 0;
+
+	const std::uint64_t cycles = halted_ ? 4 * instructions : RunThreaded<false>(instructions);
+	tstates_ += cycles;
+	return cycles;
+}
+
+std::uint64_t Cpu::Run(std::uint64_t tstates)
+{
+	if (tstates == 0)
+		return 0;
+
+	const std::uint64_t cycles = halted_ ? HaltedTStates(tstates) : RunThreaded<true>(tstates);
+	tstates_ += cycles;
+	return cycles;
+}
+
+#else
 
-	// LD r,r' block (0x400x7F except 0x76 (HALT))
-	// Used to cover the 49 'ld r,r' instructions.
-	if (opcode >= 0x40 && opcode <= 0x7F || opcode == 0x76)
+#if defined(Z80EMU_DECODE_CACHE)
+
+// Decode cache. A hit skips the opcode fetch and table lookup and serves the
+// operand bytes from the entry. Any write to a watched code page bumps the
+// Bus code generation, so one compare per instruction is enough to notice
+// that some entries may be stale.
+inline std::uint32_t Cpu::Dispatch()
+{
+	if (bus_->CodeGeneration() != seenCodeGeneration_)
+		SyncDecodeCache();
+
+	DecodedOp& op = decoded_[pc_];
+	if (op.length == 0)
+		return DecodeAndExec(op);
+
+	++pc_;
+	operand_ = op.operand.data();
+	return (this->*op.handler)();
+}
+
+std::uint32_t Cpu::DecodeAndExec(DecodedOp& op)
+{
+	const std::uint16_t pc = pc_;
+
+	// Only code read straight out of RAM/ROM is kept: a device can change
+	// what it returns without any write the cache would see
+	std::size_t mapped = 0;
+	while (mapped < 1 + op.operand.size() && bus_->ReadPointer(static_cast<std::uint16_t>(pc + mapped)) != nullptr)
+		++mapped;
+
+	// The operands are fetched from the Bus as the handler takes them, so
+	// nothing past the end of the instruction is read. Both pages an entry
+	// can cover are watched first, in case the instruction writes over itself.
+	const std::uint8_t opcode = FetchByte();
+	op.handler = opTable_[opcode];
+	bus_->WatchCodePage(static_cast<std::uint8_t>(pc >> Bus::PAGE_SHIFT));
+	bus_->WatchCodePage(static_cast<std::uint8_t>(static_cast<std::uint16_t>(pc + 2) >> Bus::PAGE_SHIFT));
+
+	capture_ = op.operand.data();
+	const std::uint32_t cycles = (this->*op.handler)();
+	const std::size_t length = 1 + static_cast<std::size_t>(capture_ - op.operand.data());
+	capture_ = nullptr;
+
+	// If the instruction wrote to its own code, leave the entry to be decoded again
+	if (length <= mapped && bus_->CodeGeneration() == seenCodeGeneration_)
+		op.length = static_cast<std::uint8_t>(length);
+
+	return cycles;
+}
+
+void Cpu::SyncDecodeCache()
+{
+	constexpr std::size_t PAGE_SIZE = std::size_t{1} << Bus::PAGE_SHIFT;
+
+	for (std::size_t page = 0; page < Bus::PAGE_COUNT; ++page)
 	{
-		ExecLdRegReg(opcode);
-		return;
+		const std::uint32_t generation = bus_->PageGeneration(static_cast<std::uint8_t>(page));
+		if (decodedGeneration_[page] == generation)
+			continue;
+
+		decodedGeneration_[page] = generation;
+
+		// The last two entries of the page before may have operands in this one
+		const std::size_t first = page * PAGE_SIZE;
+		for (std::size_t i = 0; i < PAGE_SIZE; ++i)
+			decoded_[first + i].length = 0;
+		decoded_[(first - 1) & (Bus::RAM_SIZE - 1)].length = 0;
+		decoded_[(first - 2) & (Bus::RAM_SIZE - 1)].length = 0;
 	}
 
-	switch (opcode)
-	{
-		// When we have all the OP codes implemented I shall order them properly.
-		// It's really upsetting my OCD at the moment ;-)
-		case 0x01: ExecLdRegImm16(&Cpu::SetBc);	break;						// LD BC,nn
-		case 0x11: ExecLdRegImm16(&Cpu::SetDe); break;						// LD DE,nn
-		case 0x21: ExecLdRegImm16(&Cpu::SetHl); break;						// LD HL,nn
-		case 0x31: ExecLdRegImm16(&Cpu::SetSp); break;						// LD SP,nn
-		case 0x03: SetBc(static_cast<std::uint16_t>(GetBc() + 1)); break;	// INC BC
-		case 0x13: SetDe(static_cast<std::uint16_t>(GetDe() + 1)); break;	// INC DE
-		case 0x23: SetHl(static_cast<std::uint16_t>(GetHl() + 1)); break;	// INC HL
-		case 0x33: sp_ = static_cast<std::uint16_t>(sp_ + 1); break;		// INC SP
-		case 0x0B: SetBc(static_cast<std::uint16_t>(GetBc() - 1)); break;	// DEC BC
-		case 0x1B: SetDe(static_cast<std::uint16_t>(GetDe() - 1)); break;	// DEC DE
-		case 0x2B: SetHl(static_cast<std::uint16_t>(GetHl() - 1)); break;	// DEC HL
-		case 0x3B: sp_ = static_cast<std::uint16_t>(sp_ - 1); break;		// DEC SP
-		case 0x3E: ExecLdRegImm8(&Cpu::SetA); break;						// LD A,n
-		case 0x06: ExecLdRegImm8(&Cpu::SetB); break;						// LD B,n
-		case 0x0E: ExecLdRegImm8(&Cpu::SetC); break;						// LD C,n
-		case 0x16: ExecLdRegImm8(&Cpu::SetD); break;						// LD D,n
-		case 0x1E: ExecLdRegImm8(&Cpu::SetE); break;						// LD E,n
-		case 0x26: ExecLdRegImm8(&Cpu::SetH); break;						// LD H,n
-		case 0x2E: ExecLdRegImm8(&Cpu::SetL); break;						// LD L,n
-		case 0x04: case 0x0C: case 0x14: case 0x1C:							// INC r (including (HL))
-		case 0x24: case 0x2C: case 0x34: case 0x3C: ExecIncReg(opcode);	break;
-		case 0x05: case 0x0D: case 0x15: case 0x1D:							// DEC r (including (HL))
-		case 0x25: case 0x2D: case 0x35: case 0x3D: ExecDecReg(opcode);	break;
-		case 0x37: ExecScf(); break;										// SCF
-		case 0x88: case 0x89: case 0x8A: case 0x8B:							// ADC A,r
-		case 0x8C: case 0x8D: case 0x8E: case 0x8F: ExecAdcAReg(opcode); break;
-		case 0x90: case 0x91: case 0x92: case 0x93:							// SUB r
-		case 0x94: case 0x95: case 0x96: case 0x97: ExecSubAReg(opcode); break;
-		case 0x98: case 0x99: case 0x9A: case 0x9B:							// SBC A,r
-		case 0x9C: case 0x9D: case 0x9E: case 0x9F: ExecSbcAReg(opcode); break;
-		case 0xC6: ExecAddAImm(); break;									// ADD A,n
-		case 0x09: execAddHl(GetBc()); break;
-		case 0x19: execAddHl(GetDe()); break;
-		case 0x29: execAddHl(GetHl()); break;
-		case 0x39: execAddHl(GetSp()); break;
-		case 0x80: case 0x81: case 0x82: case 0x83:							// ADD A,r
-		case 0x84: case 0x85: case 0x86: case 0x87: ExecAddAReg(opcode); break;
-		case 0xC5: ExecPush(GetBc()); break;								// PUSH BC
-		case 0xD5: ExecPush(GetDe()); break; 								// PUSH DE
-		case 0xE5: ExecPush(GetHl()); break;								// PUSH HL
-		case 0xF5: ExecPush(GetAf()); break;								// PUSH AF
-		case 0xC1: SetBc(ExecPop()); break;							// POP BC
-		case 0xD1: SetDe(ExecPop()); break;							// POP DE
-		case 0xE1: SetHl(ExecPop()); break;							// POP HL
-		case 0xF1: SetAf(ExecPop()); break;							// POP AF
-
-
-		case 0xE6:											// AND n
-		{
-			uint8_t value = FetchByte();   // however you fetch immediate
-			uint8_t result = GetA() & value;
+	seenCodeGeneration_ = bus_->CodeGeneration();
+}
 
-			SetA(result);
+void Cpu::ResetDecodeCache()
+{
+	decoded_.assign(Bus::RAM_SIZE, DecodedOp{});
+	for (std::size_t page = 0; page < Bus::PAGE_COUNT; ++page)
+		decodedGeneration_[page] = bus_->PageGeneration(static_cast<std::uint8_t>(page));
+	seenCodeGeneration_ = bus_->CodeGeneration();
+}
 
-			// Flags
-			SetFlag(Cpu::FLAG_S,(result & 0x80) != 0);
-			SetFlag(Cpu::FLAG_Z, (result == 0));
-			SetFlag(Cpu::FLAG_H ,true);
-			SetFlag(Cpu::FLAG_PV, Parity(result)); 
-			SetFlag(Cpu::FLAG_N, false);
-			SetFlag(Cpu::FLAG_C , false);
+#else
 
-			break;
-		}
+inline std::uint32_t Cpu::Dispatch()
+{
+	const uint8_t opcode = FetchByte();
+	return (this->*opTable_[opcode])();
+}
 
-		case 0xF6: // OR n
-		{
-			const uint8_t value = FetchByte();
-			const uint8_t result = GetA() | value;
+#endif
 
-			SetA(result);
+std::uint32_t Cpu::Step()
+{
+	std::uint32_t cycles = 4;     // halted: one internal NOP
 
-			SetFlag(Cpu::FLAG_S, (result & 0x80) != 0);
-			SetFlag(Cpu::FLAG_Z, (result == 0));
-			SetFlag(Cpu::FLAG_H, false);
-			SetFlag(Cpu::FLAG_PV, Parity(result));
-			SetFlag(Cpu::FLAG_N, false);
-			SetFlag(Cpu::FLAG_C, false);
+	if (!halted_)
+	{
+		blockInstructions_ = 1;
+		blockTStates_ = std::numeric_limits<std::uint64_t>::max();
+		cycles = Dispatch();
+	}
 
-			break;
-		}
+	tstates_ += cycles;
+	return cycles;
+}
+
+std::uint64_t Cpu::Execute(std::uint64_t instructions)
+{
+	std::uint64_t cycles = 0;
+	blockTStates_ = std::numeric_limits<std::uint64_t>::max();
 
-		case 0xEE:											// XOR n
+	while (instructions != 0 && !halted_)
+	{
+#if defined(Z80EMU_JIT)
+		const Jit::Result block = jit_.Run(*this, instructions, std::numeric_limits<std::uint64_t>::max());
+		if (block.instructions != 0)
 		{
-			const uint8_t value = FetchByte();
-			const uint8_t result = GetA() ^ value;
+			instructions -= block.instructions;
+			cycles += block.tstates;
+			continue;
+		}
+#endif
+		blockInstructions_ = instructions;
+		cycles += Dispatch();
+		instructions = blockInstructions_ - 1;
+	}
 
-			SetA(result);
+	// Anything left over once halted is an idle NOP
+	cycles += 4 * instructions;
 
-			SetFlag(Cpu::FLAG_S, (result & 0x80) != 0);
-			SetFlag(Cpu::FLAG_Z, (result == 0));
-			SetFlag(Cpu::FLAG_H, false);
-			SetFlag(Cpu::FLAG_PV, Parity(result));
-			SetFlag(Cpu::FLAG_N, false);
-			SetFlag(Cpu::FLAG_C, false);
+	tstates_ += cycles;
+	return cycles;
+}
 
-			break;
-		}
+std::uint64_t Cpu::Run(std::uint64_t tstates)
+{
+	std::uint64_t cycles = 0;
+	blockInstructions_ = std::numeric_limits<std::uint64_t>::max();
 
-		case 0xFE: // CP n
+	while (cycles < tstates && !halted_)
+	{
+#if defined(Z80EMU_JIT)
+		const Jit::Result block = jit_.Run(*this, std::numeric_limits<std::uint64_t>::max(), tstates - cycles);
+		if (block.instructions != 0)
 		{
-			const uint8_t value = FetchByte();
-			const uint8_t a = GetA();
-			const uint8_t result = static_cast<uint8_t>(a - value);
-
-			//SetFlag(Cpu::FLAG_S, (result & 0x80) != 0);
-			SetFlag(Cpu::FLAG_Z, (result == 0));
-			//SetFlag(Cpu::FLAG_H, (a & 0x0F) < (value & 0x0F)); // half-borrow
-			//SetFlag(Cpu::FLAG_PV, ((a ^ value) & (a ^ result) & 0x80) != 0); // overflow
-			SetFlag(Cpu::FLAG_N, true);
-			SetFlag(Cpu::FLAG_C, a < value);
-
-			break;
+			cycles += block.tstates;
+			continue;
 		}
+#endif
+		blockTStates_ = tstates - cycles;
+		cycles += Dispatch();
+	}
 
-		
+	if (halted_ && cycles < tstates)
+		cycles += HaltedTStates(tstates - cycles);
 
-		default:
-			// TODO :: For now, do nothing (well tighten this later)
-			break;
-		}
-};
\ No newline at end of file
+	tstates_ += cycles;
+	return cycles;
+}
+
+#endif
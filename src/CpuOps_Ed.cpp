@@ -0,0 +1,344 @@
+#include "Bus.h"
+#include "Cpu.h"
+#include "FlagTables.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// ED-prefixed opcodes. So far that is the block group (ED A0-BB): LDI/LDD,
+// CPI/CPD, INI/IND and OUTI/OUTD plus their repeating forms. The other ED
+// opcodes are reported like unimplemented unprefixed ones and run as NOPs.
+//
+// On the real CPU every iteration of a repeating block instruction is an
+// instruction of its own: one that repeats takes 21 T-states and leaves PC on
+// the ED prefix, so the CPU fetches it again and an interrupt can get in
+// between. Here one dispatch runs as many iterations as the caller's budget
+// allows, and stretches that stay inside mapped RAM/ROM are moved or scanned
+// with memmove/memchr instead of byte by byte. Registers, flags, memory,
+// T-states and PC come out the same as running the iterations one at a time.
+
+namespace
+{
+	constexpr std::uint32_t BLOCK_TSTATES = 16;         // LDI etc., and the last iteration of a repeat
+	constexpr std::uint32_t REPEAT_TSTATES = 21;        // an iteration that repeats
+
+	// Whether `at` lies within the `count` bytes a run covers from `start`,
+	// going up or down. Compared as integers since the pointers may come from
+	// different buffers.
+	template<bool Down>
+	bool RunCovers(const std::uint8_t* start, std::size_t count, const std::uint8_t* at, std::size_t& distance)
+	{
+		const auto from = reinterpret_cast<std::uintptr_t>(start);
+		const auto to = reinterpret_cast<std::uintptr_t>(at);
+		distance = Down ? from - to : to - from;
+		return at != nullptr && distance < count;
+	}
+}
+
+std::uint32_t Cpu::ExecEdPrefix()
+{
+	const std::uint8_t op = OperandByte();
+#if defined(Z80EMU_PROFILER)
+	profiler_.Prefixed(op);
+#endif
+	return (this->*edTable_[op])();
+}
+
+// The iterations of a repeating block instruction this dispatch may run.
+// Every one but the last takes 21 T-states, so Run() would start another
+// one for as long as it has not reached its limit.
+std::uint64_t Cpu::BlockIterations() const
+{
+	const std::uint64_t byTStates = blockTStates_ / REPEAT_TSTATES + (blockTStates_ % REPEAT_TSTATES != 0 ? 1 : 0);
+	return std::min(blockInstructions_, byTStates);
+}
+
+// The CPU fetches the instruction again for every iteration. A write or port
+// access in the last one may have changed the code or the mapping under it,
+// so check it is still there the same way: by reading it.
+bool Cpu::BlockStillAt(std::uint16_t pc, std::uint8_t op) const
+{
+	return bus_->Read(pc) == 0xED && bus_->Read(static_cast<std::uint16_t>(pc + 1)) == op;
+}
+
+// Books `iterations` iterations of a repeating block instruction. Unless it
+// finished, PC goes back onto the prefix so the next dispatch carries on.
+// Returns the T-states after the prefix fetch that Exec<0xED> adds.
+std::uint32_t Cpu::EndBlockRepeat(std::uint64_t iterations, bool finished)
+{
+	blockInstructions_ -= iterations - 1;
+	if (!finished)
+		pc_ = static_cast<std::uint16_t>(pc_ - 2);
+
+	const std::uint64_t tstates = iterations * REPEAT_TSTATES - (finished ? REPEAT_TSTATES - BLOCK_TSTATES : 0);
+	return static_cast<std::uint32_t>(tstates - OP_TSTATES[0xED]);
+}
+
+// One stretch of LDIR/LDDR done with memmove: as many of `count` bytes as
+// keep both HL and DE inside their mapping pages. Returns 0 if either side
+// (or the instruction itself) is on a device page, which has to see every
+// access in order.
+template<bool Down>
+std::size_t Cpu::BlockCopyRun(std::uint16_t pc, std::size_t count)
+{
+	constexpr std::size_t MASK = Bus::MAP_PAGE_SIZE - 1;
+
+	const std::uint16_t hl = GetHl();
+	const std::uint16_t de = GetDe();
+	// WritePointer() first: it may copy a page shared with a fork, which
+	// would leave a read pointer taken earlier on the old copy
+	std::uint8_t* dst = bus_->WritePointer(de);
+	const std::uint8_t* src = bus_->ReadPointer(hl);
+	const std::uint8_t* code[2] = { bus_->ReadPointer(pc), bus_->ReadPointer(static_cast<std::uint16_t>(pc + 1)) };
+	if (src == nullptr || dst == nullptr || code[0] == nullptr || code[1] == nullptr)
+		return 0;
+
+	std::size_t n = std::min(count, Down ? (hl & MASK) + 1 : Bus::MAP_PAGE_SIZE - (hl & MASK));
+	n = std::min(n, Down ? (de & MASK) + 1 : Bus::MAP_PAGE_SIZE - (de & MASK));
+
+	// Stop straight after a write to the instruction's own bytes, so the next
+	// iteration fetches whatever is there now
+	for (const std::uint8_t* at : code)
+	{
+		std::size_t distance = 0;
+		if (RunCovers<Down>(dst, n, at, distance))
+			n = distance + 1;
+	}
+
+	const std::uint16_t written = static_cast<std::uint16_t>(Down ? de - (n - 1) : de);
+#if defined(Z80EMU_PAGE_HASH)
+	bus_->HashOut(written, n);
+#endif
+
+	// Copying one byte at a time in the direction of travel means a source
+	// ahead of the destination by less than the run reads bytes the run has
+	// just written (LDIR with DE = HL + 1 is the classic fill). memmove keeps
+	// the old bytes, so that case stays a byte loop.
+	std::size_t gap = 0;
+	if (RunCovers<Down>(src, n, dst, gap) && gap != 0)
+	{
+		const std::ptrdiff_t stride = Down ? -1 : 1;
+		for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(n); ++i)
+			dst[i * stride] = src[i * stride];
+	}
+	else if constexpr (Down)
+		std::memmove(dst - (n - 1), src - (n - 1), n);
+	else
+		std::memmove(dst, src, n);
+
+#if defined(Z80EMU_PAGE_HASH)
+	bus_->HashIn(written, n);
+#endif
+	bus_->CodeWritten(written, n);
+
+	const std::uint16_t moved = static_cast<std::uint16_t>(n);
+	SetHl(static_cast<std::uint16_t>(Down ? hl - moved : hl + moved));
+	SetDe(static_cast<std::uint16_t>(Down ? de - moved : de + moved));
+	SetBc(static_cast<std::uint16_t>(GetBc() - moved));
+	return n;
+}
+
+// One stretch of CPIR/CPDR: compares up to `count` bytes from HL with A,
+// within HL's mapping page, and stops on the first match. `last` gets the
+// last byte compared. Returns 0 on device pages, like BlockCopyRun.
+template<bool Down>
+std::size_t Cpu::BlockScanRun(std::uint16_t pc, std::size_t count, std::uint8_t& last)
+{
+	constexpr std::size_t MASK = Bus::MAP_PAGE_SIZE - 1;
+
+	const std::uint16_t hl = GetHl();
+	const std::uint8_t* src = bus_->ReadPointer(hl);
+	if (src == nullptr || bus_->ReadPointer(pc) == nullptr || bus_->ReadPointer(static_cast<std::uint16_t>(pc + 1)) == nullptr)
+		return 0;
+
+	std::size_t n = std::min(count, Down ? (hl & MASK) + 1 : Bus::MAP_PAGE_SIZE - (hl & MASK));
+	const std::uint8_t a = GetA();
+
+	if constexpr (Down)
+	{
+		std::size_t i = 0;
+		while (i + 1 < n && src[-static_cast<std::ptrdiff_t>(i)] != a)
+			++i;
+		n = i + 1;
+		last = src[-static_cast<std::ptrdiff_t>(i)];
+	}
+	else
+	{
+		const void* match = std::memchr(src, a, n);
+		if (match != nullptr)
+			n = static_cast<std::size_t>(static_cast<const std::uint8_t*>(match) - src) + 1;
+		last = src[n - 1];
+	}
+
+	const std::uint16_t scanned = static_cast<std::uint16_t>(n);
+	SetHl(static_cast<std::uint16_t>(Down ? hl - scanned : hl + scanned));
+	SetBc(static_cast<std::uint16_t>(GetBc() - scanned));
+	return n;
+}
+
+// LDI LDD LDIR LDDR: (DE) = (HL), step HL and DE, BC - 1.
+// H and N reset, P/V = BC != 0, S Z C unchanged.
+template<std::uint8_t Op>
+std::uint32_t Cpu::ExecBlockLoad()
+{
+	constexpr bool down = (Op & 0x08) != 0;
+	constexpr bool repeat = (Op & 0x10) != 0;
+	constexpr std::uint16_t step = down ? 0xFFFF : 0x0001;
+
+	const std::uint16_t pc = static_cast<std::uint16_t>(pc_ - 2);
+	const std::uint64_t budget = repeat ? BlockIterations() : 1;
+	std::uint64_t iterations = 0;
+
+	for (;;)
+	{
+		const std::size_t count = std::min<std::uint64_t>(budget - iterations, GetBc() == 0 ? 0x10000 : GetBc());
+		std::size_t done = repeat ? BlockCopyRun<down>(pc, count) : 0;
+		if (done == 0)
+		{
+			bus_->Write(GetDe(), bus_->Read(GetHl()));
+			SetHl(static_cast<std::uint16_t>(GetHl() + step));
+			SetDe(static_cast<std::uint16_t>(GetDe() + step));
+			SetBc(static_cast<std::uint16_t>(GetBc() - 1));
+			done = 1;
+		}
+		iterations += done;
+
+		if (!repeat || GetBc() == 0 || iterations == budget || !BlockStillAt(pc, Op))
+			break;
+	}
+
+	SetF(static_cast<std::uint8_t>((GetF() & ~(FLAG_H | FLAG_PV | FLAG_N)) | (GetBc() != 0 ? FLAG_PV : 0)));
+
+	if constexpr (!repeat)
+		return BLOCK_TSTATES - OP_TSTATES[0xED];
+	else
+		return EndBlockRepeat(iterations, GetBc() == 0);
+}
+
+// CPI CPD CPIR CPDR: compare A with (HL), step HL, BC - 1. The repeats stop
+// on a match too. S Z H from A - (HL), N set, P/V = BC != 0, C unchanged.
+template<std::uint8_t Op>
+std::uint32_t Cpu::ExecBlockCompare()
+{
+	constexpr bool down = (Op & 0x08) != 0;
+	constexpr bool repeat = (Op & 0x10) != 0;
+	constexpr std::uint16_t step = down ? 0xFFFF : 0x0001;
+
+	const std::uint16_t pc = static_cast<std::uint16_t>(pc_ - 2);
+	const std::uint64_t budget = repeat ? BlockIterations() : 1;
+	std::uint64_t iterations = 0;
+	std::uint8_t last = 0;
+
+	for (;;)
+	{
+		const std::size_t count = std::min<std::uint64_t>(budget - iterations, GetBc() == 0 ? 0x10000 : GetBc());
+		std::size_t done = repeat ? BlockScanRun<down>(pc, count, last) : 0;
+		if (done == 0)
+		{
+			last = bus_->Read(GetHl());
+			SetHl(static_cast<std::uint16_t>(GetHl() + step));
+			SetBc(static_cast<std::uint16_t>(GetBc() - 1));
+			done = 1;
+		}
+		iterations += done;
+
+		if (!repeat || last == GetA() || GetBc() == 0 || iterations == budget || !BlockStillAt(pc, Op))
+			break;
+	}
+
+	const std::uint8_t sub = FlagTables::Sub[FlagTables::AluIndex(GetA(), last, 0)];
+	SetF(static_cast<std::uint8_t>((sub & (FLAG_S | FLAG_Z | FLAG_H)) | FLAG_N | (GetF() & FLAG_C) | (GetBc() != 0 ? FLAG_PV : 0)));
+
+	if constexpr (!repeat)
+		return BLOCK_TSTATES - OP_TSTATES[0xED];
+	else
+		return EndBlockRepeat(iterations, GetBc() == 0 || last == GetA());
+}
+
+// INI IND INIR INDR: (HL) = IN (BC), step HL, B - 1.
+// Z and S from the new B, N set, C unchanged.
+template<std::uint8_t Op>
+std::uint32_t Cpu::ExecBlockIn()
+{
+	constexpr bool down = (Op & 0x08) != 0;
+	constexpr bool repeat = (Op & 0x10) != 0;
+	constexpr std::uint16_t step = down ? 0xFFFF : 0x0001;
+
+	// Ports see every byte, so the repeat only saves the dispatch
+	const std::uint16_t pc = static_cast<std::uint16_t>(pc_ - 2);
+	const std::uint64_t budget = repeat ? BlockIterations() : 1;
+	std::uint64_t iterations = 0;
+
+	do
+	{
+		bus_->Write(GetHl(), bus_->In(GetBc()));
+		SetHl(static_cast<std::uint16_t>(GetHl() + step));
+		SetB(static_cast<std::uint8_t>(GetB() - 1));
+		++iterations;
+	} while (repeat && GetB() != 0 && iterations < budget && BlockStillAt(pc, Op));
+
+	SetF(static_cast<std::uint8_t>((GetF() & FLAG_C) | FLAG_N | (GetB() & FLAG_S) | (GetB() == 0 ? FLAG_Z : 0)));
+
+	if constexpr (!repeat)
+		return BLOCK_TSTATES - OP_TSTATES[0xED];
+	else
+		return EndBlockRepeat(iterations, GetB() == 0);
+}
+
+// OUTI OUTD OTIR OTDR: B - 1, then OUT (BC),(HL) with the new B on the top
+// half of the port address, step HL. Flags as for INI.
+template<std::uint8_t Op>
+std::uint32_t Cpu::ExecBlockOut()
+{
+	constexpr bool down = (Op & 0x08) != 0;
+	constexpr bool repeat = (Op & 0x10) != 0;
+	constexpr std::uint16_t step = down ? 0xFFFF : 0x0001;
+
+	const std::uint16_t pc = static_cast<std::uint16_t>(pc_ - 2);
+	const std::uint64_t budget = repeat ? BlockIterations() : 1;
+	std::uint64_t iterations = 0;
+
+	do
+	{
+		const std::uint8_t value = bus_->Read(GetHl());
+		SetB(static_cast<std::uint8_t>(GetB() - 1));
+		bus_->Out(GetBc(), value);
+		SetHl(static_cast<std::uint16_t>(GetHl() + step));
+		++iterations;
+	} while (repeat && GetB() != 0 && iterations < budget && BlockStillAt(pc, Op));
+
+	SetF(static_cast<std::uint8_t>((GetF() & FLAG_C) | FLAG_N | (GetB() & FLAG_S) | (GetB() == 0 ? FLAG_Z : 0)));
+
+	if constexpr (!repeat)
+		return BLOCK_TSTATES - OP_TSTATES[0xED];
+	else
+		return EndBlockRepeat(iterations, GetB() == 0);
+}
+
+// Compile-time decode of the byte after ED, like Exec<Op> for the main table.
+// Returns the T-states after the prefix fetch.
+template<std::uint8_t Op>
+std::uint32_t Cpu::ExecEd()
+{
+	if constexpr (Op >= 0xA0 && Op <= 0xBB && (Op & 0x04) == 0)
+	{
+		if constexpr ((Op & 0x03) == 0) return ExecBlockLoad<Op>();			// LDI LDD LDIR LDDR
+		else if constexpr ((Op & 0x03) == 1) return ExecBlockCompare<Op>();	// CPI CPD CPIR CPDR
+		else if constexpr ((Op & 0x03) == 2) return ExecBlockIn<Op>();		// INI IND INIR INDR
+		else return ExecBlockOut<Op>();										// OUTI OUTD OTIR OTDR
+	}
+	else
+	{
+		// Not implemented yet: reported as ED itself, and an 8 T-state NOP
+		ExecUnimplemented(0xED);
+		return 4;
+	}
+}
+
+template<std::size_t... Ops>
+constexpr std::array<Cpu::OpHandler, 256> Cpu::BuildEdTable(std::index_sequence<Ops...>)
+{
+	return { &Cpu::ExecEd<static_cast<std::uint8_t>(Ops)>... };
+}
+
+constexpr std::array<Cpu::OpHandler, 256> Cpu::edTable_ = Cpu::BuildEdTable(std::make_index_sequence<256>{});
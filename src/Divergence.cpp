@@ -0,0 +1,178 @@
+#include "Divergence.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Shorter runs are not worth a thread
+    constexpr std::uint64_t PARALLEL_MIN = 1 << 14;
+
+    struct Field
+    {
+        const char* name;
+        std::uint64_t value;
+    };
+
+    // The CPU state field by field, in the order differences are reported
+    std::array<Field, 24> Fields(const Cpu::State& s)
+    {
+        return { {
+            { "A", std::uint64_t{s.af} >> 8u }, { "F", std::uint64_t{s.af} & 0xFFu },
+            { "B", std::uint64_t{s.bc} >> 8u }, { "C", std::uint64_t{s.bc} & 0xFFu },
+            { "D", std::uint64_t{s.de} >> 8u }, { "E", std::uint64_t{s.de} & 0xFFu },
+            { "H", std::uint64_t{s.hl} >> 8u }, { "L", std::uint64_t{s.hl} & 0xFFu },
+            { "A'", std::uint64_t{s.afAlt} >> 8u }, { "F'", std::uint64_t{s.afAlt} & 0xFFu },
+            { "B'", std::uint64_t{s.bcAlt} >> 8u }, { "C'", std::uint64_t{s.bcAlt} & 0xFFu },
+            { "D'", std::uint64_t{s.deAlt} >> 8u }, { "E'", std::uint64_t{s.deAlt} & 0xFFu },
+            { "H'", std::uint64_t{s.hlAlt} >> 8u }, { "L'", std::uint64_t{s.hlAlt} & 0xFFu },
+            { "IX", std::uint64_t{s.ix} }, { "IY", std::uint64_t{s.iy} }, { "SP", std::uint64_t{s.sp} }, { "PC", std::uint64_t{s.pc} },
+            { "I", std::uint64_t{s.i} }, { "R", std::uint64_t{s.r} }, { "halted", std::uint64_t{s.halted} },
+            { "T-states", std::uint64_t{s.tstates} },
+        } };
+    }
+
+    std::vector<std::uint8_t> Ram(const Machine& machine)
+    {
+        std::vector<std::uint8_t> ram(Bus::RAM_SIZE);
+        machine.GetBus().ReadRam(0, ram);
+        return ram;
+    }
+
+    // Fills in the first difference between the two machines; false if
+    // there is none
+    bool Compare(const Machine& first, const Machine& second, Divergence& out)
+    {
+        out.firstState = first.GetCpu().GetState();
+        out.secondState = second.GetCpu().GetState();
+
+        const auto a = Fields(out.firstState);
+        const auto b = Fields(out.secondState);
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            if (a[i].value != b[i].value)
+            {
+                out.field = a[i].name;
+                out.first = a[i].value;
+                out.second = b[i].value;
+                return true;
+            }
+        }
+
+        const std::vector<std::uint8_t> ramA = Ram(first);
+        const std::vector<std::uint8_t> ramB = Ram(second);
+        const auto at = std::mismatch(ramA.begin(), ramA.end(), ramB.begin());
+        if (at.first == ramA.end())
+            return false;
+        out.field = "memory";
+        out.address = static_cast<std::uint16_t>(at.first - ramA.begin());
+        out.first = *at.first;
+        out.second = *at.second;
+        return true;
+    }
+
+    // Both machines `instructions` further on; true if they still hash equal
+    bool RunEqual(Machine& first, Machine& second, std::uint64_t instructions, bool parallel)
+    {
+        std::uint64_t hash = 0;
+        if (parallel && instructions >= PARALLEL_MIN)
+        {
+            std::thread other([&] {
+                first.GetCpu().Execute(instructions);
+                hash = first.Fingerprint();
+            });
+            second.GetCpu().Execute(instructions);
+            const std::uint64_t secondHash = second.Fingerprint();
+            other.join();
+            return hash == secondHash;
+        }
+
+        first.GetCpu().Execute(instructions);
+        second.GetCpu().Execute(instructions);
+        return first.Fingerprint() == second.Fingerprint();
+    }
+
+    void Peek(const Machine& machine, Divergence& out)
+    {
+        out.pc = machine.GetCpu().GetPc();
+        for (std::size_t i = 0; i < out.bytes.size(); ++i)
+        {
+            const std::uint8_t* memory = machine.GetBus().ReadPointer(static_cast<std::uint16_t>(out.pc + i));
+            out.bytes[i] = memory != nullptr ? *memory : 0;
+        }
+    }
+}
+
+Divergence DivergenceFinder::Find(Machine& first, Machine& second, std::uint64_t limit, const DivergenceConfig& config)
+{
+    Divergence result;
+
+    // The run goes on in the forks; the last matching stop is forked off
+    // them, so they keep their decode caches
+    std::unique_ptr<Machine> runFirst = first.Fork();
+    std::unique_ptr<Machine> runSecond = second.Fork();
+    if (Compare(*runFirst, *runSecond, result))
+    {
+        Peek(*runFirst, result);
+        result.found = true;
+        result.atStart = true;
+        return result;
+    }
+
+    std::unique_ptr<Machine> goodFirst = runFirst->Fork();
+    std::unique_ptr<Machine> goodSecond = runSecond->Fork();
+    std::uint64_t good = 0;
+    std::uint64_t bad = 0;
+
+    const std::uint64_t checkpoint = std::max<std::uint64_t>(config.checkpoint, 1);
+    while (good < limit)
+    {
+        const std::uint64_t run = std::min(checkpoint, limit - good);
+        if (!RunEqual(*runFirst, *runSecond, run, config.parallel))
+        {
+            bad = good + run;
+            break;
+        }
+        good += run;
+        goodFirst = runFirst->Fork();
+        goodSecond = runSecond->Fork();
+    }
+    if (good >= limit)
+        return Divergence{};
+
+    // The first difference is somewhere in (good, bad]
+    runFirst.reset();
+    runSecond.reset();
+    while (bad - good > std::max<std::uint64_t>(config.linear, 1))
+    {
+        const std::uint64_t middle = good + (bad - good) / 2;
+        std::unique_ptr<Machine> probeFirst = goodFirst->Fork();
+        std::unique_ptr<Machine> probeSecond = goodSecond->Fork();
+        if (RunEqual(*probeFirst, *probeSecond, middle - good, config.parallel))
+        {
+            goodFirst = std::move(probeFirst);
+            goodSecond = std::move(probeSecond);
+            good = middle;
+        }
+        else
+            bad = middle;
+    }
+
+    for (std::uint64_t at = good; at < bad; ++at)
+    {
+        Peek(*goodFirst, result);
+        goodFirst->GetCpu().Step();
+        goodSecond->GetCpu().Step();
+        if (Compare(*goodFirst, *goodSecond, result))
+        {
+            result.found = true;
+            result.instruction = at;
+            return result;
+        }
+    }
+
+    // Only a hash collision at the last matching stop gets here
+    return Divergence{};
+}
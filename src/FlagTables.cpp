@@ -0,0 +1,130 @@
+#include "FlagTables.h"
+#include "Cpu.h"
+
+namespace
+{
+	constexpr bool EvenParity(uint8_t value)
+	{
+		bool parity = true;
+		while (value)
+		{
+			parity = !parity;
+			value &= (value - 1);
+		}
+		return parity;
+	}
+
+	constexpr uint8_t Sz(uint8_t result)
+	{
+		return static_cast<uint8_t>((result & Cpu::FLAG_S) | (result == 0 ? Cpu::FLAG_Z : 0));
+	}
+
+	constexpr std::array<uint8_t, 256> MakeSzp()
+	{
+		std::array<uint8_t, 256> t{};
+		for (unsigned v = 0; v < 256; ++v)
+			t[v] = static_cast<uint8_t>(Sz(uint8_t(v)) | (EvenParity(uint8_t(v)) ? Cpu::FLAG_PV : 0));
+		return t;
+	}
+
+	constexpr std::array<uint8_t, 256> MakeInc()
+	{
+		std::array<uint8_t, 256> t{};
+		for (unsigned v = 0; v < 256; ++v)
+		{
+			uint8_t f = Sz(static_cast<uint8_t>(v + 1));
+			if ((v & 0x0F) == 0x0F) f |= Cpu::FLAG_H;
+			if (v == 0x7F)          f |= Cpu::FLAG_PV;     // +127 -> -128 overflow
+			t[v] = f;
+		}
+		return t;
+	}
+
+	constexpr std::array<uint8_t, 256> MakeDec()
+	{
+		std::array<uint8_t, 256> t{};
+		for (unsigned v = 0; v < 256; ++v)
+		{
+			uint8_t f = Sz(static_cast<uint8_t>(v - 1)) | Cpu::FLAG_N;
+			if ((v & 0x0F) == 0x00) f |= Cpu::FLAG_H;
+			if (v == 0x80)          f |= Cpu::FLAG_PV;     // -128 -> +127 overflow
+			t[v] = f;
+		}
+		return t;
+	}
+
+	constexpr std::array<uint8_t, FlagTables::ALU_SIZE> MakeAdd()
+	{
+		std::array<uint8_t, FlagTables::ALU_SIZE> t{};
+		for (unsigned i = 0; i < FlagTables::ALU_SIZE; ++i)
+		{
+			const unsigned carryIn = i >> 16;
+			const unsigned lhs = (i >> 8) & 0xFF;
+			const unsigned rhs = i & 0xFF;
+			const unsigned sum = lhs + rhs + carryIn;
+			const uint8_t result = static_cast<uint8_t>(sum);
+
+			uint8_t f = Sz(result);
+			if (((lhs & 0x0F) + (rhs & 0x0F) + carryIn) > 0x0F) f |= Cpu::FLAG_H;
+			if ((~(lhs ^ rhs) & (lhs ^ result) & 0x80) != 0)      f |= Cpu::FLAG_PV;
+			if (sum > 0xFF) f |= Cpu::FLAG_C;
+			t[i] = f;
+		}
+		return t;
+	}
+
+	constexpr std::array<uint8_t, FlagTables::ALU_SIZE> MakeSub()
+	{
+		std::array<uint8_t, FlagTables::ALU_SIZE> t{};
+		for (unsigned i = 0; i < FlagTables::ALU_SIZE; ++i)
+		{
+			const unsigned carryIn = i >> 16;
+			const unsigned lhs = (i >> 8) & 0xFF;
+			const unsigned rhs = i & 0xFF;
+			const uint8_t result = static_cast<uint8_t>(lhs - rhs - carryIn);
+
+			uint8_t f = Sz(result) | Cpu::FLAG_N;
+			if ((lhs & 0x0F) < ((rhs & 0x0F) + carryIn))     f |= Cpu::FLAG_H;
+			if (((lhs ^ rhs) & (lhs ^ result) & 0x80) != 0) f |= Cpu::FLAG_PV;
+			if (lhs < rhs + carryIn) f |= Cpu::FLAG_C;
+			t[i] = f;
+		}
+		return t;
+	}
+
+	constexpr std::array<uint16_t, FlagTables::DAA_SIZE> MakeDaa()
+	{
+		std::array<uint16_t, FlagTables::DAA_SIZE> t{};
+		const std::array<uint8_t, 256> szp = MakeSzp();
+		for (unsigned i = 0; i < FlagTables::DAA_SIZE; ++i)
+		{
+			const uint8_t a = static_cast<uint8_t>(i);
+			const bool c = (i & 0x100) != 0;
+			const bool n = (i & 0x200) != 0;
+			const bool h = (i & 0x400) != 0;
+
+			// Correction is 0x06 for the low digit and 0x60 for the high digit
+			uint8_t diff = 0;
+			bool carryOut = c;
+			if (c || a > 0x99)           { diff |= 0x60; carryOut = true; }
+			if (h || (a & 0x0F) > 0x09)  diff |= 0x06;
+
+			const uint8_t result = n ? static_cast<uint8_t>(a - diff) : static_cast<uint8_t>(a + diff);
+			const bool halfOut = n ? (h && (a & 0x0F) < 0x06) : ((a & 0x0F) > 0x09);
+
+			uint8_t f = szp[result];
+			if (halfOut)  f |= Cpu::FLAG_H;
+			if (n)        f |= Cpu::FLAG_N;
+			if (carryOut) f |= Cpu::FLAG_C;
+			t[i] = static_cast<uint16_t>((result << 8) | f);
+		}
+		return t;
+	}
+}
+
+constexpr std::array<std::uint8_t, 256> FlagTables::Szp = MakeSzp();
+constexpr std::array<std::uint8_t, 256> FlagTables::Inc = MakeInc();
+constexpr std::array<std::uint8_t, 256> FlagTables::Dec = MakeDec();
+constexpr std::array<std::uint8_t, FlagTables::ALU_SIZE> FlagTables::Add = MakeAdd();
+constexpr std::array<std::uint8_t, FlagTables::ALU_SIZE> FlagTables::Sub = MakeSub();
+constexpr std::array<std::uint16_t, FlagTables::DAA_SIZE> FlagTables::Daa = MakeDaa();
@@ -0,0 +1,309 @@
+#include "ImageLoader.h"
+#include <algorithm>
+#include <cctype>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ---- MappedFile ----
+
+MappedFile::MappedFile(const std::string& path)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size{};
+    if (GetFileSizeEx(file, &size) && size.QuadPart == 0)
+        open_ = true;
+    else if (size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr)
+        {
+            void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (view != nullptr)
+            {
+                data_ = static_cast<const std::uint8_t*>(view);
+                size_ = static_cast<std::size_t>(size.QuadPart);
+                mapping_ = mapping;
+                open_ = true;
+            }
+            else
+                CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat info{};
+    if (fstat(fd, &info) == 0)
+    {
+        if (info.st_size == 0)
+            open_ = true;
+        else
+        {
+            void* view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED)
+            {
+                data_ = static_cast<const std::uint8_t*>(view);
+                size_ = static_cast<std::size_t>(info.st_size);
+                open_ = true;
+            }
+        }
+    }
+    close(fd);                  // the mapping keeps the file alive
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        open_ = std::exchange(other.open_, false);
+#if defined(_WIN32)
+        mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::Close()
+{
+#if defined(_WIN32)
+    if (data_ != nullptr)
+        UnmapViewOfFile(data_);
+    if (mapping_ != nullptr)
+        CloseHandle(mapping_);
+    mapping_ = nullptr;
+#else
+    if (data_ != nullptr)
+        munmap(const_cast<std::uint8_t*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+// ---- ImageLoader ----
+
+namespace
+{
+    LoadResult Failed(std::string error)
+    {
+        LoadResult result;
+        result.error = std::move(error);
+        return result;
+    }
+
+    int HexDigit(std::uint8_t c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+}
+
+LoadResult ImageLoader::MapRom(Bus& bus, const MappedFile& rom, std::size_t firstPage)
+{
+    if (!rom.IsOpen())
+        return Failed("ROM file is not open");
+    if (rom.Bytes().empty())
+        return Failed("ROM file is empty");
+    if (firstPage >= Bus::MAP_PAGE_COUNT)
+        return Failed("ROM page is outside the address space");
+
+    // The OS maps whole pages of at least 4K and zero-fills past the end of
+    // the file, so the last (partial) 1K page is safe to point at
+    const std::size_t pages = (rom.Bytes().size() + Bus::MAP_PAGE_SIZE - 1) >> Bus::MAP_PAGE_SHIFT;
+    bus.MapRom(firstPage, pages, rom.Bytes().data());
+
+    LoadResult result;
+    result.ok = true;
+    result.bytes = std::min(rom.Bytes().size(), (Bus::MAP_PAGE_COUNT - firstPage) * Bus::MAP_PAGE_SIZE);
+    return result;
+}
+
+LoadResult ImageLoader::Load(Bus& bus, std::span<const std::uint8_t> image, ImageFormat format, std::uint16_t address)
+{
+    switch (format)
+    {
+    case ImageFormat::IntelHex:
+        return LoadIntelHex(bus, image);
+    case ImageFormat::Tagged:
+        return LoadTagged(bus, image);
+    case ImageFormat::Raw:
+        break;
+    }
+
+    if (image.size() > Bus::RAM_SIZE)
+        return Failed("raw image is larger than 64K");
+
+    bus.WriteBlock(address, image);
+
+    LoadResult result;
+    result.ok = true;
+    result.bytes = image.size();
+    return result;
+}
+
+LoadResult ImageLoader::LoadFile(Bus& bus, const std::string& path, ImageFormat format, std::uint16_t address)
+{
+    const MappedFile file(path);
+    if (!file.IsOpen())
+        return Failed("cannot open " + path);
+    return Load(bus, file.Bytes(), format, address);
+}
+
+ImageFormat ImageLoader::FormatForPath(const std::string& path)
+{
+    const std::size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos)
+        return ImageFormat::Raw;
+
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    if (extension == "hex" || extension == "ihx")
+        return ImageFormat::IntelHex;
+    if (extension == "prg")
+        return ImageFormat::Tagged;
+    return ImageFormat::Raw;
+}
+
+LoadResult ImageLoader::LoadTagged(Bus& bus, std::span<const std::uint8_t> image)
+{
+    if (image.size() < 2)
+        return Failed("tagged image has no load address");
+    if (image.size() - 2 > Bus::RAM_SIZE)
+        return Failed("tagged image is larger than 64K");
+
+    const std::uint16_t address = static_cast<std::uint16_t>(image[0] | (image[1] << 8));
+    bus.WriteBlock(address, image.subspan(2));
+
+    LoadResult result;
+    result.ok = true;
+    result.bytes = image.size() - 2;
+    result.entry = address;
+    return result;
+}
+
+// Record types 00 (data), 01 (end), 02 (segment base), 04 (linear base, must
+// stay 0 on a 16-bit bus), 03/05 (start address). Every record's checksum is
+// checked, and nothing after a bad record is stored.
+LoadResult ImageLoader::LoadIntelHex(Bus& bus, std::span<const std::uint8_t> text)
+{
+    LoadResult result;
+    std::uint32_t base = 0;
+    std::vector<std::uint8_t> record;
+    std::size_t line = 0;
+    std::size_t pos = 0;
+
+    while (pos < text.size())
+    {
+        // One line, without its line ending
+        std::size_t end = pos;
+        while (end < text.size() && text[end] != '\n')
+            ++end;
+        std::span<const std::uint8_t> row = text.subspan(pos, end - pos);
+        if (!row.empty() && row.back() == '\r')
+            row = row.first(row.size() - 1);
+        pos = end + 1;
+        ++line;
+
+        if (row.empty())
+            continue;
+
+        const std::string where = "line " + std::to_string(line);
+        if (row[0] != ':' || row.size() < 11 || (row.size() - 1) % 2 != 0)
+            return Failed("malformed Intel HEX record at " + where);
+
+        record.clear();
+        std::uint8_t sum = 0;
+        for (std::size_t i = 1; i < row.size(); i += 2)
+        {
+            const int hi = HexDigit(row[i]);
+            const int lo = HexDigit(row[i + 1]);
+            if (hi < 0 || lo < 0)
+                return Failed("bad hex digit at " + where);
+            record.push_back(static_cast<std::uint8_t>(hi << 4 | lo));
+            sum = static_cast<std::uint8_t>(sum + record.back());
+        }
+
+        const std::size_t length = record[0];
+        if (record.size() != length + 5)
+            return Failed("record length does not match at " + where);
+        if (sum != 0)
+            return Failed("checksum mismatch at " + where);
+
+        const std::uint16_t offset = static_cast<std::uint16_t>(record[1] << 8 | record[2]);
+        const std::uint8_t type = record[3];
+        const std::span<const std::uint8_t> data(record.data() + 4, length);
+
+        switch (type)
+        {
+        case 0x00:
+            if (base + offset + length > Bus::RAM_SIZE)
+                return Failed("address beyond 64K at " + where);
+            bus.WriteBlock(static_cast<std::uint16_t>(base + offset), data);
+            result.bytes += length;
+            break;
+        case 0x01:
+            result.ok = true;
+            return result;
+        case 0x02:
+            if (length != 2)
+                return Failed("bad segment record at " + where);
+            base = static_cast<std::uint32_t>((data[0] << 8 | data[1]) << 4);
+            break;
+        case 0x04:
+            if (length != 2)
+                return Failed("bad linear address record at " + where);
+            if ((data[0] | data[1]) != 0)
+                return Failed("address beyond 64K at " + where);
+            base = 0;
+            break;
+        case 0x03:
+        case 0x05:
+            if (length != 4)
+                return Failed("bad start address record at " + where);
+            result.entry = static_cast<std::uint16_t>(data[2] << 8 | data[3]);
+            break;
+        default:
+            return Failed("unknown record type at " + where);
+        }
+    }
+
+    // No end record: everything up to here was still valid
+    result.ok = true;
+    return result;
+}
@@ -0,0 +1,788 @@
+#include "Jit.h"
+#include "Cpu.h"
+#include "FlagTables.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace
+{
+	enum Reg : std::uint8_t
+	{
+		RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15
+	};
+
+	// Host register for each Z80 register, in the Cpu's REG_x order
+	// (B C D E H L F A). All of them stay zero-extended to 32 bits.
+	// Everything from R12 up is callee-saved; the rest is reloaded after any
+	// call out of the block.
+	constexpr std::array<Reg, 8> HOST = { R14, R15, RBP, R8, R9, R10, R13, R12 };
+	constexpr Reg HOST_F = HOST[6];
+	constexpr Reg HOST_A = HOST[7];
+	constexpr Reg CPU = RBX;
+
+	enum class Alu : std::uint8_t { Add = 0, Or = 1, And = 4, Sub = 5, Xor = 6 };
+	enum class Shift : std::uint8_t { Left = 4, Right = 5 };
+
+	// Just enough of an x86-64 assembler for the blocks below. Registers are
+	// used as 32-bit, memory operands are [base + disp32] or a table lookup
+	// [base + index * scale].
+	class X64Emitter
+	{
+	public:
+		const std::vector<std::uint8_t>& Code() const { return code_; }
+
+		void MovRR(Reg dst, Reg src) { Rex(false, src, RAX, dst); Byte(0x89); ModRm(3, src, dst); }
+		void MovRR64(Reg dst, Reg src) { Rex(true, src, RAX, dst); Byte(0x89); ModRm(3, src, dst); }
+		void AluRR(Alu op, Reg dst, Reg src) { Rex(false, src, RAX, dst); Byte(static_cast<std::uint8_t>(op) * 8 + 1); ModRm(3, src, dst); }
+
+		void AluRI(Alu op, Reg dst, std::int32_t imm)
+		{
+			Rex(false, RAX, RAX, dst);
+			if (imm >= -128 && imm <= 127)
+			{
+				Byte(0x83); ModRm(3, static_cast<std::uint8_t>(op), dst); Byte(static_cast<std::uint8_t>(imm));
+			}
+			else
+			{
+				Byte(0x81); ModRm(3, static_cast<std::uint8_t>(op), dst); Dword(static_cast<std::uint32_t>(imm));
+			}
+		}
+
+		void ShiftRI(Shift op, Reg dst, std::uint8_t count) { Rex(false, RAX, RAX, dst); Byte(0xC1); ModRm(3, static_cast<std::uint8_t>(op), dst); Byte(count); }
+		void MovRI(Reg dst, std::uint32_t imm) { Rex(false, RAX, RAX, dst); Byte(0xB8 + (dst & 7)); Dword(imm); }
+		void MovRI64(Reg dst, std::uint64_t imm) { Rex(true, RAX, RAX, dst); Byte(0xB8 + (dst & 7)); Qword(imm); }
+		void MovzxRR8(Reg dst, Reg src) { Rex(false, dst, RAX, src, IsLegacyByte(src)); Byte(0x0F); Byte(0xB6); ModRm(3, dst, src); }
+		void TestRR(Reg a, Reg b) { Rex(false, b, RAX, a); Byte(0x85); ModRm(3, b, a); }
+
+		// [base + disp32]
+		void Load8(Reg dst, Reg base, std::int32_t disp) { Rex(false, dst, RAX, base); Byte(0x0F); Byte(0xB6); Mem(dst, base, disp); }
+		void Load16(Reg dst, Reg base, std::int32_t disp) { Rex(false, dst, RAX, base); Byte(0x0F); Byte(0xB7); Mem(dst, base, disp); }
+		void Store8(Reg base, std::int32_t disp, Reg src) { Rex(false, src, RAX, base, IsLegacyByte(src)); Byte(0x88); Mem(src, base, disp); }
+		void Store16(Reg base, std::int32_t disp, Reg src) { Byte(0x66); Rex(false, src, RAX, base); Byte(0x89); Mem(src, base, disp); }
+		void Store8I(Reg base, std::int32_t disp, std::uint8_t imm) { Rex(false, RAX, RAX, base); Byte(0xC6); Mem(0, base, disp); Byte(imm); }
+		void Store16I(Reg base, std::int32_t disp, std::uint16_t imm) { Byte(0x66); Rex(false, RAX, RAX, base); Byte(0xC7); Mem(0, base, disp); Word(imm); }
+		void Add16I(Reg base, std::int32_t disp, std::int8_t imm) { Byte(0x66); Rex(false, RAX, RAX, base); Byte(0x83); Mem(0, base, disp); Byte(static_cast<std::uint8_t>(imm)); }
+
+		// movzx dst, byte/word [base + index * size]
+		void Table8(Reg dst, Reg base, Reg index) { Rex(false, dst, index, base); Byte(0x0F); Byte(0xB6); ModRm(0, dst, RSP); Sib(0, index, base); }
+		void Table16(Reg dst, Reg base, Reg index) { Rex(false, dst, index, base); Byte(0x0F); Byte(0xB7); ModRm(0, dst, RSP); Sib(1, index, base); }
+
+		void Push(Reg r) { if (r >= R8) Byte(0x41); Byte(0x50 + (r & 7)); }
+		void Pop(Reg r) { if (r >= R8) Byte(0x41); Byte(0x58 + (r & 7)); }
+		void SubRsp(std::uint8_t n) { Byte(0x48); Byte(0x83); Byte(0xEC); Byte(n); }
+		void AddRsp(std::uint8_t n) { Byte(0x48); Byte(0x83); Byte(0xC4); Byte(n); }
+		void Ret() { Byte(0xC3); }
+
+		void Call(const void* target)
+		{
+			MovRI64(RAX, reinterpret_cast<std::uintptr_t>(target));
+			Byte(0xFF); Byte(0xD0);         // call rax
+		}
+
+		// jz/jmp rel32 with the target filled in later by Bind()
+		std::size_t JumpIfZero() { Byte(0x0F); Byte(0x84); Dword(0); return code_.size(); }
+		std::size_t Jump() { Byte(0xE9); Dword(0); return code_.size(); }
+
+		void Bind(std::size_t jump)
+		{
+			const std::uint32_t rel = static_cast<std::uint32_t>(code_.size() - jump);
+			std::memcpy(&code_[jump - 4], &rel, sizeof(rel));
+		}
+
+	private:
+		std::vector<std::uint8_t> code_;
+
+		// spl/bpl/sil/dil need a REX prefix or they mean ah/ch/dh/bh
+		static bool IsLegacyByte(Reg r) { return r >= RSP && r <= RDI; }
+
+		void Byte(std::uint8_t b) { code_.push_back(b); }
+		void Word(std::uint16_t v) { Byte(static_cast<std::uint8_t>(v)); Byte(static_cast<std::uint8_t>(v >> 8)); }
+		void Dword(std::uint32_t v) { for (int i = 0; i < 4; ++i) Byte(static_cast<std::uint8_t>(v >> (8 * i))); }
+		void Qword(std::uint64_t v) { for (int i = 0; i < 8; ++i) Byte(static_cast<std::uint8_t>(v >> (8 * i))); }
+
+		void Rex(bool w, std::uint8_t reg, std::uint8_t index, std::uint8_t base, bool force = false)
+		{
+			const std::uint8_t rex = static_cast<std::uint8_t>(0x40 | (w ? 8 : 0) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3));
+			if (rex != 0x40 || force)
+				Byte(rex);
+		}
+
+		void ModRm(std::uint8_t mod, std::uint8_t reg, std::uint8_t rm) { Byte(static_cast<std::uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7))); }
+		void Sib(std::uint8_t scale, std::uint8_t index, std::uint8_t base) { Byte(static_cast<std::uint8_t>((scale << 6) | ((index & 7) << 3) | (base & 7))); }
+
+		void Mem(std::uint8_t reg, Reg base, std::int32_t disp)
+		{
+			const bool short8 = disp >= -128 && disp <= 127;
+			ModRm(short8 ? 1 : 2, reg, base);
+			if ((base & 7) == RSP)
+				Byte(0x24);
+			if (short8)
+				Byte(static_cast<std::uint8_t>(disp));
+			else
+				Dword(static_cast<std::uint32_t>(disp));
+		}
+	};
+
+	// Where the Cpu fields a block touches live, relative to the Cpu itself
+	struct CpuLayout
+	{
+		std::array<std::int32_t, 8> reg8;       // live B C D E H L F A
+		std::array<std::int32_t, 8> alt8;       // the same bytes in the shadow set
+		std::int32_t pc;
+		std::int32_t sp;
+		std::int32_t halted;
+	};
+
+	// Bytes after the opcode for the instructions compiled below
+	std::uint8_t OperandBytes(std::uint8_t op)
+	{
+		if (op < 0x40 && (op & 0x0F) == 0x01)                   // LD rr,nn
+			return 2;
+		if (op < 0x40 && (op & 0x07) == 6)                      // LD r,n
+			return 1;
+		if (op == 0xC6 || op == 0xFE || op == 0xE6 || op == 0xF6 || op == 0xEE)
+			return 1;                                           // ALU A,n
+		return 0;
+	}
+
+	class BlockCompiler
+	{
+	public:
+		explicit BlockCompiler(const CpuLayout& layout) : at_(layout) {}
+
+		X64Emitter& Asm() { return e_; }
+
+		void Prologue()
+		{
+			for (Reg r : { RBX, RBP, R12, R13, R14, R15 })
+				e_.Push(r);
+			e_.SubRsp(8);                   // keep rsp 16-byte aligned for calls
+			e_.MovRR64(CPU, RDI);
+			LoadRegs();
+		}
+
+		void LoadRegs()
+		{
+			for (std::size_t r = 0; r < 8; ++r)
+				e_.Load8(HOST[r], CPU, at_.reg8[r]);
+		}
+
+		void StoreRegs()
+		{
+			for (std::size_t r = 0; r < 8; ++r)
+				e_.Store8(CPU, at_.reg8[r], HOST[r]);
+		}
+
+		// End of the block: the interpreter carries on at nextPc as if it had
+		// run `instructions` instructions taking `tstates`. Early exits jump
+		// into the tail of this with the same two values in edx and rax.
+		void Exit(std::uint16_t nextPc, std::uint32_t instructions, std::uint32_t tstates)
+		{
+			e_.MovRI(RDX, nextPc);
+			e_.MovRI64(RAX, Packed(instructions, tstates));
+
+			for (std::size_t jump : earlyExits_)
+				e_.Bind(jump);
+			StoreRegs();
+			e_.Store16(CPU, at_.pc, RDX);
+			e_.AddRsp(8);
+			for (Reg r : { R15, R14, R13, R12, RBP, RBX })
+				e_.Pop(r);
+			e_.Ret();
+		}
+
+		// After a call that returns nonzero in eax for a write to a watched
+		// code page: stop here, the rest of the block may be stale
+		void ExitIfCodeWritten(std::uint16_t nextPc, std::uint32_t instructions, std::uint32_t tstates)
+		{
+			e_.TestRR(RAX, RAX);
+			const std::size_t stay = e_.JumpIfZero();
+			e_.MovRI(RDX, nextPc);
+			e_.MovRI64(RAX, Packed(instructions, tstates));
+			earlyExits_.push_back(e_.Jump());
+			e_.Bind(stay);
+		}
+
+		// Call one of the memory helpers with rsi/rdx already set. Only the
+		// Z80 registers in caller-saved host registers (E H L) need keeping.
+		void CallHelper(const void* helper)
+		{
+			for (Reg r : { R8, R9, R10, R11 })
+				e_.Push(r);
+			e_.MovRR64(RDI, CPU);
+			e_.Call(helper);
+			for (Reg r : { R11, R10, R9, R8 })
+				e_.Pop(r);
+		}
+
+		void Halt()
+		{
+			e_.Store8I(CPU, at_.halted, 1);
+		}
+
+		// ---- 16-bit pairs held as two host registers ----
+		void PairToEax(std::uint8_t hi, std::uint8_t lo)
+		{
+			e_.MovRR(RAX, HOST[hi]);
+			e_.ShiftRI(Shift::Left, RAX, 8);
+			e_.AluRR(Alu::Or, RAX, HOST[lo]);
+		}
+
+		void EaxToPair(std::uint8_t hi, std::uint8_t lo)
+		{
+			e_.MovzxRR8(HOST[lo], RAX);
+			e_.ShiftRI(Shift::Right, RAX, 8);
+			e_.MovzxRR8(HOST[hi], RAX);
+		}
+
+		void LoadPair(std::uint8_t pair, std::uint16_t value)
+		{
+			if (pair == 3)
+			{
+				e_.Store16I(CPU, at_.sp, value);
+				return;
+			}
+			e_.MovRI(HOST[2 * pair], value >> 8);
+			e_.MovRI(HOST[2 * pair + 1], value & 0xFF);
+		}
+
+		void StepPair(std::uint8_t pair, std::int8_t delta)
+		{
+			if (pair == 3)
+			{
+				e_.Add16I(CPU, at_.sp, delta);
+				return;
+			}
+			PairToEax(2 * pair, 2 * pair + 1);
+			e_.AluRI(Alu::Add, RAX, delta);
+			EaxToPair(2 * pair, 2 * pair + 1);
+		}
+
+		// ADD HL,rr: H from bit 11, C from bit 15, N reset, S Z P/V kept
+		void AddHl(std::uint8_t pair)
+		{
+			if (pair == 3)
+				e_.Load16(RDX, CPU, at_.sp);
+			else
+			{
+				PairToEax(2 * pair, 2 * pair + 1);
+				e_.MovRR(RDX, RAX);
+			}
+			PairToEax(4, 5);
+
+			e_.MovRR(RCX, RAX);
+			e_.AluRI(Alu::And, RCX, 0x0FFF);
+			e_.MovRR(RSI, RDX);
+			e_.AluRI(Alu::And, RSI, 0x0FFF);
+			e_.AluRR(Alu::Add, RCX, RSI);
+			e_.ShiftRI(Shift::Right, RCX, 12);
+			e_.ShiftRI(Shift::Left, RCX, 4);        // 1 -> FLAG_H
+
+			e_.AluRR(Alu::Add, RAX, RDX);
+			e_.MovRR(RSI, RAX);
+			e_.ShiftRI(Shift::Right, RSI, 16);      // carry out of bit 15 -> FLAG_C
+
+			e_.AluRI(Alu::And, HOST_F, static_cast<std::uint8_t>(~(Cpu::FLAG_H | Cpu::FLAG_N | Cpu::FLAG_C)));
+			e_.AluRR(Alu::Or, HOST_F, RCX);
+			e_.AluRR(Alu::Or, HOST_F, RSI);
+
+			e_.AluRI(Alu::And, RAX, 0xFFFF);
+			EaxToPair(4, 5);
+		}
+
+		// ---- Memory, through the Jit's helpers ----
+		void LoadFromHl(std::uint8_t r, const void* read)
+		{
+			PairToEax(4, 5);
+			e_.MovRR(RSI, RAX);
+			CallHelper(read);
+			e_.MovRR(HOST[r], RAX);
+		}
+
+		// LD (HL),r / LD (HL),n with the byte already in edx
+		void StoreToHl(const void* write)
+		{
+			PairToEax(4, 5);
+			e_.MovRR(RSI, RAX);
+			CallHelper(write);
+		}
+
+		void PushPair(std::uint8_t hi, std::uint8_t lo, const void* push)
+		{
+			PairToEax(hi, lo);
+			e_.MovRR(RSI, RAX);
+			CallHelper(push);
+		}
+
+		void PopPair(std::uint8_t hi, std::uint8_t lo, const void* pop)
+		{
+			CallHelper(pop);
+			EaxToPair(hi, lo);
+		}
+
+		// ---- 8-bit ALU, flags straight from FlagTables ----
+		void IncDec(std::uint8_t r, bool inc)
+		{
+			e_.MovRR(RAX, HOST[r]);
+			e_.MovRI64(RCX, reinterpret_cast<std::uintptr_t>(inc ? FlagTables::Inc.data() : FlagTables::Dec.data()));
+			e_.Table8(RDX, RCX, RAX);
+			e_.AluRI(Alu::And, HOST_F, Cpu::FLAG_C);
+			e_.AluRR(Alu::Or, HOST_F, RDX);
+			e_.AluRI(Alu::Add, HOST[r], inc ? 1 : -1);
+			e_.AluRI(Alu::And, HOST[r], 0xFF);
+		}
+
+		// ADD/ADC/SUB/SBC/CP with the right-hand side already in rhs
+		void AddSub(Reg rhs, bool subtract, bool withCarry, bool keepResult)
+		{
+			// Table index: carry << 16 | A << 8 | rhs
+			e_.MovRR(RAX, HOST_A);
+			e_.ShiftRI(Shift::Left, RAX, 8);
+			e_.AluRR(Alu::Or, RAX, rhs);
+
+			e_.MovRR(RDX, HOST_A);
+			e_.AluRR(subtract ? Alu::Sub : Alu::Add, RDX, rhs);
+
+			if (withCarry)
+			{
+				e_.MovRR(RCX, HOST_F);
+				e_.AluRI(Alu::And, RCX, Cpu::FLAG_C);
+				e_.AluRR(subtract ? Alu::Sub : Alu::Add, RDX, RCX);
+				e_.ShiftRI(Shift::Left, RCX, 16);
+				e_.AluRR(Alu::Or, RAX, RCX);
+			}
+
+			e_.MovRI64(RCX, reinterpret_cast<std::uintptr_t>(subtract ? FlagTables::Sub.data() : FlagTables::Add.data()));
+			e_.Table8(HOST_F, RCX, RAX);
+
+			if (keepResult)
+				e_.MovzxRR8(HOST_A, RDX);
+		}
+
+		// AND/OR/XOR n: F is S Z P from the result, plus H for AND
+		void Logic(Alu op, std::uint8_t n, std::uint8_t hFlag)
+		{
+			e_.AluRI(op, HOST_A, static_cast<std::int8_t>(n));
+			e_.AluRI(Alu::And, HOST_A, 0xFF);
+			e_.MovRR(RAX, HOST_A);
+			e_.MovRI64(RCX, reinterpret_cast<std::uintptr_t>(FlagTables::Szp.data()));
+			e_.Table8(HOST_F, RCX, RAX);
+			if (hFlag != 0)
+				e_.AluRI(Alu::Or, HOST_F, hFlag);
+		}
+
+		void Daa()
+		{
+			// Index: (C N H folded into 3 bits) << 8 | A, see FlagTables::DaaIndex
+			e_.MovRR(RAX, HOST_F);
+			e_.AluRI(Alu::And, RAX, Cpu::FLAG_C | Cpu::FLAG_N);
+			e_.MovRR(RDX, HOST_F);
+			e_.AluRI(Alu::And, RDX, Cpu::FLAG_H);
+			e_.ShiftRI(Shift::Right, RDX, 2);
+			e_.AluRR(Alu::Or, RAX, RDX);
+			e_.ShiftRI(Shift::Left, RAX, 8);
+			e_.AluRR(Alu::Or, RAX, HOST_A);
+
+			e_.MovRI64(RCX, reinterpret_cast<std::uintptr_t>(FlagTables::Daa.data()));
+			e_.Table16(RAX, RCX, RAX);
+			e_.MovzxRR8(HOST_F, RAX);
+			e_.ShiftRI(Shift::Right, RAX, 8);
+			e_.MovRR(HOST_A, RAX);
+		}
+
+		void Scf()
+		{
+			e_.AluRI(Alu::Or, HOST_F, Cpu::FLAG_C);
+			e_.AluRI(Alu::And, HOST_F, static_cast<std::uint8_t>(~(Cpu::FLAG_N | Cpu::FLAG_H)));
+		}
+
+		// EX AF,AF' (first = 6) or EXX (registers 0..5) against the shadow set in memory
+		void Exchange(std::uint8_t first, std::uint8_t last)
+		{
+			for (std::uint8_t r = first; r <= last; ++r)
+			{
+				e_.Load8(RAX, CPU, at_.alt8[r]);
+				e_.Store8(CPU, at_.alt8[r], HOST[r]);
+				e_.MovRR(HOST[r], RAX);
+			}
+		}
+
+		// Hand one instruction to the interpreter, which works on the Cpu's
+		// copy of the registers
+		void Interpret(std::uint16_t pc, std::uint8_t opcode, std::uint16_t nextPc, std::uint32_t instructions, std::uint32_t tstates,
+			std::uint32_t (*handler)(Cpu*, std::uint32_t, std::uint32_t))
+		{
+			StoreRegs();
+			e_.MovRR64(RDI, CPU);
+			e_.MovRI(RSI, static_cast<std::uint16_t>(pc + 1));
+			e_.MovRI(RDX, opcode);
+			e_.Call(reinterpret_cast<const void*>(handler));
+			LoadRegs();
+			ExitIfCodeWritten(nextPc, instructions, tstates);
+		}
+
+	private:
+		X64Emitter e_;
+		const CpuLayout& at_;
+		std::vector<std::size_t> earlyExits_;
+
+		static std::uint64_t Packed(std::uint32_t instructions, std::uint32_t tstates)
+		{
+			return (static_cast<std::uint64_t>(instructions) << 32) | tstates;
+		}
+	};
+
+	std::int32_t Offset(const Cpu& cpu, const void* field)
+	{
+		return static_cast<std::int32_t>(static_cast<const std::uint8_t*>(field) - reinterpret_cast<const std::uint8_t*>(&cpu));
+	}
+}
+
+Jit::Jit()
+	: entry_(Bus::RAM_SIZE, NO_BLOCK),
+	  heat_(Bus::RAM_SIZE, 0)
+{
+	void* code = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	code_ = code == MAP_FAILED ? nullptr : static_cast<std::uint8_t*>(code);
+}
+
+Jit::~Jit()
+{
+	if (code_ != nullptr)
+		munmap(code_, CODE_SIZE);
+}
+
+std::size_t Jit::BlockCount() const
+{
+	std::size_t live = 0;
+	for (const Block& block : blocks_)
+		live += block.live ? 1 : 0;
+	return live;
+}
+
+void Jit::Reset(const Bus* bus)
+{
+	Flush();
+	if (bus == nullptr)
+		return;
+
+	for (std::size_t page = 0; page < Bus::PAGE_COUNT; ++page)
+		pageGeneration_[page] = bus->PageGeneration(static_cast<std::uint8_t>(page));
+	seenGeneration_ = bus->CodeGeneration();
+}
+
+void Jit::Flush()
+{
+	blocks_.clear();
+	std::fill(entry_.begin(), entry_.end(), NO_BLOCK);
+	std::fill(heat_.begin(), heat_.end(), std::uint16_t{0});
+	pageDrops_.fill(0);
+	codeUsed_ = 0;
+}
+
+void Jit::Sync(const Bus& bus)
+{
+	for (std::size_t page = 0; page < Bus::PAGE_COUNT; ++page)
+	{
+		const std::uint32_t generation = bus.PageGeneration(static_cast<std::uint8_t>(page));
+		if (pageGeneration_[page] != generation)
+		{
+			pageGeneration_[page] = generation;
+			DropPage(static_cast<std::uint8_t>(page));
+		}
+	}
+
+	seenGeneration_ = bus.CodeGeneration();
+}
+
+void Jit::DropPage(std::uint8_t page)
+{
+	for (Block& block : blocks_)
+	{
+		if (!block.live)
+			continue;
+
+		const std::uint8_t firstPage = static_cast<std::uint8_t>(block.start >> Bus::PAGE_SHIFT);
+		const std::uint16_t last = static_cast<std::uint16_t>(block.start + block.length - 1);
+		const std::uint8_t pages = static_cast<std::uint8_t>((last >> Bus::PAGE_SHIFT) - firstPage);
+
+		if (static_cast<std::uint8_t>(page - firstPage) <= pages)
+		{
+			block.live = false;
+			entry_[block.start] = NO_BLOCK;
+		}
+	}
+
+	if (pageDrops_[page] < SELF_MODIFYING_DROPS)
+		++pageDrops_[page];
+
+	// A PC refused for its opcode may hold something compilable now
+	const std::size_t first = static_cast<std::size_t>(page) << Bus::PAGE_SHIFT;
+	for (std::size_t i = 0; i < (std::size_t{1} << Bus::PAGE_SHIFT); ++i)
+	{
+		if (entry_[first + i] == NOT_COMPILABLE)
+			entry_[first + i] = NO_BLOCK;
+	}
+}
+
+Jit::Result Jit::Run(Cpu& cpu, std::uint64_t maxInstructions, std::uint64_t maxTStates)
+{
+	if (!IsEnabled() || cpu.bus_ == nullptr)
+		return {};
+
+	const Bus& bus = *cpu.bus_;
+	if (bus.CodeGeneration() != seenGeneration_)
+		Sync(bus);
+
+	const std::uint16_t pc = cpu.pc_;
+	std::int32_t index = entry_[pc];
+
+	if (index == NOT_COMPILABLE)
+		return {};
+
+	if (index == NO_BLOCK)
+	{
+		// Code that keeps rewriting itself would only churn the code buffer
+		if (pageDrops_[pc >> Bus::PAGE_SHIFT] >= SELF_MODIFYING_DROPS)
+			return {};
+
+		if (++heat_[pc] < threshold_)
+			return {};
+
+		heat_[pc] = 0;
+		index = Compile(cpu, pc);
+		entry_[pc] = index;
+		if (index < 0)
+			return {};
+	}
+
+	const Block& block = blocks_[static_cast<std::size_t>(index)];
+	if (block.instructions > maxInstructions || block.tstatesBeforeLast >= maxTStates)
+		return {};
+
+#if defined(Z80EMU_LAZY_FLAGS)
+	cpu.FlushFlags();               // blocks read and write F directly
+#endif
+
+	const std::uint64_t packed = block.code(&cpu);
+	return { static_cast<std::uint32_t>(packed >> 32), static_cast<std::uint32_t>(packed) };
+}
+
+std::uint32_t Jit::ReadByte(Cpu* cpu, std::uint32_t address)
+{
+	return cpu->bus_->Read(static_cast<std::uint16_t>(address));
+}
+
+std::uint32_t Jit::WriteByte(Cpu* cpu, std::uint32_t address, std::uint32_t value)
+{
+	const std::uint32_t generation = cpu->bus_->CodeGeneration();
+	cpu->bus_->Write(static_cast<std::uint16_t>(address), static_cast<std::uint8_t>(value));
+	return cpu->bus_->CodeGeneration() != generation ? 1 : 0;
+}
+
+std::uint32_t Jit::PushWord(Cpu* cpu, std::uint32_t value)
+{
+	const std::uint32_t generation = cpu->bus_->CodeGeneration();
+	cpu->ExecPush(static_cast<std::uint16_t>(value));
+	return cpu->bus_->CodeGeneration() != generation ? 1 : 0;
+}
+
+std::uint32_t Jit::PopWord(Cpu* cpu)
+{
+	return cpu->ExecPop();
+}
+
+std::uint32_t Jit::ExecInterpreted(Cpu* cpu, std::uint32_t pc, std::uint32_t opcode)
+{
+	const std::uint32_t generation = cpu->bus_->CodeGeneration();
+
+	cpu->pc_ = static_cast<std::uint16_t>(pc);
+	(cpu->*Cpu::opTable_[opcode])();
+#if defined(Z80EMU_LAZY_FLAGS)
+	cpu->FlushFlags();
+#endif
+
+	return cpu->bus_->CodeGeneration() != generation ? 1 : 0;
+}
+
+std::int32_t Jit::Compile(Cpu& cpu, std::uint16_t pc)
+{
+	Bus& bus = *cpu.bus_;
+
+	CpuLayout layout{};
+	for (std::uint8_t r = 0; r < 8; ++r)
+	{
+		const auto* regs = reinterpret_cast<const std::uint8_t*>(cpu.regs_.data());
+		layout.reg8[r] = Offset(cpu, regs + Cpu::REG8_BYTE[r]);
+		layout.alt8[r] = Offset(cpu, regs + 2 * Cpu::ALT_BANK + Cpu::REG8_BYTE[r]);
+	}
+	layout.pc = Offset(cpu, &cpu.pc_);
+	layout.sp = Offset(cpu, &cpu.sp_);
+	layout.halted = Offset(cpu, &cpu.halted_);
+
+	BlockCompiler c(layout);
+	c.Prologue();
+
+	std::uint16_t addr = pc;
+	std::uint32_t instructions = 0;
+	std::uint32_t tstates = 0;
+	std::uint32_t lastTStates = 0;
+	bool halted = false;
+
+	while (instructions < MAX_BLOCK_INSTRUCTIONS && !halted)
+	{
+		// Stop where the next page starts, so blocks entered at different
+		// PCs line up again there instead of compiling the same code twice
+		if (instructions > 0 && (addr >> Bus::PAGE_SHIFT) != (pc >> Bus::PAGE_SHIFT))
+			break;
+
+		// Only code read straight out of RAM/ROM is compiled: a device can
+		// change what it returns without any write that would drop the block.
+		// Nothing past the instruction's own bytes is looked at.
+		const std::uint8_t* opcode = bus.ReadPointer(addr);
+		if (opcode == nullptr)
+			break;
+		const std::uint8_t op = *opcode;
+		const std::uint8_t length = static_cast<std::uint8_t>(1 + OperandBytes(op));
+
+		std::array<std::uint8_t, 2> operand{};
+		std::uint8_t fetched = 1;
+		for (; fetched < length; ++fetched)
+		{
+			const std::uint8_t* byte = bus.ReadPointer(static_cast<std::uint16_t>(addr + fetched));
+			if (byte == nullptr)
+				break;
+			operand[fetched - 1] = *byte;
+		}
+		if (fetched < length)
+			break;
+
+		const std::uint8_t n = operand[0];
+		const std::uint16_t nn = static_cast<std::uint16_t>(operand[0] | (operand[1] << 8));
+		const std::uint8_t x = static_cast<std::uint8_t>((op >> 3) & 0x07);
+		const std::uint8_t z = static_cast<std::uint8_t>(op & 0x07);
+		const std::uint8_t pair = static_cast<std::uint8_t>(op >> 4);       // for the x0/x1/x3/x9/xB rows
+		const std::uint32_t cost = Cpu::OP_TSTATES[op];
+
+		const std::uint32_t doneInstructions = instructions + 1;
+		const std::uint32_t doneTStates = tstates + cost;
+
+		// PUSH/POP pairs: BC DE HL, then AF held as A:F
+		const std::uint8_t stackHi = pair == 0x0F ? 7 : static_cast<std::uint8_t>(2 * (pair & 3));
+		const std::uint8_t stackLo = pair == 0x0F ? 6 : static_cast<std::uint8_t>(2 * (pair & 3) + 1);
+
+		if (op == 0x00) {}                                              // NOP
+		else if (op < 0x40 && (op & 0x0F) == 0x01) c.LoadPair(pair, nn); // LD rr,nn
+		else if (op < 0x40 && (op & 0x0F) == 0x03) c.StepPair(pair, 1);  // INC rr
+		else if (op < 0x40 && (op & 0x0F) == 0x0B) c.StepPair(pair, -1); // DEC rr
+		else if (op < 0x40 && (op & 0x0F) == 0x09) c.AddHl(pair);        // ADD HL,rr
+		else if (op == 0x08) c.Exchange(6, 7);                          // EX AF,AF'
+		else if (op == 0x27) c.Daa();                                   // DAA
+		else if (op == 0x37) c.Scf();                                   // SCF
+		else if (op < 0x40 && (z == 4 || z == 5))                       // INC r / DEC r
+		{
+			if (x == 6)
+				c.Interpret(addr, op, static_cast<std::uint16_t>(addr + 1), doneInstructions, doneTStates, &Jit::ExecInterpreted);
+			else
+				c.IncDec(x, z == 4);
+		}
+		else if (op < 0x40 && z == 6)                                   // LD r,n
+		{
+			if (x == 6)
+			{
+				c.Asm().MovRI(RDX, n);
+				c.StoreToHl(reinterpret_cast<const void*>(&Jit::WriteByte));
+				c.ExitIfCodeWritten(static_cast<std::uint16_t>(addr + 2), doneInstructions, doneTStates);
+			}
+			else
+				c.Asm().MovRI(HOST[x], n);
+		}
+		else if (op == 0x76)                                            // HALT
+		{
+			c.Halt();
+			halted = true;
+		}
+		else if (op >= 0x40 && op <= 0x7F)                              // LD r,r'
+		{
+			if (z == 6)
+				c.LoadFromHl(x, reinterpret_cast<const void*>(&Jit::ReadByte));
+			else if (x == 6)
+			{
+				c.Asm().MovRR(RDX, HOST[z]);
+				c.StoreToHl(reinterpret_cast<const void*>(&Jit::WriteByte));
+				c.ExitIfCodeWritten(static_cast<std::uint16_t>(addr + 1), doneInstructions, doneTStates);
+			}
+			else if (x != z)
+				c.Asm().MovRR(HOST[x], HOST[z]);
+		}
+		else if (op >= 0x80 && op <= 0x9F)                              // ADD/ADC/SUB/SBC A,r
+		{
+			// The (HL) forms do nothing yet, same as the interpreter
+			if (z != 6)
+				c.AddSub(HOST[z], op >= 0x90, (op & 0x08) != 0, true);
+		}
+		else if (op == 0xC6 || op == 0xFE)                              // ADD A,n / CP n
+		{
+			c.Asm().MovRI(RSI, n);
+			c.AddSub(RSI, op == 0xFE, false, op == 0xC6);
+		}
+		else if (op == 0xE6) c.Logic(Alu::And, n, Cpu::FLAG_H);         // AND n
+		else if (op == 0xF6) c.Logic(Alu::Or, n, 0);                    // OR n
+		else if (op == 0xEE) c.Logic(Alu::Xor, n, 0);                   // XOR n
+		else if (op == 0xD9) c.Exchange(0, 5);                          // EXX
+		else if (op >= 0xC1 && (op & 0x0F) == 0x01)                     // POP rr
+			c.PopPair(stackHi, stackLo, reinterpret_cast<const void*>(&Jit::PopWord));
+		else if (op >= 0xC5 && (op & 0x0F) == 0x05)                     // PUSH rr
+		{
+			c.PushPair(stackHi, stackLo, reinterpret_cast<const void*>(&Jit::PushWord));
+			c.ExitIfCodeWritten(static_cast<std::uint16_t>(addr + 1), doneInstructions, doneTStates);
+		}
+		else
+			break;                          // not handled here; the interpreter takes over
+
+		instructions = doneInstructions;
+		tstates = doneTStates;
+		lastTStates = cost;
+		addr = static_cast<std::uint16_t>(addr + length);
+	}
+
+	if (instructions == 0)
+	{
+		bus.WatchCodePage(static_cast<std::uint8_t>(pc >> Bus::PAGE_SHIFT));   // so the refusal is retried if it changes
+		return NOT_COMPILABLE;
+	}
+
+	c.Exit(addr, instructions, tstates);
+
+	const std::vector<std::uint8_t>& code = c.Asm().Code();
+	if (codeUsed_ + code.size() > CODE_SIZE)
+	{
+		Flush();
+		if (code.size() > CODE_SIZE)
+			return NOT_COMPILABLE;
+	}
+
+	// Write, then flip back to executable so the mapping is never both
+	std::uint8_t* dst = code_ + codeUsed_;
+	mprotect(code_, CODE_SIZE, PROT_READ | PROT_WRITE);
+	std::memcpy(dst, code.data(), code.size());
+	mprotect(code_, CODE_SIZE, PROT_READ | PROT_EXEC);
+	codeUsed_ += (code.size() + 15) & ~std::size_t{15};
+
+	Block block;
+	block.code = reinterpret_cast<BlockFn>(dst);
+	block.start = pc;
+	block.length = static_cast<std::uint16_t>(addr - pc);
+	block.instructions = instructions;
+	block.tstatesBeforeLast = tstates - lastTStates;
+	block.live = true;
+
+	// Any write to these bytes has to drop the block
+	for (std::uint32_t offset = 0; offset < block.length; ++offset)
+		bus.WatchCodePage(static_cast<std::uint8_t>(static_cast<std::uint16_t>(pc + offset) >> Bus::PAGE_SHIFT));
+
+	blocks_.push_back(block);
+	return static_cast<std::int32_t>(blocks_.size() - 1);
+}
@@ -0,0 +1,722 @@
+#include "LockstepCpu.h"
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// One vector of lanes and the byte operations the kernels are built
+	// from: AVX2 when the build targets it (Z80EMU_AVX2), SSE2 on any other
+	// x86-64, and plain loops elsewhere.
+#if defined(__AVX2__)
+	struct Bytes
+	{
+		static constexpr std::size_t SIZE = 32;
+		__m256i v;
+	};
+
+	inline Bytes Load(const std::uint8_t* p) { return { _mm256_load_si256(reinterpret_cast<const __m256i*>(p)) }; }
+	inline void Store(std::uint8_t* p, Bytes a) { _mm256_store_si256(reinterpret_cast<__m256i*>(p), a.v); }
+	inline Bytes Splat(std::uint8_t x) { return { _mm256_set1_epi8(static_cast<char>(x)) }; }
+	inline Bytes operator&(Bytes a, Bytes b) { return { _mm256_and_si256(a.v, b.v) }; }
+	inline Bytes operator|(Bytes a, Bytes b) { return { _mm256_or_si256(a.v, b.v) }; }
+	inline Bytes operator^(Bytes a, Bytes b) { return { _mm256_xor_si256(a.v, b.v) }; }
+	inline Bytes operator+(Bytes a, Bytes b) { return { _mm256_add_epi8(a.v, b.v) }; }
+	inline Bytes operator-(Bytes a, Bytes b) { return { _mm256_sub_epi8(a.v, b.v) }; }
+	inline Bytes AndNot(Bytes a, Bytes b) { return { _mm256_andnot_si256(a.v, b.v) }; }
+	inline Bytes Equal(Bytes a, Bytes b) { return { _mm256_cmpeq_epi8(a.v, b.v) }; }
+	inline Bytes Negative(Bytes a) { return { _mm256_cmpgt_epi8(_mm256_setzero_si256(), a.v) }; }
+
+	template<int N>
+	inline Bytes ShiftRight(Bytes a) { return Bytes{ _mm256_srli_epi16(a.v, N) } & Splat(0xFF >> N); }
+#elif defined(__SSE2__)
+	struct Bytes
+	{
+		static constexpr std::size_t SIZE = 16;
+		__m128i v;
+	};
+
+	inline Bytes Load(const std::uint8_t* p) { return { _mm_load_si128(reinterpret_cast<const __m128i*>(p)) }; }
+	inline void Store(std::uint8_t* p, Bytes a) { _mm_store_si128(reinterpret_cast<__m128i*>(p), a.v); }
+	inline Bytes Splat(std::uint8_t x) { return { _mm_set1_epi8(static_cast<char>(x)) }; }
+	inline Bytes operator&(Bytes a, Bytes b) { return { _mm_and_si128(a.v, b.v) }; }
+	inline Bytes operator|(Bytes a, Bytes b) { return { _mm_or_si128(a.v, b.v) }; }
+	inline Bytes operator^(Bytes a, Bytes b) { return { _mm_xor_si128(a.v, b.v) }; }
+	inline Bytes operator+(Bytes a, Bytes b) { return { _mm_add_epi8(a.v, b.v) }; }
+	inline Bytes operator-(Bytes a, Bytes b) { return { _mm_sub_epi8(a.v, b.v) }; }
+	inline Bytes AndNot(Bytes a, Bytes b) { return { _mm_andnot_si128(a.v, b.v) }; }
+	inline Bytes Equal(Bytes a, Bytes b) { return { _mm_cmpeq_epi8(a.v, b.v) }; }
+	inline Bytes Negative(Bytes a) { return { _mm_cmplt_epi8(a.v, _mm_setzero_si128()) }; }
+
+	template<int N>
+	inline Bytes ShiftRight(Bytes a) { return Bytes{ _mm_srli_epi16(a.v, N) } & Splat(0xFF >> N); }
+#else
+	struct Bytes
+	{
+		static constexpr std::size_t SIZE = 16;
+		std::array<std::uint8_t, SIZE> v;
+	};
+
+	template<typename Op>
+	inline Bytes Each(Bytes a, Bytes b, Op op)
+	{
+		Bytes out;
+		for (std::size_t i = 0; i < Bytes::SIZE; ++i)
+			out.v[i] = static_cast<std::uint8_t>(op(a.v[i], b.v[i]));
+		return out;
+	}
+
+	inline Bytes Load(const std::uint8_t* p) { Bytes a; std::copy(p, p + Bytes::SIZE, a.v.begin()); return a; }
+	inline void Store(std::uint8_t* p, Bytes a) { std::copy(a.v.begin(), a.v.end(), p); }
+	inline Bytes Splat(std::uint8_t x) { Bytes a; a.v.fill(x); return a; }
+	inline Bytes operator&(Bytes a, Bytes b) { return Each(a, b, [](unsigned x, unsigned y) { return x & y; }); }
+	inline Bytes operator|(Bytes a, Bytes b) { return Each(a, b, [](unsigned x, unsigned y) { return x | y; }); }
+	inline Bytes operator^(Bytes a, Bytes b) { return Each(a, b, [](unsigned x, unsigned y) { return x ^ y; }); }
+	inline Bytes operator+(Bytes a, Bytes b) { return Each(a, b, [](unsigned x, unsigned y) { return x + y; }); }
+	inline Bytes operator-(Bytes a, Bytes b) { return Each(a, b, [](unsigned x, unsigned y) { return x - y; }); }
+	inline Bytes AndNot(Bytes a, Bytes b) { return Each(a, b, [](unsigned x, unsigned y) { return ~x & y; }); }
+	inline Bytes Equal(Bytes a, Bytes b) { return Each(a, b, [](unsigned x, unsigned y) { return x == y ? 0xFF : 0x00; }); }
+	inline Bytes Negative(Bytes a) { return Each(a, a, [](unsigned x, unsigned) { return (x & 0x80) ? 0xFF : 0x00; }); }
+
+	template<int N>
+	inline Bytes ShiftRight(Bytes a) { return Each(a, a, [](unsigned x, unsigned) { return x >> N; }); }
+#endif
+
+	// mask ? a : b, lane by lane
+	inline Bytes Select(Bytes mask, Bytes a, Bytes b)
+	{
+		return (mask & a) | AndNot(mask, b);
+	}
+
+	// The carry out of every bit of a + b (+ carry in) = sum, so bit 7 is the
+	// carry out of the byte
+	inline Bytes Carries(Bytes a, Bytes b, Bytes sum)
+	{
+		return (a & b) | AndNot(sum, a | b);
+	}
+
+	// The borrow out of every bit of a - b (- borrow in) = difference
+	inline Bytes Borrows(Bytes a, Bytes b, Bytes difference)
+	{
+		return AndNot(a, b) | AndNot(a ^ b, difference);
+	}
+
+	// The same flags FlagTables holds, worked out for every lane at once
+	inline Bytes Sz(Bytes result)
+	{
+		return (result & Splat(Cpu::FLAG_S)) | (Equal(result, Splat(0)) & Splat(Cpu::FLAG_Z));
+	}
+
+	inline Bytes Szp(Bytes result)
+	{
+		Bytes parity = result ^ ShiftRight<4>(result);
+		parity = parity ^ ShiftRight<2>(parity);
+		parity = parity ^ ShiftRight<1>(parity);
+		return Sz(result) | (Equal(parity & Splat(1), Splat(0)) & Splat(Cpu::FLAG_PV));
+	}
+
+	struct AluResult
+	{
+		Bytes value;
+		Bytes flags;
+	};
+
+	inline AluResult Add8(Bytes lhs, Bytes rhs, Bytes carryIn)
+	{
+		const Bytes sum = lhs + rhs + carryIn;
+		const Bytes overflow = AndNot(lhs ^ rhs, lhs ^ sum);
+		return { sum, Sz(sum)
+			| ((lhs ^ rhs ^ sum) & Splat(Cpu::FLAG_H))
+			| (Negative(overflow) & Splat(Cpu::FLAG_PV))
+			| (Negative(Carries(lhs, rhs, sum)) & Splat(Cpu::FLAG_C)) };
+	}
+
+	inline AluResult Sub8(Bytes lhs, Bytes rhs, Bytes carryIn)
+	{
+		const Bytes difference = lhs - rhs - carryIn;
+		const Bytes overflow = (lhs ^ rhs) & (lhs ^ difference);
+		return { difference, Sz(difference) | Splat(Cpu::FLAG_N)
+			| ((lhs ^ rhs ^ difference) & Splat(Cpu::FLAG_H))
+			| (Negative(overflow) & Splat(Cpu::FLAG_PV))
+			| (Negative(Borrows(lhs, rhs, difference)) & Splat(Cpu::FLAG_C)) };
+	}
+
+	// Opcodes the vector group runs itself. The rest (ED, DAA, IN/OUT and
+	// the unimplemented ones) go to the scalar Cpus.
+	constexpr bool HasKernel(std::uint8_t op)
+	{
+		if (op >= 0x40 && op <= 0x9F)
+			return true;                                    // LD r,r' / HALT, ADD ADC SUB SBC A,r
+		if (op < 0x40)
+		{
+			switch (op & 0x0F)
+			{
+				case 0x01: case 0x03: case 0x09: case 0x0B:	// LD rr,nn  INC rr  ADD HL,rr  DEC rr
+				case 0x04: case 0x05: case 0x06:			// INC r  DEC r  LD r,n
+				case 0x0C: case 0x0D: case 0x0E:
+					return true;
+				default:
+					return op == 0x00 || op == 0x08 || op == 0x37;	// NOP, EX AF,AF', SCF
+			}
+		}
+		switch (op)
+		{
+			case 0xC1: case 0xD1: case 0xE1: case 0xF1:		// POP
+			case 0xC5: case 0xD5: case 0xE5: case 0xF5:		// PUSH
+			case 0xC6: case 0xE6: case 0xEE: case 0xF6: case 0xFE:	// ADD AND XOR OR CP n
+			case 0xD9:										// EXX
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	// Bytes in an instruction that has a kernel
+	constexpr std::uint16_t Length(std::uint8_t op)
+	{
+		if (op < 0x40 && (op & 0x0F) == 0x01)
+			return 3;                                       // LD rr,nn
+		if (op < 0x40 && (op & 0x07) == 0x06)
+			return 2;                                       // LD r,n
+		if (op >= 0xC0 && (op & 0x07) == 0x06)
+			return 2;                                       // ALU n
+		return 1;
+	}
+}
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::Connect(std::size_t lane, Bus* bus)
+{
+	bus_[lane] = bus;
+	scalar_[lane].Connect(bus);
+}
+
+template<std::size_t Lanes>
+Cpu::State LockstepCpu<Lanes>::GetState(std::size_t lane) const
+{
+	const auto pair = [&](std::uint8_t hi, std::uint8_t lo)
+	{
+		return static_cast<std::uint16_t>((regs_[hi][lane] << 8) | regs_[lo][lane]);
+	};
+
+	Cpu::State state;
+	state.af = pair(REG_A, REG_F);
+	state.bc = pair(REG_B, REG_C);
+	state.de = pair(REG_D, REG_E);
+	state.hl = pair(REG_H, REG_L);
+	state.afAlt = pair(ALT_BANK + REG_A, ALT_BANK + REG_F);
+	state.bcAlt = pair(ALT_BANK + REG_B, ALT_BANK + REG_C);
+	state.deAlt = pair(ALT_BANK + REG_D, ALT_BANK + REG_E);
+	state.hlAlt = pair(ALT_BANK + REG_H, ALT_BANK + REG_L);
+	state.pc = pc_[lane];
+	state.sp = sp_[lane];
+	state.ix = ix_[lane];
+	state.iy = iy_[lane];
+	state.i = i_[lane];
+	state.r = r_[lane];
+	state.halted = halted_[lane];
+	state.tstates = tstates_[lane];
+	return state;
+}
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::SetState(std::size_t lane, const Cpu::State& state)
+{
+	const auto pair = [&](std::uint8_t hi, std::uint8_t lo, std::uint16_t value)
+	{
+		regs_[hi][lane] = static_cast<std::uint8_t>(value >> 8);
+		regs_[lo][lane] = static_cast<std::uint8_t>(value);
+	};
+
+	pair(REG_A, REG_F, state.af);
+	pair(REG_B, REG_C, state.bc);
+	pair(REG_D, REG_E, state.de);
+	pair(REG_H, REG_L, state.hl);
+	pair(ALT_BANK + REG_A, ALT_BANK + REG_F, state.afAlt);
+	pair(ALT_BANK + REG_B, ALT_BANK + REG_C, state.bcAlt);
+	pair(ALT_BANK + REG_D, ALT_BANK + REG_E, state.deAlt);
+	pair(ALT_BANK + REG_H, ALT_BANK + REG_L, state.hlAlt);
+	pc_[lane] = state.pc;
+	sp_[lane] = state.sp;
+	ix_[lane] = state.ix;
+	iy_[lane] = state.iy;
+	i_[lane] = state.i;
+	r_[lane] = state.r;
+	halted_[lane] = state.halted;
+	tstates_[lane] = state.tstates;
+}
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::Execute(std::uint64_t instructions)
+{
+	std::array<std::uint8_t, Lanes> running{};
+	std::size_t runningCount = 0;
+	std::size_t idleCount = 0;
+
+	// Set while the last round ran every running lane as one vector group
+	// without halting any: they are all still at one PC, so only the opcode
+	// needs checking, and the group's T-states are added up once at the end
+	bool converged = false;
+	std::uint64_t groupTStates = 0;
+
+	const auto flushGroupTStates = [&]
+	{
+		EachInGroup([&](std::size_t lane) { tstates_[lane] += groupTStates; });
+		groupTStates = 0;
+	};
+
+	for (; instructions != 0; --instructions)
+	{
+		std::uint8_t op = 0;
+		if (converged)
+		{
+			const std::uint16_t pc = pc_[group_[0]];
+			op = bus_[group_[0]]->Read(pc);
+			bool same = true;
+			EachInGroup([&](std::size_t lane) { same &= bus_[lane]->Read(pc) == op; });
+			converged = same;
+		}
+
+		if (!converged)
+		{
+			flushGroupTStates();
+
+			// The per-lane loops are branch-free so they vectorise as well
+			runningCount = 0;
+			idleCount = 0;
+			for (std::size_t lane = 0; lane < Lanes; ++lane)
+			{
+				const bool connected = bus_[lane] != nullptr;
+				running[lane] = connected & !halted_[lane];
+				runningCount += running[lane];
+				idleCount += connected & halted_[lane];
+			}
+			if (runningCount == 0)
+				break;
+
+			op = FormGroup(running, runningCount);
+		}
+
+		// Halted lanes idle through the round
+		if (idleCount != 0)
+		{
+			for (std::size_t lane = 0; lane < Lanes; ++lane)
+				tstates_[lane] += (bus_[lane] != nullptr && halted_[lane]) ? 4 : 0;
+		}
+
+		const Kernel kernel = kernels_[op];
+		if (kernel == nullptr)
+		{
+			// Every running lane, the group included, takes the scalar path
+			converged = false;
+			flushGroupTStates();
+			for (std::size_t lane = 0; lane < Lanes; ++lane)
+			{
+				if (running[lane])
+					StepScalar(lane);
+			}
+			continue;
+		}
+
+		(this->*kernel)();
+		const std::uint16_t length = Length(op);
+		for (std::size_t lane = 0; lane < Lanes; ++lane)
+			pc_[lane] = static_cast<std::uint16_t>(pc_[lane] + (mask_[lane] & length));
+		groupTStates += Cpu::OP_TSTATES[op];
+		vectorSteps_ += groupSize_;
+
+		converged = groupSize_ == runningCount && op != 0x76;
+		if (converged)
+			continue;
+
+		flushGroupTStates();
+		for (std::size_t lane = 0; lane < Lanes; ++lane)
+		{
+			if (running[lane] && mask_[lane] == 0)
+				StepScalar(lane);
+		}
+	}
+
+	flushGroupTStates();
+
+	// Every connected lane is halted: the rest is idle NOPs
+	for (std::size_t lane = 0; lane < Lanes; ++lane)
+	{
+		if (bus_[lane] != nullptr)
+			tstates_[lane] += 4 * instructions;
+	}
+}
+
+template<std::size_t Lanes>
+std::uint8_t LockstepCpu<Lanes>::FormGroup(const std::array<std::uint8_t, Lanes>& running, std::size_t runningCount)
+{
+	std::size_t lead = 0;
+	while (!running[lead])
+		++lead;
+
+	// Lanes running the same program nearly always sit at one PC, so check
+	// for that before searching for the most common one
+	std::uint16_t pc = pc_[lead];
+	std::size_t together = 0;
+	for (std::size_t lane = 0; lane < Lanes; ++lane)
+		together += running[lane] & (pc_[lane] == pc);
+
+	if (together != runningCount)
+	{
+		std::array<bool, Lanes> counted{};
+		std::size_t uncounted = runningCount;
+		std::size_t best = 0;
+		for (std::size_t lane = lead; lane < Lanes && uncounted > best; ++lane)
+		{
+			if (!running[lane] || counted[lane])
+				continue;
+
+			std::size_t count = 0;
+			for (std::size_t other = lane; other < Lanes; ++other)
+			{
+				if (running[other] && pc_[other] == pc_[lane])
+				{
+					counted[other] = true;
+					++count;
+				}
+			}
+			uncounted -= count;
+			if (count > best)
+			{
+				best = count;
+				pc = pc_[lane];
+			}
+		}
+	}
+
+	// Lanes have their own memory, so the opcode at that PC can still differ
+	mask_.fill(0);
+	groupSize_ = 0;
+	std::uint8_t op = 0;
+	for (std::size_t lane = lead; lane < Lanes; ++lane)
+	{
+		if (!running[lane] || pc_[lane] != pc)
+			continue;
+
+		const std::uint8_t laneOp = bus_[lane]->Read(pc);
+		if (groupSize_ == 0)
+			op = laneOp;
+		if (laneOp != op)
+			continue;
+
+		mask_[lane] = 0xFF;
+		group_[groupSize_++] = static_cast<std::uint8_t>(lane);
+	}
+	return op;
+}
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::StepScalar(std::size_t lane)
+{
+	Cpu& cpu = scalar_[lane];
+	cpu.SetState(GetState(lane));
+	cpu.Step();
+	SetState(lane, cpu.GetState());
+	++scalarSteps_;
+}
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::GatherOperands(std::size_t count)
+{
+	EachInGroup([&](std::size_t lane)
+	{
+		const Bus& bus = *bus_[lane];
+		operand0_[lane] = bus.Read(static_cast<std::uint16_t>(pc_[lane] + 1));
+		if (count > 1)
+			operand1_[lane] = bus.Read(static_cast<std::uint16_t>(pc_[lane] + 2));
+	});
+}
+
+// **********************************************
+// *                  KERNELS                   *
+// **********************************************
+// Each one works through the lanes a vector at a time and blends its
+// results in under mask_, so lanes outside the group keep their values.
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::ExecLoad(std::uint8_t r, const std::uint8_t* from)
+{
+	std::uint8_t* to = Reg(r);
+	for (std::size_t at = 0; at < Lanes; at += Bytes::SIZE)
+		Store(to + at, Select(Load(mask_.data() + at), Load(from + at), Load(to + at)));
+}
+
+template<std::size_t Lanes>
+template<bool Inc>
+void LockstepCpu<Lanes>::ExecIncDec(std::uint8_t* value)
+{
+	// S Z H P/V from the result, N set for DEC, C unchanged
+	std::uint8_t* f = Reg(REG_F);
+	for (std::size_t at = 0; at < Lanes; at += Bytes::SIZE)
+	{
+		const Bytes mask = Load(mask_.data() + at);
+		const Bytes before = Load(value + at);
+		const Bytes flags = Load(f + at);
+
+		Bytes after;
+		Bytes newFlags = flags & Splat(Cpu::FLAG_C);
+		if constexpr (Inc)
+		{
+			after = before + Splat(1);
+			newFlags = newFlags | (Equal(after & Splat(0x0F), Splat(0x00)) & Splat(Cpu::FLAG_H))
+				| (Equal(after, Splat(0x80)) & Splat(Cpu::FLAG_PV));
+		}
+		else
+		{
+			after = before - Splat(1);
+			newFlags = newFlags | Splat(Cpu::FLAG_N) | (Equal(before & Splat(0x0F), Splat(0x00)) & Splat(Cpu::FLAG_H))
+				| (Equal(before, Splat(0x80)) & Splat(Cpu::FLAG_PV));
+		}
+
+		Store(value + at, Select(mask, after, before));
+		Store(f + at, Select(mask, newFlags | Sz(after), flags));
+	}
+}
+
+template<std::size_t Lanes>
+template<bool Inc>
+void LockstepCpu<Lanes>::ExecIncDecPair(std::uint8_t hi, std::uint8_t lo)
+{
+	// Equal() is 0xFF (-1) where the low byte carried or borrowed
+	for (std::size_t at = 0; at < Lanes; at += Bytes::SIZE)
+	{
+		const Bytes mask = Load(mask_.data() + at);
+		const Bytes low = Load(Reg(lo) + at);
+		const Bytes high = Load(Reg(hi) + at);
+
+		const Bytes newLow = Inc ? low + Splat(1) : low - Splat(1);
+		const Bytes newHigh = Inc ? high - Equal(newLow, Splat(0x00)) : high + Equal(low, Splat(0x00));
+
+		Store(Reg(lo) + at, Select(mask, newLow, low));
+		Store(Reg(hi) + at, Select(mask, newHigh, high));
+	}
+}
+
+template<std::size_t Lanes>
+template<std::uint8_t Kind>
+void LockstepCpu<Lanes>::ExecAlu(const std::uint8_t* rhs)
+{
+	// Kind is bits 3-5 of the opcode: ADD ADC SUB SBC AND XOR OR CP
+	std::uint8_t* a = Reg(REG_A);
+	std::uint8_t* f = Reg(REG_F);
+	for (std::size_t at = 0; at < Lanes; at += Bytes::SIZE)
+	{
+		const Bytes mask = Load(mask_.data() + at);
+		const Bytes lhs = Load(a + at);
+		const Bytes value = Load(rhs + at);
+		const Bytes flags = Load(f + at);
+		const Bytes carry = (Kind == 1 || Kind == 3) ? flags & Splat(Cpu::FLAG_C) : Splat(0);
+
+		AluResult result;
+		if constexpr (Kind == 0 || Kind == 1)
+			result = Add8(lhs, value, carry);
+		else if constexpr (Kind == 2 || Kind == 3)
+			result = Sub8(lhs, value, carry);
+		else if constexpr (Kind == 4)
+			result = { lhs & value, Szp(lhs & value) | Splat(Cpu::FLAG_H) };
+		else if constexpr (Kind == 5)
+			result = { lhs ^ value, Szp(lhs ^ value) };
+		else if constexpr (Kind == 6)
+			result = { lhs | value, Szp(lhs | value) };
+		else
+			result = { lhs, Sub8(lhs, value, carry).flags };
+
+		Store(a + at, Select(mask, result.value, lhs));
+		Store(f + at, Select(mask, result.flags, flags));
+	}
+}
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::ExecAddHl(const std::uint8_t* hi, const std::uint8_t* lo)
+{
+	// H from bit 11, C from bit 15, N reset; every other bit of F unchanged
+	std::uint8_t* h = Reg(REG_H);
+	std::uint8_t* l = Reg(REG_L);
+	std::uint8_t* f = Reg(REG_F);
+	for (std::size_t at = 0; at < Lanes; at += Bytes::SIZE)
+	{
+		const Bytes mask = Load(mask_.data() + at);
+		const Bytes lhsLow = Load(l + at);
+		const Bytes lhsHigh = Load(h + at);
+		const Bytes rhsLow = Load(lo + at);
+		const Bytes rhsHigh = Load(hi + at);
+		const Bytes flags = Load(f + at);
+
+		const Bytes low = lhsLow + rhsLow;
+		const Bytes carry = Negative(Carries(lhsLow, rhsLow, low)) & Splat(1);
+		const Bytes high = lhsHigh + rhsHigh + carry;
+
+		const Bytes newFlags = (flags & Splat(static_cast<std::uint8_t>(~(Cpu::FLAG_H | Cpu::FLAG_N | Cpu::FLAG_C))))
+			| ((lhsHigh ^ rhsHigh ^ high) & Splat(Cpu::FLAG_H))
+			| (Negative(Carries(lhsHigh, rhsHigh, high)) & Splat(Cpu::FLAG_C));
+
+		Store(l + at, Select(mask, low, lhsLow));
+		Store(h + at, Select(mask, high, lhsHigh));
+		Store(f + at, Select(mask, newFlags, flags));
+	}
+}
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::ExecScf()
+{
+	std::uint8_t* f = Reg(REG_F);
+	for (std::size_t at = 0; at < Lanes; at += Bytes::SIZE)
+	{
+		const Bytes flags = Load(f + at);
+		const Bytes newFlags = (flags & Splat(static_cast<std::uint8_t>(~(Cpu::FLAG_H | Cpu::FLAG_N)))) | Splat(Cpu::FLAG_C);
+		Store(f + at, Select(Load(mask_.data() + at), newFlags, flags));
+	}
+}
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::ExecSwap(std::uint8_t first, std::uint8_t count)
+{
+	for (std::uint8_t r = first; r < first + count; ++r)
+	{
+		for (std::size_t at = 0; at < Lanes; at += Bytes::SIZE)
+		{
+			const Bytes mask = Load(mask_.data() + at);
+			const Bytes live = Load(Reg(r) + at);
+			const Bytes alt = Load(Reg(ALT_BANK + r) + at);
+			Store(Reg(r) + at, Select(mask, alt, live));
+			Store(Reg(ALT_BANK + r) + at, Select(mask, live, alt));
+		}
+	}
+}
+
+// The stack is per lane memory, so PUSH and POP go one lane at a time
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::ExecPush(std::uint8_t hi, std::uint8_t lo)
+{
+	EachInGroup([&](std::size_t lane)
+	{
+		Bus& bus = *bus_[lane];
+		sp_[lane] = static_cast<std::uint16_t>(sp_[lane] - 1);
+		bus.Write(sp_[lane], regs_[hi][lane]);
+		sp_[lane] = static_cast<std::uint16_t>(sp_[lane] - 1);
+		bus.Write(sp_[lane], regs_[lo][lane]);
+	});
+}
+
+template<std::size_t Lanes>
+void LockstepCpu<Lanes>::ExecPop(std::uint8_t hi, std::uint8_t lo)
+{
+	EachInGroup([&](std::size_t lane)
+	{
+		const Bus& bus = *bus_[lane];
+		regs_[lo][lane] = bus.Read(sp_[lane]);
+		sp_[lane] = static_cast<std::uint16_t>(sp_[lane] + 1);
+		regs_[hi][lane] = bus.Read(sp_[lane]);
+		sp_[lane] = static_cast<std::uint16_t>(sp_[lane] + 1);
+	});
+}
+
+// The vector group's version of Cpu::Exec<Op>, for the opcodes HasKernel()
+// takes. Kept in the same order. The PC and T-states are moved on by Execute().
+template<std::size_t Lanes>
+template<std::uint8_t Op>
+void LockstepCpu<Lanes>::Exec()
+{
+	constexpr std::uint8_t dst = (Op >> 3) & 0x07;
+	constexpr std::uint8_t src = Op & 0x07;
+	constexpr std::uint8_t pair = (Op >> 4) & 0x03;           // BC DE HL SP/AF
+	constexpr std::uint8_t hi = 2 * pair;
+	constexpr std::uint8_t lo = 2 * pair + 1;
+
+	if constexpr (Op == 0x00) {}											// NOP
+	else if constexpr (Op == 0x08) ExecSwap(REG_F, 2);						// EX AF,AF'
+	else if constexpr (Op == 0x37) ExecScf();								// SCF
+	else if constexpr (Op == 0x31)											// LD SP,nn
+	{
+		GatherOperands(2);
+		EachInGroup([&](std::size_t lane) { sp_[lane] = static_cast<std::uint16_t>((operand1_[lane] << 8) | operand0_[lane]); });
+	}
+	else if constexpr (Op == 0x33) EachInGroup([&](std::size_t lane) { ++sp_[lane]; });	// INC SP
+	else if constexpr (Op == 0x3B) EachInGroup([&](std::size_t lane) { --sp_[lane]; });	// DEC SP
+	else if constexpr (Op == 0x39)											// ADD HL,SP
+	{
+		EachInGroup([&](std::size_t lane)
+		{
+			scratchHi_[lane] = static_cast<std::uint8_t>(sp_[lane] >> 8);
+			scratchLo_[lane] = static_cast<std::uint8_t>(sp_[lane]);
+		});
+		ExecAddHl(scratchHi_.data(), scratchLo_.data());
+	}
+	else if constexpr (Op < 0x40 && (Op & 0x0F) == 0x01)					// LD rr,nn
+	{
+		GatherOperands(2);
+		ExecLoad(lo, operand0_.data());
+		ExecLoad(hi, operand1_.data());
+	}
+	else if constexpr (Op < 0x40 && (Op & 0x0F) == 0x03) ExecIncDecPair<true>(hi, lo);	// INC rr
+	else if constexpr (Op < 0x40 && (Op & 0x0F) == 0x0B) ExecIncDecPair<false>(hi, lo);	// DEC rr
+	else if constexpr (Op < 0x40 && (Op & 0x0F) == 0x09) ExecAddHl(Reg(hi), Reg(lo));	// ADD HL,rr
+	else if constexpr (Op < 0x40 && (src == 0x04 || src == 0x05))			// INC r / DEC r
+	{
+		if constexpr (dst == 6)
+		{
+			// INC (HL) / DEC (HL)
+			EachInGroup([&](std::size_t lane) { scratchLo_[lane] = bus_[lane]->Read(Hl(lane)); });
+			ExecIncDec<src == 0x04>(scratchLo_.data());
+			EachInGroup([&](std::size_t lane) { bus_[lane]->Write(Hl(lane), scratchLo_[lane]); });
+		}
+		else
+		{
+			ExecIncDec<src == 0x04>(Reg(dst));
+		}
+	}
+	else if constexpr (Op < 0x40 && src == 0x06)							// LD r,n
+	{
+		GatherOperands(1);
+		if constexpr (dst == 6)
+			EachInGroup([&](std::size_t lane) { bus_[lane]->Write(Hl(lane), operand0_[lane]); });
+		else
+			ExecLoad(dst, operand0_.data());
+	}
+	else if constexpr (Op == 0x76) EachInGroup([&](std::size_t lane) { halted_[lane] = true; });	// HALT
+	else if constexpr (Op >= 0x40 && Op <= 0x7F)							// LD r,r'
+	{
+		if constexpr (src == 6)
+			EachInGroup([&](std::size_t lane) { regs_[dst][lane] = bus_[lane]->Read(Hl(lane)); });
+		else if constexpr (dst == 6)
+			EachInGroup([&](std::size_t lane) { bus_[lane]->Write(Hl(lane), regs_[src][lane]); });
+		else
+			ExecLoad(dst, Reg(src));
+	}
+	else if constexpr (Op >= 0x80 && Op <= 0x9F)							// ADD ADC SUB SBC A,r
+	{
+		// The Cpu has no (HL) forms of these yet and runs them as NOPs
+		if constexpr (src != 6)
+			ExecAlu<dst>(Reg(src));
+	}
+	else if constexpr (Op == 0xD9) ExecSwap(REG_B, 6);						// EXX
+	else if constexpr (Op >= 0xC0 && (Op & 0x0F) == 0x01) ExecPop(pair == 3 ? REG_A : hi, pair == 3 ? REG_F : lo);	// POP rr
+	else if constexpr (Op >= 0xC0 && (Op & 0x0F) == 0x05) ExecPush(pair == 3 ? REG_A : hi, pair == 3 ? REG_F : lo);	// PUSH rr
+	else if constexpr (Op >= 0xC0 && src == 0x06)							// ADD AND XOR OR CP n
+	{
+		GatherOperands(1);
+		ExecAlu<dst>(operand0_.data());
+	}
+}
+
+template<std::size_t Lanes>
+template<std::size_t... Ops>
+constexpr std::array<typename LockstepCpu<Lanes>::Kernel, 256> LockstepCpu<Lanes>::BuildKernelTable(std::index_sequence<Ops...>)
+{
+	return { (HasKernel(static_cast<std::uint8_t>(Ops)) ? &LockstepCpu::Exec<static_cast<std::uint8_t>(Ops)> : nullptr)... };
+}
+
+template<std::size_t Lanes>
+constexpr std::array<typename LockstepCpu<Lanes>::Kernel, 256> LockstepCpu<Lanes>::kernels_ =
+	LockstepCpu<Lanes>::BuildKernelTable(std::make_index_sequence<256>{});
+
+template class LockstepCpu<8>;
+template class LockstepCpu<16>;
+template class LockstepCpu<32>;
@@ -0,0 +1,153 @@
+#include "LzCodec.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace
+{
+    constexpr std::size_t MIN_MATCH = 4;
+    constexpr std::size_t MAX_OFFSET = 0xFFFF;
+    constexpr unsigned HASH_BITS = 12;
+
+    std::uint32_t Load32(const std::uint8_t* p)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    std::uint32_t Hash(std::uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // The part of a count that did not fit its nibble
+    void PutCount(std::vector<std::uint8_t>& out, std::size_t count)
+    {
+        for (; count >= 255; count -= 255)
+            out.push_back(255);
+        out.push_back(static_cast<std::uint8_t>(count));
+    }
+
+    void PutSequence(std::vector<std::uint8_t>& out, std::span<const std::uint8_t> literals, std::size_t offset, std::size_t length)
+    {
+        const std::size_t extra = length - MIN_MATCH;
+        out.push_back(static_cast<std::uint8_t>((std::min<std::size_t>(literals.size(), 15) << 4) | std::min<std::size_t>(extra, 15)));
+        if (literals.size() >= 15)
+            PutCount(out, literals.size() - 15);
+        out.insert(out.end(), literals.begin(), literals.end());
+        out.push_back(static_cast<std::uint8_t>(offset));
+        out.push_back(static_cast<std::uint8_t>(offset >> 8));
+        if (extra >= 15)
+            PutCount(out, extra - 15);
+    }
+
+    void PutLastLiterals(std::vector<std::uint8_t>& out, std::span<const std::uint8_t> literals)
+    {
+        out.push_back(static_cast<std::uint8_t>(std::min<std::size_t>(literals.size(), 15) << 4));
+        if (literals.size() >= 15)
+            PutCount(out, literals.size() - 15);
+        out.insert(out.end(), literals.begin(), literals.end());
+    }
+
+    bool GetCount(std::span<const std::uint8_t> in, std::size_t& pos, std::size_t& count)
+    {
+        std::uint8_t more = 255;
+        while (more == 255)
+        {
+            if (pos >= in.size())
+                return false;
+            more = in[pos++];
+            count += more;
+        }
+        return true;
+    }
+}
+
+void LzCodec::Compress(std::span<const std::uint8_t> in, std::vector<std::uint8_t>& out)
+{
+    // Positions + 1, so 0 means empty
+    std::array<std::uint32_t, std::size_t{1} << HASH_BITS> table{};
+
+    std::size_t anchor = 0;
+    std::size_t pos = 0;
+    while (pos + MIN_MATCH <= in.size())
+    {
+        const std::uint32_t sequence = Load32(in.data() + pos);
+        std::uint32_t& slot = table[Hash(sequence)];
+        const std::size_t candidate = slot;
+        slot = static_cast<std::uint32_t>(pos + 1);
+
+        if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || Load32(in.data() + candidate - 1) != sequence)
+        {
+            ++pos;
+            continue;
+        }
+
+        const std::size_t match = candidate - 1;
+        std::size_t length = MIN_MATCH;
+        while (pos + length < in.size() && in[match + length] == in[pos + length])
+            ++length;
+
+        PutSequence(out, in.subspan(anchor, pos - anchor), pos - match, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    PutLastLiterals(out, in.subspan(anchor));
+}
+
+bool LzCodec::Decompress(std::span<const std::uint8_t> in, std::span<std::uint8_t> out)
+{
+    std::size_t ip = 0;
+    std::size_t op = 0;
+
+    while (ip < in.size())
+    {
+        const std::uint8_t token = in[ip++];
+
+        std::size_t literals = token >> 4;
+        if (literals == 15 && !GetCount(in, ip, literals))
+            return false;
+        if (literals > in.size() - ip || literals > out.size() - op)
+            return false;
+        std::memcpy(out.data() + op, in.data() + ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == in.size())
+            break;                          // the last sequence has no match
+
+        if (in.size() - ip < 2)
+            return false;
+        const std::size_t offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op)
+            return false;
+
+        std::size_t length = (token & 0x0F) + MIN_MATCH;
+        if ((token & 0x0F) == 15 && !GetCount(in, ip, length))
+            return false;
+        if (length > out.size() - op)
+            return false;
+
+        // A match may overlap what it is producing (a run of one byte has
+        // offset 1). Copying `offset` bytes at a time never overlaps.
+        std::uint8_t* dst = out.data() + op;
+        op += length;
+        if (offset == 1)
+            std::memset(dst, dst[-1], length);
+        else
+        {
+            while (length != 0)
+            {
+                const std::size_t chunk = std::min(offset, length);
+                std::memcpy(dst, dst - offset, chunk);
+                dst += chunk;
+                length -= chunk;
+            }
+        }
+    }
+
+    return op == out.size();
+}
@@ -0,0 +1,43 @@
+#include "Machine.h"
+
+#include <bit>
+#include <vector>
+
+Machine::Machine()
+    : Machine(std::make_unique<Bus>())
+{
+    cpu_.Reset();
+}
+
+Machine::Machine(std::unique_ptr<Bus> bus)
+    : bus_(std::move(bus))
+{
+    cpu_.Connect(bus_.get());
+}
+
+std::uint64_t Machine::Fingerprint() const
+{
+#if defined(Z80EMU_PAGE_HASH)
+    std::uint64_t hash = bus_->RamHash();
+#else
+    std::vector<std::uint8_t> ram(Bus::RAM_SIZE);
+    bus_->ReadRam(0, ram);
+    std::uint64_t hash = Bus::HashRun(0, ram);
+#endif
+
+    const Cpu::State s = cpu_.GetState();
+    const std::uint64_t fields[] = {
+        s.af, s.bc, s.de, s.hl, s.afAlt, s.bcAlt, s.deAlt, s.hlAlt,
+        s.pc, s.sp, s.ix, s.iy, s.i, s.r, s.halted ? 1u : 0u, s.tstates,
+    };
+    for (std::uint64_t field : fields)
+        hash = std::rotl((hash ^ field) * 0x9E3779B97F4A7C15ull, 29);
+    return hash;
+}
+
+std::unique_ptr<Machine> Machine::Fork()
+{
+    std::unique_ptr<Machine> child(new Machine(bus_->Fork()));
+    child->cpu_.SetState(cpu_.GetState());
+    return child;
+}
@@ -0,0 +1,172 @@
+#include "MachinePool.h"
+#include <algorithm>
+
+MachinePool::MachinePool(std::size_t threads, std::uint64_t slice)
+    : slice_(std::max<std::uint64_t>(slice, 1))
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (std::size_t i = 0; i < threads; ++i)
+        workers_.push_back(std::make_unique<Worker>());
+    for (std::size_t i = 0; i < threads; ++i)
+        workers_[i]->thread = std::thread(&MachinePool::Work, this, i);
+}
+
+MachinePool::~MachinePool()
+{
+    Wait();
+    {
+        std::lock_guard lock(idleMutex_);
+        stopping_ = true;
+    }
+    idle_.notify_all();
+    for (auto& worker : workers_)
+        worker->thread.join();
+}
+
+std::size_t MachinePool::Add(std::unique_ptr<Machine> machine)
+{
+    std::lock_guard lock(machinesMutex_);
+    machines_.push_back(std::move(machine));
+    return machines_.size() - 1;
+}
+
+Machine& MachinePool::GetMachine(std::size_t id)
+{
+    std::lock_guard lock(machinesMutex_);
+    return *machines_[id];
+}
+
+std::size_t MachinePool::Size() const
+{
+    std::lock_guard lock(machinesMutex_);
+    return machines_.size();
+}
+
+std::future<MachineRun> MachinePool::Run(std::size_t id, std::uint64_t tstates, Completion done)
+{
+    Task task;
+    task.machine = &GetMachine(id);
+    task.remaining = tstates;
+    task.run.id = id;
+    task.done = std::move(done);
+    std::future<MachineRun> result = task.promise.get_future();
+
+    {
+        std::lock_guard lock(doneMutex_);
+        ++outstanding_;
+    }
+    // New runs are dealt round-robin; stealing evens out the rest
+    Push(nextWorker_++ % workers_.size(), std::move(task), false);
+    return result;
+}
+
+void MachinePool::RunAll(std::uint64_t tstates, const Completion& done)
+{
+    const std::size_t count = Size();
+    for (std::size_t id = 0; id < count; ++id)
+        Run(id, tstates, done);
+}
+
+void MachinePool::Wait()
+{
+    std::unique_lock lock(doneMutex_);
+    done_.wait(lock, [this] { return outstanding_ == 0; });
+}
+
+void MachinePool::Push(std::size_t worker, Task task, bool front)
+{
+    std::size_t waiting = 0;
+    {
+        std::lock_guard lock(workers_[worker]->mutex);
+        if (front)
+            workers_[worker]->tasks.push_front(std::move(task));
+        else
+            workers_[worker]->tasks.push_back(std::move(task));
+        waiting = workers_[worker]->tasks.size();
+    }
+    ++queued_;
+
+    // A worker requeueing its only task can run it itself; anything more is
+    // worth waking a sleeper for. The lock orders this against a worker that
+    // has checked queued_ and is about to wait.
+    if (sleeping_ != 0 && (!front || waiting > 1))
+    {
+        std::lock_guard lock(idleMutex_);
+        idle_.notify_one();
+    }
+}
+
+bool MachinePool::Pop(std::size_t worker, Task& task)
+{
+    std::lock_guard lock(workers_[worker]->mutex);
+    if (workers_[worker]->tasks.empty())
+        return false;
+    task = std::move(workers_[worker]->tasks.back());
+    workers_[worker]->tasks.pop_back();
+    --queued_;
+    return true;
+}
+
+bool MachinePool::Steal(std::size_t thief, Task& task)
+{
+    for (std::size_t i = 1; i < workers_.size(); ++i)
+    {
+        Worker& victim = *workers_[(thief + i) % workers_.size()];
+        std::lock_guard lock(victim.mutex);
+        if (victim.tasks.empty())
+            continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        --queued_;
+        return true;
+    }
+    return false;
+}
+
+void MachinePool::Work(std::size_t self)
+{
+    for (;;)
+    {
+        Task task;
+        if (Pop(self, task) || Steal(self, task))
+        {
+            RunSlice(self, task);
+            continue;
+        }
+
+        std::unique_lock lock(idleMutex_);
+        ++sleeping_;
+        idle_.wait(lock, [this] { return stopping_ || queued_ != 0; });
+        --sleeping_;
+        if (stopping_)
+            return;
+    }
+}
+
+void MachinePool::RunSlice(std::size_t self, Task& task)
+{
+    Cpu& cpu = task.machine->GetCpu();
+    const std::uint64_t budget = std::min(slice_, task.remaining);
+    const std::uint64_t cycles = cpu.Run(budget);
+    task.run.tstates += cycles;
+    task.remaining -= std::min(cycles, task.remaining);
+
+    if (task.remaining != 0 && !cpu.is_halted())
+    {
+        // To the front, behind the worker's other machines and first in
+        // line for a thief
+        Push(self, std::move(task), true);
+        return;
+    }
+
+    task.run.halted = cpu.is_halted();
+    if (task.done)
+        task.done(*task.machine, task.run);
+    task.promise.set_value(task.run);
+
+    std::lock_guard lock(doneMutex_);
+    if (--outstanding_ == 0)
+        done_.notify_all();
+}
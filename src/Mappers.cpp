@@ -0,0 +1,176 @@
+#include "Mappers.h"
+#include <algorithm>
+
+namespace
+{
+    constexpr std::size_t PagesFor(std::size_t bytes) { return bytes >> Bus::MAP_PAGE_SHIFT; }
+    constexpr std::size_t PageOf(std::size_t address) { return address >> Bus::MAP_PAGE_SHIFT; }
+}
+
+// ---- Spectrum 128 ----
+
+Spectrum128Mapper::Spectrum128Mapper(std::size_t romBanks)
+    : romBanks_(romBanks),
+      store_((romBanks + RAM_BANKS) * BANK_SIZE, 0)
+{
+}
+
+void Spectrum128Mapper::Attach(Bus& bus)
+{
+    bus_ = &bus;
+    bus.AttachPorts(this);
+    Reset();
+}
+
+void Spectrum128Mapper::Reset()
+{
+    port7FFD_ = 0;
+    slots_.fill(nullptr);
+    Remap();
+}
+
+void Spectrum128Mapper::MapSlot(std::size_t slot, std::uint8_t* bank, bool rom)
+{
+    if (bus_ == nullptr || slots_[slot] == bank)
+        return;
+
+    slots_[slot] = bank;
+    if (rom)
+        bus_->MapRom(PageOf(slot * BANK_SIZE), PagesFor(BANK_SIZE), bank);
+    else
+        bus_->MapRam(PageOf(slot * BANK_SIZE), PagesFor(BANK_SIZE), bank);
+}
+
+void Spectrum128Mapper::Remap()
+{
+    MapSlot(0, Rom((port7FFD_ >> 4) & 0x01), true);
+    MapSlot(1, Ram(5), false);
+    MapSlot(2, Ram(2), false);
+    MapSlot(3, Ram(port7FFD_ & 0x07), false);
+}
+
+void Spectrum128Mapper::Out(std::uint16_t port, std::uint8_t value)
+{
+    if ((port & 0x8002) != 0 || IsLocked())
+        return;
+
+    port7FFD_ = value;
+    Remap();
+}
+
+// ---- Spectrum +2A/+3 ----
+
+void SpectrumPlus3Mapper::Reset()
+{
+    port1FFD_ = 0;
+    Spectrum128Mapper::Reset();
+}
+
+void SpectrumPlus3Mapper::Out(std::uint16_t port, std::uint8_t value)
+{
+    if (IsLocked())
+        return;
+
+    if ((port & 0xC002) == 0x4000)
+        port7FFD_ = value;
+    else if ((port & 0xF002) == 0x1000)
+        port1FFD_ = value;
+    else
+        return;
+
+    Remap();
+}
+
+void SpectrumPlus3Mapper::Remap()
+{
+    if ((port1FFD_ & 0x01) != 0)
+    {
+        // Special paging: four all-RAM layouts
+        static constexpr std::uint8_t LAYOUTS[4][4] = {
+            { 0, 1, 2, 3 },
+            { 4, 5, 6, 7 },
+            { 4, 5, 6, 3 },
+            { 4, 7, 6, 3 },
+        };
+        const std::uint8_t* layout = LAYOUTS[(port1FFD_ >> 1) & 0x03];
+        for (std::size_t slot = 0; slot < 4; ++slot)
+            MapSlot(slot, Ram(layout[slot]), false);
+        return;
+    }
+
+    const std::size_t rom = ((port1FFD_ >> 1) & 0x02) | ((port7FFD_ >> 4) & 0x01);
+    MapSlot(0, Rom(rom), true);
+    MapSlot(1, Ram(5), false);
+    MapSlot(2, Ram(2), false);
+    MapSlot(3, Ram(port7FFD_ & 0x07), false);
+}
+
+// ---- MSX ASCII8 / ASCII16 ----
+
+MsxAsciiMapper::MsxAsciiMapper(std::vector<std::uint8_t> rom, std::size_t bankSize)
+    : rom_(std::move(rom)),
+      bankSize_(bankSize)
+{
+    const std::size_t banks = std::max<std::size_t>(1, (rom_.size() + bankSize_ - 1) / bankSize_);
+    rom_.resize(banks * bankSize_, 0xFF);
+}
+
+void MsxAsciiMapper::Attach(Bus& bus)
+{
+    bus_ = &bus;
+    Reset();
+}
+
+void MsxAsciiMapper::Reset()
+{
+    banks_.fill(0);
+    for (std::size_t slot = 0; slot < SlotCount(); ++slot)
+        MapSlot(slot);
+}
+
+void MsxAsciiMapper::MapSlot(std::size_t slot)
+{
+    if (bus_ == nullptr)
+        return;
+
+    // Reads come straight from the image; writes come here for the registers
+    bus_->MapRom(PageOf(CARTRIDGE_START + slot * bankSize_), PagesFor(bankSize_), &rom_[banks_[slot] * bankSize_], this);
+}
+
+// Only reached if the Bus is asked to read through the device pointer
+std::uint8_t MsxAsciiMapper::Read(std::uint16_t address)
+{
+    const std::size_t offset = static_cast<std::size_t>(address - CARTRIDGE_START) & (CARTRIDGE_SIZE - 1);
+    const std::size_t slot = offset / bankSize_;
+    return rom_[banks_[slot] * bankSize_ + offset % bankSize_];
+}
+
+void MsxAsciiMapper::Write(std::uint16_t address, std::uint8_t value)
+{
+    const int slot = SlotForWrite(address);
+    if (slot < 0)
+        return;
+
+    const std::size_t bank = value % BankCount();
+    if (banks_[static_cast<std::size_t>(slot)] == bank)
+        return;
+
+    banks_[static_cast<std::size_t>(slot)] = bank;
+    MapSlot(static_cast<std::size_t>(slot));
+}
+
+int MsxAscii8Mapper::SlotForWrite(std::uint16_t address) const
+{
+    if (address < 0x6000 || address >= 0x8000)
+        return -1;
+    return (address >> 11) & 0x03;
+}
+
+int MsxAscii16Mapper::SlotForWrite(std::uint16_t address) const
+{
+    if (address >= 0x6000 && address < 0x6800)
+        return 0;
+    if (address >= 0x7000 && address < 0x7800)
+        return 1;
+    return -1;
+}
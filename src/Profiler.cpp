@@ -0,0 +1,127 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+namespace
+{
+    constexpr std::size_t PC_COUNT = 0x10000;
+
+    // One line of a top-N list
+    struct Entry
+    {
+        std::string name;
+        std::uint64_t count = 0;
+    };
+
+    std::string Hex(unsigned value, int digits)
+    {
+        char buffer[8];
+        std::snprintf(buffer, sizeof(buffer), "%0*X", digits, value);
+        return buffer;
+    }
+
+    void WriteTop(std::ostream& out, const char* title, std::vector<Entry> entries, std::uint64_t total, std::size_t top)
+    {
+        const std::size_t shown = std::min(top, entries.size());
+        std::partial_sort(entries.begin(), entries.begin() + static_cast<std::ptrdiff_t>(shown), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.count > b.count; });
+
+        out << '\n' << title << '\n';
+        for (std::size_t i = 0; i < shown; ++i)
+        {
+            char line[64];
+            std::snprintf(line, sizeof(line), "  %-8s %16llu %6.2f%%\n", entries[i].name.c_str(),
+                static_cast<unsigned long long>(entries[i].count), total ? 100.0 * entries[i].count / total : 0.0);
+            out << line;
+        }
+    }
+
+    // The non-zero entries of a 64K table, named by address
+    std::vector<Entry> ByAddress(const std::vector<std::uint64_t>& table)
+    {
+        std::vector<Entry> entries;
+        for (std::size_t pc = 0; pc < table.size(); ++pc)
+            if (table[pc] != 0)
+                entries.push_back({ Hex(static_cast<unsigned>(pc), 4), table[pc] });
+        return entries;
+    }
+}
+
+void Profiler::SetMode(Mode mode)
+{
+    mode_ = mode;
+    if (mode == Mode::Count && pcs_.empty())
+        pcs_.assign(PC_COUNT, 0);
+    if (mode == Mode::Sample && samples_.empty())
+        samples_.assign(PC_COUNT, 0);
+}
+
+void Profiler::SetSampleInterval(std::uint32_t tstates)
+{
+    interval_ = tstates == 0 ? 1 : tstates;
+    untilSample_ = interval_;
+}
+
+void Profiler::Clear()
+{
+    instructions_ = 0;
+    sampleTotal_ = 0;
+    untilSample_ = interval_;
+    std::fill(opcodes_.begin(), opcodes_.end(), 0);
+    std::fill(edOpcodes_.begin(), edOpcodes_.end(), 0);
+    std::fill(pcs_.begin(), pcs_.end(), 0);
+    std::fill(samples_.begin(), samples_.end(), 0);
+}
+
+// The instruction at pc ran through one or more sample points; each one is
+// a sample of pc
+void Profiler::Sample(std::uint16_t pc, std::uint32_t tstates)
+{
+    const std::uint32_t past = tstates - untilSample_;
+    const std::uint32_t points = 1 + past / interval_;
+    samples_[pc] += points;
+    sampleTotal_ += points;
+    untilSample_ = interval_ - past % interval_;
+}
+
+void Profiler::WriteText(std::ostream& out, std::size_t top) const
+{
+    out << "Profile: " << instructions_ << " instructions counted, " << sampleTotal_
+        << " samples every " << interval_ << " T-states\n";
+
+    if (instructions_ != 0)
+    {
+        // ED itself is left out: its count is the sum of the ED opcodes
+        std::vector<Entry> opcodes;
+        for (unsigned op = 0; op < 256; ++op)
+        {
+            if (opcodes_[op] != 0 && op != 0xED)
+                opcodes.push_back({ Hex(op, 2), opcodes_[op] });
+            if (edOpcodes_[op] != 0)
+                opcodes.push_back({ "ED " + Hex(op, 2), edOpcodes_[op] });
+        }
+        WriteTop(out, "Opcodes", opcodes, instructions_, top);
+        WriteTop(out, "PCs", ByAddress(pcs_), instructions_, top);
+    }
+
+    if (sampleTotal_ != 0)
+        WriteTop(out, "Sampled PCs", ByAddress(samples_), sampleTotal_, top);
+}
+
+void Profiler::WriteCsv(std::ostream& out) const
+{
+    out << "kind,key,count\n";
+    for (unsigned op = 0; op < 256; ++op)
+        if (opcodes_[op] != 0)
+            out << "opcode,0x" << Hex(op, 2) << ',' << opcodes_[op] << '\n';
+    for (unsigned op = 0; op < 256; ++op)
+        if (edOpcodes_[op] != 0)
+            out << "ed,0x" << Hex(op, 2) << ',' << edOpcodes_[op] << '\n';
+    for (const Entry& entry : ByAddress(pcs_))
+        out << "pc,0x" << entry.name << ',' << entry.count << '\n';
+    for (const Entry& entry : ByAddress(samples_))
+        out << "sample,0x" << entry.name << ',' << entry.count << '\n';
+}
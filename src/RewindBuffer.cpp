@@ -0,0 +1,113 @@
+#include "RewindBuffer.h"
+#include <algorithm>
+
+RewindBuffer::RewindBuffer(Cpu& cpu, Bus& bus, const RewindConfig& config)
+    : cpu_(cpu),
+      bus_(bus),
+      config_(config)
+{
+    config_.interval = std::max<std::uint64_t>(config_.interval, 1);
+    deltasSinceKeyframe_ = config_.keyframeEvery;
+    Record();
+}
+
+std::uint64_t RewindBuffer::Execute(std::uint64_t instructions)
+{
+    std::uint64_t cycles = 0;
+    while (instructions != 0)
+    {
+        const std::uint64_t nextSnapshot = snapshots_.back().position + config_.interval;
+        const std::uint64_t run = std::min(instructions, nextSnapshot - position_);
+        cycles += cpu_.Execute(run);
+        position_ += run;
+        instructions -= run;
+        if (position_ == nextSnapshot)
+            Record();
+    }
+    return cycles;
+}
+
+void RewindBuffer::Record()
+{
+    const bool keyframe = deltasSinceKeyframe_ >= config_.keyframeEvery;
+    scratch_.clear();
+    if (keyframe)
+    {
+        SaveState::Save(cpu_, bus_, scratch_, config_.compression);
+        bus_.ClearDirty();
+        deltasSinceKeyframe_ = 0;
+    }
+    else
+    {
+        SaveState::SaveDelta(cpu_, bus_, scratch_, config_.compression);
+        ++deltasSinceKeyframe_;
+    }
+
+    Snapshot& snapshot = snapshots_.emplace_back();
+    snapshot.position = position_;
+    snapshot.keyframe = keyframe;
+    snapshot.data.assign(scratch_.begin(), scratch_.end());
+    memoryUsed_ += snapshot.data.size();
+    Trim();
+}
+
+// Drops whole groups from the front: a delta is no use without its keyframe
+void RewindBuffer::Trim()
+{
+    while (memoryUsed_ > config_.memoryCap)
+    {
+        const auto nextKeyframe = std::find_if(snapshots_.begin() + 1, snapshots_.end(),
+                                               [](const Snapshot& snapshot) { return snapshot.keyframe; });
+        if (nextKeyframe == snapshots_.end())
+            return;
+        for (auto it = snapshots_.begin(); it != nextKeyframe; ++it)
+            memoryUsed_ -= it->data.size();
+        snapshots_.erase(snapshots_.begin(), nextKeyframe);
+    }
+}
+
+bool RewindBuffer::SeekTo(std::uint64_t position)
+{
+    if (position > position_ || position < Oldest())
+        return false;
+    if (position == position_)
+        return true;
+
+    // The last snapshot at or before `position`, and the keyframe it builds on
+    const auto target = std::prev(std::upper_bound(snapshots_.begin(), snapshots_.end(), position,
+                                                   [](std::uint64_t at, const Snapshot& snapshot) { return at < snapshot.position; }));
+    auto keyframe = target;
+    while (!keyframe->keyframe)
+        --keyframe;
+
+    // A snapshot that fails to restore would leave the machine part way
+    // along the chain, so keep the current state to put back
+    const Cpu::State state = cpu_.GetState();
+    scratch_.resize(Bus::RAM_SIZE);
+    bus_.ReadRam(0, scratch_);
+    for (auto it = keyframe; it != std::next(target); ++it)
+    {
+        if (!SaveState::Restore(cpu_, bus_, it->data).ok)
+        {
+            bus_.RestoreRam(0, scratch_);
+            cpu_.SetState(state);
+            return false;
+        }
+    }
+    bus_.ClearDirty();
+
+    for (auto it = std::next(target); it != snapshots_.end(); ++it)
+        memoryUsed_ -= it->data.size();
+    deltasSinceKeyframe_ = static_cast<std::size_t>(target - keyframe);
+    position_ = target->position;
+    snapshots_.erase(std::next(target), snapshots_.end());
+
+    cpu_.Execute(position - position_);
+    position_ = position;
+    return true;
+}
+
+bool RewindBuffer::StepBack(std::uint64_t instructions)
+{
+    return instructions <= position_ && SeekTo(position_ - instructions);
+}
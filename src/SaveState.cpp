@@ -0,0 +1,253 @@
+#include "SaveState.h"
+#include "LzCodec.h"
+#include <array>
+#include <cstring>
+
+namespace
+{
+    constexpr std::array<std::uint8_t, 4> MAGIC = { 'Z', '8', '0', 'S' };
+    constexpr std::uint8_t CODEC_RAW = 0;
+    constexpr std::uint8_t CODEC_LZ = 1;
+
+    void Put16(std::vector<std::uint8_t>& out, std::uint16_t value)
+    {
+        out.push_back(static_cast<std::uint8_t>(value));
+        out.push_back(static_cast<std::uint8_t>(value >> 8));
+    }
+
+    void Put64(std::vector<std::uint8_t>& out, std::uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i)
+            out.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+
+    // Reads the state front to back; every Get fails once the data runs out
+    struct Reader
+    {
+        std::span<const std::uint8_t> data;
+        std::size_t pos = 0;
+
+        bool Has(std::size_t bytes) const { return data.size() - pos >= bytes; }
+
+        std::span<const std::uint8_t> Take(std::size_t bytes)
+        {
+            const std::span<const std::uint8_t> taken = data.subspan(pos, bytes);
+            pos += bytes;
+            return taken;
+        }
+
+        bool Get8(std::uint8_t& value)
+        {
+            if (!Has(1))
+                return false;
+            value = data[pos++];
+            return true;
+        }
+
+        bool Get16(std::uint16_t& value)
+        {
+            if (!Has(2))
+                return false;
+            value = static_cast<std::uint16_t>(data[pos] | (data[pos + 1] << 8));
+            pos += 2;
+            return true;
+        }
+
+        bool Get64(std::uint64_t& value)
+        {
+            if (!Has(8))
+                return false;
+            value = 0;
+            for (int i = 0; i < 8; ++i)
+                value |= static_cast<std::uint64_t>(data[pos + i]) << (8 * i);
+            pos += 8;
+            return true;
+        }
+    };
+
+    RestoreResult Failed(std::string error)
+    {
+        RestoreResult result;
+        result.error = std::move(error);
+        return result;
+    }
+
+    void PutHeader(std::vector<std::uint8_t>& out, const Cpu& cpu, std::uint16_t flags)
+    {
+        out.insert(out.end(), MAGIC.begin(), MAGIC.end());
+        Put16(out, SaveState::VERSION);
+        Put16(out, flags);
+
+        const Cpu::State state = cpu.GetState();
+        for (const std::uint16_t pair : { state.af, state.bc, state.de, state.hl,
+                                          state.afAlt, state.bcAlt, state.deAlt, state.hlAlt,
+                                          state.pc, state.sp, state.ix, state.iy })
+            Put16(out, pair);
+        out.push_back(state.i);
+        out.push_back(state.r);
+        out.push_back(state.halted ? 1 : 0);
+        out.push_back(0);
+        Put64(out, state.tstates);
+    }
+
+    // Codec, length and the bytes, compressed straight into place; the raw
+    // bytes are kept if that did not save anything
+    void PutRam(std::vector<std::uint8_t>& out, std::span<const std::uint8_t> bytes, SaveCompression compression)
+    {
+        const std::size_t header = out.size();
+        out.push_back(CODEC_LZ);
+        Put16(out, 0);
+
+        std::size_t length = bytes.size();
+        if (compression == SaveCompression::Lz)
+        {
+            LzCodec::Compress(bytes, out);
+            length = out.size() - header - 3;
+        }
+        if (length >= bytes.size())
+        {
+            out.resize(header + 3);
+            out[header] = CODEC_RAW;
+            out.insert(out.end(), bytes.begin(), bytes.end());
+            length = bytes.size();
+        }
+        out[header + 1] = static_cast<std::uint8_t>(length);
+        out[header + 2] = static_cast<std::uint8_t>(length >> 8);
+    }
+
+    // Decodes one PutRam() record into `decoded` and hands it to the Bus at `offset`
+    bool GetRam(Reader& in, Bus& bus, std::size_t offset, std::span<std::uint8_t> decoded, std::string& error)
+    {
+        std::uint8_t codec = 0;
+        std::uint16_t length = 0;
+        if (!in.Get8(codec) || !in.Get16(length) || !in.Has(length))
+        {
+            error = "truncated data";
+            return false;
+        }
+
+        const std::span<const std::uint8_t> bytes = in.Take(length);
+        if (codec == CODEC_RAW)
+        {
+            if (length != decoded.size())
+            {
+                error = "bad length";
+                return false;
+            }
+            bus.RestoreRam(offset, bytes);
+        }
+        else if (codec == CODEC_LZ)
+        {
+            if (!LzCodec::Decompress(bytes, decoded))
+            {
+                error = "corrupt compressed data";
+                return false;
+            }
+            bus.RestoreRam(offset, decoded);
+        }
+        else
+        {
+            error = "unknown codec";
+            return false;
+        }
+        return true;
+    }
+}
+
+void SaveState::Save(const Cpu& cpu, const Bus& bus, std::vector<std::uint8_t>& out, SaveCompression compression)
+{
+    out.reserve(out.size() + 64 + RAM_BLOCKS * (3 + RAM_BLOCK_SIZE));
+    PutHeader(out, cpu, 0);
+
+    std::array<std::uint8_t, RAM_BLOCK_SIZE> bytes;
+    for (std::size_t block = 0; block < RAM_BLOCKS; ++block)
+    {
+        bus.ReadRam(block * RAM_BLOCK_SIZE, bytes);
+        PutRam(out, bytes, compression);
+    }
+}
+
+void SaveState::SaveDelta(const Cpu& cpu, Bus& bus, std::vector<std::uint8_t>& out, SaveCompression compression)
+{
+    const Bus::PageSet dirty = bus.CollectDirty();
+    out.reserve(out.size() + 64 + dirty.count() * (4 + Bus::MAP_PAGE_SIZE));
+    PutHeader(out, cpu, FLAG_DELTA);
+
+    out.push_back(static_cast<std::uint8_t>(dirty.count()));
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> bytes;
+    for (std::size_t page = 0; page < Bus::MAP_PAGE_COUNT; ++page)
+    {
+        if (!dirty[page])
+            continue;
+        bus.ReadRam(page * Bus::MAP_PAGE_SIZE, bytes);
+        out.push_back(static_cast<std::uint8_t>(page));
+        PutRam(out, bytes, compression);
+    }
+    bus.ClearDirty();
+}
+
+RestoreResult SaveState::Restore(Cpu& cpu, Bus& bus, std::span<const std::uint8_t> data)
+{
+    Reader in{ data };
+
+    if (!in.Has(MAGIC.size()) || std::memcmp(data.data(), MAGIC.data(), MAGIC.size()) != 0)
+        return Failed("not a save state");
+    in.pos = MAGIC.size();
+
+    std::uint16_t version = 0;
+    std::uint16_t flags = 0;
+    if (!in.Get16(version) || !in.Get16(flags))
+        return Failed("truncated header");
+    if (version != VERSION)
+        return Failed("unsupported save state version " + std::to_string(version));
+    if ((flags & ~FLAG_DELTA) != 0)
+        return Failed("unknown flags");
+
+    Cpu::State state;
+    std::uint8_t halted = 0;
+    std::uint8_t reserved = 0;
+    bool cpuOk = true;
+    for (std::uint16_t* pair : { &state.af, &state.bc, &state.de, &state.hl,
+                                 &state.afAlt, &state.bcAlt, &state.deAlt, &state.hlAlt,
+                                 &state.pc, &state.sp, &state.ix, &state.iy })
+        cpuOk = cpuOk && in.Get16(*pair);
+    cpuOk = cpuOk && in.Get8(state.i) && in.Get8(state.r) && in.Get8(halted) && in.Get8(reserved) && in.Get64(state.tstates);
+    if (!cpuOk)
+        return Failed("truncated CPU state");
+    state.halted = halted != 0;
+
+    std::string error;
+    if ((flags & FLAG_DELTA) != 0)
+    {
+        std::uint8_t pages = 0;
+        if (!in.Get8(pages))
+            return Failed("truncated page count");
+
+        std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> decoded;
+        for (std::size_t i = 0; i < pages; ++i)
+        {
+            std::uint8_t page = 0;
+            if (!in.Get8(page))
+                return Failed("truncated data in page record " + std::to_string(i));
+            if (page >= Bus::MAP_PAGE_COUNT)
+                return Failed("bad page number " + std::to_string(page));
+            if (!GetRam(in, bus, page * Bus::MAP_PAGE_SIZE, decoded, error))
+                return Failed(error + " in RAM page " + std::to_string(page));
+        }
+    }
+    else
+    {
+        std::array<std::uint8_t, RAM_BLOCK_SIZE> decoded;
+        for (std::size_t block = 0; block < RAM_BLOCKS; ++block)
+        {
+            if (!GetRam(in, bus, block * RAM_BLOCK_SIZE, decoded, error))
+                return Failed(error + " in RAM block " + std::to_string(block));
+        }
+    }
+
+    cpu.SetState(state);
+
+    RestoreResult result;
+    result.ok = true;
+    return result;
+}
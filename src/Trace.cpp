@@ -0,0 +1,495 @@
+#include "Trace.h"
+#include "LzCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+
+namespace
+{
+    constexpr std::array<char, 8> MAGIC = { 'Z', '8', '0', 'T', 'R', 'A', 'C', 'E' };
+    constexpr std::uint32_t VERSION = 1;
+    constexpr std::size_t FRAME_HEADER = 4 + 4 + 4 + 8 + 8;
+
+    // Record header byte
+    constexpr std::uint8_t LENGTH_MASK = 0x07;      // opcode bytes that follow
+    constexpr std::uint8_t EXPLICIT_PC = 0x08;      // it did not start where the last one left PC
+    constexpr std::uint8_t HAS_FIELDS = 0x10;       // a field mask and the changed fields follow
+    constexpr std::uint8_t HAS_WRITES = 0x20;
+
+    // Field mask, in the order the values follow it
+    using Word = std::uint16_t Cpu::State::*;
+    constexpr std::array<Word, 11> WORDS = {
+        &Cpu::State::af, &Cpu::State::bc, &Cpu::State::de, &Cpu::State::hl,
+        &Cpu::State::afAlt, &Cpu::State::bcAlt, &Cpu::State::deAlt, &Cpu::State::hlAlt,
+        &Cpu::State::sp, &Cpu::State::ix, &Cpu::State::iy,
+    };
+    constexpr std::uint16_t FIELD_I = 1 << 11;
+    constexpr std::uint16_t FIELD_R = 1 << 12;
+    constexpr std::uint16_t FIELD_HALTED = 1 << 13;  // flipped; no value
+    constexpr std::uint16_t FIELD_PC = 1 << 14;      // PC after is not pc + length
+
+    // Header, PC, 4 opcode bytes, T-states, the field mask and every field,
+    // the write count; 3 bytes per write on top
+    constexpr std::size_t MAX_RECORD = 1 + 2 + 4 + 5 + 2 + 2 * WORDS.size() + 2 + 2 + 5;
+
+    void Put16(std::uint8_t*& out, std::uint16_t value)
+    {
+        out[0] = static_cast<std::uint8_t>(value);
+        out[1] = static_cast<std::uint8_t>(value >> 8);
+        out += 2;
+    }
+
+    void PutVarint(std::uint8_t*& out, std::uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            *out++ = static_cast<std::uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        *out++ = static_cast<std::uint8_t>(value);
+    }
+
+    void PutLe(std::uint8_t* out, std::uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            out[i] = static_cast<std::uint8_t>(value >> (8 * i));
+    }
+
+    std::uint64_t GetLe(const std::uint8_t* in, int bytes)
+    {
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value |= static_cast<std::uint64_t>(in[i]) << (8 * i);
+        return value;
+    }
+
+    // Reads a frame front to back; every Get fails once the data runs out
+    struct Reader
+    {
+        std::span<const std::uint8_t> data;
+        std::size_t pos = 0;
+
+        bool Get8(std::uint8_t& value)
+        {
+            if (pos >= data.size())
+                return false;
+            value = data[pos++];
+            return true;
+        }
+
+        bool Get16(std::uint16_t& value)
+        {
+            if (data.size() - pos < 2)
+                return false;
+            value = static_cast<std::uint16_t>(data[pos] | (data[pos + 1] << 8));
+            pos += 2;
+            return true;
+        }
+
+        bool GetVarint(std::uint32_t& value)
+        {
+            value = 0;
+            for (int shift = 0; shift < 35; shift += 7)
+            {
+                std::uint8_t byte = 0;
+                if (!Get8(byte))
+                    return false;
+                value |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    return true;
+            }
+            return false;
+        }
+    };
+}
+
+// **********************************************
+// *                 RECORDER                   *
+// **********************************************
+TraceRecorder::TraceRecorder(Cpu& cpu, Bus& bus, const std::string& path, const TraceConfig& config)
+    : cpu_(cpu),
+      bus_(bus),
+      file_(path, std::ios::binary | std::ios::trunc)
+{
+    std::array<std::uint8_t, 4> version{};
+    PutLe(version.data(), VERSION, 4);
+    file_.write(MAGIC.data(), MAGIC.size());
+    file_.write(reinterpret_cast<const char*>(version.data()), version.size());
+    if (!file_)
+        return;
+
+    // Step() fills one frame while the writer may hold all the others
+    frames_.resize(std::max<std::size_t>(config.frames, 2));
+    for (Frame& frame : frames_)
+        frame.data.resize(std::clamp(config.frameSize, MAX_RECORD, TraceConfig::MAX_FRAME_SIZE));
+    for (std::size_t i = 1; i < frames_.size(); ++i)
+        free_.push_back(i);
+
+    open_ = true;
+    writer_ = std::thread(&TraceRecorder::WriterLoop, this);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    Close();
+}
+
+std::uint32_t TraceRecorder::Step()
+{
+    if (!open_)
+        return cpu_.Step();
+
+    // The opcode bytes as they are before the instruction runs, in case it
+    // writes over itself. Bytes on a device page are recorded as 0: reading
+    // them could set something off.
+    const std::uint16_t pc = cpu_.GetPc();
+    const bool halted = cpu_.is_halted();
+    std::array<std::uint8_t, 4> bytes{};
+    if (!halted)
+    {
+        for (std::size_t i = 0; i < bytes.size(); ++i)
+        {
+            const std::uint8_t* memory = bus_.ReadPointer(static_cast<std::uint16_t>(pc + i));
+            bytes[i] = memory != nullptr ? *memory : 0;
+        }
+    }
+
+    writes_.clear();
+    bus_.SetWriteLog(&writes_);
+    const std::uint32_t tstates = cpu_.Step();
+    bus_.SetWriteLog(nullptr);
+
+    // There are no jumps, so PC moved by the instruction's length, except for
+    // a block repeat, which goes back onto its ED prefix
+    const Cpu::State state = cpu_.GetState();
+    std::uint8_t length = 0;
+    if (!halted)
+    {
+        const std::uint16_t moved = static_cast<std::uint16_t>(state.pc - pc);
+        length = moved >= 1 && moved <= 4 ? static_cast<std::uint8_t>(moved) : 2;
+    }
+
+    Encode(pc, bytes.data(), length, tstates, state);
+    return tstates;
+}
+
+std::uint64_t TraceRecorder::Execute(std::uint64_t instructions)
+{
+    std::uint64_t cycles = 0;
+    for (std::uint64_t i = 0; i < instructions; ++i)
+        cycles += Step();
+    return cycles;
+}
+
+void TraceRecorder::Encode(std::uint16_t pc, const std::uint8_t* bytes, std::uint8_t length, std::uint32_t tstates, const Cpu::State& state)
+{
+    const std::size_t needed = MAX_RECORD + 3 * writes_.size();
+    if (frames_[current_].records != 0 && frames_[current_].used + needed > frames_[current_].data.size())
+        Publish();
+
+    Frame& frame = frames_[current_];
+    if (frame.data.size() - frame.used < needed)
+        frame.data.resize(frame.used + needed);
+    if (frame.records == 0)
+    {
+        frame.firstInstruction = recorded_;
+        frame.tstates = state.tstates - tstates;
+        last_ = Cpu::State{};
+    }
+
+    std::uint8_t* const start = frame.data.data() + frame.used;
+    std::uint8_t* out = start + 1;
+    std::uint8_t header = length;
+
+    if (pc != last_.pc)
+    {
+        header |= EXPLICIT_PC;
+        Put16(out, pc);
+    }
+    for (std::uint8_t i = 0; i < length; ++i)
+        *out++ = bytes[i];
+    PutVarint(out, tstates);
+
+    // The mask goes in front of the fields, so leave room for it and fill
+    // it in after
+    std::uint8_t* const mask = out;
+    out += 2;
+    std::uint16_t fields = 0;
+    for (std::size_t i = 0; i < WORDS.size(); ++i)
+    {
+        if (state.*WORDS[i] != last_.*WORDS[i])
+        {
+            fields |= static_cast<std::uint16_t>(1u << i);
+            Put16(out, state.*WORDS[i]);
+        }
+    }
+    if (state.i != last_.i)
+    {
+        fields |= FIELD_I;
+        *out++ = state.i;
+    }
+    if (state.r != last_.r)
+    {
+        fields |= FIELD_R;
+        *out++ = state.r;
+    }
+    if (state.halted != last_.halted)
+        fields |= FIELD_HALTED;
+    if (state.pc != static_cast<std::uint16_t>(pc + length))
+    {
+        fields |= FIELD_PC;
+        Put16(out, state.pc);
+    }
+
+    if (fields != 0)
+    {
+        header |= HAS_FIELDS;
+        std::uint8_t* at = mask;
+        Put16(at, fields);
+    }
+    else
+        out = mask;
+
+    if (!writes_.empty())
+    {
+        header |= HAS_WRITES;
+        PutVarint(out, static_cast<std::uint32_t>(writes_.size()));
+        for (const Bus::LoggedWrite& write : writes_)
+        {
+            Put16(out, write.address);
+            *out++ = write.value;
+        }
+    }
+
+    *start = header;
+    frame.used += static_cast<std::size_t>(out - start);
+    ++frame.records;
+    ++recorded_;
+    last_ = state;
+}
+
+// Hands the frame being filled to the writer and takes a free one, waiting
+// for the writer if there is none
+void TraceRecorder::Publish()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    full_.push_back(current_);
+    queued_.notify_one();
+
+    if (free_.empty())
+        ++stalls_;
+    freed_.wait(lock, [&] { return !free_.empty(); });
+    current_ = free_.front();
+    free_.pop_front();
+
+    frames_[current_].used = 0;
+    frames_[current_].records = 0;
+}
+
+bool TraceRecorder::Close()
+{
+    if (!open_)
+        return !failed_;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (frames_[current_].records != 0)
+            full_.push_back(current_);
+        stopping_ = true;
+    }
+    queued_.notify_one();
+    writer_.join();
+
+    file_.close();
+    if (!file_)
+        failed_ = true;
+    open_ = false;
+    return !failed_;
+}
+
+void TraceRecorder::WriterLoop()
+{
+    std::vector<std::uint8_t> packed;
+    for (;;)
+    {
+        std::size_t index = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [&] { return !full_.empty() || stopping_; });
+            if (full_.empty())
+                return;
+            index = full_.front();
+            full_.pop_front();
+        }
+
+        const Frame& frame = frames_[index];
+        packed.clear();
+        LzCodec::Compress({ frame.data.data(), frame.used }, packed);
+        const bool raw = packed.size() >= frame.used;
+        const std::uint8_t* payload = raw ? frame.data.data() : packed.data();
+        const std::size_t stored = raw ? frame.used : packed.size();
+
+        std::array<std::uint8_t, FRAME_HEADER> header{};
+        PutLe(header.data(), frame.used, 4);
+        PutLe(header.data() + 4, stored, 4);
+        PutLe(header.data() + 8, frame.records, 4);
+        PutLe(header.data() + 12, frame.firstInstruction, 8);
+        PutLe(header.data() + 20, frame.tstates, 8);
+        file_.write(reinterpret_cast<const char*>(header.data()), header.size());
+        file_.write(reinterpret_cast<const char*>(payload), static_cast<std::streamsize>(stored));
+        const bool ok = static_cast<bool>(file_);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!ok)
+                failed_ = true;
+            free_.push_back(index);
+        }
+        freed_.notify_one();
+    }
+}
+
+// **********************************************
+// *                  READER                    *
+// **********************************************
+TraceReader::TraceReader(const std::string& path)
+    : file_(path, std::ios::binary)
+{
+    std::array<char, 8> magic{};
+    std::array<std::uint8_t, 4> version{};
+    file_.read(magic.data(), magic.size());
+    file_.read(reinterpret_cast<char*>(version.data()), version.size());
+    open_ = file_ && magic == MAGIC && GetLe(version.data(), 4) == VERSION;
+}
+
+bool TraceReader::Next(TraceStep& step)
+{
+    if (!open_ || failed_)
+        return false;
+
+    while (recordsLeft_ == 0)
+    {
+        if (!ReadFrame())
+            return false;
+    }
+
+    if (!Decode(step))
+    {
+        failed_ = true;
+        return false;
+    }
+    --recordsLeft_;
+    return true;
+}
+
+bool TraceReader::ReadFrame()
+{
+    std::array<std::uint8_t, FRAME_HEADER> header{};
+    file_.read(reinterpret_cast<char*>(header.data()), header.size());
+    if (file_.gcount() == 0 && file_.eof())
+        return false;                       // the end
+    if (static_cast<std::size_t>(file_.gcount()) != header.size())
+    {
+        failed_ = true;
+        return false;
+    }
+
+    const std::size_t size = static_cast<std::size_t>(GetLe(header.data(), 4));
+    const std::size_t stored = static_cast<std::size_t>(GetLe(header.data() + 4, 4));
+    recordsLeft_ = static_cast<std::uint32_t>(GetLe(header.data() + 8, 4));
+    instruction_ = GetLe(header.data() + 12, 8);
+    last_ = Cpu::State{};
+    last_.tstates = GetLe(header.data() + 20, 8);
+    at_ = 0;
+
+    // Checked before anything is allocated for it
+    if (size > TraceConfig::MAX_FRAME_SIZE || stored > size)
+    {
+        failed_ = true;
+        return false;
+    }
+
+    std::vector<std::uint8_t> payload(stored);
+    file_.read(reinterpret_cast<char*>(payload.data()), static_cast<std::streamsize>(stored));
+    if (static_cast<std::size_t>(file_.gcount()) != stored)
+    {
+        failed_ = true;
+        return false;
+    }
+
+    if (stored == size)
+        frame_ = std::move(payload);
+    else
+    {
+        frame_.resize(size);
+        if (!LzCodec::Decompress(payload, frame_))
+        {
+            failed_ = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TraceReader::Decode(TraceStep& step)
+{
+    Reader in{ frame_, at_ };
+
+    std::uint8_t header = 0;
+    if (!in.Get8(header) || (header & LENGTH_MASK) > 4)
+        return false;
+
+    step.pc = last_.pc;
+    if ((header & EXPLICIT_PC) != 0 && !in.Get16(step.pc))
+        return false;
+    step.length = header & LENGTH_MASK;
+    step.bytes = {};
+    for (std::uint8_t i = 0; i < step.length; ++i)
+    {
+        if (!in.Get8(step.bytes[i]))
+            return false;
+    }
+    if (!in.GetVarint(step.tstates))
+        return false;
+
+    Cpu::State state = last_;
+    std::uint16_t fields = 0;
+    if ((header & HAS_FIELDS) != 0 && !in.Get16(fields))
+        return false;
+    for (std::size_t i = 0; i < WORDS.size(); ++i)
+    {
+        if ((fields & (1u << i)) != 0 && !in.Get16(state.*WORDS[i]))
+            return false;
+    }
+    if ((fields & FIELD_I) != 0 && !in.Get8(state.i))
+        return false;
+    if ((fields & FIELD_R) != 0 && !in.Get8(state.r))
+        return false;
+    if ((fields & FIELD_HALTED) != 0)
+        state.halted = !state.halted;
+    state.pc = static_cast<std::uint16_t>(step.pc + step.length);
+    if ((fields & FIELD_PC) != 0 && !in.Get16(state.pc))
+        return false;
+    state.tstates = last_.tstates + step.tstates;
+
+    step.writes.clear();
+    if ((header & HAS_WRITES) != 0)
+    {
+        std::uint32_t count = 0;
+        if (!in.GetVarint(count) || count > (frame_.size() - in.pos) / 3)
+            return false;
+        step.writes.resize(count);
+        for (Bus::LoggedWrite& write : step.writes)
+        {
+            in.Get16(write.address);
+            in.Get8(write.value);
+        }
+    }
+
+    at_ = in.pos;
+    step.instruction = instruction_++;
+    step.state = state;
+    last_ = state;
+    return true;
+}
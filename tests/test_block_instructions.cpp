@@ -0,0 +1,448 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include "Mappers.h"
+#include <array>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+struct CpuFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    CpuFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+    }
+};
+
+namespace
+{
+    // Logs every OUT and answers IN with an incrementing counter
+    struct CountingPorts : PortDevice
+    {
+        std::uint8_t next = 0x40;
+        std::vector<std::pair<std::uint16_t, std::uint8_t>> outs;
+        std::vector<std::uint16_t> ins;
+
+        std::uint8_t In(std::uint16_t port) override { ins.push_back(port); return next++; }
+        void Out(std::uint16_t port, std::uint8_t value) override { outs.emplace_back(port, value); }
+    };
+
+    // Logs every access and answers reads with the low address byte
+    struct RecordingDevice : MemoryDevice
+    {
+        std::vector<std::pair<std::uint16_t, std::uint8_t>> writes;
+
+        std::uint8_t Read(std::uint16_t address) override { return static_cast<std::uint8_t>(address); }
+        void Write(std::uint16_t address, std::uint8_t value) override { writes.emplace_back(address, value); }
+    };
+
+    // Everything a block instruction can change
+    struct Snapshot
+    {
+        std::array<std::uint16_t, 8> regs{};
+        std::uint64_t tstates = 0;
+        std::vector<std::uint8_t> memory;
+
+        Snapshot(const Cpu& cpu, const Bus& bus)
+            : regs{ cpu.GetAf(), cpu.GetBc(), cpu.GetDe(), cpu.GetHl(), cpu.GetPc(), cpu.GetSp(), cpu.GetIx(), cpu.GetIy() },
+              tstates(cpu.GetTStates()),
+              memory(Bus::RAM_SIZE)
+        {
+            bus.ReadBlock(0x0000, memory);
+        }
+
+        bool operator==(const Snapshot&) const = default;
+    };
+
+    // A machine set up by `setup`, so the same start can be run several ways
+    struct Machine
+    {
+        Bus bus;
+        Cpu cpu;
+
+        explicit Machine(const std::function<void(Bus&, Cpu&)>& setup)
+        {
+            cpu.Connect(&bus);
+            cpu.Reset();
+            setup(bus, cpu);
+        }
+
+        Snapshot State() const { return Snapshot(cpu, bus); }
+    };
+
+    // Runs `setup` to the T-state limit once through Run() and once a Step()
+    // (so one iteration) at a time, the way Run() would without the fast path
+    void RequireRunMatchesSteps(const std::function<void(Bus&, Cpu&)>& setup, std::uint64_t tstates)
+    {
+        Machine bulk(setup);
+        Machine stepped(setup);
+
+        const std::uint64_t bulkCycles = bulk.cpu.Run(tstates);
+        std::uint64_t steppedCycles = 0;
+        while (steppedCycles < tstates)
+            steppedCycles += stepped.cpu.Step();
+
+        CAPTURE(tstates);
+        REQUIRE(bulkCycles == steppedCycles);
+        REQUIRE(bulk.State() == stepped.State());
+    }
+
+    void RequireExecuteMatchesSteps(const std::function<void(Bus&, Cpu&)>& setup, std::uint64_t instructions)
+    {
+        Machine bulk(setup);
+        Machine stepped(setup);
+
+        bulk.cpu.Execute(instructions);
+        for (std::uint64_t i = 0; i < instructions; ++i)
+            stepped.cpu.Step();
+
+        CAPTURE(instructions);
+        REQUIRE(bulk.State() == stepped.State());
+    }
+
+    void Load(Bus& bus, std::uint16_t address, const std::vector<std::uint8_t>& bytes)
+    {
+        bus.WriteBlock(address, bytes);
+    }
+}
+
+// **********************************************
+// *            LDI / LDD / LDIR / LDDR         *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "LDI copies one byte and sets P/V while BC is not zero", "[ed][block][ldi]")
+{
+    Load(bus, 0x0000, { 0xED, 0xA0 });
+    bus.Write(0x4000, 0x5A);
+    cpu.SetHl(0x4000);
+    cpu.SetDe(0x5000);
+    cpu.SetBc(0x0002);
+    cpu.SetF(Cpu::FLAG_S | Cpu::FLAG_Z | Cpu::FLAG_C | Cpu::FLAG_H | Cpu::FLAG_N);
+
+    const auto cycles = cpu.Step();
+
+    REQUIRE(cycles == 16);
+    REQUIRE(bus.Read(0x5000) == 0x5A);
+    REQUIRE(cpu.GetHl() == 0x4001);
+    REQUIRE(cpu.GetDe() == 0x5001);
+    REQUIRE(cpu.GetBc() == 0x0001);
+    REQUIRE(cpu.GetPc() == 0x0002);
+    REQUIRE(cpu.GetF() == (Cpu::FLAG_S | Cpu::FLAG_Z | Cpu::FLAG_C | Cpu::FLAG_PV));
+}
+
+TEST_CASE_METHOD(CpuFixture, "LDIR copies the block in one Run, 21 T-states per byte and 16 for the last", "[ed][block][ldir]")
+{
+    Load(bus, 0x0000, { 0xED, 0xB0 });
+    for (std::uint16_t i = 0; i < 3000; ++i)
+        bus.Write(static_cast<std::uint16_t>(0x2000 + i), static_cast<std::uint8_t>(i * 3));
+    cpu.SetHl(0x2000);
+    cpu.SetDe(0x8000);
+    cpu.SetBc(3000);
+
+    const auto cycles = cpu.Run(21 * 2999 + 16);
+
+    REQUIRE(cycles == 21 * 2999 + 16);
+    REQUIRE(cpu.GetPc() == 0x0002);
+    REQUIRE(cpu.GetBc() == 0x0000);
+    REQUIRE(cpu.GetHl() == 0x2000 + 3000);
+    REQUIRE(cpu.GetDe() == 0x8000 + 3000);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_PV) == 0);
+    for (std::uint16_t i = 0; i < 3000; ++i)
+        REQUIRE(bus.Read(static_cast<std::uint16_t>(0x8000 + i)) == static_cast<std::uint8_t>(i * 3));
+}
+
+TEST_CASE_METHOD(CpuFixture, "One LDIR step is one iteration that puts PC back on the prefix", "[ed][block][ldir]")
+{
+    Load(bus, 0x1000, { 0xED, 0xB0 });
+    cpu.Reset(0x1000);
+    cpu.SetHl(0x2000);
+    cpu.SetDe(0x3000);
+    cpu.SetBc(5);
+
+    REQUIRE(cpu.Step() == 21);
+    REQUIRE(cpu.GetPc() == 0x1000);
+    REQUIRE(cpu.GetBc() == 4);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_PV) == 1);
+
+    // Execute() counts each iteration as an instruction
+    REQUIRE(cpu.Execute(3) == 3 * 21);
+    REQUIRE(cpu.GetBc() == 1);
+    REQUIRE(cpu.Execute(1) == 16);
+    REQUIRE(cpu.GetPc() == 0x1002);
+}
+
+TEST_CASE_METHOD(CpuFixture, "LDIR with DE = HL + 1 fills like the byte loop, not like memmove", "[ed][block][ldir]")
+{
+    Load(bus, 0x0000, { 0xED, 0xB0 });
+    bus.Write(0x4000, 0xE5);
+    cpu.SetHl(0x4000);
+    cpu.SetDe(0x4001);
+    cpu.SetBc(0x0FFF);
+
+    cpu.Run(21 * 0x0FFF);
+
+    for (std::uint16_t address = 0x4000; address < 0x5000; ++address)
+        REQUIRE(bus.Read(address) == 0xE5);
+    REQUIRE(bus.Read(0x5000) == 0x00);
+}
+
+TEST_CASE_METHOD(CpuFixture, "LDDR copies downwards and wraps HL and DE at 64K", "[ed][block][lddr]")
+{
+    Load(bus, 0x8000, { 0xED, 0xB8 });
+    Load(bus, 0xFFFE, { 0x11, 0x22 });
+    Load(bus, 0x0000, { 0x33, 0x44 });
+    cpu.Reset(0x8000);
+    cpu.SetHl(0x0001);
+    cpu.SetDe(0x4003);
+    cpu.SetBc(4);
+
+    cpu.Run(21 * 3 + 16);
+
+    REQUIRE(bus.Read(0x4000) == 0x11);
+    REQUIRE(bus.Read(0x4001) == 0x22);
+    REQUIRE(bus.Read(0x4002) == 0x33);
+    REQUIRE(bus.Read(0x4003) == 0x44);
+    REQUIRE(cpu.GetHl() == 0xFFFD);
+    REQUIRE(cpu.GetDe() == 0x3FFF);
+}
+
+TEST_CASE_METHOD(CpuFixture, "LDIR drops writes to ROM and hands device pages every byte", "[ed][block][ldir]")
+{
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> rom{};
+    RecordingDevice device;
+    bus.MapRom(8, 1, rom.data());           // 0x2000
+    bus.MapDevice(9, 1, &device);           // 0x2400
+    Load(bus, 0x0000, { 0xED, 0xB0 });
+    bus.Fill(0x4000, 0x0800, 0x77);
+    cpu.SetHl(0x4000);
+    cpu.SetDe(0x23FE);
+    cpu.SetBc(6);
+
+    cpu.Run(21 * 5 + 16);
+
+    REQUIRE(rom[0x3FE] == 0x00);
+    REQUIRE(rom[0x3FF] == 0x00);
+    REQUIRE(device.writes.size() == 4);
+    REQUIRE(device.writes[3] == std::pair<std::uint16_t, std::uint8_t>{ 0x2403, 0x77 });
+    REQUIRE(cpu.GetBc() == 0);
+}
+
+TEST_CASE_METHOD(CpuFixture, "LDIR that overwrites itself stops where the new code starts", "[ed][block][ldir]")
+{
+    // The second byte copied lands on the B0 of its own ED B0, turning it
+    // into ED 00. The budget would allow a third iteration.
+    Load(bus, 0x1000, { 0xED, 0xB0 });
+    cpu.Reset(0x1000);
+    cpu.SetHl(0x3000);
+    cpu.SetDe(0x1000);
+    cpu.SetBc(0x10);
+    bus.Write(0x3000, 0xED);
+
+    const auto cycles = cpu.Run(21 * 2 + 1);
+
+    REQUIRE(cycles == 21 * 2 + 8);          // two iterations, then ED 00
+    REQUIRE(cpu.GetBc() == 0x0E);
+    REQUIRE(cpu.GetPc() == 0x1002);
+    REQUIRE(bus.Read(0x1001) == 0x00);
+    REQUIRE(cpu.has_unimplemented());
+}
+
+// **********************************************
+// *            CPI / CPD / CPIR / CPDR         *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "CPIR stops on the first match with Z set", "[ed][block][cpir]")
+{
+    Load(bus, 0x0000, { 0xED, 0xB1 });
+    bus.Fill(0x4000, 0x0900, 0x11);
+    bus.Write(0x4812, 0x99);
+    cpu.SetA(0x99);
+    cpu.SetHl(0x4000);
+    cpu.SetBc(0x1000);
+    cpu.SetFlag(Cpu::FLAG_C, true);
+
+    const auto cycles = cpu.Run(21 * 0x812 + 16);
+
+    REQUIRE(cycles == 21 * 0x812 + 16);
+    REQUIRE(cpu.GetHl() == 0x4813);
+    REQUIRE(cpu.GetBc() == 0x1000 - 0x813);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_Z) == 1);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_PV) == 1);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_N) == 1);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_C) == 1);
+}
+
+TEST_CASE_METHOD(CpuFixture, "CPDR without a match runs BC down to zero", "[ed][block][cpdr]")
+{
+    Load(bus, 0x0000, { 0xED, 0xB9 });
+    cpu.SetA(0x81);
+    cpu.SetHl(0x8000);
+    cpu.SetBc(0x0500);
+
+    const auto cycles = cpu.Execute(0x0500);
+
+    REQUIRE(cycles == 21 * 0x04FF + 16);
+    REQUIRE(cpu.GetHl() == 0x8000 - 0x0500);
+    REQUIRE(cpu.GetBc() == 0);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_Z) == 0);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_PV) == 0);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_S) == 1);     // 0x81 - 0x00
+}
+
+// **********************************************
+// *        INI / INIR / OUTI / OTIR ...        *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "INIR reads port BC into memory until B is zero", "[ed][block][inir]")
+{
+    CountingPorts ports;
+    bus.AttachPorts(&ports);
+    Load(bus, 0x0000, { 0xED, 0xB2 });
+    cpu.SetHl(0x6000);
+    cpu.SetBc(0x03FE);
+
+    const auto cycles = cpu.Run(21 * 2 + 16);
+
+    REQUIRE(cycles == 21 * 2 + 16);
+    REQUIRE(ports.ins == std::vector<std::uint16_t>{ 0x03FE, 0x02FE, 0x01FE });
+    REQUIRE(bus.Read(0x6000) == 0x40);
+    REQUIRE(bus.Read(0x6002) == 0x42);
+    REQUIRE(cpu.GetB() == 0);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_Z) == 1);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_N) == 1);
+}
+
+TEST_CASE_METHOD(CpuFixture, "OTDR puts the decremented B on the port address", "[ed][block][otdr]")
+{
+    CountingPorts ports;
+    bus.AttachPorts(&ports);
+    Load(bus, 0x0000, { 0xED, 0xBB });
+    Load(bus, 0x6000, { 0xA1, 0xA2 });
+    cpu.SetHl(0x6001);
+    cpu.SetBc(0x0298);
+
+    REQUIRE(cpu.Execute(2) == 21 + 16);
+    REQUIRE(ports.outs.size() == 2);
+    REQUIRE(ports.outs[0] == std::pair<std::uint16_t, std::uint8_t>{ 0x0198, 0xA2 });
+    REQUIRE(ports.outs[1] == std::pair<std::uint16_t, std::uint8_t>{ 0x0098, 0xA1 });
+    REQUIRE(cpu.GetHl() == 0x5FFF);
+}
+
+TEST_CASE("OTIR that pages its own code out fetches the new bank's code next", "[ed][block][otir][mapper]")
+{
+    // Running from bank 0 at 0xC000, the first OUT pages bank 1 in under PC.
+    // Bank 1 holds NOPs there, so the CPU must not carry on with the OTIR.
+    std::vector<std::unique_ptr<Spectrum128Mapper>> mappers;    // one per machine, outliving them all
+    const auto setup = [&mappers](Bus& bus, Cpu& cpu)
+    {
+        Spectrum128Mapper* mapper = mappers.emplace_back(std::make_unique<Spectrum128Mapper>()).get();
+        mapper->Attach(bus);
+        mapper->Ram(0)[0] = 0xED;
+        mapper->Ram(0)[1] = 0xB3;
+        mapper->Ram(2)[0] = 0x01;                   // bytes to send, at 0x8000
+        mapper->Ram(2)[1] = 0x02;
+        cpu.Reset(0xC000);
+        cpu.SetHl(0x8000);
+        cpu.SetBc(0x80FD);
+    };
+
+    Machine machine(setup);
+    machine.cpu.Run(100);
+    REQUIRE(machine.cpu.GetB() == 0x7F);
+    REQUIRE(machine.cpu.GetPc() > 0xC002);
+
+    for (std::uint64_t tstates : { 21u, 22u, 50u, 100u })
+        RequireRunMatchesSteps(setup, tstates);
+}
+
+// **********************************************
+// *        BULK RUNS MATCH SINGLE ITERATIONS   *
+// **********************************************
+TEST_CASE("Run and Execute leave block instructions where single steps would", "[ed][block][equivalence]")
+{
+    using Setup = std::function<void(Bus&, Cpu&)>;
+    const std::vector<std::pair<const char*, Setup>> cases = {
+        { "LDIR across pages", [](Bus& bus, Cpu& cpu)
+            {
+                bus.WriteBlock(0x0100, std::vector<std::uint8_t>{ 0xED, 0xB0, 0x3C });
+                for (std::uint16_t i = 0; i < 0x0900; ++i)
+                    bus.Write(static_cast<std::uint16_t>(0x23F0 + i), static_cast<std::uint8_t>(i ^ 0x5A));
+                cpu.Reset(0x0100);
+                cpu.SetHl(0x23F0);
+                cpu.SetDe(0x77F7);
+                cpu.SetBc(0x0900);
+            } },
+        { "LDIR fill with a 3-byte period", [](Bus& bus, Cpu& cpu)
+            {
+                bus.WriteBlock(0x0100, std::vector<std::uint8_t>{ 0xED, 0xB0 });
+                bus.WriteBlock(0x4000, std::vector<std::uint8_t>{ 1, 2, 3 });
+                cpu.Reset(0x0100);
+                cpu.SetHl(0x4000);
+                cpu.SetDe(0x4003);
+                cpu.SetBc(0x0500);
+            } },
+        { "LDDR overlapping downwards", [](Bus& bus, Cpu& cpu)
+            {
+                bus.WriteBlock(0x0100, std::vector<std::uint8_t>{ 0xED, 0xB8 });
+                for (std::uint16_t i = 0; i < 0x0600; ++i)
+                    bus.Write(static_cast<std::uint16_t>(0x5000 + i), static_cast<std::uint8_t>(i * 7));
+                cpu.Reset(0x0100);
+                cpu.SetHl(0x55FF);
+                cpu.SetDe(0x5602);
+                cpu.SetBc(0x0600);
+            } },
+        { "LDIR over its own code", [](Bus& bus, Cpu& cpu)
+            {
+                bus.WriteBlock(0x0200, std::vector<std::uint8_t>{ 0xED, 0xB0 });
+                bus.WriteBlock(0x3000, std::vector<std::uint8_t>{ 0xED, 0xB0, 0xED, 0xB0, 0x04, 0x04 });
+                cpu.Reset(0x0200);
+                cpu.SetHl(0x3000);
+                cpu.SetDe(0x01FE);
+                cpu.SetBc(0x0006);
+            } },
+        { "CPIR finding a byte two pages on", [](Bus& bus, Cpu& cpu)
+            {
+                bus.WriteBlock(0x0100, std::vector<std::uint8_t>{ 0xED, 0xB1 });
+                bus.Fill(0x1000, 0x1000, 0x20);
+                bus.Write(0x1A00, 0x0D);
+                cpu.Reset(0x0100);
+                cpu.SetA(0x0D);
+                cpu.SetHl(0x1000);
+                cpu.SetBc(0x0000);          // 64K
+            } },
+        { "CPDR through the 64K wrap", [](Bus& bus, Cpu& cpu)
+            {
+                bus.WriteBlock(0x8000, std::vector<std::uint8_t>{ 0xED, 0xB9 });
+                bus.Write(0xFF00, 0x42);
+                cpu.Reset(0x8000);
+                cpu.SetA(0x42);
+                cpu.SetHl(0x0200);
+                cpu.SetBc(0x0400);
+            } },
+    };
+
+    for (const auto& [name, setup] : cases)
+    {
+        CAPTURE(name);
+        for (std::uint64_t tstates : { 1u, 21u, 22u, 42u, 43u, 1000u, 21500u, 60000u, 3000000u })
+            RequireRunMatchesSteps(setup, tstates);
+        for (std::uint64_t instructions : { 1u, 2u, 7u, 1024u, 1025u, 5000u })
+            RequireExecuteMatchesSteps(setup, instructions);
+    }
+}
+
+// **********************************************
+// *            OTHER ED OPCODES                *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "ED opcodes without a handler are reported and take 8 T-states", "[ed]")
+{
+    Load(bus, 0x0000, { 0xED, 0x44 });      // NEG, not implemented yet
+
+    REQUIRE(cpu.Step() == 8);
+    REQUIRE(cpu.GetPc() == 0x0002);
+    REQUIRE(cpu.has_unimplemented());
+    REQUIRE(cpu.last_unimplemented() == 0xED);
+}
@@ -0,0 +1,167 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include <array>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Logs every access and answers reads with the low address byte
+    struct RecordingDevice : MemoryDevice
+    {
+        std::vector<std::uint16_t> reads;
+        std::vector<std::pair<std::uint16_t, std::uint8_t>> writes;
+
+        std::uint8_t Read(std::uint16_t address) override
+        {
+            reads.push_back(address);
+            return static_cast<std::uint8_t>(address);
+        }
+
+        void Write(std::uint16_t address, std::uint8_t value) override
+        {
+            writes.emplace_back(address, value);
+        }
+    };
+
+    std::vector<std::uint8_t> Pattern(std::size_t size)
+    {
+        std::vector<std::uint8_t> bytes(size);
+        for (std::size_t i = 0; i < size; ++i)
+            bytes[i] = static_cast<std::uint8_t>(i * 13 + 1);
+        return bytes;
+    }
+}
+
+// **********************************************
+// *             READBLOCK / WRITEBLOCK         *
+// **********************************************
+TEST_CASE("ReadBlock returns what the byte loop would, across pages and the wrap", "[bus][block]")
+{
+    Bus bus;
+    const std::vector<std::uint8_t> data = Pattern(3000);
+    bus.WriteBlock(0xFA00, data);
+
+    std::vector<std::uint8_t> out(data.size());
+    bus.ReadBlock(0xFA00, out);
+
+    REQUIRE(out == data);
+    for (std::size_t i = 0; i < data.size(); ++i)
+        REQUIRE(bus.Read(static_cast<std::uint16_t>(0xFA00 + i)) == data[i]);
+}
+
+TEST_CASE("WriteBlock drops ROM writes and leaves the RAM around them written", "[bus][block]")
+{
+    Bus bus;
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> rom;
+    rom.fill(0xC9);
+    bus.MapRom(2, 1, rom.data());
+
+    bus.WriteBlock(0x07FF, std::vector<std::uint8_t>(Bus::MAP_PAGE_SIZE + 2, 0x55));
+
+    REQUIRE(bus.Read(0x07FF) == 0x55);
+    REQUIRE(bus.Read(0x0800) == 0xC9);
+    REQUIRE(bus.Read(0x0BFF) == 0xC9);
+    REQUIRE(bus.Read(0x0C00) == 0x55);
+    REQUIRE(rom[0] == 0xC9);
+}
+
+TEST_CASE("Block reads and writes give device pages every byte in order", "[bus][block]")
+{
+    Bus bus;
+    RecordingDevice device;
+    bus.MapDevice(1, 1, &device);
+
+    std::array<std::uint8_t, 4> out{};
+    bus.ReadBlock(0x07FE, out);
+    REQUIRE(out == std::array<std::uint8_t, 4>{ 0xFE, 0xFF, 0x00, 0x00 });
+    REQUIRE(device.reads == std::vector<std::uint16_t>{ 0x07FE, 0x07FF });
+
+    bus.WriteBlock(0x07FF, std::vector<std::uint8_t>{ 0xAA, 0xBB });
+    REQUIRE(device.writes.size() == 1);
+    REQUIRE(device.writes[0] == std::pair<std::uint16_t, std::uint8_t>{ 0x07FF, 0xAA });
+    REQUIRE(bus.Read(0x0800) == 0xBB);
+}
+
+// **********************************************
+// *                    FILL                    *
+// **********************************************
+TEST_CASE("Fill sets RAM, wraps at 64K and skips ROM", "[bus][block]")
+{
+    Bus bus;
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> rom{};
+    bus.MapRom(0, 1, rom.data());
+
+    bus.Fill(0xFFF0, 0x20, 0xE5);
+
+    REQUIRE(bus.Read(0xFFEF) == 0x00);
+    REQUIRE(bus.Read(0xFFF0) == 0xE5);
+    REQUIRE(bus.Read(0xFFFF) == 0xE5);
+    REQUIRE(bus.Read(0x0000) == 0x00);
+    REQUIRE(bus.Read(0x000F) == 0x00);
+    REQUIRE(rom[0] == 0x00);
+
+    bus.Fill(0x1000, 0, 0xE5);
+    REQUIRE(bus.Read(0x1000) == 0x00);
+}
+
+TEST_CASE("Fill hands device pages one write per byte", "[bus][block]")
+{
+    Bus bus;
+    RecordingDevice device;
+    bus.MapDevice(63, 1, &device);
+
+    bus.Fill(0xFFFE, 4, 0x7E);
+
+    REQUIRE(device.writes.size() == 2);
+    REQUIRE(device.writes[1] == std::pair<std::uint16_t, std::uint8_t>{ 0xFFFF, 0x7E });
+    REQUIRE(bus.Read(0x0001) == 0x7E);
+}
+
+TEST_CASE("Filling over code that already ran replaces it", "[bus][block][decode-cache]")
+{
+    Bus bus;
+    Cpu cpu;
+    cpu.Connect(&bus);
+
+    bus.Fill(0x0000, 4, 0x3C);      // INC A
+    cpu.Reset(0x0000);
+    cpu.Step();
+    bus.Fill(0x0000, 4, 0x04);      // INC B
+    cpu.Reset(0x0000);
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x01);
+    REQUIRE(cpu.GetB() == 0x01);
+}
+
+// **********************************************
+// *                  COMPARE                   *
+// **********************************************
+TEST_CASE("Compare counts the matching prefix", "[bus][block]")
+{
+    Bus bus;
+    std::vector<std::uint8_t> data = Pattern(2500);
+    bus.WriteBlock(0xFC00, data);
+
+    REQUIRE(bus.Compare(0xFC00, data) == data.size());
+    REQUIRE(bus.Compare(0xFC00, std::span<const std::uint8_t>{}) == 0);
+
+    data[1500] ^= 0xFF;     // past the 64K wrap
+    REQUIRE(bus.Compare(0xFC00, data) == 1500);
+
+    data[3] ^= 0xFF;
+    REQUIRE(bus.Compare(0xFC00, data) == 3);
+}
+
+TEST_CASE("Compare reads device pages through the device", "[bus][block]")
+{
+    Bus bus;
+    RecordingDevice device;
+    bus.MapDevice(1, 1, &device);
+
+    const std::vector<std::uint8_t> expected = { 0x00, 0x01, 0x02, 0x09 };
+    REQUIRE(bus.Compare(0x0400, expected) == 3);
+    REQUIRE(device.reads.size() == 4);
+}
@@ -106,3 +106,46 @@ TEST_CASE_METHOD(CpuFixture, "0x76 sets HALT state (not treated as LD (HL),(HL))
 
     REQUIRE(cpu.is_halted() == true);
 }
+
+// **********************************************
+// *   UNIMPLEMENTED OP CODE   ::   0xC7        *
+// **********************************************
+// *                                            *
+// *  Runs as a NOP but is reported, not lost   *
+// *                                            *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "Unimplemented opcode is reported and skipped", "[cpu][dispatch]")
+{
+    bus.Write(0x0000, 0xC7);
+    bus.Write(0x0001, 0x00);
+
+    cpu.Step();
+
+    REQUIRE(cpu.has_unimplemented());
+    REQUIRE(cpu.last_unimplemented() == 0xC7);
+    REQUIRE(cpu.GetPc() == 0x0001);
+
+    cpu.Reset();
+    REQUIRE_FALSE(cpu.has_unimplemented());
+}
+
+// **********************************************
+// *   EXECUTE N INSTRUCTIONS IN ONE CALL       *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "Execute(n) runs n instructions back to back", "[cpu][dispatch]")
+{
+    bus.Write(0x0000, 0x3E); // LD A,0x01
+    bus.Write(0x0001, 0x01);
+    bus.Write(0x0002, 0x47); // LD B,A
+    bus.Write(0x0003, 0x80); // ADD A,B
+    bus.Write(0x0004, 0x3C); // INC A
+
+    cpu.Execute(4);
+
+    REQUIRE(cpu.GetA() == 0x03);
+    REQUIRE(cpu.GetB() == 0x01);
+    REQUIRE(cpu.GetPc() == 0x0005);
+
+    cpu.Execute(0);
+    REQUIRE(cpu.GetPc() == 0x0005);
+}
@@ -0,0 +1,128 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+
+struct CpuFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    CpuFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+    }
+};
+
+// **********************************************
+// *          CODE REWRITTEN AT RUNTIME         *
+// **********************************************
+// *                                            *
+// *  Whatever the build caches, re-running an  *
+// *  address must see the bytes in memory now. *
+// *                                            *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "Opcode replaced by the host is picked up on the next run", "[decode-cache]")
+{
+    bus.Write(0x0000, 0x3C); // INC A
+
+    cpu.Step();
+    REQUIRE(cpu.GetA() == 0x01);
+
+    bus.Write(0x0000, 0x04); // INC B
+    cpu.Reset(0x0000);
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x01);
+    REQUIRE(cpu.GetB() == 0x01);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Opcode rewritten by the program itself is picked up on the next run", "[decode-cache]")
+{
+    bus.Write(0x0000, 0x3C); // INC A
+    bus.Write(0x0001, 0x21); // LD HL,0x0000
+    bus.Write(0x0002, 0x00);
+    bus.Write(0x0003, 0x00);
+    bus.Write(0x0004, 0x36); // LD (HL),0x04   -> INC B
+    bus.Write(0x0005, 0x04);
+
+    cpu.Execute(3);
+    REQUIRE(cpu.GetA() == 0x01);
+
+    cpu.Reset(0x0000);
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x01);
+    REQUIRE(cpu.GetB() == 0x01);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Immediate operand rewritten by the program is picked up on the next run", "[decode-cache]")
+{
+    bus.Write(0x0000, 0x3E); // LD A,0x11
+    bus.Write(0x0001, 0x11);
+    bus.Write(0x0002, 0x21); // LD HL,0x0001
+    bus.Write(0x0003, 0x01);
+    bus.Write(0x0004, 0x00);
+    bus.Write(0x0005, 0x36); // LD (HL),0x22
+    bus.Write(0x0006, 0x22);
+
+    cpu.Execute(3);
+    REQUIRE(cpu.GetA() == 0x11);
+
+    cpu.Reset(0x0000);
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x22);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Operand on the next page is picked up when only that page is written", "[decode-cache]")
+{
+    bus.Write(0x00FF, 0x3E); // LD A,n with n at 0x0100
+    bus.Write(0x0100, 0x11);
+
+    cpu.Reset(0x00FF);
+    cpu.Step();
+    REQUIRE(cpu.GetA() == 0x11);
+
+    bus.Write(0x0100, 0x22);
+    cpu.Reset(0x00FF);
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x22);
+    REQUIRE(cpu.GetPc() == 0x0101);
+}
+
+#if defined(Z80EMU_DECODE_CACHE)
+// **********************************************
+// *          BUS CODE PAGE TRACKING            *
+// **********************************************
+TEST_CASE("Writes only bump the generation of watched pages, once per watch", "[decode-cache][bus]")
+{
+    Bus bus;
+
+    bus.Write(0x1234, 0xAA);
+    REQUIRE(bus.CodeGeneration() == 0);
+
+    bus.WatchCodePage(0x12);
+    bus.Write(0x1200, 0xBB);
+    bus.Write(0x12FF, 0xCC);    // no longer watched
+
+    REQUIRE(bus.CodeGeneration() == 1);
+    REQUIRE(bus.PageGeneration(0x12) == 1);
+    REQUIRE(bus.PageGeneration(0x13) == 0);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Data writes outside the code pages leave the cache alone", "[decode-cache]")
+{
+    bus.Write(0x0000, 0x21); // LD HL,0x8000
+    bus.Write(0x0001, 0x00);
+    bus.Write(0x0002, 0x80);
+    bus.Write(0x0003, 0x36); // LD (HL),0x55
+    bus.Write(0x0004, 0x55);
+
+    cpu.Execute(2);
+
+    REQUIRE(bus.Read(0x8000) == 0x55);
+    REQUIRE(bus.CodeGeneration() == 0);
+}
+#endif
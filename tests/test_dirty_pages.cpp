@@ -0,0 +1,148 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct DirtyFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    DirtyFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+        bus.ClearDirty();
+    }
+};
+
+namespace
+{
+    // Answers reads with the low address byte and ignores writes
+    struct NullDevice : MemoryDevice
+    {
+        std::uint8_t Read(std::uint16_t address) override { return static_cast<std::uint8_t>(address); }
+        void Write(std::uint16_t, std::uint8_t) override {}
+    };
+
+    Bus::PageSet Pages(std::initializer_list<std::size_t> pages)
+    {
+        Bus::PageSet set;
+        for (const std::size_t page : pages)
+            set.set(page);
+        return set;
+    }
+}
+
+// **********************************************
+// *              COLLECT / CLEAR               *
+// **********************************************
+TEST_CASE("Every page counts as dirty until the first ClearDirty", "[dirty][bus]")
+{
+    Bus bus;
+    REQUIRE(bus.CollectDirty().all());
+
+    bus.ClearDirty();
+    REQUIRE(bus.CollectDirty().none());
+}
+
+TEST_CASE_METHOD(DirtyFixture, "Write marks the page it lands in", "[dirty][bus]")
+{
+    bus.Write(0x0000, 0x01);
+    bus.Write(0x13FF, 0x02);
+    bus.Write(0x1400, 0x03);
+    bus.Write(0x1401, 0x04);
+
+    REQUIRE(bus.CollectDirty() == Pages({ 0, 4, 5 }));
+    REQUIRE(bus.Read(0x13FF) == 0x02);
+    REQUIRE(bus.Read(0x1401) == 0x04);
+
+    bus.ClearDirty();
+    REQUIRE(bus.CollectDirty().none());
+    bus.Write(0x13FF, 0x05);
+    REQUIRE(bus.CollectDirty() == Pages({ 4 }));
+    REQUIRE(bus.Read(0x13FF) == 0x05);
+}
+
+TEST_CASE_METHOD(DirtyFixture, "Block writes mark every page they touch, across the wrap", "[dirty][bus]")
+{
+    SECTION("WriteBlock")
+    {
+        bus.WriteBlock(0xFFFE, std::vector<std::uint8_t>(4, 0xAA));
+    }
+
+    SECTION("Fill")
+    {
+        bus.Fill(0xFFFE, 4, 0xAA);
+    }
+
+    SECTION("RestoreRam")
+    {
+        const std::vector<std::uint8_t> bytes(2, 0xAA);
+        bus.RestoreRam(0xFFFE, bytes);
+        bus.RestoreRam(0x0000, bytes);
+    }
+
+    REQUIRE(bus.CollectDirty() == Pages({ 0, 63 }));
+}
+
+TEST_CASE_METHOD(DirtyFixture, "Writes that miss own RAM are not counted", "[dirty][bus]")
+{
+    const std::vector<std::uint8_t> rom(Bus::MAP_PAGE_SIZE, 0xC9);
+    std::vector<std::uint8_t> external(Bus::MAP_PAGE_SIZE);
+    NullDevice device;
+    bus.MapRom(0, 1, rom.data());
+    bus.MapDevice(1, 1, &device);
+    bus.MapRam(2, 1, external.data());
+
+    bus.Write(0x0000, 0x01);
+    bus.Write(0x0400, 0x01);
+    bus.Write(0x0800, 0x01);
+
+    REQUIRE(bus.CollectDirty().none());
+    REQUIRE(external[0] == 0x01);
+}
+
+TEST_CASE_METHOD(DirtyFixture, "Own RAM mapped back in is still tracked", "[dirty][bus]")
+{
+    const std::vector<std::uint8_t> rom(Bus::MAP_PAGE_SIZE, 0xC9);
+    bus.MapRom(0, 1, rom.data());
+    bus.ClearDirty();
+    bus.UnmapAll();
+
+    bus.Write(0x0000, 0x01);
+    REQUIRE(bus.CollectDirty() == Pages({ 0 }));
+    REQUIRE(bus.Read(0x0000) == 0x01);
+}
+
+TEST_CASE_METHOD(DirtyFixture, "Instructions mark the pages they write", "[dirty][cpu]")
+{
+    // LD HL,0x8000 ; LD (HL),A ; LDIR from 0x4000 to 0x9000, 0x800 bytes
+    bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0x21, 0x00, 0x80, 0x77,
+                                                       0x21, 0x00, 0x40, 0x11, 0x00, 0x90, 0x01, 0x00, 0x08, 0xED, 0xB0 });
+    bus.ClearDirty();
+    cpu.Execute(5 + 0x800);
+
+    REQUIRE(cpu.GetBc() == 0x0000);
+    REQUIRE(bus.CollectDirty() == Pages({ 0x20, 0x24, 0x25 }));
+}
+
+TEST_CASE("Forks track their own writes", "[dirty][fork]")
+{
+    Bus parent;
+    parent.ClearDirty();
+    parent.Write(0x0000, 0x01);
+    const std::unique_ptr<Bus> child = parent.Fork();
+
+    REQUIRE(child->CollectDirty() == Pages({ 0 }));
+    child->ClearDirty();
+    child->Write(0x0400, 0x02);
+    parent.Write(0x0800, 0x03);
+
+    REQUIRE(child->CollectDirty() == Pages({ 1 }));
+    REQUIRE(parent.CollectDirty() == Pages({ 0, 2 }));
+    REQUIRE(parent.Read(0x0400) == 0x00);
+    REQUIRE(child->Read(0x0800) == 0x00);
+}
@@ -0,0 +1,145 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Divergence.h"
+#include "Machine.h"
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+    // Two machines that start the same and differ in one byte of ROM, which
+    // is not part of the state that is compared
+    struct Twins
+    {
+        Machine first;
+        Machine second;
+        std::vector<std::uint8_t> firstRom;
+        std::vector<std::uint8_t> secondRom;
+
+        // `rom` mapped from `firstPage` into both, with `address` changed
+        // to `value` in the second
+        Twins(std::size_t firstPage, std::vector<std::uint8_t> rom, std::uint16_t address, std::uint8_t value)
+            : firstRom(rom),
+              secondRom(std::move(rom))
+        {
+            secondRom[address - firstPage * Bus::MAP_PAGE_SIZE] = value;
+            const std::size_t pages = firstRom.size() / Bus::MAP_PAGE_SIZE;
+            first.GetBus().MapRom(firstPage, pages, firstRom.data());
+            second.GetBus().MapRom(firstPage, pages, secondRom.data());
+        }
+
+        void SetHl(std::uint16_t value)
+        {
+            first.GetCpu().SetHl(value);
+            second.GetCpu().SetHl(value);
+        }
+    };
+
+    // NOPs with `code` at `address`
+    std::vector<std::uint8_t> Page(std::uint16_t address, const std::vector<std::uint8_t>& code)
+    {
+        std::vector<std::uint8_t> page(Bus::MAP_PAGE_SIZE, 0x00);
+        std::copy(code.begin(), code.end(), page.begin() + address);
+        return page;
+    }
+}
+
+// **********************************************
+// *            FINDING THE INSTRUCTION         *
+// **********************************************
+TEST_CASE("A register difference is traced to the instruction that made it", "[divergence]")
+{
+    Twins twins(0, Page(0x0200, { 0x3E, 0x11 }), 0x0201, 0x22);     // LD A,11h / LD A,22h
+
+    DivergenceConfig config;
+    config.checkpoint = 4096;
+    config.linear = 16;
+    const Divergence divergence = DivergenceFinder::Find(twins.first, twins.second, 1000000, config);
+
+    REQUIRE(divergence.found);
+    REQUIRE_FALSE(divergence.atStart);
+    REQUIRE(divergence.instruction == 0x0200);
+    REQUIRE(divergence.pc == 0x0200);
+    REQUIRE(divergence.bytes == std::array<std::uint8_t, 4>{ 0x3E, 0x11, 0x00, 0x00 });
+    REQUIRE(divergence.field == "A");
+    REQUIRE(divergence.first == 0x11);
+    REQUIRE(divergence.second == 0x22);
+    REQUIRE(divergence.firstState.pc == 0x0202);
+}
+
+TEST_CASE("A memory difference names the byte", "[divergence]")
+{
+    Twins twins(0, Page(0x0100, { 0x36, 0x11 }), 0x0101, 0x22);     // LD (HL),11h / LD (HL),22h
+    twins.SetHl(0xC000);
+
+    const Divergence divergence = DivergenceFinder::Find(twins.first, twins.second, 1000000);
+
+    REQUIRE(divergence.found);
+    REQUIRE(divergence.instruction == 0x0100);
+    REQUIRE(divergence.field == "memory");
+    REQUIRE(divergence.address == 0xC000);
+    REQUIRE(divergence.first == 0x11);
+    REQUIRE(divergence.second == 0x22);
+    REQUIRE(divergence.firstState == divergence.secondState);
+}
+
+TEST_CASE("A difference many checkpoints in is found by bisection", "[divergence]")
+{
+    // LD A,(HL) ; ADD A,B ; LD B,A ; INC HL once per trip round the 64K,
+    // which is NOPs and the ROM at 8000h, so B sums the bytes HL walks
+    // over. The last ROM byte is LD A,A in the second machine: the same as a
+    // NOP when it runs, but not when it is loaded on the 21st trip, and B
+    // keeps the difference from then on.
+    Twins twins(0x20, std::vector<std::uint8_t>(0x4000, 0x00), 0xBFFF, 0x7F);
+    twins.first.GetBus().WriteBlock(0xFFFC, std::vector<std::uint8_t>{ 0x7E, 0x80, 0x47, 0x23 });
+    twins.second.GetBus().WriteBlock(0xFFFC, std::vector<std::uint8_t>{ 0x7E, 0x80, 0x47, 0x23 });
+    twins.SetHl(0xBFFF - 20);
+    const std::uint64_t expected = 20 * 65536 + 65532;
+
+    DivergenceConfig config;
+    config.checkpoint = 100000;
+    SECTION("in parallel") { config.parallel = true; }
+    SECTION("on one thread") { config.parallel = false; config.linear = 1; }
+
+    const Divergence divergence = DivergenceFinder::Find(twins.first, twins.second, 10000000, config);
+
+    REQUIRE(divergence.found);
+    REQUIRE(divergence.instruction == expected);
+    REQUIRE(divergence.pc == 0xFFFC);
+    REQUIRE(divergence.field == "A");
+    REQUIRE(divergence.first == 0x00);
+    REQUIRE(divergence.second == 0x7F);
+    REQUIRE(divergence.firstState.hl == 0xBFFF);
+    REQUIRE(divergence.firstState.tstates == divergence.secondState.tstates);
+}
+
+// **********************************************
+// *          NO DIFFERENCE, OR FROM START      *
+// **********************************************
+TEST_CASE("Runs that agree up to the limit report nothing and are left alone", "[divergence]")
+{
+    Twins twins(0, Page(0x0200, { 0x3E, 0x11 }), 0x0201, 0x22);
+
+    REQUIRE_FALSE(DivergenceFinder::Find(twins.first, twins.second, 0x0200).found);
+    REQUIRE(DivergenceFinder::Find(twins.first, twins.second, 0x0201).found);
+    REQUIRE(twins.first.GetCpu().GetPc() == 0x0000);
+    REQUIRE(twins.second.GetCpu().GetTStates() == 0);
+}
+
+TEST_CASE("Machines that differ before they start are reported at once", "[divergence]")
+{
+    Machine first;
+    Machine second;
+    second.GetBus().Write(0x1234, 0x56);
+
+    Divergence divergence = DivergenceFinder::Find(first, second, 1000);
+    REQUIRE(divergence.found);
+    REQUIRE(divergence.atStart);
+    REQUIRE(divergence.field == "memory");
+    REQUIRE(divergence.address == 0x1234);
+
+    second.GetBus().Write(0x1234, 0x00);
+    second.GetCpu().SetDe(0x0001);
+    divergence = DivergenceFinder::Find(first, second, 1000);
+    REQUIRE(divergence.atStart);
+    REQUIRE(divergence.field == "E");
+}
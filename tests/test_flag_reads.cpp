@@ -0,0 +1,123 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+
+struct CpuFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    CpuFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+    }
+};
+
+// **********************************************
+// *      READING F AFTER AN ALU OP             *
+// **********************************************
+// *                                            *
+// *  Every way F can be read after it was set  *
+// *  by an ALU op. With Z80EMU_LAZY_FLAGS on,  *
+// *  these are the points where F is built.    *
+// *                                            *
+// **********************************************
+
+TEST_CASE_METHOD(CpuFixture, "PUSH AF after ADD pushes the ADD flags", "[flags][stack]")
+{
+    bus.Write(0x0000, 0x80); // ADD A,B
+    bus.Write(0x0001, 0xF5); // PUSH AF
+
+    cpu.SetSp(0x1000);
+    cpu.SetA(0x7F);
+    cpu.SetB(0x01);
+
+    cpu.Step();
+    cpu.Step();
+
+    REQUIRE(bus.Read(0x0FFF) == 0x80);
+    REQUIRE(bus.Read(0x0FFE) == (Cpu::FLAG_S | Cpu::FLAG_H | Cpu::FLAG_PV));
+    REQUIRE(cpu.GetAf() == 0x8094);
+}
+
+TEST_CASE_METHOD(CpuFixture, "ADC takes its carry from a preceding SUB borrow", "[flags][alu8]")
+{
+    bus.Write(0x0000, 0x90); // SUB B      0x00 - 0x01 borrows
+    bus.Write(0x0001, 0x89); // ADC A,C    0xFF + 0x00 + 1
+
+    cpu.SetA(0x00);
+    cpu.SetB(0x01);
+    cpu.SetC(0x00);
+
+    cpu.Step();
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x00);
+    REQUIRE(cpu.GetF() == (Cpu::FLAG_Z | Cpu::FLAG_H | Cpu::FLAG_C));
+}
+
+TEST_CASE_METHOD(CpuFixture, "INC keeps the carry from a preceding ADD", "[flags][incdec]")
+{
+    bus.Write(0x0000, 0x80); // ADD A,B    0xFF + 0x02 carries
+    bus.Write(0x0001, 0x04); // INC B
+
+    cpu.SetA(0xFF);
+    cpu.SetB(0x02);
+
+    cpu.Step();
+    cpu.Step();
+
+    REQUIRE(cpu.GetB() == 0x03);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_C) == 1);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_N) == 0);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_Z) == 0);
+}
+
+TEST_CASE_METHOD(CpuFixture, "DEC then SBC chains carry through two lazy ops", "[flags][alu8]")
+{
+    bus.Write(0x0000, 0xC6); // ADD A,0x01  0xFF + 1 carries
+    bus.Write(0x0001, 0x01);
+    bus.Write(0x0002, 0x05); // DEC B       keeps C
+    bus.Write(0x0003, 0x98); // SBC A,B     0x00 - 0x00 - 1
+
+    cpu.SetA(0xFF);
+    cpu.SetB(0x01);
+
+    cpu.Execute(3);
+
+    REQUIRE(cpu.GetA() == 0xFF);
+    REQUIRE(cpu.GetF() == (Cpu::FLAG_S | Cpu::FLAG_H | Cpu::FLAG_N | Cpu::FLAG_C));
+}
+
+TEST_CASE_METHOD(CpuFixture, "SCF after a logic op only changes C, H and N", "[flags][scf]")
+{
+    bus.Write(0x0000, 0xE6); // AND 0x00
+    bus.Write(0x0001, 0x00);
+    bus.Write(0x0002, 0x37); // SCF
+
+    cpu.SetA(0xFF);
+
+    cpu.Step();
+    cpu.Step();
+
+    REQUIRE(cpu.GetF() == (Cpu::FLAG_Z | Cpu::FLAG_PV | Cpu::FLAG_C));
+}
+
+TEST_CASE_METHOD(CpuFixture, "POP AF replaces flags left pending by an ALU op", "[flags][stack]")
+{
+    bus.Write(0x0000, 0x90); // SUB B
+    bus.Write(0x0001, 0xF1); // POP AF
+    bus.Write(0x0F00, 0x00); // F
+    bus.Write(0x0F01, 0x12); // A
+
+    cpu.SetSp(0x0F00);
+    cpu.SetA(0x00);
+    cpu.SetB(0x01);
+
+    cpu.Step();
+    cpu.Step();
+
+    REQUIRE(cpu.GetAf() == 0x1200);
+    REQUIRE(cpu.GetF() == 0x00);
+}
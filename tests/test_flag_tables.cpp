@@ -0,0 +1,235 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include "FlagTables.h"
+
+struct CpuFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    CpuFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+    }
+};
+
+// **********************************************
+// *        REFERENCE FLAG FORMULAS             *
+// **********************************************
+// *                                            *
+// *  The bit-by-bit versions the tables        *
+// *  replaced. Every table entry must match.   *
+// *                                            *
+// **********************************************
+namespace
+{
+    bool Parity(uint8_t value)
+    {
+        bool parity = true; // even parity
+        while (value)
+        {
+            parity = !parity;
+            value &= (value - 1);
+        }
+        return parity;
+    }
+
+    uint8_t RefSzp(uint8_t result)
+    {
+        uint8_t f = 0;
+        if (result & 0x80) f |= Cpu::FLAG_S;
+        if (result == 0)   f |= Cpu::FLAG_Z;
+        if (Parity(result)) f |= Cpu::FLAG_PV;
+        return f;
+    }
+
+    uint8_t RefInc(uint8_t v)
+    {
+        const uint8_t r = static_cast<uint8_t>(v + 1);
+        uint8_t f = 0;
+        if (r & 0x80) f |= Cpu::FLAG_S;
+        if (r == 0)   f |= Cpu::FLAG_Z;
+        if ((v & 0x0F) == 0x0F) f |= Cpu::FLAG_H;
+        if (v == 0x7F) f |= Cpu::FLAG_PV;
+        return f;
+    }
+
+    uint8_t RefDec(uint8_t v)
+    {
+        const uint8_t r = static_cast<uint8_t>(v - 1);
+        uint8_t f = Cpu::FLAG_N;
+        if (r & 0x80) f |= Cpu::FLAG_S;
+        if (r == 0)   f |= Cpu::FLAG_Z;
+        if ((v & 0x0F) == 0x00) f |= Cpu::FLAG_H;
+        if (v == 0x80) f |= Cpu::FLAG_PV;
+        return f;
+    }
+
+    uint8_t RefAdd(uint8_t lhs, uint8_t rhs, uint8_t carryIn)
+    {
+        const uint16_t sum = static_cast<uint16_t>(lhs) + rhs + carryIn;
+        const uint8_t result = static_cast<uint8_t>(sum);
+
+        uint8_t f = 0;
+        if (result & 0x80) f |= Cpu::FLAG_S;
+        if (result == 0)   f |= Cpu::FLAG_Z;
+        if (((lhs & 0x0F) + (rhs & 0x0F) + carryIn) > 0x0F) f |= Cpu::FLAG_H;
+        if ((~(lhs ^ rhs) & (lhs ^ result) & 0x80) != 0)      f |= Cpu::FLAG_PV;
+        if (sum > 0xFF) f |= Cpu::FLAG_C;
+        return f;
+    }
+
+    uint8_t RefSub(uint8_t lhs, uint8_t rhs, uint8_t carryIn)
+    {
+        const uint16_t subtrahend = static_cast<uint16_t>(rhs) + carryIn;
+        const uint8_t result = static_cast<uint8_t>(lhs - rhs - carryIn);
+
+        uint8_t f = Cpu::FLAG_N;
+        if (result & 0x80) f |= Cpu::FLAG_S;
+        if (result == 0)   f |= Cpu::FLAG_Z;
+        if ((lhs & 0x0F) < ((rhs & 0x0F) + carryIn)) f |= Cpu::FLAG_H;
+        if (((lhs ^ rhs) & (lhs ^ result) & 0x80) != 0) f |= Cpu::FLAG_PV;
+        if (static_cast<uint16_t>(lhs) < subtrahend) f |= Cpu::FLAG_C;
+        return f;
+    }
+
+    // DAA worked out digit by digit, the way the Zilog manual's table reads
+    uint16_t RefDaa(uint8_t a, bool c, bool h, bool n)
+    {
+        const uint8_t hi = a >> 4;
+        const uint8_t lo = a & 0x0F;
+
+        uint8_t correction = 0;
+        bool carryOut = false;
+
+        if (lo > 9 || h)
+            correction += 0x06;
+        if (c || hi > 9 || (hi >= 9 && lo > 9))
+        {
+            correction += 0x60;
+            carryOut = true;
+        }
+
+        const uint8_t result = n ? static_cast<uint8_t>(a - correction) : static_cast<uint8_t>(a + correction);
+        const bool halfOut = n ? (h && lo < 6) : (lo > 9);
+
+        uint8_t f = RefSzp(result);
+        if (halfOut)  f |= Cpu::FLAG_H;
+        if (n)        f |= Cpu::FLAG_N;
+        if (carryOut) f |= Cpu::FLAG_C;
+        return static_cast<uint16_t>((result << 8) | f);
+    }
+}
+
+// **********************************************
+// *        EXHAUSTIVE TABLE CHECKS             *
+// **********************************************
+TEST_CASE("SZP table matches sign/zero/parity for every byte", "[flags][tables]")
+{
+    for (unsigned v = 0; v < 256; ++v)
+    {
+        CAPTURE(v);
+        REQUIRE(FlagTables::Szp[v] == RefSzp(uint8_t(v)));
+    }
+}
+
+TEST_CASE("INC and DEC tables match the Inc8/Dec8 formulas for every byte", "[flags][tables]")
+{
+    for (unsigned v = 0; v < 256; ++v)
+    {
+        CAPTURE(v);
+        REQUIRE(FlagTables::Inc[v] == RefInc(uint8_t(v)));
+        REQUIRE(FlagTables::Dec[v] == RefDec(uint8_t(v)));
+    }
+}
+
+TEST_CASE("ADD/ADC and SUB/SBC tables match for every operand pair and carry", "[flags][tables]")
+{
+    std::size_t addMismatches = 0;
+    std::size_t subMismatches = 0;
+
+    for (unsigned carry = 0; carry < 2; ++carry)
+        for (unsigned lhs = 0; lhs < 256; ++lhs)
+            for (unsigned rhs = 0; rhs < 256; ++rhs)
+            {
+                const auto i = FlagTables::AluIndex(uint8_t(lhs), uint8_t(rhs), uint8_t(carry));
+                if (FlagTables::Add[i] != RefAdd(uint8_t(lhs), uint8_t(rhs), uint8_t(carry))) ++addMismatches;
+                if (FlagTables::Sub[i] != RefSub(uint8_t(lhs), uint8_t(rhs), uint8_t(carry))) ++subMismatches;
+            }
+
+    REQUIRE(addMismatches == 0);
+    REQUIRE(subMismatches == 0);
+}
+
+TEST_CASE("DAA table matches the digit-by-digit adjust for every A and C/H/N", "[flags][tables][daa]")
+{
+    for (unsigned cnh = 0; cnh < 8; ++cnh)
+        for (unsigned a = 0; a < 256; ++a)
+        {
+            const bool c = cnh & 1;
+            const bool n = cnh & 2;
+            const bool h = cnh & 4;
+            const uint8_t f = static_cast<uint8_t>((c ? Cpu::FLAG_C : 0) | (n ? Cpu::FLAG_N : 0) | (h ? Cpu::FLAG_H : 0));
+
+            CAPTURE(a, c, h, n);
+            REQUIRE(FlagTables::Daa[FlagTables::DaaIndex(uint8_t(a), f)] == RefDaa(uint8_t(a), c, h, n));
+        }
+}
+
+// **********************************************
+// *           DAA   ::    OP CODE: 0x27        *
+// **********************************************
+// *                                            *
+// *     Decimal adjust A after BCD maths       *
+// *                                            *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "DAA (0x27) after ADD gives the BCD sum (15 + 27 = 42)", "[alu8][daa]")
+{
+    bus.Write(0x0000, 0xC6); // ADD A,0x27
+    bus.Write(0x0001, 0x27);
+    bus.Write(0x0002, 0x27); // DAA
+
+    cpu.SetA(0x15);
+
+    cpu.Step();
+    REQUIRE(cpu.GetA() == 0x3C);
+
+    cpu.Step();
+    REQUIRE(cpu.GetA() == 0x42);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_C) == 0);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_N) == 0);
+}
+
+TEST_CASE_METHOD(CpuFixture, "DAA (0x27) after SUB gives the BCD difference with borrow (10 - 20 = 90)", "[alu8][daa]")
+{
+    bus.Write(0x0000, 0x90); // SUB B
+    bus.Write(0x0001, 0x27); // DAA
+
+    cpu.SetA(0x10);
+    cpu.SetB(0x20);
+
+    cpu.Step();
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x90);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_C) != 0);
+    REQUIRE(cpu.GetFlag(Cpu::FLAG_N) != 0);
+}
+
+// **********************************************
+// *           CP n   ::     OP CODE: 0xFE      *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "CP n sets the full SUB flag set without touching A", "[cpu][alu][cp]")
+{
+    bus.Write(0x0000, 0xFE); // CP 0x01
+    bus.Write(0x0001, 0x01);
+
+    cpu.SetA(0x80);
+
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x80);
+    REQUIRE(cpu.GetF() == (Cpu::FLAG_H | Cpu::FLAG_PV | Cpu::FLAG_N)); // 0x80 - 1 = 0x7F overflows
+}
@@ -0,0 +1,240 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Machine.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    // Logs every write and answers reads with the low address byte
+    struct RecordingDevice : MemoryDevice
+    {
+        std::vector<std::pair<std::uint16_t, std::uint8_t>> writes;
+
+        std::uint8_t Read(std::uint16_t address) override { return static_cast<std::uint8_t>(address); }
+        void Write(std::uint16_t address, std::uint8_t value) override { writes.emplace_back(address, value); }
+    };
+
+    void Load(Bus& bus, std::uint16_t address, const std::vector<std::uint8_t>& bytes)
+    {
+        bus.WriteBlock(address, bytes);
+    }
+
+    std::vector<std::uint8_t> RamOf(const Bus& bus)
+    {
+        std::vector<std::uint8_t> ram(Bus::RAM_SIZE);
+        bus.ReadRam(0, ram);
+        return ram;
+    }
+
+    // LD HL,0x8000 ; LD A,(HL) ; ADD A,A ; INC HL ; LD (HL),A ; HALT
+    const std::vector<std::uint8_t> DOUBLER = { 0x21, 0x00, 0x80, 0x7E, 0x87, 0x23, 0x77, 0x76 };
+}
+
+// **********************************************
+// *                 BUS::FORK                  *
+// **********************************************
+TEST_CASE("A forked Bus starts with the parent's memory", "[fork][bus]")
+{
+    Bus parent;
+    Load(parent, 0x0000, { 1, 2, 3 });
+    parent.Write(0xFFFF, 0x99);
+
+    const std::unique_ptr<Bus> child = parent.Fork();
+
+    REQUIRE(child->Read(0x0000) == 1);
+    REQUIRE(child->Read(0x0002) == 3);
+    REQUIRE(child->Read(0xFFFF) == 0x99);
+    REQUIRE(RamOf(*child) == RamOf(parent));
+}
+
+TEST_CASE("Writes after a fork are seen only by the side that made them", "[fork][bus]")
+{
+    Bus parent;
+    parent.Write(0x4000, 0x11);
+    const std::unique_ptr<Bus> child = parent.Fork();
+
+    child->Write(0x4000, 0x22);
+    REQUIRE(parent.Read(0x4000) == 0x11);
+    REQUIRE(child->Read(0x4000) == 0x22);
+
+    parent.Write(0x4001, 0x33);
+    REQUIRE(parent.Read(0x4001) == 0x33);
+    REQUIRE(child->Read(0x4001) == 0x00);
+
+    // Pages neither side wrote to are still the same
+    REQUIRE(parent.Read(0x8000) == child->Read(0x8000));
+}
+
+TEST_CASE("Every way of writing copies a shared page first", "[fork][bus]")
+{
+    Bus parent;
+    Load(parent, 0x2000, std::vector<std::uint8_t>(Bus::MAP_PAGE_SIZE, 0x5A));
+    const std::unique_ptr<Bus> child = parent.Fork();
+
+    SECTION("WriteBlock")
+    {
+        Load(*child, 0x2000, { 1, 2, 3 });
+    }
+
+    SECTION("Fill")
+    {
+        child->Fill(0x2000, 3, 0x01);
+    }
+
+    SECTION("RestoreRam")
+    {
+        const std::vector<std::uint8_t> bytes = { 1, 2, 3 };
+        child->RestoreRam(0x2000, bytes);
+    }
+
+    SECTION("WritePointer")
+    {
+        child->WritePointer(0x2000)[0] = 0x01;
+    }
+
+    REQUIRE(child->Read(0x2000) == 0x01);
+    REQUIRE(child->Read(0x2003) == 0x5A);
+    REQUIRE(parent.Read(0x2000) == 0x5A);
+    REQUIRE(parent.Compare(0x2000, std::vector<std::uint8_t>(Bus::MAP_PAGE_SIZE, 0x5A)) == Bus::MAP_PAGE_SIZE);
+}
+
+TEST_CASE("Forks of forks are independent of each other", "[fork][bus]")
+{
+    Bus root;
+    root.Write(0x1000, 0x01);
+    const std::unique_ptr<Bus> child = root.Fork();
+    const std::unique_ptr<Bus> grandchild = child->Fork();
+    const std::unique_ptr<Bus> sibling = root.Fork();
+
+    child->Write(0x1000, 0x02);
+    grandchild->Write(0x1000, 0x03);
+
+    REQUIRE(root.Read(0x1000) == 0x01);
+    REQUIRE(child->Read(0x1000) == 0x02);
+    REQUIRE(grandchild->Read(0x1000) == 0x03);
+    REQUIRE(sibling->Read(0x1000) == 0x01);
+}
+
+TEST_CASE("A fork outlives its parent", "[fork][bus]")
+{
+    auto parent = std::make_unique<Bus>();
+    parent->Write(0x3000, 0x42);
+    const std::unique_ptr<Bus> child = parent->Fork();
+    parent.reset();
+
+    REQUIRE(child->Read(0x3000) == 0x42);
+    child->Write(0x3000, 0x43);
+    REQUIRE(child->Read(0x3000) == 0x43);
+}
+
+TEST_CASE("A fork keeps the parent's ROM and device mappings", "[fork][bus]")
+{
+    Bus parent;
+    const std::vector<std::uint8_t> rom(Bus::MAP_PAGE_SIZE, 0xC9);
+    RecordingDevice device;
+    parent.MapRom(0, 1, rom.data());
+    parent.MapDevice(1, 1, &device);
+    const std::unique_ptr<Bus> child = parent.Fork();
+
+    child->Write(0x0010, 0x00);
+    REQUIRE(child->Read(0x0010) == 0xC9);
+
+    // Devices are not forked: both Buses talk to the same one
+    child->Write(0x0400, 0x77);
+    parent.Write(0x0401, 0x88);
+    REQUIRE(device.writes.size() == 2);
+    REQUIRE(child->Read(0x0405) == 0x05);
+}
+
+TEST_CASE("Own RAM mapped back in after a fork is still copy-on-write", "[fork][bus]")
+{
+    Bus parent;
+    parent.Write(0x0000, 0x10);
+    const std::unique_ptr<Bus> child = parent.Fork();
+
+    const std::vector<std::uint8_t> rom(Bus::MAP_PAGE_SIZE, 0xFF);
+    child->MapRom(0, 1, rom.data());
+    child->UnmapAll();
+    child->Write(0x0000, 0x20);
+
+    REQUIRE(child->Read(0x0000) == 0x20);
+    REQUIRE(parent.Read(0x0000) == 0x10);
+}
+
+// **********************************************
+// *               MACHINE::FORK                *
+// **********************************************
+TEST_CASE("A forked Machine carries on from the same CPU state", "[fork][machine]")
+{
+    Machine parent;
+    parent.GetCpu().SetBc(0x1234);
+    parent.GetCpu().SetAfAlt(0xABCD);
+    parent.GetCpu().Run(100);
+
+    const std::unique_ptr<Machine> child = parent.Fork();
+
+    REQUIRE(child->GetCpu().GetState() == parent.GetCpu().GetState());
+    REQUIRE(&child->GetBus() != &parent.GetBus());
+}
+
+TEST_CASE("Branches forked from one checkpoint run different inputs independently", "[fork][machine]")
+{
+    Machine checkpoint;
+    Load(checkpoint.GetBus(), 0x0000, DOUBLER);
+
+    std::vector<std::unique_ptr<Machine>> branches;
+    for (std::uint8_t input = 1; input <= 4; ++input)
+    {
+        branches.push_back(checkpoint.Fork());
+        branches.back()->GetBus().Write(0x8000, input);
+    }
+    for (auto& branch : branches)
+        branch->GetCpu().Execute(6);
+
+    for (std::size_t i = 0; i < branches.size(); ++i)
+    {
+        REQUIRE(branches[i]->GetBus().Read(0x8001) == 2 * (i + 1));
+        REQUIRE(branches[i]->GetCpu().is_halted());
+    }
+    REQUIRE(checkpoint.GetBus().Read(0x8000) == 0x00);
+    REQUIRE(checkpoint.GetBus().Read(0x8001) == 0x00);
+    REQUIRE(checkpoint.GetCpu().GetPc() == 0x0000);
+}
+
+TEST_CASE("Code patched in a fork does not change what the parent runs", "[fork][machine][decode-cache]")
+{
+    Machine parent;
+    // LD A,0x11 ; HALT
+    Load(parent.GetBus(), 0x0000, { 0x3E, 0x11, 0x76 });
+    parent.GetCpu().Execute(1);
+
+    const std::unique_ptr<Machine> child = parent.Fork();
+    child->GetBus().Write(0x0001, 0x22);
+    child->GetCpu().Reset(0x0000);
+    child->GetCpu().Execute(1);
+    parent.GetCpu().Reset(0x0000);
+    parent.GetCpu().SetA(0x00);
+    parent.GetCpu().Execute(1);
+
+    REQUIRE(child->GetCpu().GetA() == 0x22);
+    REQUIRE(parent.GetCpu().GetA() == 0x11);
+}
+
+TEST_CASE("LDIR in a fork copies into the fork's own page", "[fork][machine][ed]")
+{
+    Machine parent;
+    // LDIR ; HALT
+    Load(parent.GetBus(), 0x0000, { 0xED, 0xB0, 0x76 });
+    Load(parent.GetBus(), 0x4000, std::vector<std::uint8_t>(0x100, 0xAB));
+    parent.GetCpu().SetHl(0x4000);
+    parent.GetCpu().SetDe(0x4100);
+    parent.GetCpu().SetBc(0x0100);
+
+    const std::unique_ptr<Machine> child = parent.Fork();
+    child->GetCpu().Execute(0x101);
+
+    REQUIRE(child->GetCpu().GetBc() == 0x0000);
+    REQUIRE(child->GetBus().Compare(0x4100, std::vector<std::uint8_t>(0x100, 0xAB)) == 0x100);
+    REQUIRE(parent.GetBus().Read(0x4100) == 0x00);
+}
@@ -0,0 +1,231 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Bus.h"
+#include "Cpu.h"
+#include "ImageLoader.h"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // A file in the temp directory that is removed again at the end of the test
+    struct TempFile
+    {
+        std::filesystem::path path;
+
+        TempFile(const std::string& name, const std::vector<std::uint8_t>& bytes)
+            : path(std::filesystem::temp_directory_path() / ("z80emu_" + name))
+        {
+            std::ofstream out(path, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        }
+
+        TempFile(const std::string& name, const std::string& text)
+            : TempFile(name, std::vector<std::uint8_t>(text.begin(), text.end()))
+        {
+        }
+
+        ~TempFile() { std::filesystem::remove(path); }
+
+        std::string Name() const { return path.string(); }
+    };
+
+    std::span<const std::uint8_t> Bytes(const std::string& text)
+    {
+        return { reinterpret_cast<const std::uint8_t*>(text.data()), text.size() };
+    }
+}
+
+// **********************************************
+// *               MAPPED ROM FILES             *
+// **********************************************
+TEST_CASE("A ROM file is mapped in place and stays read-only", "[loader][rom]")
+{
+    std::vector<std::uint8_t> image(0x0600);
+    for (std::size_t i = 0; i < image.size(); ++i)
+        image[i] = static_cast<std::uint8_t>(i * 7);
+    TempFile file("rom.bin", image);
+
+    Bus bus;
+    const MappedFile rom(file.Name());
+    REQUIRE(rom.IsOpen());
+
+    const LoadResult result = ImageLoader::MapRom(bus, rom, 0);
+    REQUIRE(result.ok);
+    REQUIRE(result.bytes == image.size());
+
+    REQUIRE(bus.Read(0x0000) == image[0]);
+    REQUIRE(bus.Read(0x05FF) == image[0x05FF]);
+    REQUIRE(bus.Read(0x0600) == 0x00);      // rest of the last page is zero fill
+    REQUIRE(bus.Read(0x0800) == 0x00);      // the page after is RAM again
+
+    bus.Write(0x0010, 0xEE);
+    REQUIRE(bus.Read(0x0010) == image[0x0010]);
+}
+
+TEST_CASE("Several machines share one mapped ROM", "[loader][rom]")
+{
+    TempFile file("shared.rom", std::vector<std::uint8_t>(0x4000, 0x3C));
+    const MappedFile rom(file.Name());
+
+    std::vector<std::unique_ptr<Bus>> buses;
+    for (int i = 0; i < 4; ++i)
+    {
+        buses.push_back(std::make_unique<Bus>());
+        REQUIRE(ImageLoader::MapRom(*buses.back(), rom, 0).ok);
+    }
+
+    for (const auto& bus : buses)
+        REQUIRE(bus->Read(0x3FFF) == 0x3C);
+}
+
+TEST_CASE("Mapping a missing or empty ROM file fails cleanly", "[loader][rom]")
+{
+    Bus bus;
+
+    const MappedFile missing((std::filesystem::temp_directory_path() / "z80emu_no_such_file.rom").string());
+    REQUIRE_FALSE(missing.IsOpen());
+    REQUIRE_FALSE(ImageLoader::MapRom(bus, missing, 0).ok);
+
+    TempFile file("empty.rom", std::vector<std::uint8_t>{});
+    const MappedFile empty(file.Name());
+    REQUIRE(empty.IsOpen());
+    REQUIRE(empty.Bytes().empty());
+    REQUIRE_FALSE(ImageLoader::MapRom(bus, empty, 0).ok);
+}
+
+// **********************************************
+// *                 RAW IMAGES                 *
+// **********************************************
+TEST_CASE("A raw image is copied in at the given address and wraps at 64K", "[loader][raw]")
+{
+    Bus bus;
+    const std::vector<std::uint8_t> image = { 0x11, 0x22, 0x33, 0x44 };
+
+    const LoadResult result = ImageLoader::Load(bus, image, ImageFormat::Raw, 0xFFFE);
+
+    REQUIRE(result.ok);
+    REQUIRE(result.bytes == 4);
+    REQUIRE(bus.Read(0xFFFE) == 0x11);
+    REQUIRE(bus.Read(0xFFFF) == 0x22);
+    REQUIRE(bus.Read(0x0000) == 0x33);
+    REQUIRE(bus.Read(0x0001) == 0x44);
+}
+
+TEST_CASE("A raw image loaded from disk runs", "[loader][raw]")
+{
+    TempFile file("program.bin", std::vector<std::uint8_t>{ 0x3E, 0x42, 0x47 });    // LD A,0x42 / LD B,A
+
+    Bus bus;
+    Cpu cpu;
+    REQUIRE(ImageLoader::LoadFile(bus, file.Name(), ImageFormat::Raw, 0x8000).ok);
+
+    cpu.Connect(&bus);
+    cpu.Reset(0x8000);
+    cpu.Execute(2);
+
+    REQUIRE(cpu.GetB() == 0x42);
+}
+
+TEST_CASE("Loading over code that already ran replaces it", "[loader][raw][decode-cache]")
+{
+    Bus bus;
+    Cpu cpu;
+    cpu.Connect(&bus);
+
+    REQUIRE(ImageLoader::Load(bus, std::vector<std::uint8_t>{ 0x3C }, ImageFormat::Raw, 0x0000).ok);     // INC A
+    cpu.Reset(0x0000);
+    cpu.Step();
+    REQUIRE(ImageLoader::Load(bus, std::vector<std::uint8_t>{ 0x04 }, ImageFormat::Raw, 0x0000).ok);     // INC B
+    cpu.Reset(0x0000);
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x01);
+    REQUIRE(cpu.GetB() == 0x01);
+}
+
+// **********************************************
+// *                 INTEL HEX                  *
+// **********************************************
+TEST_CASE("Intel HEX data records land at their addresses", "[loader][hex]")
+{
+    Bus bus;
+    const std::string hex =
+        ":0300300002337A1E\r\n"
+        ":02FFFE00AABB9C\n"
+        "\n"
+        ":0400000500001234B1\n"
+        ":00000001FF\n"
+        ":01000000FFFF\n";       // after the end record: ignored
+
+    const LoadResult result = ImageLoader::Load(bus, Bytes(hex), ImageFormat::IntelHex);
+
+    REQUIRE(result.ok);
+    REQUIRE(result.bytes == 5);
+    REQUIRE(result.entry == 0x1234);
+    REQUIRE(bus.Read(0x0030) == 0x02);
+    REQUIRE(bus.Read(0x0031) == 0x33);
+    REQUIRE(bus.Read(0x0032) == 0x7A);
+    REQUIRE(bus.Read(0xFFFE) == 0xAA);
+    REQUIRE(bus.Read(0xFFFF) == 0xBB);
+    REQUIRE(bus.Read(0x0000) == 0x00);
+}
+
+TEST_CASE("Intel HEX segment records move the base address", "[loader][hex]")
+{
+    Bus bus;
+    const std::string hex =
+        ":020000020100FB\n"     // segment 0x0100 -> base 0x1000
+        ":0100040055A6\n"
+        ":00000001FF\n";
+
+    REQUIRE(ImageLoader::Load(bus, Bytes(hex), ImageFormat::IntelHex).ok);
+    REQUIRE(bus.Read(0x1004) == 0x55);
+}
+
+TEST_CASE("Intel HEX errors name the line and keep earlier records", "[loader][hex]")
+{
+    Bus bus;
+
+    const std::string badSum = ":0100000011EE\n:0100010022FF\n";
+    const LoadResult sum = ImageLoader::Load(bus, Bytes(badSum), ImageFormat::IntelHex);
+    REQUIRE_FALSE(sum.ok);
+    REQUIRE(sum.error == "checksum mismatch at line 2");
+    REQUIRE(bus.Read(0x0000) == 0x11);
+    REQUIRE(bus.Read(0x0001) == 0x00);
+
+    REQUIRE_FALSE(ImageLoader::Load(bus, Bytes("0100000011EE\n"), ImageFormat::IntelHex).ok);          // no colon
+    REQUIRE_FALSE(ImageLoader::Load(bus, Bytes(":0100000G11EE\n"), ImageFormat::IntelHex).ok);         // bad digit
+    REQUIRE_FALSE(ImageLoader::Load(bus, Bytes(":020000040001F9\n"), ImageFormat::IntelHex).ok);       // above 64K
+    REQUIRE_FALSE(ImageLoader::Load(bus, Bytes(":02FFFF00AABB9B\n"), ImageFormat::IntelHex).ok);       // runs past 0xFFFF
+}
+
+// **********************************************
+// *            LOAD-ADDRESS TAGGED             *
+// **********************************************
+TEST_CASE("A tagged image loads at its own address and reports it", "[loader][tagged]")
+{
+    Bus bus;
+    const std::vector<std::uint8_t> image = { 0x00, 0xC0, 0xDE, 0xAD };
+
+    const LoadResult result = ImageLoader::Load(bus, image, ImageFormat::Tagged);
+
+    REQUIRE(result.ok);
+    REQUIRE(result.bytes == 2);
+    REQUIRE(result.entry == 0xC000);
+    REQUIRE(bus.Read(0xC000) == 0xDE);
+    REQUIRE(bus.Read(0xC001) == 0xAD);
+
+    REQUIRE_FALSE(ImageLoader::Load(bus, std::vector<std::uint8_t>{ 0x00 }, ImageFormat::Tagged).ok);
+}
+
+TEST_CASE("Image format follows the file extension", "[loader]")
+{
+    REQUIRE(ImageLoader::FormatForPath("game.HEX") == ImageFormat::IntelHex);
+    REQUIRE(ImageLoader::FormatForPath("out/build.ihx") == ImageFormat::IntelHex);
+    REQUIRE(ImageLoader::FormatForPath("demo.prg") == ImageFormat::Tagged);
+    REQUIRE(ImageLoader::FormatForPath("48.rom") == ImageFormat::Raw);
+    REQUIRE(ImageLoader::FormatForPath("noextension") == ImageFormat::Raw);
+}
@@ -0,0 +1,111 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include <utility>
+#include <vector>
+
+struct CpuFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    CpuFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+    }
+};
+
+namespace
+{
+    // Answers one port with a fixed byte and logs every OUT
+    struct LatchDevice : PortDevice
+    {
+        std::uint16_t port;
+        std::uint8_t answer;
+        std::vector<std::pair<std::uint16_t, std::uint8_t>> outs;
+
+        LatchDevice(std::uint16_t port, std::uint8_t answer) : port(port), answer(answer) {}
+
+        std::uint8_t In(std::uint16_t address) override { return address == port ? answer : 0xFF; }
+        void Out(std::uint16_t address, std::uint8_t value) override { outs.emplace_back(address, value); }
+    };
+}
+
+// **********************************************
+// *              OUT (n),A  (0xD3)             *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "OUT (n),A puts A on the high port byte and the data bus", "[io][out]")
+{
+    LatchDevice device(0x0000, 0x00);
+    bus.AttachPorts(&device);
+
+    bus.Write(0x0000, 0x3E);    // LD A,0x7F
+    bus.Write(0x0001, 0x7F);
+    bus.Write(0x0002, 0xD3);    // OUT (0xFD),A
+    bus.Write(0x0003, 0xFD);
+
+    const auto f = cpu.GetF();
+    cpu.Step();
+    const auto cycles = cpu.Step();
+
+    REQUIRE(cycles == 11);
+    REQUIRE(cpu.GetPc() == 0x0004);
+    REQUIRE(cpu.GetF() == f);
+    REQUIRE(device.outs.size() == 1);
+    REQUIRE(device.outs[0] == std::pair<std::uint16_t, std::uint8_t>{ 0x7FFD, 0x7F });
+}
+
+// **********************************************
+// *              IN A,(n)  (0xDB)              *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "IN A,(n) reads the port addressed by A and n", "[io][in]")
+{
+    LatchDevice device(0x12FE, 0xA5);
+    bus.AttachPorts(&device);
+
+    bus.Write(0x0000, 0x3E);    // LD A,0x12
+    bus.Write(0x0001, 0x12);
+    bus.Write(0x0002, 0xDB);    // IN A,(0xFE)
+    bus.Write(0x0003, 0xFE);
+
+    cpu.SetF(0xFF);
+    cpu.Step();
+    const auto cycles = cpu.Step();
+
+    REQUIRE(cycles == 11);
+    REQUIRE(cpu.GetA() == 0xA5);
+    REQUIRE(cpu.GetF() == 0xFF);
+}
+
+TEST_CASE("Ports nobody answers read as 0xFF and answers are ANDed", "[io][bus]")
+{
+    Bus bus;
+    REQUIRE(bus.In(0x00FE) == 0xFF);
+
+    LatchDevice a(0x00FE, 0xF0);
+    LatchDevice b(0x00FE, 0x3C);
+    bus.AttachPorts(&a);
+    bus.AttachPorts(&b);
+
+    REQUIRE(bus.In(0x00FE) == 0x30);
+    REQUIRE(bus.In(0x00FF) == 0xFF);
+}
+
+TEST_CASE("Every attached device sees every OUT until it is detached", "[io][bus]")
+{
+    Bus bus;
+    LatchDevice a(0x0000, 0xFF);
+    LatchDevice b(0x0000, 0xFF);
+
+    bus.AttachPorts(&a);
+    bus.AttachPorts(&b);
+    bus.AttachPorts(&a);        // attaching twice is a no-op
+    bus.Out(0x1234, 0x56);
+    bus.DetachPorts(&a);
+    bus.Out(0x4321, 0x65);
+
+    REQUIRE(a.outs.size() == 1);
+    REQUIRE(b.outs.size() == 2);
+    REQUIRE(b.outs[1] == std::pair<std::uint16_t, std::uint8_t>{ 0x4321, 0x65 });
+}
@@ -0,0 +1,270 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+
+#if defined(Z80EMU_JIT)
+#include "MemoryDevice.h"
+#include <random>
+#include <vector>
+
+namespace
+{
+    struct Machine
+    {
+        Bus bus;
+        Cpu cpu;
+
+        explicit Machine(bool jit)
+        {
+            cpu.Connect(&bus);
+            cpu.Reset();
+            cpu.GetJit().SetEnabled(jit);
+            cpu.GetJit().SetThreshold(1);
+        }
+    };
+
+    // Every opcode the interpreter implements, HALT aside
+    std::vector<uint8_t> ImplementedOpcodes()
+    {
+        std::vector<uint8_t> ops = {
+            0x00, 0x01, 0x03, 0x08, 0x09, 0x0B, 0x11, 0x13, 0x19, 0x1B,
+            0x21, 0x23, 0x27, 0x29, 0x2B, 0x31, 0x33, 0x37, 0x39, 0x3B,
+            0xC1, 0xC5, 0xC6, 0xD1, 0xD5, 0xD9, 0xE1, 0xE5, 0xE6, 0xEE,
+            0xF1, 0xF5, 0xF6, 0xFE,
+        };
+        for (unsigned r = 0; r < 8; ++r)
+        {
+            ops.push_back(uint8_t(0x04 | r << 3));      // INC r
+            ops.push_back(uint8_t(0x05 | r << 3));      // DEC r
+            ops.push_back(uint8_t(0x06 | r << 3));      // LD r,n
+        }
+        for (unsigned op = 0x40; op <= 0x9F; ++op)
+            if (op != 0x76)
+                ops.push_back(uint8_t(op));
+        return ops;
+    }
+
+    void Load(Machine& a, Machine& b, uint16_t address, uint8_t value)
+    {
+        a.bus.Write(address, value);
+        b.bus.Write(address, value);
+    }
+
+    // Fill all of memory with a random instruction stream and randomise the registers
+    void Seed(Machine& jit, Machine& interp, std::mt19937& rng)
+    {
+        const std::vector<uint8_t> ops = ImplementedOpcodes();
+
+        for (uint32_t address = 0; address < Bus::RAM_SIZE; ++address)
+            Load(jit, interp, uint16_t(address), ops[rng() % ops.size()]);
+
+        // Sprinkle random bytes in as operands (and as the odd unimplemented opcode)
+        for (int i = 0; i < 4096; ++i)
+            Load(jit, interp, uint16_t(rng()), uint8_t(rng()));
+
+        const uint32_t regsSeed = rng();
+        for (Cpu* cpu : { &jit.cpu, &interp.cpu })
+        {
+            std::mt19937 regs(regsSeed);
+            cpu->SetAf(uint16_t(regs())); cpu->SetBc(uint16_t(regs()));
+            cpu->SetDe(uint16_t(regs())); cpu->SetHl(uint16_t(regs()));
+            cpu->SetAfAlt(uint16_t(regs())); cpu->SetBcAlt(uint16_t(regs()));
+            cpu->SetDeAlt(uint16_t(regs())); cpu->SetHlAlt(uint16_t(regs()));
+            cpu->SetSp(uint16_t(regs()));
+        }
+    }
+
+    void RequireSameState(const Machine& jit, const Machine& interp)
+    {
+        REQUIRE(jit.cpu.GetPc() == interp.cpu.GetPc());
+        REQUIRE(jit.cpu.GetSp() == interp.cpu.GetSp());
+        REQUIRE(jit.cpu.GetAf() == interp.cpu.GetAf());
+        REQUIRE(jit.cpu.GetBc() == interp.cpu.GetBc());
+        REQUIRE(jit.cpu.GetDe() == interp.cpu.GetDe());
+        REQUIRE(jit.cpu.GetHl() == interp.cpu.GetHl());
+        REQUIRE(jit.cpu.GetAfAlt() == interp.cpu.GetAfAlt());
+        REQUIRE(jit.cpu.GetBcAlt() == interp.cpu.GetBcAlt());
+        REQUIRE(jit.cpu.GetDeAlt() == interp.cpu.GetDeAlt());
+        REQUIRE(jit.cpu.GetHlAlt() == interp.cpu.GetHlAlt());
+        REQUIRE(jit.cpu.GetTStates() == interp.cpu.GetTStates());
+        REQUIRE(jit.cpu.is_halted() == interp.cpu.is_halted());
+
+        std::size_t memoryMismatches = 0;
+        for (uint32_t address = 0; address < Bus::RAM_SIZE; ++address)
+            if (jit.bus.Read(uint16_t(address)) != interp.bus.Read(uint16_t(address)))
+                ++memoryMismatches;
+        REQUIRE(memoryMismatches == 0);
+    }
+}
+
+// **********************************************
+// *        JIT  vs  INTERPRETER                *
+// **********************************************
+// *                                            *
+// *  Random programs run on both; registers,   *
+// *  memory and T-states must match exactly.   *
+// *                                            *
+// **********************************************
+TEST_CASE("JIT matches the interpreter on random programs", "[jit][differential]")
+{
+    for (uint32_t seed = 1; seed <= 8; ++seed)
+    {
+        CAPTURE(seed);
+        std::mt19937 rng(seed);
+
+        Machine jit(true);
+        Machine interp(false);
+        Seed(jit, interp, rng);
+
+        for (int round = 0; round < 20; ++round)
+        {
+            CAPTURE(round);
+
+            const uint64_t instructions = rng() % 20000;
+            REQUIRE(jit.cpu.Execute(instructions) == interp.cpu.Execute(instructions));
+            RequireSameState(jit, interp);
+
+            const uint64_t tstates = rng() % 100000;
+            REQUIRE(jit.cpu.Run(tstates) == interp.cpu.Run(tstates));
+            RequireSameState(jit, interp);
+        }
+
+        REQUIRE(jit.cpu.GetJit().BlockCount() > 0);
+        REQUIRE(interp.cpu.GetJit().BlockCount() == 0);
+    }
+}
+
+TEST_CASE("JIT block stops at HALT like the interpreter", "[jit][halt]")
+{
+    Machine jit(true);
+    Machine interp(false);
+
+    for (uint16_t i = 0; i < 10; ++i)
+        Load(jit, interp, i, 0x3C); // INC A
+    Load(jit, interp, 0x000A, 0x76); // HALT
+
+    REQUIRE(jit.cpu.Execute(20) == interp.cpu.Execute(20));
+
+    REQUIRE(jit.cpu.is_halted());
+    REQUIRE(jit.cpu.GetA() == 10);
+    REQUIRE(jit.cpu.GetJit().BlockCount() == 1);
+    RequireSameState(jit, interp);
+}
+
+TEST_CASE("JIT block leaves as soon as it rewrites code ahead of itself", "[jit][self-modifying]")
+{
+    Machine jit(true);
+    Machine interp(false);
+
+    const uint8_t program[] = {
+        0x21, 0x06, 0x00,   // LD HL,0x0006
+        0x36, 0x04,         // LD (HL),0x04   -> INC B
+        0x00,               // NOP
+        0x3C,               // INC A (rewritten before it runs)
+    };
+    for (uint16_t i = 0; i < sizeof(program); ++i)
+        Load(jit, interp, i, program[i]);
+
+    REQUIRE(jit.cpu.Execute(4) == interp.cpu.Execute(4));
+
+    REQUIRE(jit.cpu.GetA() == 0x00);
+    REQUIRE(jit.cpu.GetB() == 0x01);
+    RequireSameState(jit, interp);
+}
+
+TEST_CASE("JIT stops compiling a page that keeps being rewritten", "[jit][self-modifying]")
+{
+    Machine jit(true);
+
+    for (uint32_t round = 0; round <= Jit::SELF_MODIFYING_DROPS; ++round)
+    {
+        jit.cpu.Reset(0x1000);
+        jit.cpu.Execute(1);
+        REQUIRE(jit.cpu.GetJit().BlockCount() == (round < Jit::SELF_MODIFYING_DROPS ? 1u : 0u));
+
+        jit.bus.Write(0x1080, 0x00);    // same page, drops the block
+    }
+
+    // Other pages still compile
+    jit.cpu.Reset(0x2000);
+    jit.cpu.Execute(1);
+    REQUIRE(jit.cpu.GetJit().BlockCount() == 1);
+}
+
+TEST_CASE("Run never starts a block it would finish past the budget by more than one instruction", "[jit][timing]")
+{
+    Machine jit(true);
+    Machine interp(false);
+
+    for (uint16_t i = 0; i < 64; ++i)
+        Load(jit, interp, i, 0x00); // NOP, 4 T-states each
+
+    for (uint64_t budget : { 1u, 4u, 5u, 17u, 64u })
+    {
+        CAPTURE(budget);
+        REQUIRE(jit.cpu.Run(budget) == interp.cpu.Run(budget));
+        RequireSameState(jit, interp);
+    }
+}
+
+namespace
+{
+    // Serves the same opcode from every address and counts the reads
+    struct CodeDevice : MemoryDevice
+    {
+        std::uint8_t opcode = 0x3C;
+        std::size_t reads = 0;
+
+        std::uint8_t Read(std::uint16_t) override
+        {
+            ++reads;
+            return opcode;
+        }
+
+        void Write(std::uint16_t, std::uint8_t) override {}
+    };
+}
+
+TEST_CASE("JIT leaves code on device pages to the interpreter", "[jit][mmio]")
+{
+    Machine jit(true);
+    CodeDevice device;              // INC A
+    jit.bus.MapDevice(4, 1, &device);
+
+    jit.cpu.Reset(0x1000);
+    jit.cpu.Execute(4);
+    REQUIRE(jit.cpu.GetA() == 4);
+    REQUIRE(jit.cpu.GetJit().BlockCount() == 0);
+
+    // A block compiled from the device would never see this
+    device.opcode = 0x04;           // INC B
+    jit.cpu.Reset(0x1000);
+    jit.cpu.Execute(4);
+
+    REQUIRE(jit.cpu.GetA() == 4);
+    REQUIRE(jit.cpu.GetB() == 4);
+}
+
+TEST_CASE("JIT block ends before an operand on a device page, which is read once", "[jit][mmio]")
+{
+    Machine jit(true);
+    Machine interp(false);
+    CodeDevice jitDevice;
+    CodeDevice interpDevice;
+    jit.bus.MapDevice(5, 1, &jitDevice);
+    interp.bus.MapDevice(5, 1, &interpDevice);
+
+    Load(jit, interp, 0x13FE, 0x3C);        // INC A
+    Load(jit, interp, 0x13FF, 0x3E);        // LD A,n with n at 0x1400
+
+    jit.cpu.Reset(0x13FE);
+    interp.cpu.Reset(0x13FE);
+    REQUIRE(jit.cpu.Execute(2) == interp.cpu.Execute(2));
+
+    REQUIRE(jit.cpu.GetA() == 0x3C);
+    REQUIRE(jit.cpu.GetJit().BlockCount() == 1);
+    REQUIRE(jitDevice.reads == 1);
+    REQUIRE(interpDevice.reads == 1);
+    RequireSameState(jit, interp);
+}
+#endif
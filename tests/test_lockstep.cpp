@@ -0,0 +1,271 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include "LockstepCpu.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    // A group plus, for every lane, a scalar Cpu on a Bus of its own that is
+    // given the same memory and state, as the reference
+    template<std::size_t Lanes>
+    struct Lockstep
+    {
+        LockstepCpu<Lanes> group;
+        std::vector<std::unique_ptr<Bus>> buses;
+        std::vector<std::unique_ptr<Bus>> referenceBuses;
+        std::vector<std::unique_ptr<Cpu>> references;
+
+        Lockstep()
+        {
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+            {
+                buses.push_back(std::make_unique<Bus>());
+                referenceBuses.push_back(std::make_unique<Bus>());
+                references.push_back(std::make_unique<Cpu>());
+                references.back()->Connect(referenceBuses.back().get());
+                group.Connect(lane, buses.back().get());
+            }
+        }
+
+        void Load(std::size_t lane, std::uint16_t address, const std::vector<std::uint8_t>& bytes)
+        {
+            buses[lane]->WriteBlock(address, bytes);
+            referenceBuses[lane]->WriteBlock(address, bytes);
+        }
+
+        void LoadAll(std::uint16_t address, const std::vector<std::uint8_t>& bytes)
+        {
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+                Load(lane, address, bytes);
+        }
+
+        void SetState(std::size_t lane, const Cpu::State& state)
+        {
+            group.SetState(lane, state);
+            references[lane]->SetState(state);
+        }
+
+        void Execute(std::uint64_t instructions)
+        {
+            group.Execute(instructions);
+            for (auto& cpu : references)
+                cpu->Execute(instructions);
+        }
+
+        void RequireSameAsScalar() const
+        {
+            std::vector<std::uint8_t> ram(Bus::RAM_SIZE);
+            std::vector<std::uint8_t> expected(Bus::RAM_SIZE);
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+            {
+                CAPTURE(lane);
+                REQUIRE(group.GetState(lane) == references[lane]->GetState());
+                buses[lane]->ReadRam(0, ram);
+                referenceBuses[lane]->ReadRam(0, expected);
+                REQUIRE(ram == expected);
+            }
+        }
+    };
+
+    // Every opcode with a vector kernel. The stack sits at 0x8000 and HL at
+    // 0x9000, so the memory forms stay off the code.
+    const std::vector<std::uint8_t> KERNEL_MIX = {
+        0x31, 0x00, 0x80, 0x21, 0x00, 0x90,         // LD SP,0x8000 ; LD HL,0x9000
+        0x80, 0x89, 0x92, 0x9B,                     // ADD A,B ; ADC A,C ; SUB D ; SBC A,E
+        0xC6, 0x35, 0xE6, 0xF7, 0xEE, 0x5A,         // ADD A,n ; AND n ; XOR n
+        0xF6, 0x81, 0xFE, 0x40,                     // OR n ; CP n
+        0x04, 0x0D, 0x14, 0x1D, 0x24, 0x2D, 0x3C,   // INC/DEC r
+        0x34, 0x35, 0x36, 0x7F,                     // INC (HL) ; DEC (HL) ; LD (HL),n
+        0x46, 0x70, 0x4F, 0x57, 0x7B,               // LD B,(HL) ; LD (HL),B ; LD r,r'
+        0x03, 0x0B, 0x13, 0x1B, 0x23, 0x2B,         // INC/DEC rr
+        0x33, 0x3B,                                 // INC SP ; DEC SP
+        0x09, 0x19, 0x29, 0x39,                     // ADD HL,rr
+        0x21, 0x00, 0x90,                           // LD HL,0x9000
+        0x01, 0xF0, 0x7F, 0x11, 0x0F, 0x80,         // LD BC,nn ; LD DE,nn
+        0x37, 0x08, 0x8F, 0x08, 0xD9, 0x88, 0xD9,   // SCF ; EX AF,AF' ; ADC A,A ; EXX ; ADC A,B
+        0xC5, 0xD5, 0xE5, 0xF5, 0xC1, 0xD1, 0xF1, 0xE1,   // PUSH / POP, crossed
+        0x86, 0x00,                                 // ADD A,(HL) (not in the core yet) ; NOP
+    };
+
+    Cpu::State Seeded(std::uint32_t seed)
+    {
+        // Spread the registers over every value and flag combination
+        const auto byte = [&](int shift) { return static_cast<std::uint16_t>(((seed * 0x9E3779B1u) >> shift) & 0xFF); };
+        Cpu::State state;
+        state.af = static_cast<std::uint16_t>((byte(24) << 8) | byte(0));
+        state.bc = static_cast<std::uint16_t>((byte(16) << 8) | byte(8));
+        state.de = static_cast<std::uint16_t>((byte(4) << 8) | byte(12));
+        state.hl = static_cast<std::uint16_t>((byte(20) << 8) | byte(2));
+        state.afAlt = static_cast<std::uint16_t>(seed * 7);
+        state.bcAlt = static_cast<std::uint16_t>(seed * 13);
+        state.deAlt = static_cast<std::uint16_t>(seed * 29);
+        state.hlAlt = static_cast<std::uint16_t>(seed * 31);
+        state.ix = static_cast<std::uint16_t>(seed);
+        state.r = static_cast<std::uint8_t>(seed);
+        return state;
+    }
+
+    template<std::size_t Lanes>
+    void RunKernelMix()
+    {
+        Lockstep<Lanes> lockstep;
+        lockstep.LoadAll(0x0000, KERNEL_MIX);
+        for (std::uint32_t seed = 0; seed < 64; seed += Lanes)
+        {
+            for (std::size_t lane = 0; lane < Lanes; ++lane)
+            {
+                lockstep.Load(lane, 0x9000, { static_cast<std::uint8_t>(seed + lane) });
+                lockstep.SetState(lane, Seeded(seed + static_cast<std::uint32_t>(lane)));
+            }
+
+            lockstep.Execute(KERNEL_MIX.size());
+            lockstep.RequireSameAsScalar();
+        }
+        REQUIRE(lockstep.group.ScalarSteps() == 0);
+    }
+}
+
+// **********************************************
+// *                  KERNELS                   *
+// **********************************************
+TEST_CASE("Every kernel matches the scalar Cpu at 8, 16 and 32 lanes", "[lockstep]")
+{
+    RunKernelMix<8>();
+    RunKernelMix<16>();
+    RunKernelMix<32>();
+}
+
+TEST_CASE("8-bit ALU flags match the scalar Cpu for every operand and carry", "[lockstep]")
+{
+    // ADD ADC SUB SBC A,B ; INC A ; DEC A ; AND OR XOR CP with B as n
+    const std::vector<std::vector<std::uint8_t>> programs = {
+        { 0x80 }, { 0x88 }, { 0x90 }, { 0x98 }, { 0x3C }, { 0x3D },
+        { 0xE6, 0x00 }, { 0xF6, 0x00 }, { 0xEE, 0x00 }, { 0xFE, 0x00 },
+    };
+
+    Lockstep<32> lockstep;
+    for (const auto& program : programs)
+    {
+        CAPTURE(program[0]);
+        for (std::uint32_t first = 0; first < 2 * 256 * 256; first += 32)
+        {
+            for (std::size_t lane = 0; lane < 32; ++lane)
+            {
+                const std::uint32_t index = first + static_cast<std::uint32_t>(lane);
+                const std::uint8_t a = static_cast<std::uint8_t>(index >> 8);
+                const std::uint8_t b = static_cast<std::uint8_t>(index);
+                std::vector<std::uint8_t> code = program;
+                if (code.size() == 2)
+                    code[1] = b;
+                lockstep.Load(lane, 0x0000, code);
+
+                Cpu::State state;
+                state.af = static_cast<std::uint16_t>((a << 8) | (index >> 16));
+                state.bc = static_cast<std::uint16_t>(b << 8);
+                lockstep.SetState(lane, state);
+            }
+            lockstep.Execute(1);
+            for (std::size_t lane = 0; lane < 32; ++lane)
+            {
+                if (lockstep.group.GetState(lane).af != lockstep.references[lane]->GetState().af)
+                {
+                    CAPTURE(first + lane);
+                    REQUIRE(lockstep.group.GetState(lane).af == lockstep.references[lane]->GetState().af);
+                }
+            }
+        }
+    }
+    REQUIRE(lockstep.group.ScalarSteps() == 0);
+}
+
+TEST_CASE("ADD HL,rr and SCF keep the F bits they do not set", "[lockstep]")
+{
+    // ADD HL,BC ; SCF, from every F value, the undocumented bits included
+    Lockstep<32> lockstep;
+    lockstep.LoadAll(0x0000, { 0x09, 0x37 });
+    for (std::uint32_t first = 0; first < 256; first += 32)
+    {
+        for (std::size_t lane = 0; lane < 32; ++lane)
+        {
+            Cpu::State state;
+            state.af = static_cast<std::uint16_t>(first + lane);
+            state.hl = static_cast<std::uint16_t>(0x0FFF * lane);
+            state.bc = 0x7801;
+            lockstep.SetState(lane, state);
+        }
+        lockstep.Execute(2);
+        lockstep.RequireSameAsScalar();
+    }
+}
+
+// **********************************************
+// *                 DIVERGENCE                 *
+// **********************************************
+TEST_CASE("Lanes that leave the group run on the scalar Cpu and stay exact", "[lockstep]")
+{
+    // LDIR copies a different length in every lane, so they come out of it
+    // on different rounds, then run the ALU/stack code out of step
+    Lockstep<16> lockstep;
+    std::vector<std::uint8_t> program = { 0x21, 0x00, 0x40, 0x11, 0x00, 0x50, 0xED, 0xB0, 0x31, 0x00, 0x80 };
+    for (int i = 0; i < 8; ++i)
+        program.insert(program.end(), { 0x80, 0x3C, 0xC5, 0x09, 0xE1, 0x2B, 0xFE, 0x10 });
+    program.push_back(0x76);
+    lockstep.LoadAll(0x0000, program);
+    lockstep.LoadAll(0x4000, std::vector<std::uint8_t>(64, 0xA5));
+
+    for (std::size_t lane = 0; lane < 16; ++lane)
+    {
+        Cpu::State state;
+        state.bc = static_cast<std::uint16_t>(1 + 3 * lane);
+        lockstep.SetState(lane, state);
+    }
+
+    lockstep.Execute(150);
+    lockstep.RequireSameAsScalar();
+    REQUIRE(lockstep.group.ScalarSteps() > 0);
+    REQUIRE(lockstep.group.VectorSteps() > 0);
+    REQUIRE(lockstep.group.GetState(0).halted);
+}
+
+TEST_CASE("A lane whose memory holds other code drops out of the group", "[lockstep]")
+{
+    Lockstep<8> lockstep;
+    const std::vector<std::uint8_t> program(32, 0x3C);     // INC A
+    lockstep.LoadAll(0x0000, program);
+    lockstep.Load(3, 0x0010, { 0x3D, 0x3D, 0x27 });         // DEC A ; DEC A ; DAA
+
+    lockstep.Execute(32);
+    lockstep.RequireSameAsScalar();
+    REQUIRE(lockstep.group.ScalarSteps() == 3);
+}
+
+TEST_CASE("Halted lanes idle 4 T-states an instruction while the rest run", "[lockstep]")
+{
+    Lockstep<8> lockstep;
+    lockstep.LoadAll(0x0000, std::vector<std::uint8_t>(64, 0x04));    // INC B
+    for (std::size_t lane = 0; lane < 8; ++lane)
+        lockstep.Load(lane, static_cast<std::uint16_t>(4 * lane), { 0x76 });
+
+    lockstep.Execute(10);
+    lockstep.RequireSameAsScalar();
+    lockstep.Execute(100);
+    lockstep.RequireSameAsScalar();
+}
+
+TEST_CASE("Lanes without a Bus are left alone", "[lockstep]")
+{
+    LockstepCpu<8> group;
+    Bus bus;
+    bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0x3C, 0x3C, 0x3C });
+    group.Connect(2, &bus);
+
+    group.Execute(3);
+
+    REQUIRE(group.GetState(2).af == 0x0300);
+    REQUIRE(group.GetState(2).tstates == 12);
+    REQUIRE(group.GetState(0) == Cpu::State{});
+    REQUIRE(group.GetState(7) == Cpu::State{});
+}
@@ -0,0 +1,144 @@
+#include <catch2/catch_test_macros.hpp>
+#include "MachinePool.h"
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // ADD A,B ; INC B over all of memory: no writes, no HALT, and a result
+    // that depends on where B started
+    std::unique_ptr<Machine> Adder(std::uint8_t b)
+    {
+        auto machine = std::make_unique<Machine>();
+        std::vector<std::uint8_t> program(Bus::RAM_SIZE);
+        for (std::size_t i = 0; i < program.size(); ++i)
+            program[i] = (i & 1) == 0 ? 0x80 : 0x04;
+        machine->GetBus().WriteBlock(0x0000, program);
+        machine->GetCpu().SetB(b);
+        return machine;
+    }
+
+    // NOPs up to a HALT at 0x0010
+    std::unique_ptr<Machine> Halter()
+    {
+        auto machine = std::make_unique<Machine>();
+        machine->GetBus().Write(0x0010, 0x76);
+        return machine;
+    }
+
+    constexpr std::uint64_t BUDGET = 1000003;
+}
+
+// **********************************************
+// *                  RESULTS                   *
+// **********************************************
+TEST_CASE("Pooled runs end where one Cpu::Run of the whole budget does", "[pool]")
+{
+    MachinePool pool(4, 50000);
+    std::vector<std::unique_ptr<Machine>> expected;
+    for (std::uint8_t b = 0; b < 32; ++b)
+    {
+        pool.Add(Adder(b));
+        expected.push_back(Adder(b));
+        expected.back()->GetCpu().Run(BUDGET);
+    }
+
+    pool.RunAll(BUDGET);
+    pool.Wait();
+
+    for (std::size_t id = 0; id < expected.size(); ++id)
+    {
+        CAPTURE(id);
+        REQUIRE(pool.GetMachine(id).GetCpu().GetState() == expected[id]->GetCpu().GetState());
+    }
+}
+
+TEST_CASE("Futures and the completion callback report each run once", "[pool]")
+{
+    MachinePool pool(3, 10000);
+    for (std::uint8_t b = 0; b < 8; ++b)
+        pool.Add(Adder(b));
+    const std::size_t halter = pool.Add(Halter());
+
+    std::mutex mutex;
+    std::vector<MachineRun> reported;
+    bool machinesMatch = true;
+    // Runs on the workers, so it only records; the checks are made below
+    auto done = [&](Machine& machine, const MachineRun& run)
+    {
+        std::lock_guard lock(mutex);
+        reported.push_back(run);
+        machinesMatch = machinesMatch && &machine == &pool.GetMachine(run.id);
+    };
+
+    std::vector<std::future<MachineRun>> futures;
+    for (std::size_t id = 0; id < pool.Size(); ++id)
+        futures.push_back(pool.Run(id, 100000, done));
+
+    for (std::size_t id = 0; id < futures.size(); ++id)
+    {
+        const MachineRun run = futures[id].get();
+        REQUIRE(run.id == id);
+        REQUIRE(run.halted == (id == halter));
+        REQUIRE(run.tstates >= (id == halter ? 0 : 100000));
+    }
+    pool.Wait();
+    REQUIRE(reported.size() == pool.Size());
+    REQUIRE(machinesMatch);
+}
+
+TEST_CASE("A halted machine completes after the slice it halted in", "[pool]")
+{
+    MachinePool pool(2, 1000);
+    pool.Add(Halter());
+
+    const MachineRun run = pool.Run(0, 1000000000).get();
+
+    REQUIRE(run.halted);
+    REQUIRE(run.tstates == 1000);
+    REQUIRE(pool.GetMachine(0).GetCpu().GetPc() == 0x0011);
+}
+
+TEST_CASE("Runs pick up where the last one stopped", "[pool]")
+{
+    MachinePool pool(2, 7000);
+    pool.Add(Adder(5));
+    auto expected = Adder(5);
+
+    for (int round = 0; round < 3; ++round)
+    {
+        pool.Run(0, 40000).get();
+        expected->GetCpu().Run(40000);
+    }
+
+    REQUIRE(pool.GetMachine(0).GetCpu().GetState() == expected->GetCpu().GetState());
+}
+
+TEST_CASE("Many more machines than threads all finish, and the pool waits for them on exit", "[pool]")
+{
+    std::vector<std::future<MachineRun>> futures;
+    {
+        MachinePool pool(4, 5000);
+        REQUIRE(pool.Threads() == 4);
+        for (std::size_t i = 0; i < 200; ++i)
+        {
+            const std::size_t id = pool.Add(Adder(static_cast<std::uint8_t>(i)));
+            // Uneven budgets, so some workers run dry and have to steal
+            futures.push_back(pool.Run(id, (i % 4 == 0) ? 200000 : 5000));
+        }
+    }
+
+    for (auto& future : futures)
+        REQUIRE(future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+}
+
+TEST_CASE("A pool sized by the hardware has at least one thread", "[pool]")
+{
+    MachinePool pool;
+    REQUIRE(pool.Threads() >= 1);
+    pool.Add(Adder(1));
+    REQUIRE(pool.Run(0, 1000).get().tstates >= 1000);
+}
@@ -0,0 +1,262 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include "Mappers.h"
+#include <vector>
+
+namespace
+{
+    // Tags the first byte of every bank so a read tells which one is mapped
+    void TagBanks(Spectrum128Mapper& mapper)
+    {
+        for (std::size_t rom = 0; rom < mapper.RomBanks(); ++rom)
+            mapper.Rom(rom)[0] = static_cast<std::uint8_t>(0xA0 + rom);
+        for (std::size_t ram = 0; ram < Spectrum128Mapper::RAM_BANKS; ++ram)
+            mapper.Ram(ram)[0] = static_cast<std::uint8_t>(0xB0 + ram);
+    }
+
+    // Bank n of the image is filled with n
+    std::vector<std::uint8_t> BankedImage(std::size_t bankSize, std::size_t banks)
+    {
+        std::vector<std::uint8_t> image(bankSize * banks);
+        for (std::size_t i = 0; i < image.size(); ++i)
+            image[i] = static_cast<std::uint8_t>(i / bankSize);
+        return image;
+    }
+}
+
+// **********************************************
+// *              SPECTRUM 128 (7FFD)           *
+// **********************************************
+TEST_CASE("Spectrum 128 powers up with ROM 0, banks 5, 2 and 0", "[mapper][spectrum]")
+{
+    Bus bus;
+    Spectrum128Mapper mapper;
+    TagBanks(mapper);
+    mapper.Attach(bus);
+
+    REQUIRE(bus.Read(0x0000) == 0xA0);
+    REQUIRE(bus.Read(0x4000) == 0xB5);
+    REQUIRE(bus.Read(0x8000) == 0xB2);
+    REQUIRE(bus.Read(0xC000) == 0xB0);
+    REQUIRE(mapper.ScreenBank() == 5);
+}
+
+TEST_CASE("Spectrum 128 pages RAM and ROM on a 7FFD write without copying", "[mapper][spectrum]")
+{
+    Bus bus;
+    Spectrum128Mapper mapper;
+    TagBanks(mapper);
+    mapper.Attach(bus);
+
+    bus.Out(0x7FFD, 0x1B);      // RAM 3, screen 7, ROM 1
+
+    REQUIRE(bus.Read(0x0000) == 0xA1);
+    REQUIRE(bus.Read(0xC000) == 0xB3);
+    REQUIRE(mapper.ScreenBank() == 7);
+
+    // Writes land in the bank itself
+    bus.Write(0xC001, 0x42);
+    REQUIRE(mapper.Ram(3)[1] == 0x42);
+
+    // ROM stays read-only
+    bus.Write(0x0001, 0x42);
+    REQUIRE(mapper.Rom(1)[1] == 0x00);
+}
+
+TEST_CASE("Spectrum 128 decodes 7FFD on A15 and A1 only", "[mapper][spectrum]")
+{
+    Bus bus;
+    Spectrum128Mapper mapper;
+    TagBanks(mapper);
+    mapper.Attach(bus);
+
+    bus.Out(0x00FD, 0x04);      // A15 = 0, A1 = 0: still the paging port
+    REQUIRE(bus.Read(0xC000) == 0xB4);
+
+    bus.Out(0xFFFD, 0x01);      // A15 = 1 (the AY register port)
+    bus.Out(0x7FFF, 0x01);      // A1 = 1
+    REQUIRE(bus.Read(0xC000) == 0xB4);
+}
+
+TEST_CASE("Spectrum 128 lock bit ignores further paging until reset", "[mapper][spectrum]")
+{
+    Bus bus;
+    Spectrum128Mapper mapper;
+    TagBanks(mapper);
+    mapper.Attach(bus);
+
+    bus.Out(0x7FFD, 0x26);      // RAM 6, locked
+    bus.Out(0x7FFD, 0x01);
+
+    REQUIRE(mapper.IsLocked());
+    REQUIRE(bus.Read(0xC000) == 0xB6);
+
+    mapper.Reset();
+    REQUIRE_FALSE(mapper.IsLocked());
+    REQUIRE(bus.Read(0xC000) == 0xB0);
+}
+
+TEST_CASE("Spectrum 128 program pages a bank in with OUT and reads it", "[mapper][spectrum][io]")
+{
+    Bus bus;
+    Cpu cpu;
+    Spectrum128Mapper mapper;
+    mapper.Attach(bus);
+    mapper.Ram(7)[0] = 0x77;
+
+    const std::uint8_t program[] = {
+        0x3E, 0x07,             // LD A,7
+        0xD3, 0xFD,             // OUT (0xFD),A   -> port 0x07FD
+        0x21, 0x00, 0xC0,       // LD HL,0xC000
+        0x7E,                   // LD A,(HL)
+    };
+    for (std::size_t i = 0; i < sizeof(program); ++i)
+        mapper.Ram(5)[i] = program[i];
+
+    cpu.Connect(&bus);
+    cpu.Reset(0x4000);
+    cpu.Execute(4);
+
+    REQUIRE(cpu.GetA() == 0x77);
+}
+
+// **********************************************
+// *            SPECTRUM +3 (7FFD/1FFD)         *
+// **********************************************
+TEST_CASE("Spectrum +3 picks one of four ROMs from both ports", "[mapper][plus3]")
+{
+    Bus bus;
+    SpectrumPlus3Mapper mapper;
+    TagBanks(mapper);
+    mapper.Attach(bus);
+
+    bus.Out(0x7FFD, 0x10);
+    REQUIRE(bus.Read(0x0000) == 0xA1);
+
+    bus.Out(0x1FFD, 0x04);
+    REQUIRE(bus.Read(0x0000) == 0xA3);
+
+    bus.Out(0x7FFD, 0x00);
+    REQUIRE(bus.Read(0x0000) == 0xA2);
+}
+
+TEST_CASE("Spectrum +3 special paging maps four RAM banks", "[mapper][plus3]")
+{
+    Bus bus;
+    SpectrumPlus3Mapper mapper;
+    TagBanks(mapper);
+    mapper.Attach(bus);
+
+    const std::uint8_t layouts[4][4] = {
+        { 0xB0, 0xB1, 0xB2, 0xB3 },
+        { 0xB4, 0xB5, 0xB6, 0xB7 },
+        { 0xB4, 0xB5, 0xB6, 0xB3 },
+        { 0xB4, 0xB7, 0xB6, 0xB3 },
+    };
+    for (std::uint8_t mode = 0; mode < 4; ++mode)
+    {
+        CAPTURE(mode);
+        bus.Out(0x1FFD, static_cast<std::uint8_t>(0x01 | mode << 1));
+        for (std::size_t slot = 0; slot < 4; ++slot)
+            REQUIRE(bus.Read(static_cast<std::uint16_t>(slot * 0x4000)) == layouts[mode][slot]);
+    }
+
+    // Special paging is RAM, so slot 0 is writable
+    bus.Write(0x0001, 0x99);
+    REQUIRE(mapper.Ram(4)[1] == 0x99);
+}
+
+TEST_CASE("Spectrum +3 decodes its ports more fully than the 128", "[mapper][plus3]")
+{
+    Bus bus;
+    SpectrumPlus3Mapper mapper;
+    TagBanks(mapper);
+    mapper.Attach(bus);
+
+    bus.Out(0x00FD, 0x03);      // A14 = 0: not 7FFD on the +3
+    REQUIRE(bus.Read(0xC000) == 0xB0);
+
+    bus.Out(0x7FFD, 0x23);      // lock
+    bus.Out(0x1FFD, 0x01);
+    REQUIRE(bus.Read(0x0000) == 0xA0);
+    REQUIRE(bus.Read(0xC000) == 0xB3);
+}
+
+// **********************************************
+// *             MSX ASCII8 / ASCII16           *
+// **********************************************
+TEST_CASE("ASCII8 selects an 8K bank per slot through its register writes", "[mapper][msx]")
+{
+    Bus bus;
+    MsxAscii8Mapper mapper(BankedImage(0x2000, 16));
+    mapper.Attach(bus);
+
+    for (std::uint16_t slot = 0; slot < 4; ++slot)
+        REQUIRE(bus.Read(static_cast<std::uint16_t>(0x4000 + slot * 0x2000)) == 0);
+
+    bus.Write(0x6000, 3);
+    bus.Write(0x6FFF, 5);
+    bus.Write(0x7000, 9);
+    bus.Write(0x7800, 15);
+
+    REQUIRE(bus.Read(0x4000) == 3);
+    REQUIRE(bus.Read(0x7FFF) == 5);
+    REQUIRE(bus.Read(0x8000) == 9);
+    REQUIRE(bus.Read(0xBFFF) == 15);
+
+    // Bank numbers wrap at the image size; other writes do nothing
+    bus.Write(0x6000, 17);
+    bus.Write(0x4000, 7);
+    REQUIRE(bus.Read(0x4000) == 1);
+    REQUIRE(mapper.Bank(0) == 1);
+}
+
+TEST_CASE("ASCII16 selects 16K banks from 0x6000 and 0x7000", "[mapper][msx]")
+{
+    Bus bus;
+    MsxAscii16Mapper mapper(BankedImage(0x4000, 8));
+    mapper.Attach(bus);
+
+    bus.Write(0x6000, 2);
+    bus.Write(0x7000, 6);
+    bus.Write(0x6800, 7);       // no register here on ASCII16
+
+    REQUIRE(bus.Read(0x4000) == 2);
+    REQUIRE(bus.Read(0x7FFF) == 2);
+    REQUIRE(bus.Read(0x8000) == 6);
+    REQUIRE(bus.Read(0xBFFF) == 6);
+}
+
+TEST_CASE("A short cartridge image is padded with 0xFF to whole banks", "[mapper][msx]")
+{
+    Bus bus;
+    MsxAscii16Mapper mapper(std::vector<std::uint8_t>(0x5000, 0x11));
+    mapper.Attach(bus);
+
+    REQUIRE(mapper.BankCount() == 2);
+    bus.Write(0x6000, 1);
+    REQUIRE(bus.Read(0x4000) == 0x11);
+    REQUIRE(bus.Read(0x5000) == 0xFF);
+}
+
+TEST_CASE("Code run from a switched-out bank is not reused after the switch", "[mapper][msx][decode-cache]")
+{
+    Bus bus;
+    Cpu cpu;
+    std::vector<std::uint8_t> image(0x2000 * 2, 0x00);
+    image[0x0000] = 0x3C;       // bank 0: INC A
+    image[0x2000] = 0x04;       // bank 1: INC B
+    MsxAscii8Mapper mapper(image);
+    mapper.Attach(bus);
+    cpu.Connect(&bus);
+
+    cpu.Reset(0x4000);
+    cpu.Step();
+    bus.Write(0x6000, 1);
+    cpu.Reset(0x4000);
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x01);
+    REQUIRE(cpu.GetB() == 0x01);
+}
@@ -0,0 +1,256 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+struct CpuFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    CpuFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+    }
+};
+
+namespace
+{
+    // Logs every access and answers reads with the low address byte
+    struct RecordingDevice : MemoryDevice
+    {
+        std::vector<std::uint16_t> reads;
+        std::vector<std::pair<std::uint16_t, std::uint8_t>> writes;
+
+        std::uint8_t Read(std::uint16_t address) override
+        {
+            reads.push_back(address);
+            return static_cast<std::uint8_t>(address);
+        }
+
+        void Write(std::uint16_t address, std::uint8_t value) override
+        {
+            writes.emplace_back(address, value);
+        }
+    };
+
+    // Serves a program out of `code` and logs every read
+    struct CodeDevice : MemoryDevice
+    {
+        std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> code{};
+        std::vector<std::uint16_t> reads;
+
+        std::uint8_t Read(std::uint16_t address) override
+        {
+            reads.push_back(address);
+            return code[address & (Bus::MAP_PAGE_SIZE - 1)];
+        }
+
+        void Write(std::uint16_t, std::uint8_t) override {}
+    };
+
+    constexpr std::uint16_t PageAddress(std::size_t page)
+    {
+        return static_cast<std::uint16_t>(page << Bus::MAP_PAGE_SHIFT);
+    }
+}
+
+// **********************************************
+// *                 RAM PAGES                  *
+// **********************************************
+TEST_CASE("External RAM mapped over a page is read and written in place", "[bus][memory-map]")
+{
+    Bus bus;
+    std::array<std::uint8_t, 2 * Bus::MAP_PAGE_SIZE> bank{};
+    bank[0] = 0x11;
+    bank[Bus::MAP_PAGE_SIZE] = 0x22;
+
+    bus.MapRam(4, 2, bank.data());
+
+    REQUIRE(bus.Read(PageAddress(4)) == 0x11);
+    REQUIRE(bus.Read(PageAddress(5)) == 0x22);
+
+    bus.Write(PageAddress(5) + 3, 0x33);
+    REQUIRE(bank[Bus::MAP_PAGE_SIZE + 3] == 0x33);
+
+    // Neighbours still hit the bus's own RAM
+    bus.Write(PageAddress(6), 0x44);
+    REQUIRE(bus.Read(PageAddress(6)) == 0x44);
+}
+
+TEST_CASE("UnmapAll brings back the bus's own RAM with its contents", "[bus][memory-map]")
+{
+    Bus bus;
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> bank{};
+    bus.Write(0x0010, 0x5A);
+
+    bus.MapRam(0, 1, bank.data());
+    bus.Write(0x0010, 0xA5);
+    bus.UnmapAll();
+
+    REQUIRE(bus.Read(0x0010) == 0x5A);
+    REQUIRE(bank[0x0010] == 0xA5);
+}
+
+TEST_CASE("Mappings past the end of the address space are clipped", "[bus][memory-map]")
+{
+    Bus bus;
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> bank{};
+    bank[0] = 0x77;
+
+    bus.MapRam(Bus::MAP_PAGE_COUNT - 1, 8, bank.data());
+    bus.MapRam(Bus::MAP_PAGE_COUNT, 1, nullptr);
+
+    REQUIRE(bus.Read(PageAddress(Bus::MAP_PAGE_COUNT - 1)) == 0x77);
+    REQUIRE(bus.Read(0x0000) == 0x00);
+}
+
+// **********************************************
+// *                 ROM PAGES                  *
+// **********************************************
+TEST_CASE("Writes to a ROM page are dropped", "[bus][memory-map][rom]")
+{
+    Bus bus;
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> rom{};
+    rom.fill(0xC9);
+
+    bus.MapRom(0, 1, rom.data());
+    bus.Write(0x0001, 0x00);
+
+    REQUIRE(bus.Read(0x0001) == 0xC9);
+    REQUIRE(rom[1] == 0xC9);
+}
+
+TEST_CASE_METHOD(CpuFixture, "CPU runs code from ROM and cannot overwrite it", "[bus][memory-map][rom]")
+{
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> rom{};
+    const std::uint8_t program[] = {
+        0x21, 0x00, 0x00,   // LD HL,0x0000
+        0x36, 0x3C,         // LD (HL),0x3C
+        0x04,               // INC B
+    };
+    std::copy(std::begin(program), std::end(program), rom.begin());
+    bus.MapRom(0, 1, rom.data());
+
+    cpu.Execute(3);
+    REQUIRE(cpu.GetB() == 0x01);
+    REQUIRE(bus.Read(0x0000) == 0x21);
+}
+
+// **********************************************
+// *                DEVICE PAGES                *
+// **********************************************
+TEST_CASE("Device pages route every access to the device with the full address", "[bus][memory-map][mmio]")
+{
+    Bus bus;
+    RecordingDevice device;
+
+    bus.MapDevice(8, 1, &device);
+
+    REQUIRE(bus.Read(PageAddress(8) + 0x12) == 0x12);
+    bus.Write(PageAddress(8) + 0x34, 0x56);
+
+    REQUIRE(device.reads == std::vector<std::uint16_t>{ static_cast<std::uint16_t>(PageAddress(8) + 0x12) });
+    REQUIRE(device.writes.size() == 1);
+    REQUIRE(device.writes[0].first == PageAddress(8) + 0x34);
+    REQUIRE(device.writes[0].second == 0x56);
+
+    // RAM pages never reach it
+    bus.Write(PageAddress(9), 0x01);
+    REQUIRE(bus.Read(PageAddress(9)) == 0x01);
+    REQUIRE(device.reads.size() == 1);
+    REQUIRE(device.writes.size() == 1);
+}
+
+TEST_CASE("A device page with no device reads as open bus", "[bus][memory-map][mmio]")
+{
+    Bus bus;
+
+    bus.MapDevice(2, 1, nullptr);
+    bus.Write(PageAddress(2), 0x00);
+
+    REQUIRE(bus.Read(PageAddress(2)) == 0xFF);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Stack pushes into a device page reach the device", "[bus][memory-map][mmio]")
+{
+    RecordingDevice device;
+    bus.MapDevice(Bus::MAP_PAGE_COUNT - 1, 1, &device);
+
+    bus.Write(0x0000, 0x01);    // LD BC,0x1234
+    bus.Write(0x0001, 0x34);
+    bus.Write(0x0002, 0x12);
+    bus.Write(0x0003, 0xC5);    // PUSH BC
+    cpu.Execute(2);
+
+    REQUIRE(device.writes.size() == 2);
+    REQUIRE(device.writes[0] == std::pair<std::uint16_t, std::uint8_t>{ 0xFFFE, 0x12 });
+    REQUIRE(device.writes[1] == std::pair<std::uint16_t, std::uint8_t>{ 0xFFFD, 0x34 });
+}
+
+// **********************************************
+// *        REMAPPING DECODED CODE PAGES        *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "Code decoded from a page is dropped when another bank is mapped over it", "[bus][memory-map][decode-cache]")
+{
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> bankA{};
+    std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> bankB{};
+    bankA[0] = 0x3C;    // INC A
+    bankB[0] = 0x04;    // INC B
+
+    bus.MapRom(0, 1, bankA.data());
+    cpu.Step();
+    REQUIRE(cpu.GetA() == 0x01);
+
+    bus.MapRom(0, 1, bankB.data());
+    cpu.Reset(0x0000);
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x01);
+    REQUIRE(cpu.GetB() == 0x01);
+}
+
+// **********************************************
+// *           CODE ON DEVICE PAGES             *
+// **********************************************
+// *                                            *
+// *  Every fetch reaches the device, and only  *
+// *  the instruction's own bytes are read.     *
+// *                                            *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "Code on a device page reads only its own bytes", "[bus][memory-map][mmio][decode-cache]")
+{
+    CodeDevice device;
+    device.code[0] = 0x3C;      // INC A
+    device.code[1] = 0x3E;      // LD A,0x42
+    device.code[2] = 0x42;
+
+    bus.MapDevice(4, 1, &device);
+    cpu.Reset(PageAddress(4));
+    cpu.Execute(2);
+
+    REQUIRE(cpu.GetA() == 0x42);
+    REQUIRE(device.reads == std::vector<std::uint16_t>{ PageAddress(4), PageAddress(4) + 1, PageAddress(4) + 2 });
+}
+
+TEST_CASE_METHOD(CpuFixture, "Code on a device page is fetched again on every run", "[bus][memory-map][mmio][decode-cache]")
+{
+    CodeDevice device;
+    device.code[0] = 0x3C;      // INC A
+
+    bus.MapDevice(4, 1, &device);
+    cpu.Reset(PageAddress(4));
+    cpu.Step();
+    REQUIRE(cpu.GetA() == 0x01);
+
+    device.code[0] = 0x04;      // INC B, with no write through the Bus
+    cpu.Reset(PageAddress(4));
+    cpu.Step();
+
+    REQUIRE(cpu.GetA() == 0x01);
+    REQUIRE(cpu.GetB() == 0x01);
+}
@@ -0,0 +1,187 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Bus.h"
+#include "Cpu.h"
+#include "Machine.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace
+{
+#if defined(Z80EMU_PAGE_HASH)
+    std::vector<std::uint8_t> RamOf(const Bus& bus)
+    {
+        std::vector<std::uint8_t> ram(Bus::RAM_SIZE);
+        bus.ReadRam(0, ram);
+        return ram;
+    }
+
+    // Every kept hash against one worked out from scratch
+    void RequireHashesMatch(const Bus& bus)
+    {
+        const std::vector<std::uint8_t> ram = RamOf(bus);
+        std::uint64_t all = 0;
+        for (std::size_t page = 0; page < Bus::MAP_PAGE_COUNT; ++page)
+        {
+            const std::size_t base = page * Bus::MAP_PAGE_SIZE;
+            const std::uint64_t expected = Bus::HashRun(static_cast<std::uint16_t>(base), { ram.data() + base, Bus::MAP_PAGE_SIZE });
+            INFO("page " << page);
+            REQUIRE(bus.PageHash(page) == expected);
+            all ^= expected;
+        }
+        REQUIRE(bus.RamHash() == all);
+    }
+#endif
+}
+
+// **********************************************
+// *               FINGERPRINTS                 *
+// **********************************************
+TEST_CASE("A fingerprint follows the CPU and RAM", "[hash]")
+{
+    Machine machine;
+    const std::uint64_t fresh = machine.Fingerprint();
+    REQUIRE(machine.Fork()->Fingerprint() == fresh);
+
+    machine.GetBus().Write(0x8000, 1);
+    REQUIRE(machine.Fingerprint() != fresh);
+    machine.GetBus().Write(0x8000, 0);
+    REQUIRE(machine.Fingerprint() == fresh);
+
+    machine.GetCpu().Step();
+    REQUIRE(machine.Fingerprint() != fresh);
+}
+
+TEST_CASE("The same RAM fingerprints the same however it was written", "[hash]")
+{
+    const std::vector<std::uint8_t> image = { 0x12, 0x34, 0x00, 0x56 };
+
+    Machine bytes;
+    for (std::size_t i = 0; i < image.size(); ++i)
+        bytes.GetBus().Write(static_cast<std::uint16_t>(0x43FE + i), image[i]);
+
+    Machine block;
+    block.GetBus().Fill(0x4000, 0x800, 0xAA);
+    block.GetBus().Fill(0x4000, 0x800, 0x00);
+    block.GetBus().WriteBlock(0x43FE, image);
+
+    Machine restored;
+    restored.GetBus().RestoreRam(0x43FE, image);
+
+    REQUIRE(bytes.Fingerprint() == block.Fingerprint());
+    REQUIRE(bytes.Fingerprint() == restored.Fingerprint());
+    REQUIRE(Bus::HashRun(0x43FE, image) != Bus::HashRun(0x43FF, image));
+    REQUIRE(Bus::HashRun(0x1234, std::vector<std::uint8_t>(16, 0x00)) == 0);
+}
+
+#if defined(Z80EMU_PAGE_HASH)
+// **********************************************
+// *            KEPT PAGE HASHES                *
+// **********************************************
+TEST_CASE("Page hashes stay exact through every kind of write", "[hash]")
+{
+    Bus bus;
+    REQUIRE(bus.RamHash() == 0);
+
+    bus.Write(0x0000, 0x3C);
+    bus.Write(0x0000, 0x3D);
+    bus.Write(0xFFFF, 0x01);
+    bus.WriteBlock(0x13F0, std::vector<std::uint8_t>(0x40, 0x5A));     // across a page boundary
+    bus.Fill(0x2000, 0x900, 0xE7);
+    bus.Fill(0x2100, 0x10, 0x00);
+    RequireHashesMatch(bus);
+
+    bus.ClearDirty();                       // the next write to each page is trapped
+    bus.Write(0x2001, 0x99);
+    bus.WriteBlock(0x2002, std::vector<std::uint8_t>{ 1, 2, 3 });
+    RequireHashesMatch(bus);
+
+    // RestoreRam writes own RAM even where ROM is mapped over it
+    const std::vector<std::uint8_t> rom(Bus::MAP_PAGE_SIZE, 0xC9);
+    bus.MapRom(0x30, 1, rom.data());
+    bus.RestoreRam(0xC000, std::vector<std::uint8_t>(0x20, 0x77));
+    bus.RestoreRam(0xC3F0, std::vector<std::uint8_t>(0x20, 0x66));
+    RequireHashesMatch(bus);
+}
+
+TEST_CASE("Writes that miss own RAM leave the hashes alone", "[hash]")
+{
+    Bus bus;
+    std::vector<std::uint8_t> external(Bus::MAP_PAGE_SIZE, 0x00);
+    const std::vector<std::uint8_t> rom(Bus::MAP_PAGE_SIZE, 0x00);
+    bus.MapRam(0x10, 1, external.data());
+    bus.MapRom(0x11, 1, rom.data());
+
+    bus.Write(0x4000, 0x12);                // external RAM
+    bus.Write(0x4400, 0x34);                // ROM
+    bus.WriteBlock(0x43FE, std::vector<std::uint8_t>{ 1, 2, 3, 4 });
+    bus.Fill(0x4000, 0x800, 0xFF);
+
+    REQUIRE(external[0] == 0xFF);
+    REQUIRE(bus.RamHash() == 0);
+    RequireHashesMatch(bus);
+}
+
+TEST_CASE("A fork and its parent keep their own hashes", "[hash][fork]")
+{
+    Bus parent;
+    parent.Fill(0x8000, 0x100, 0x11);
+    const std::unique_ptr<Bus> child = parent.Fork();
+    REQUIRE(child->RamHash() == parent.RamHash());
+
+    parent.Write(0x8000, 0x22);             // copies the page on both sides
+    child->Write(0x8001, 0x33);
+    child->Write(0x9000, 0x44);
+    RequireHashesMatch(parent);
+    RequireHashesMatch(*child);
+    REQUIRE(child->RamHash() != parent.RamHash());
+}
+
+TEST_CASE("Block instructions keep the hashes exact", "[hash][block]")
+{
+    Bus bus;
+    Cpu cpu;
+    cpu.Connect(&bus);
+    cpu.Reset();
+    for (std::uint16_t i = 0; i < 0x600; ++i)
+        bus.Write(static_cast<std::uint16_t>(0x4000 + i), static_cast<std::uint8_t>(i * 5 + 1));
+
+    SECTION("LDIR copy")
+    {
+        bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0xED, 0xB0 });
+        cpu.SetHl(0x4000);
+        cpu.SetDe(0x83F0);
+        cpu.SetBc(0x500);
+    }
+    SECTION("LDIR fill over its own source")
+    {
+        bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0xED, 0xB0 });
+        cpu.SetHl(0x4000);
+        cpu.SetDe(0x4001);
+        cpu.SetBc(0x5FF);
+    }
+    SECTION("LDDR")
+    {
+        bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0xED, 0xB8 });
+        cpu.SetHl(0x45FF);
+        cpu.SetDe(0x47FF);
+        cpu.SetBc(0x600);
+    }
+
+    cpu.Execute(0x600);
+    REQUIRE(cpu.GetBc() == 0);
+    RequireHashesMatch(bus);
+}
+
+TEST_CASE("The fingerprint uses the kept hashes", "[hash]")
+{
+    Machine machine;
+    machine.GetBus().Write(0x1234, 0x56);
+    const std::uint64_t before = machine.Fingerprint();
+
+    Machine copy;
+    copy.GetBus().RestoreRam(0, RamOf(machine.GetBus()));
+    REQUIRE(copy.GetBus().RamHash() == machine.GetBus().RamHash());
+    REQUIRE(copy.Fingerprint() == before);
+}
+#endif
@@ -0,0 +1,150 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+
+#if defined(Z80EMU_PROFILER)
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Machine
+    {
+        Bus bus;
+        Cpu cpu;
+
+        explicit Machine(Profiler::Mode mode)
+        {
+            cpu.Connect(&bus);
+            cpu.Reset();
+            cpu.GetProfiler().SetMode(mode);
+        }
+    };
+}
+
+// **********************************************
+// *                COUNT MODE                  *
+// **********************************************
+TEST_CASE("Count mode counts every opcode and PC the core runs", "[profiler]")
+{
+    Machine machine(Profiler::Mode::Count);
+    machine.bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0x3C, 0x04, 0x3C });    // INC A ; INC B ; INC A
+
+    machine.cpu.Execute(3);
+    machine.cpu.Reset(0x0000);
+    machine.cpu.Step();
+    machine.cpu.Run(8);
+
+    const Profiler& profiler = machine.cpu.GetProfiler();
+    REQUIRE(profiler.Instructions() == 6);
+    REQUIRE(profiler.OpcodeCount(0x3C) == 4);
+    REQUIRE(profiler.OpcodeCount(0x04) == 2);
+    REQUIRE(profiler.PcCount(0x0000) == 2);
+    REQUIRE(profiler.PcCount(0x0001) == 2);
+    REQUIRE(profiler.PcCount(0x0002) == 2);
+    REQUIRE(profiler.PcCount(0x0003) == 0);
+}
+
+TEST_CASE("Each iteration of a block repeat counts as an instruction at its PC", "[profiler]")
+{
+    Machine machine(Profiler::Mode::Count);
+    machine.bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0xED, 0xB0 });         // LDIR
+    machine.cpu.SetHl(0x4000);
+    machine.cpu.SetDe(0x5000);
+    machine.cpu.SetBc(40);
+
+    machine.cpu.Execute(10);        // one dispatch runs all ten
+    machine.cpu.Step();
+    machine.cpu.Run(21 * 28 + 16);  // the other 29
+
+    const Profiler& profiler = machine.cpu.GetProfiler();
+    REQUIRE(machine.cpu.GetBc() == 0);
+    REQUIRE(profiler.Instructions() == 40);
+    REQUIRE(profiler.OpcodeCount(0xED) == 40);
+    REQUIRE(profiler.EdOpcodeCount(0xB0) == 40);
+    REQUIRE(profiler.PcCount(0x0000) == 40);
+}
+
+TEST_CASE("Off records nothing and Clear zeroes the counts", "[profiler]")
+{
+    Machine machine(Profiler::Mode::Off);
+    machine.cpu.Execute(100);
+    REQUIRE(machine.cpu.GetProfiler().Instructions() == 0);
+    REQUIRE(machine.cpu.GetProfiler().OpcodeCount(0x00) == 0);
+
+    machine.cpu.GetProfiler().SetMode(Profiler::Mode::Count);
+    machine.cpu.Execute(100);
+    REQUIRE(machine.cpu.GetProfiler().OpcodeCount(0x00) == 100);
+
+    machine.cpu.GetProfiler().Clear();
+    REQUIRE(machine.cpu.GetProfiler().Instructions() == 0);
+    REQUIRE(machine.cpu.GetProfiler().PcCount(0x0000) == 0);
+    REQUIRE(machine.cpu.GetProfiler().GetMode() == Profiler::Mode::Count);
+}
+
+// **********************************************
+// *                SAMPLE MODE                 *
+// **********************************************
+TEST_CASE("Sample mode records the PC every N T-states", "[profiler]")
+{
+    Machine machine(Profiler::Mode::Sample);
+    machine.cpu.GetProfiler().SetSampleInterval(10);
+
+    // NOPs, 4 T-states each: the 10th T-state falls in the one at 0x0002,
+    // the 20th in the one at 0x0004, the 30th in 0x0007
+    machine.cpu.Execute(100);
+
+    const Profiler& profiler = machine.cpu.GetProfiler();
+    REQUIRE(profiler.Samples() == 40);
+    REQUIRE(profiler.Instructions() == 0);
+    REQUIRE(profiler.SampleCount(0x0002) == 1);
+    REQUIRE(profiler.SampleCount(0x0003) == 0);
+    REQUIRE(profiler.SampleCount(0x0004) == 1);
+    REQUIRE(profiler.SampleCount(0x0007) == 1);
+    REQUIRE(profiler.PcCount(0x0002) == 0);
+}
+
+TEST_CASE("An instruction longer than the interval takes every sample it spans", "[profiler]")
+{
+    Machine machine(Profiler::Mode::Sample);
+    machine.cpu.GetProfiler().SetSampleInterval(3);
+
+    machine.cpu.Execute(3);         // NOPs: samples at T-states 3, 6, 9 and 12
+
+    const Profiler& profiler = machine.cpu.GetProfiler();
+    REQUIRE(profiler.Samples() == 4);
+    REQUIRE(profiler.SampleCount(0x0000) == 1);
+    REQUIRE(profiler.SampleCount(0x0001) == 1);
+    REQUIRE(profiler.SampleCount(0x0002) == 2);
+}
+
+// **********************************************
+// *                  DUMPS                     *
+// **********************************************
+TEST_CASE("Text and CSV dumps list the counts", "[profiler]")
+{
+    Machine machine(Profiler::Mode::Count);
+    machine.bus.WriteBlock(0x0100, std::vector<std::uint8_t>{ 0x3C, 0x3C, 0xED, 0xA0 });   // INC A ; INC A ; LDI
+    machine.cpu.Reset(0x0100);
+    machine.cpu.Execute(3);
+
+    std::ostringstream text;
+    machine.cpu.GetProfiler().WriteText(text);
+    REQUIRE(text.str().find("3 instructions counted") != std::string::npos);
+    REQUIRE(text.str().find("3C") != std::string::npos);
+    REQUIRE(text.str().find("ED A0") != std::string::npos);
+    REQUIRE(text.str().find("0101") != std::string::npos);
+
+    std::ostringstream csv;
+    machine.cpu.GetProfiler().WriteCsv(csv);
+    REQUIRE(csv.str() ==
+        "kind,key,count\n"
+        "opcode,0x3C,2\n"
+        "opcode,0xED,1\n"
+        "ed,0xA0,1\n"
+        "pc,0x0100,1\n"
+        "pc,0x0101,1\n"
+        "pc,0x0102,1\n");
+}
+#endif
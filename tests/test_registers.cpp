@@ -0,0 +1,169 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+
+struct CpuFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    CpuFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+    }
+};
+
+// **********************************************
+// *            REGISTER FILE                   *
+// **********************************************
+// *                                            *
+// *  8-bit registers are the bytes of their    *
+// *  pairs, so both views must always agree.   *
+// *                                            *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "8-bit setters land in the right half of each pair", "[registers]")
+{
+    cpu.SetB(0x12); cpu.SetC(0x34);
+    cpu.SetD(0x56); cpu.SetE(0x78);
+    cpu.SetH(0x9A); cpu.SetL(0xBC);
+    cpu.SetA(0xDE); cpu.SetF(0xF0);
+
+    REQUIRE(cpu.GetBc() == 0x1234);
+    REQUIRE(cpu.GetDe() == 0x5678);
+    REQUIRE(cpu.GetHl() == 0x9ABC);
+    REQUIRE(cpu.GetAf() == 0xDEF0);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Setting the high byte leaves the low byte alone", "[registers]")
+{
+    cpu.SetC(0x34); cpu.SetB(0x12);
+    cpu.SetE(0x78); cpu.SetD(0x56);     // SetD used to mask the wrong half and clear E
+    cpu.SetL(0xBC); cpu.SetH(0x9A);
+
+    REQUIRE(cpu.GetBc() == 0x1234);
+    REQUIRE(cpu.GetDe() == 0x5678);
+    REQUIRE(cpu.GetHl() == 0x9ABC);
+}
+
+TEST_CASE_METHOD(CpuFixture, "16-bit setters are visible through the 8-bit getters", "[registers]")
+{
+    cpu.SetBc(0x0102);
+    cpu.SetDe(0x0304);
+    cpu.SetHl(0x0506);
+    cpu.SetAf(0x0708);
+
+    REQUIRE(cpu.GetB() == 0x01); REQUIRE(cpu.GetC() == 0x02);
+    REQUIRE(cpu.GetD() == 0x03); REQUIRE(cpu.GetE() == 0x04);
+    REQUIRE(cpu.GetH() == 0x05); REQUIRE(cpu.GetL() == 0x06);
+    REQUIRE(cpu.GetA() == 0x07); REQUIRE(cpu.GetF() == 0x08);
+}
+
+TEST_CASE_METHOD(CpuFixture, "LD r,n writes every register and (HL)", "[registers][ld]")
+{
+    const uint8_t program[] = {
+        0x06, 0x11,     // LD B,0x11
+        0x0E, 0x22,     // LD C,0x22
+        0x16, 0x33,     // LD D,0x33
+        0x1E, 0x44,     // LD E,0x44
+        0x26, 0x80,     // LD H,0x80
+        0x2E, 0x00,     // LD L,0x00
+        0x36, 0x55,     // LD (HL),0x55
+        0x3E, 0x66,     // LD A,0x66
+    };
+    for (uint16_t i = 0; i < sizeof(program); ++i)
+        bus.Write(i, program[i]);
+
+    cpu.Execute(8);
+
+    REQUIRE(cpu.GetBc() == 0x1122);
+    REQUIRE(cpu.GetDe() == 0x3344);
+    REQUIRE(cpu.GetHl() == 0x8000);
+    REQUIRE(bus.Read(0x8000) == 0x55);
+    REQUIRE(cpu.GetA() == 0x66);
+    REQUIRE(cpu.GetPc() == sizeof(program));
+}
+
+// **********************************************
+// *        EX AF,AF'   ::    OP CODE: 0x08     *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "EX AF,AF' (0x08) swaps AF with its shadow and back", "[registers][exchange]")
+{
+    bus.Write(0x0000, 0x08); // EX AF,AF'
+    bus.Write(0x0001, 0x08); // EX AF,AF'
+
+    cpu.SetAf(0x1234);
+    cpu.SetAfAlt(0x5678);
+    cpu.SetBc(0x9ABC);
+
+    cpu.Step();
+    REQUIRE(cpu.GetAf() == 0x5678);
+    REQUIRE(cpu.GetAfAlt() == 0x1234);
+    REQUIRE(cpu.GetBc() == 0x9ABC);     // only AF takes part
+
+    cpu.Step();
+    REQUIRE(cpu.GetAf() == 0x1234);
+    REQUIRE(cpu.GetAfAlt() == 0x5678);
+}
+
+TEST_CASE_METHOD(CpuFixture, "EX AF,AF' (0x08) keeps the flags of the ALU op before it", "[registers][exchange][flags]")
+{
+    bus.Write(0x0000, 0xC6); // ADD A,0x01
+    bus.Write(0x0001, 0x01);
+    bus.Write(0x0002, 0x08); // EX AF,AF'
+
+    cpu.SetA(0xFF);
+
+    cpu.Execute(2);
+
+    REQUIRE(cpu.GetAfAlt() == (0x0000 | Cpu::FLAG_Z | Cpu::FLAG_H | Cpu::FLAG_C));
+}
+
+// **********************************************
+// *           EXX   ::    OP CODE: 0xD9        *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "EXX (0xD9) swaps BC, DE and HL with their shadows but not AF", "[registers][exchange]")
+{
+    bus.Write(0x0000, 0xD9); // EXX
+    bus.Write(0x0001, 0x04); // INC B
+    bus.Write(0x0002, 0xD9); // EXX
+
+    cpu.SetBc(0x1111); cpu.SetDe(0x2222); cpu.SetHl(0x3333);
+    cpu.SetBcAlt(0x4444); cpu.SetDeAlt(0x5555); cpu.SetHlAlt(0x6666);
+    cpu.SetAf(0x7700);
+
+    cpu.Step();
+    REQUIRE(cpu.GetBc() == 0x4444);
+    REQUIRE(cpu.GetDe() == 0x5555);
+    REQUIRE(cpu.GetHl() == 0x6666);
+    REQUIRE(cpu.GetBcAlt() == 0x1111);
+    REQUIRE(cpu.GetA() == 0x77);
+
+    cpu.Step();                         // INC B works on the shadow bank now
+    cpu.Step();
+
+    REQUIRE(cpu.GetBc() == 0x1111);
+    REQUIRE(cpu.GetBcAlt() == 0x4544);
+    REQUIRE(cpu.GetHl() == 0x3333);
+}
+
+// **********************************************
+// *          IX / IY / I / R                   *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "Index and special registers hold their values and reset clears I and R", "[registers]")
+{
+    cpu.SetIx(0xABCD);
+    cpu.SetIy(0x1357);
+    cpu.SetI(0x3F);
+    cpu.SetR(0x7E);
+
+    REQUIRE(cpu.GetIx() == 0xABCD);
+    REQUIRE(cpu.GetIy() == 0x1357);
+    REQUIRE(cpu.GetI() == 0x3F);
+    REQUIRE(cpu.GetR() == 0x7E);
+
+    cpu.Reset();
+
+    REQUIRE(cpu.GetI() == 0x00);
+    REQUIRE(cpu.GetR() == 0x00);
+}
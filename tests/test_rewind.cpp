@@ -0,0 +1,185 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include "RewindBuffer.h"
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+    // 48K of ROM looping INC A ; AND 0x3F ; LD (HL),A ; INC L, with an INC H
+    // closing every 256 bytes. HL starts in the RAM at 0xC000, so the program
+    // keeps writing RAM and then runs through what it wrote (0x00-0x3F,
+    // which holds no HALT).
+    const std::vector<std::uint8_t>& Program()
+    {
+        static const std::vector<std::uint8_t> rom = []
+        {
+            std::vector<std::uint8_t> bytes(0xC000);
+            const std::uint8_t loop[] = { 0x3C, 0xE6, 0x3F, 0x77, 0x2C };
+            for (std::size_t i = 0; i < bytes.size(); ++i)
+                bytes[i] = (i & 0xFF) == 0xFF ? 0x24 : loop[(i & 0xFF) % sizeof(loop)];
+            return bytes;
+        }();
+        return rom;
+    }
+
+    struct RomMachine
+    {
+        Bus bus;
+        Cpu cpu;
+
+        RomMachine()
+        {
+            cpu.Connect(&bus);
+            cpu.Reset();
+            bus.MapRom(0, 0xC000 / Bus::MAP_PAGE_SIZE, Program().data());
+            cpu.SetHl(0xC000);
+        }
+
+        std::vector<std::uint8_t> Ram() const
+        {
+            std::vector<std::uint8_t> ram(Bus::RAM_SIZE);
+            bus.ReadRam(0, ram);
+            return ram;
+        }
+    };
+
+    // Runs a second machine straight to `position` for the expected state
+    void RequireSameAsStraightRun(const RomMachine& rewound, std::uint64_t position)
+    {
+        RomMachine straight;
+        straight.cpu.Execute(position);
+
+        CAPTURE(position);
+        REQUIRE(rewound.cpu.GetState() == straight.cpu.GetState());
+        REQUIRE(rewound.Ram() == straight.Ram());
+    }
+
+    RewindConfig SmallConfig()
+    {
+        RewindConfig config;
+        config.interval = 1000;
+        config.keyframeEvery = 4;
+        return config;
+    }
+}
+
+// **********************************************
+// *                  SEEKING                   *
+// **********************************************
+TEST_CASE("Seeking back lands on exactly the state a straight run reaches", "[rewind]")
+{
+    RomMachine machine;
+    RewindBuffer rewind(machine.cpu, machine.bus, SmallConfig());
+    rewind.Execute(20000);
+    REQUIRE(rewind.Position() == 20000);
+    REQUIRE_FALSE(machine.cpu.is_halted());
+
+    // On a snapshot, between two, on a keyframe, and the very start
+    for (const std::uint64_t position : { 19999u, 15000u, 12345u, 8000u, 7999u, 1u, 0u })
+    {
+        REQUIRE(rewind.SeekTo(position));
+        REQUIRE(rewind.Position() == position);
+        RequireSameAsStraightRun(machine, position);
+    }
+}
+
+TEST_CASE("Execute through the buffer matches Cpu::Execute", "[rewind]")
+{
+    RomMachine recorded;
+    RomMachine plain;
+    RewindBuffer rewind(recorded.cpu, recorded.bus, SmallConfig());
+
+    const std::uint64_t recordedCycles = rewind.Execute(5500);
+    const std::uint64_t plainCycles = plain.cpu.Execute(5500);
+
+    REQUIRE(recordedCycles == plainCycles);
+    REQUIRE(recorded.cpu.GetState() == plain.cpu.GetState());
+    REQUIRE(recorded.Ram() == plain.Ram());
+    REQUIRE(rewind.Snapshots() == 6);
+}
+
+TEST_CASE("StepBack walks back one instruction at a time", "[rewind]")
+{
+    RomMachine machine;
+    RewindBuffer rewind(machine.cpu, machine.bus, SmallConfig());
+    rewind.Execute(2003);
+
+    for (std::uint64_t position = 2002; position >= 1997; --position)
+    {
+        REQUIRE(rewind.StepBack());
+        RequireSameAsStraightRun(machine, position);
+    }
+}
+
+TEST_CASE("Running on after a seek records the new future", "[rewind]")
+{
+    RomMachine machine;
+    RewindBuffer rewind(machine.cpu, machine.bus, SmallConfig());
+    rewind.Execute(9000);
+    REQUIRE(rewind.SeekTo(3500));
+    REQUIRE(rewind.Snapshots() == 4);
+
+    // A different future: the program writes elsewhere from here on
+    machine.cpu.SetHl(0xE000);
+    rewind.Execute(4000);
+    REQUIRE(rewind.Position() == 7500);
+
+    RomMachine straight;
+    straight.cpu.Execute(3500);
+    straight.cpu.SetHl(0xE000);
+    straight.cpu.Execute(2000);
+    REQUIRE(rewind.SeekTo(5500));
+    REQUIRE(machine.cpu.GetState() == straight.cpu.GetState());
+    REQUIRE(machine.Ram() == straight.Ram());
+}
+
+TEST_CASE("Seeks outside the recording are refused and change nothing", "[rewind]")
+{
+    RomMachine machine;
+    RewindBuffer rewind(machine.cpu, machine.bus, SmallConfig());
+    rewind.Execute(3000);
+    const Cpu::State before = machine.cpu.GetState();
+
+    REQUIRE_FALSE(rewind.SeekTo(3001));
+    REQUIRE_FALSE(rewind.StepBack(3001));
+    REQUIRE(rewind.SeekTo(3000));
+
+    REQUIRE(rewind.Position() == 3000);
+    REQUIRE(machine.cpu.GetState() == before);
+}
+
+// **********************************************
+// *                 MEMORY CAP                 *
+// **********************************************
+TEST_CASE("The memory cap drops the oldest keyframe groups", "[rewind]")
+{
+    RomMachine machine;
+    RewindConfig config = SmallConfig();
+    config.memoryCap = 16 * 1024;
+    RewindBuffer rewind(machine.cpu, machine.bus, config);
+    rewind.Execute(100000);
+
+    REQUIRE(rewind.MemoryUsed() <= config.memoryCap);
+    REQUIRE(rewind.Oldest() > 0);
+    REQUIRE(rewind.Oldest() % (config.interval * (config.keyframeEvery + 1)) == 0);
+
+    REQUIRE_FALSE(rewind.SeekTo(rewind.Oldest() - 1));
+    const std::uint64_t oldest = rewind.Oldest();
+    REQUIRE(rewind.SeekTo(oldest + 1));
+    RequireSameAsStraightRun(machine, oldest + 1);
+}
+
+TEST_CASE("The newest keyframe group is kept even over the cap", "[rewind]")
+{
+    RomMachine machine;
+    RewindConfig config = SmallConfig();
+    config.memoryCap = 0;
+    RewindBuffer rewind(machine.cpu, machine.bus, config);
+    rewind.Execute(10500);
+
+    REQUIRE(rewind.Snapshots() >= 1);
+    REQUIRE(rewind.SeekTo(rewind.Oldest()));
+    RequireSameAsStraightRun(machine, rewind.Position());
+}
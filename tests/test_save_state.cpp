@@ -0,0 +1,388 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+#include "LzCodec.h"
+#include "SaveState.h"
+#include <cstdint>
+#include <vector>
+
+struct CpuFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    CpuFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+    }
+};
+
+namespace
+{
+    // Offsets into a version 1 save state
+    constexpr std::size_t VERSION_OFFSET = 4;
+    constexpr std::size_t FIRST_BLOCK_OFFSET = 8 + 12 * 2 + 4 + 8;
+
+    Cpu::State SampleState()
+    {
+        Cpu::State state;
+        state.af = 0x12D7;
+        state.bc = 0x3456;
+        state.de = 0x789A;
+        state.hl = 0xBCDE;
+        state.afAlt = 0xF0C5;
+        state.bcAlt = 0x1111;
+        state.deAlt = 0x2222;
+        state.hlAlt = 0x3333;
+        state.pc = 0x8123;
+        state.sp = 0xFFF0;
+        state.ix = 0x4444;
+        state.iy = 0x5555;
+        state.i = 0x3F;
+        state.r = 0x81;
+        state.halted = true;
+        state.tstates = 0x0123456789ABull;
+        return state;
+    }
+
+    // Half the RAM a repeating pattern, half bytes that do not compress
+    void FillRam(Bus& bus)
+    {
+        std::vector<std::uint8_t> bytes(Bus::RAM_SIZE);
+        std::uint32_t seed = 0x1234567;
+        for (std::size_t i = 0; i < bytes.size(); ++i)
+        {
+            seed = seed * 1103515245u + 12345u;
+            bytes[i] = i < bytes.size() / 2 ? static_cast<std::uint8_t>(i % 7) : static_cast<std::uint8_t>(seed >> 16);
+        }
+        bus.WriteBlock(0x0000, bytes);
+    }
+
+    std::vector<std::uint8_t> RamOf(const Bus& bus)
+    {
+        std::vector<std::uint8_t> ram(Bus::RAM_SIZE);
+        bus.ReadRam(0, ram);
+        return ram;
+    }
+
+    std::vector<std::uint8_t> RoundTrip(std::span<const std::uint8_t> in)
+    {
+        std::vector<std::uint8_t> packed;
+        LzCodec::Compress(in, packed);
+        std::vector<std::uint8_t> out(in.size());
+        REQUIRE(LzCodec::Decompress(packed, out));
+        return out;
+    }
+}
+
+// **********************************************
+// *                   LZCODEC                  *
+// **********************************************
+TEST_CASE("LzCodec round-trips empty, short, repetitive and random data", "[save-state][lz]")
+{
+    REQUIRE(RoundTrip({}).empty());
+
+    const std::vector<std::uint8_t> shortInput = { 1, 2, 3 };
+    REQUIRE(RoundTrip(shortInput) == shortInput);
+
+    // Runs of one byte and short periods overlap their own output
+    std::vector<std::uint8_t> repetitive(5000);
+    for (std::size_t i = 0; i < repetitive.size(); ++i)
+        repetitive[i] = i < 1000 ? 0xAA : static_cast<std::uint8_t>(i % 3);
+    REQUIRE(RoundTrip(repetitive) == repetitive);
+
+    std::vector<std::uint8_t> random(5000);
+    std::uint32_t seed = 99;
+    for (auto& byte : random)
+    {
+        seed = seed * 1103515245u + 12345u;
+        byte = static_cast<std::uint8_t>(seed >> 16);
+    }
+    REQUIRE(RoundTrip(random) == random);
+}
+
+TEST_CASE("LzCodec shrinks a zeroed block to a few bytes", "[save-state][lz]")
+{
+    const std::vector<std::uint8_t> zeros(4096);
+    std::vector<std::uint8_t> packed;
+    LzCodec::Compress(zeros, packed);
+    REQUIRE(packed.size() < 40);
+}
+
+TEST_CASE("LzCodec rejects streams that do not decode to exactly the output size", "[save-state][lz]")
+{
+    std::vector<std::uint8_t> input(300);
+    for (std::size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<std::uint8_t>(i % 10);
+    std::vector<std::uint8_t> packed;
+    LzCodec::Compress(input, packed);
+
+    std::vector<std::uint8_t> tooSmall(input.size() - 1);
+    REQUIRE_FALSE(LzCodec::Decompress(packed, tooSmall));
+
+    std::vector<std::uint8_t> tooBig(input.size() + 1);
+    REQUIRE_FALSE(LzCodec::Decompress(packed, tooBig));
+
+    std::vector<std::uint8_t> out(input.size());
+    const std::vector<std::uint8_t> truncated(packed.begin(), packed.begin() + packed.size() / 2);
+    REQUIRE_FALSE(LzCodec::Decompress(truncated, out));
+
+    // A match reaching back before the start of the output
+    const std::vector<std::uint8_t> badOffset = { 0x10, 0x55, 0x02, 0x00, 0x00 };
+    REQUIRE_FALSE(LzCodec::Decompress(badOffset, out));
+}
+
+// **********************************************
+// *                 ROUND TRIPS                *
+// **********************************************
+TEST_CASE("Cpu::State round-trips through GetState and SetState", "[save-state][cpu]")
+{
+    Cpu cpu;
+    const Cpu::State state = SampleState();
+    cpu.SetState(state);
+
+    REQUIRE(cpu.GetState() == state);
+    REQUIRE(cpu.GetAf() == 0x12D7);
+    REQUIRE(cpu.GetAfAlt() == 0xF0C5);
+    REQUIRE(cpu.GetPc() == 0x8123);
+    REQUIRE(cpu.is_halted());
+    REQUIRE(cpu.GetTStates() == 0x0123456789ABull);
+}
+
+TEST_CASE_METHOD(CpuFixture, "A save state restores the CPU and RAM it was taken from", "[save-state]")
+{
+    FillRam(bus);
+    cpu.SetState(SampleState());
+
+    for (const SaveCompression compression : { SaveCompression::None, SaveCompression::Lz })
+    {
+        std::vector<std::uint8_t> saved;
+        SaveState::Save(cpu, bus, saved, compression);
+
+        Bus other;
+        Cpu otherCpu;
+        otherCpu.Connect(&other);
+        otherCpu.Reset();
+        const RestoreResult result = SaveState::Restore(otherCpu, other, saved);
+
+        CAPTURE(static_cast<int>(compression));
+        REQUIRE(result.ok);
+        REQUIRE(result.error.empty());
+        REQUIRE(otherCpu.GetState() == SampleState());
+        REQUIRE(RamOf(other) == RamOf(bus));
+    }
+}
+
+TEST_CASE_METHOD(CpuFixture, "Uncompressed states have a fixed size and compressed ones are smaller", "[save-state]")
+{
+    std::vector<std::uint8_t> raw;
+    SaveState::Save(cpu, bus, raw, SaveCompression::None);
+    REQUIRE(raw.size() == FIRST_BLOCK_OFFSET + SaveState::RAM_BLOCKS * (3 + SaveState::RAM_BLOCK_SIZE));
+
+    std::vector<std::uint8_t> packed;
+    SaveState::Save(cpu, bus, packed);
+    REQUIRE(packed.size() < 1024);
+
+    // Blocks that do not compress are stored raw, so a state never grows
+    FillRam(bus);
+    std::vector<std::uint8_t> mixed;
+    SaveState::Save(cpu, bus, mixed);
+    REQUIRE(mixed.size() < raw.size());
+}
+
+TEST_CASE_METHOD(CpuFixture, "Save appends to what is already in the buffer", "[save-state]")
+{
+    std::vector<std::uint8_t> saved = { 0xEE, 0xEE };
+    SaveState::Save(cpu, bus, saved);
+
+    REQUIRE(saved[0] == 0xEE);
+    REQUIRE(saved[2] == 'Z');
+    REQUIRE(SaveState::Restore(cpu, bus, std::span(saved).subspan(2)).ok);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Restoring over code that already ran runs the restored code", "[save-state][decode-cache]")
+{
+    // LD A,0x11 ; HALT
+    bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0x3E, 0x11, 0x76 });
+    std::vector<std::uint8_t> saved;
+    SaveState::Save(cpu, bus, saved);
+
+    bus.Write(0x0001, 0x22);
+    cpu.Execute(2);
+    REQUIRE(cpu.GetA() == 0x22);
+
+    REQUIRE(SaveState::Restore(cpu, bus, saved).ok);
+    cpu.Execute(2);
+    REQUIRE(cpu.GetA() == 0x11);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Restore writes the Bus's own RAM even under a mapping", "[save-state]")
+{
+    std::vector<std::uint8_t> saved;
+    bus.Write(0x0100, 0x5A);
+    SaveState::Save(cpu, bus, saved);
+
+    std::vector<std::uint8_t> rom(Bus::MAP_PAGE_SIZE, 0xC9);
+    bus.MapRom(0, 1, rom.data());
+    bus.Write(0x0100, 0x00);
+    REQUIRE(SaveState::Restore(cpu, bus, saved).ok);
+
+    REQUIRE(bus.Read(0x0100) == 0xC9);
+    REQUIRE(RamOf(bus)[0x0100] == 0x5A);
+}
+
+// **********************************************
+// *              DAMAGED STATES                *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "Damaged states are rejected with a reason", "[save-state]")
+{
+    FillRam(bus);
+    std::vector<std::uint8_t> saved;
+    SaveState::Save(cpu, bus, saved);
+
+    SECTION("wrong magic")
+    {
+        saved[0] = 'X';
+        const RestoreResult result = SaveState::Restore(cpu, bus, saved);
+        REQUIRE_FALSE(result.ok);
+        REQUIRE(result.error == "not a save state");
+    }
+
+    SECTION("newer version")
+    {
+        saved[VERSION_OFFSET] = SaveState::VERSION + 1;
+        const RestoreResult result = SaveState::Restore(cpu, bus, saved);
+        REQUIRE_FALSE(result.ok);
+        REQUIRE(result.error == "unsupported save state version 2");
+    }
+
+    SECTION("truncated anywhere")
+    {
+        for (const std::size_t size : { std::size_t{ 0 }, std::size_t{ 6 }, std::size_t{ 20 }, FIRST_BLOCK_OFFSET + 1, saved.size() - 1 })
+        {
+            CAPTURE(size);
+            REQUIRE_FALSE(SaveState::Restore(cpu, bus, std::span(saved).first(size)).ok);
+        }
+    }
+
+    SECTION("unknown codec")
+    {
+        saved[FIRST_BLOCK_OFFSET] = 7;
+        const RestoreResult result = SaveState::Restore(cpu, bus, saved);
+        REQUIRE_FALSE(result.ok);
+        REQUIRE(result.error == "unknown codec in RAM block 0");
+    }
+
+    SECTION("corrupt compressed block")
+    {
+        // The first block repeats, so it is compressed; damage its first match offset
+        REQUIRE(saved[FIRST_BLOCK_OFFSET] == 1);
+        saved[FIRST_BLOCK_OFFSET + 3 + 1 + 7] = 0xFF;
+        saved[FIRST_BLOCK_OFFSET + 3 + 1 + 8] = 0xFF;
+        const RestoreResult result = SaveState::Restore(cpu, bus, saved);
+        REQUIRE_FALSE(result.ok);
+        REQUIRE(result.error == "corrupt compressed data in RAM block 0");
+    }
+}
+
+TEST_CASE_METHOD(CpuFixture, "A rejected state leaves the CPU as it was", "[save-state]")
+{
+    std::vector<std::uint8_t> saved;
+    SaveState::Save(cpu, bus, saved);
+    saved.pop_back();
+
+    cpu.SetState(SampleState());
+    REQUIRE_FALSE(SaveState::Restore(cpu, bus, saved).ok);
+    REQUIRE(cpu.GetState() == SampleState());
+}
+
+// **********************************************
+// *                   DELTAS                   *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "A delta holds only the pages written since the last one", "[save-state][delta]")
+{
+    FillRam(bus);
+    bus.ClearDirty();
+    bus.Write(0x0000, 0xAA);
+    bus.Write(0xC000, 0xBB);
+
+    std::vector<std::uint8_t> delta;
+    SaveState::SaveDelta(cpu, bus, delta, SaveCompression::None);
+
+    REQUIRE(delta.size() == FIRST_BLOCK_OFFSET + 1 + 2 * (4 + Bus::MAP_PAGE_SIZE));
+    REQUIRE(bus.CollectDirty().none());
+
+    std::vector<std::uint8_t> empty;
+    SaveState::SaveDelta(cpu, bus, empty);
+    REQUIRE(empty.size() == FIRST_BLOCK_OFFSET + 1);
+}
+
+TEST_CASE_METHOD(CpuFixture, "A full state and its deltas replay to every recorded state", "[save-state][delta]")
+{
+    FillRam(bus);
+    std::vector<std::uint8_t> keyframe;
+    SaveState::Save(cpu, bus, keyframe);
+    bus.ClearDirty();
+
+    // Frames that each touch a few pages and move the CPU on
+    std::vector<std::vector<std::uint8_t>> deltas;
+    std::vector<std::vector<std::uint8_t>> frames;
+    std::vector<Cpu::State> states;
+    for (std::uint8_t frame = 0; frame < 5; ++frame)
+    {
+        bus.Write(static_cast<std::uint16_t>(0x1000 * frame + frame), frame);
+        bus.Fill(0x8000 + 0x123 * frame, 0x200, static_cast<std::uint8_t>(0x80 | frame));
+        cpu.SetBc(frame);
+        cpu.Step();
+
+        deltas.emplace_back();
+        SaveState::SaveDelta(cpu, bus, deltas.back());
+        frames.push_back(RamOf(bus));
+        states.push_back(cpu.GetState());
+    }
+
+    Bus other;
+    Cpu otherCpu;
+    otherCpu.Connect(&other);
+    REQUIRE(SaveState::Restore(otherCpu, other, keyframe).ok);
+    for (std::size_t frame = 0; frame < deltas.size(); ++frame)
+    {
+        CAPTURE(frame);
+        REQUIRE(SaveState::Restore(otherCpu, other, deltas[frame]).ok);
+        REQUIRE(RamOf(other) == frames[frame]);
+        REQUIRE(otherCpu.GetState() == states[frame]);
+    }
+}
+
+TEST_CASE_METHOD(CpuFixture, "Damaged deltas are rejected with a reason", "[save-state][delta]")
+{
+    bus.ClearDirty();
+    bus.Write(0x0400, 0x01);
+    std::vector<std::uint8_t> delta;
+    SaveState::SaveDelta(cpu, bus, delta);
+
+    SECTION("page number out of range")
+    {
+        delta[FIRST_BLOCK_OFFSET + 1] = Bus::MAP_PAGE_COUNT;
+        const RestoreResult result = SaveState::Restore(cpu, bus, delta);
+        REQUIRE_FALSE(result.ok);
+        REQUIRE(result.error == "bad page number 64");
+    }
+
+    SECTION("truncated")
+    {
+        delta.pop_back();
+        const RestoreResult result = SaveState::Restore(cpu, bus, delta);
+        REQUIRE_FALSE(result.ok);
+        REQUIRE(result.error == "truncated data in RAM page 1");
+    }
+
+    SECTION("unknown flags")
+    {
+        delta[VERSION_OFFSET + 2] |= 0x02;
+        const RestoreResult result = SaveState::Restore(cpu, bus, delta);
+        REQUIRE_FALSE(result.ok);
+        REQUIRE(result.error == "unknown flags");
+    }
+}
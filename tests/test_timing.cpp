@@ -0,0 +1,135 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+
+struct CpuFixture
+{
+    Bus bus;
+    Cpu cpu;
+
+    CpuFixture()
+    {
+        cpu.Connect(&bus);
+        cpu.Reset();
+    }
+};
+
+// **********************************************
+// *        T-STATE TIMING PER INSTRUCTION      *
+// **********************************************
+// *                                            *
+// *   Step() returns the T-states it used      *
+// *   (Zilog UM0080 timings)                   *
+// *                                            *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "Step returns the T-states of each implemented instruction", "[timing]")
+{
+    struct Timing { uint8_t opcode; uint32_t tstates; };
+
+    const Timing timings[] = {
+        { 0x00,  4 },   // NOP
+        { 0x01, 10 },   // LD BC,nn
+        { 0x03,  6 },   // INC BC
+        { 0x04,  4 },   // INC B
+        { 0x06,  7 },   // LD B,n
+        { 0x09, 11 },   // ADD HL,BC
+        { 0x27,  4 },   // DAA
+        { 0x34, 11 },   // INC (HL)
+        { 0x35, 11 },   // DEC (HL)
+        { 0x37,  4 },   // SCF
+        { 0x41,  4 },   // LD B,C
+        { 0x46,  7 },   // LD B,(HL)
+        { 0x70,  7 },   // LD (HL),B
+        { 0x80,  4 },   // ADD A,B
+        { 0x98,  4 },   // SBC A,B
+        { 0xC1, 10 },   // POP BC
+        { 0xC5, 11 },   // PUSH BC
+        { 0xC6,  7 },   // ADD A,n
+        { 0xE6,  7 },   // AND n
+        { 0xFE,  7 },   // CP n
+    };
+
+    for (const auto& t : timings)
+    {
+        cpu.Reset();
+        cpu.SetSp(0x8000);
+        cpu.SetHl(0x4000);
+        bus.Write(0x0000, t.opcode);
+
+        CAPTURE(t.opcode);
+        REQUIRE(cpu.Step() == t.tstates);
+        REQUIRE(cpu.GetTStates() == t.tstates);
+    }
+}
+
+// **********************************************
+// *        RUN A T-STATE BUDGET                *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "Run executes until the T-state budget is used up", "[timing][run]")
+{
+    // NOP (4), LD B,n (7), ADD A,B (4), INC BC (6) ... then NOPs
+    bus.Write(0x0000, 0x00);
+    bus.Write(0x0001, 0x06);
+    bus.Write(0x0002, 0x05);
+    bus.Write(0x0003, 0x80);
+    bus.Write(0x0004, 0x03);
+
+    // 4 + 7 = 11 covers a budget of 10 exactly one instruction over
+    REQUIRE(cpu.Run(10) == 11);
+    REQUIRE(cpu.GetPc() == 0x0003);
+    REQUIRE(cpu.GetB() == 0x05);
+
+    // 4 + 6 = 10 lands on the budget
+    REQUIRE(cpu.Run(10) == 10);
+    REQUIRE(cpu.GetPc() == 0x0005);
+    REQUIRE(cpu.GetA() == 0x05);
+    REQUIRE(cpu.GetBc() == 0x0501);
+
+    REQUIRE(cpu.GetTStates() == 21);
+    REQUIRE(cpu.Run(0) == 0);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Execute returns the T-states of the instructions it ran", "[timing][run]")
+{
+    bus.Write(0x0000, 0x01); // LD BC,nn  10
+    bus.Write(0x0003, 0xC5); // PUSH BC   11
+    bus.Write(0x0004, 0xE1); // POP HL    10
+
+    REQUIRE(cpu.Execute(3) == 31);
+    REQUIRE(cpu.GetTStates() == 31);
+}
+
+// **********************************************
+// *        HALTED CPU IDLES                    *
+// **********************************************
+TEST_CASE_METHOD(CpuFixture, "A halted CPU idles 4 T-states per step without fetching", "[timing][halt]")
+{
+    bus.Write(0x0000, 0x76); // HALT
+    bus.Write(0x0001, 0x04); // INC B (must not run)
+
+    REQUIRE(cpu.Step() == 4);
+    REQUIRE(cpu.is_halted());
+    REQUIRE(cpu.GetPc() == 0x0001);
+
+    REQUIRE(cpu.Step() == 4);
+    REQUIRE(cpu.Execute(3) == 12);
+    REQUIRE(cpu.GetPc() == 0x0001);
+    REQUIRE(cpu.GetB() == 0x00);
+}
+
+TEST_CASE_METHOD(CpuFixture, "Run stops executing at HALT and idles out the rest of the budget", "[timing][halt][run]")
+{
+    bus.Write(0x0000, 0x06); // LD B,n  7
+    bus.Write(0x0001, 0x01);
+    bus.Write(0x0002, 0x76); // HALT    4
+    bus.Write(0x0003, 0x04); // INC B (must not run)
+
+    // 7 + 4 = 11, then 9 left over are covered by three idle NOPs
+    REQUIRE(cpu.Run(20) == 23);
+    REQUIRE(cpu.is_halted());
+    REQUIRE(cpu.GetPc() == 0x0003);
+    REQUIRE(cpu.GetB() == 0x01);
+
+    REQUIRE(cpu.Run(8) == 8);
+    REQUIRE(cpu.GetTStates() == 31);
+}
@@ -0,0 +1,209 @@
+#include <catch2/catch_test_macros.hpp>
+#include "Cpu.h"
+#include "Bus.h"
+
+#if defined(Z80EMU_TRACE)
+#include "Trace.h"
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Machine
+    {
+        Bus bus;
+        Cpu cpu;
+
+        // LD A,42h ; PUSH BC ; LD (HL),99h ; LDIR ; HALT
+        Machine()
+        {
+            cpu.Connect(&bus);
+            cpu.Reset();
+            bus.WriteBlock(0x0000, std::vector<std::uint8_t>{ 0x3E, 0x42, 0xC5, 0x36, 0x99, 0xED, 0xB0, 0x76 });
+            for (std::uint16_t i = 0; i < 64; ++i)
+                bus.Write(static_cast<std::uint16_t>(0x4000 + i), static_cast<std::uint8_t>(i * 3));
+            cpu.SetSp(0x8000);
+            cpu.SetBc(48);
+            cpu.SetHl(0x4000);
+            cpu.SetDe(0x5000);
+        }
+    };
+
+    // A file in the temp directory that is removed again at the end of the test
+    struct TempFile
+    {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "z80emu_trace.bin";
+
+        ~TempFile() { std::filesystem::remove(path); }
+
+        std::string Name() const { return path.string(); }
+    };
+
+    // Records `steps` instructions of the test program into `file`
+    void Record(const TempFile& file, std::size_t steps, const TraceConfig& config = {})
+    {
+        Machine machine;
+        TraceRecorder recorder(machine.cpu, machine.bus, file.Name(), config);
+        REQUIRE(recorder.IsOpen());
+        recorder.Execute(steps);
+        REQUIRE(recorder.Recorded() == steps);
+        REQUIRE(recorder.Close());
+    }
+}
+
+// **********************************************
+// *                 ROUND TRIP                 *
+// **********************************************
+TEST_CASE("A trace reads back as the run it recorded, step by step", "[trace]")
+{
+    TempFile file;
+    TraceConfig config;
+    config.frameSize = 256;         // many small frames through a ring of two
+    config.frames = 2;
+    Record(file, 200, config);
+
+    Machine reference;
+    TraceReader reader(file.Name());
+    REQUIRE(reader.IsOpen());
+
+    constexpr std::uint8_t LENGTHS[8] = { 2, 0, 1, 2, 0, 2, 0, 1 };    // by PC
+    TraceStep step;
+    std::uint64_t count = 0;
+    std::size_t writes = 0;
+    while (reader.Next(step))
+    {
+        const std::uint16_t pc = reference.cpu.GetPc();
+        const bool halted = reference.cpu.is_halted();
+        const std::uint32_t tstates = reference.cpu.Step();
+
+        REQUIRE(step.instruction == count);
+        REQUIRE(step.pc == pc);
+        REQUIRE(step.tstates == tstates);
+        REQUIRE(step.state == reference.cpu.GetState());
+        REQUIRE(step.length == (halted ? 0 : LENGTHS[pc]));
+        for (std::uint8_t i = 0; i < step.length; ++i)
+            REQUIRE(step.bytes[i] == reference.bus.Read(static_cast<std::uint16_t>(pc + i)));
+        for (const Bus::LoggedWrite& write : step.writes)
+            REQUIRE(reference.bus.Read(write.address) == write.value);
+        writes += step.writes.size();
+        ++count;
+    }
+
+    REQUIRE_FALSE(reader.Failed());
+    REQUIRE(count == 200);
+    REQUIRE(writes == 2 + 1 + 48);  // PUSH, LD (HL),n, the LDIR
+    REQUIRE(reference.cpu.is_halted());
+}
+
+TEST_CASE("Every write an instruction makes is in its record", "[trace]")
+{
+    TempFile file;
+    Record(file, 4);
+
+    TraceReader reader(file.Name());
+    TraceStep step;
+    REQUIRE(reader.Next(step));     // LD A,42h
+    REQUIRE(step.writes.empty());
+
+    REQUIRE(reader.Next(step));     // PUSH BC
+    REQUIRE(step.writes == std::vector<Bus::LoggedWrite>{ { 0x7FFF, 0x00 }, { 0x7FFE, 48 } });
+
+    REQUIRE(reader.Next(step));     // LD (HL),99h
+    REQUIRE(step.writes == std::vector<Bus::LoggedWrite>{ { 0x4000, 0x99 } });
+
+    REQUIRE(reader.Next(step));     // LDIR, as many iterations as one step runs
+    REQUIRE_FALSE(step.writes.empty());
+    REQUIRE(step.writes.front() == Bus::LoggedWrite{ 0x5000, 0x99 });
+    REQUIRE(step.writes.back().address == step.state.de - 1);
+
+    REQUIRE_FALSE(reader.Next(step));
+    REQUIRE_FALSE(reader.Failed());
+}
+
+TEST_CASE("Block writes to ROM are logged with the values written, like single writes", "[trace]")
+{
+    TempFile file;
+    {
+        Machine machine;
+        std::array<std::uint8_t, Bus::MAP_PAGE_SIZE> rom;
+        rom.fill(0xEE);
+        machine.bus.MapRom(0x5000 >> Bus::MAP_PAGE_SHIFT, 1, rom.data());
+
+        TraceRecorder recorder(machine.cpu, machine.bus, file.Name());
+        recorder.Execute(4);
+        REQUIRE(recorder.Close());
+        REQUIRE(machine.bus.Read(0x5000) == 0xEE);
+    }
+
+    TraceReader reader(file.Name());
+    TraceStep step;
+    for (int i = 0; i < 4; ++i)
+        REQUIRE(reader.Next(step));
+
+    // LDIR copying from 0x4000, where LD (HL),99h went first
+    REQUIRE_FALSE(step.writes.empty());
+    for (std::size_t i = 0; i < step.writes.size(); ++i)
+    {
+        REQUIRE(step.writes[i].address == 0x5000 + i);
+        REQUIRE(step.writes[i].value == (i == 0 ? 0x99 : i * 3));
+    }
+}
+
+// **********************************************
+// *                  FAILURES                  *
+// **********************************************
+TEST_CASE("A cut-off trace reads up to the damage and then fails", "[trace]")
+{
+    TempFile file;
+    TraceConfig config;
+    config.frameSize = 256;
+    Record(file, 100, config);
+    std::filesystem::resize_file(file.path, std::filesystem::file_size(file.path) - 5);
+
+    TraceReader reader(file.Name());
+    REQUIRE(reader.IsOpen());
+    TraceStep step;
+    std::uint64_t count = 0;
+    while (reader.Next(step))
+        ++count;
+
+    REQUIRE(reader.Failed());
+    REQUIRE(count > 0);
+    REQUIRE(count < 100);
+}
+
+TEST_CASE("A frame header claiming more than a frame can hold fails before reading it", "[trace]")
+{
+    TempFile file;
+    Record(file, 10);
+
+    // The first frame's size and stored size, straight after the file header
+    {
+        std::fstream out(file.path, std::ios::binary | std::ios::in | std::ios::out);
+        const char huge[8] = { '\xF0', '\xFF', '\xFF', '\xFF', '\xF0', '\xFF', '\xFF', '\xFF' };
+        out.seekp(12);
+        out.write(huge, sizeof(huge));
+    }
+
+    TraceReader reader(file.Name());
+    REQUIRE(reader.IsOpen());
+    TraceStep step;
+    REQUIRE_FALSE(reader.Next(step));
+    REQUIRE(reader.Failed());
+}
+
+TEST_CASE("A recorder that cannot create its file still runs the CPU", "[trace]")
+{
+    Machine machine;
+    TraceRecorder recorder(machine.cpu, machine.bus, "/nonexistent/dir/trace.bin");
+    REQUIRE_FALSE(recorder.IsOpen());
+
+    recorder.Execute(3);
+    REQUIRE(recorder.Recorded() == 0);
+    REQUIRE(machine.cpu.GetPc() == 0x0005);
+    REQUIRE_FALSE(TraceReader("/nonexistent/dir/trace.bin").IsOpen());
+}
+#endif
@@ -0,0 +1,55 @@
+#include "Trace.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Prints a trace file written by TraceRecorder, one instruction per line:
+//
+//   z80_trace <file> [first [count]]
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 4)
+    {
+        std::fprintf(stderr, "usage: %s <file> [first [count]]\n", argv[0]);
+        return 2;
+    }
+
+    const unsigned long long first = argc > 2 ? std::strtoull(argv[2], nullptr, 0) : 0;
+    const unsigned long long count = argc > 3 ? std::strtoull(argv[3], nullptr, 0) : ~0ull;
+
+    TraceReader reader(argv[1]);
+    if (!reader.IsOpen())
+    {
+        std::fprintf(stderr, "%s: not a trace file\n", argv[1]);
+        return 1;
+    }
+
+    TraceStep step;
+    unsigned long long shown = 0;
+    while (shown < count && reader.Next(step))
+    {
+        if (step.instruction < first)
+            continue;
+
+        char bytes[16] = "--";
+        for (std::uint8_t i = 0; i < step.length; ++i)
+            std::snprintf(bytes + 3 * i, sizeof(bytes) - 3 * i, "%02X ", step.bytes[i]);
+
+        const Cpu::State& s = step.state;
+        std::printf("%10llu %04X  %-12s %3u  AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X IX=%04X IY=%04X%s",
+            static_cast<unsigned long long>(step.instruction), step.pc, bytes, step.tstates,
+            s.af, s.bc, s.de, s.hl, s.sp, s.ix, s.iy, s.halted ? " HALT" : "");
+        for (const Bus::LoggedWrite& write : step.writes)
+            std::printf(" [%04X]=%02X", write.address, write.value);
+        std::printf("\n");
+        ++shown;
+    }
+
+    if (reader.Failed())
+    {
+        std::fprintf(stderr, "%s: damaged after instruction %llu\n", argv[1],
+            static_cast<unsigned long long>(step.instruction));
+        return 1;
+    }
+    return 0;
+}